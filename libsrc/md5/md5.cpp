@@ -348,6 +348,17 @@ std::string MD5::hexdigest() const
 
 //////////////////////////////
 
+// copies the binary digest (16 bytes) to output, zeroes if not finalized
+void MD5::rawdigest(unsigned char output[16]) const
+{
+  if (!finalized)
+    memset(output, 0, 16);
+  else
+    memcpy(output, digest, 16);
+}
+
+//////////////////////////////
+
 std::ostream& operator<<(std::ostream& out, MD5 md5)
 {
   return out << md5.hexdigest();
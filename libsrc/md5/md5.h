@@ -42,7 +42,7 @@ documentation and/or software.
 //
 // usage: 1) feed it blocks of uchars with update()
 //      2) finalize()
-//      3) get hexdigest() string
+//      3) get hexdigest() string (or the 16 raw bytes via rawdigest())
 //      or
 //      MD5(std::string).hexdigest()
 //
@@ -58,6 +58,7 @@ public:
   void update(const char *buf, size_type length);
   MD5& finalize();
   std::string hexdigest() const;
+  void rawdigest(unsigned char output[16]) const;
   friend std::ostream& operator<<(std::ostream&, MD5 md5);
 
 private:
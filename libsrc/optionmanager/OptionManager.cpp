@@ -64,6 +64,19 @@ bool CharPtrOption::process(const char* value) {
 
 const char* CharPtrOption::expected_type() { return "a string"; }
 
+// -------------- StringListOption --------------
+void StringListOption::prepare() {
+    target_variable->clear();
+}
+
+bool StringListOption::process(const char* value) {
+    if (value == NULL) return false;
+    target_variable->push_back(value);
+    return true;
+}
+
+const char* StringListOption::expected_type() { return "a string"; }
+
 
 // -------------- OptionManager --------------
 
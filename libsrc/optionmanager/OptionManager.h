@@ -109,6 +109,20 @@ public:
     const char* expected_type();
 };
 
+/**
+ * OptionReader for options that may be given several times. Collects all values in order.
+ */
+class StringListOption: public OptionReader {
+public:
+    vector<string>* target_variable;
+    
+    StringListOption(vector<string>* target_variable): target_variable(target_variable) {}
+     
+    void prepare();
+    bool process(const char* value);
+    const char* expected_type();
+};
+
 /**
  * Structure to keep information about each option.
  */
@@ -67,8 +67,7 @@ void FtpClientSocket::Abort() {
     std::string response = SendCommand("ABOR");
 }
 
-SocketClient* FtpClientSocket::PasvRestRetrX(const char* filename, unsigned long long rest) {
-    // Start with a PASV
+SocketClient* FtpClientSocket::Pasv() {
     std::string response = SendCommand("PASV");
     while(true) { // Ignore "Failed writing network stream" responses. TODO: Limit number of iterations?
         if (response == "426" || response == "226") {
@@ -101,8 +100,14 @@ SocketClient* FtpClientSocket::PasvRestRetrX(const char* filename, unsigned long
     uint16_t port = (p1 << 8) | p2;
     
     // Open connection
-    SocketClient* result = new SocketClient(host, port);
-  
+    return new SocketClient(host, port);
+}
+
+SocketClient* FtpClientSocket::PasvRestRetrX(const char* filename, unsigned long long rest) {
+    // Start with a PASV
+    SocketClient* result = Pasv();
+    std::string response;
+
     // Send rest command
     if (rest != 0) {
         std::ostringstream os;
@@ -127,3 +132,23 @@ SocketClient* FtpClientSocket::PasvRestRetrX(const char* filename, unsigned long
     return result;
 }
 
+std::string FtpClientSocket::PasvList(const std::string& command, std::string& listing) {
+    SocketClient* data = Pasv();
+    std::string response;
+    try {
+        response = SendCommand(command);
+        while (response == "426" || response == "226") response = GetResponse();
+    }
+    catch (const char*) {
+        delete data;
+        throw;
+    }
+    if (response[0] == '1') {
+        bool ok = data->ReceiveAll(listing);
+        const char* error = ok ? NULL : Socket::TimedOut() ? "TIMED_OUT" : "CONNECTION_LOST";
+        delete data;
+        if (!ok) throw error;
+    }
+    else delete data;
+    return response;
+}
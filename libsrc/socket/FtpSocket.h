@@ -42,6 +42,16 @@ public:
     // data connections and 226 (File transfer successful) - that's why the "X" in the title.
     // The caller is responsible for freeing the socket object.
     SocketClient* PasvRestRetrX(const char* filename, unsigned long long rest = 0);
+
+    // Does a PASV, then the given listing command (e.g. "MLSD /dir" or "LIST /dir"), and reads
+    // the listing sent over the data connection into listing. Returns the response code to the
+    // command, which starts with '1' on success. Like PasvRestRetrX, leaves the closing 226 to
+    // be skipped by the next command.
+    std::string PasvList(const std::string& command, std::string& listing);
+
+protected:
+    // Sends PASV and opens the data connection. The caller is responsible for freeing the socket object.
+    SocketClient* Pasv();
 };
 
 #endif
@@ -12,6 +12,11 @@
 #include <cstdio>
 using std::sscanf;
 
+// The error thrown when a receive fails
+static const char* receive_error() {
+    return Socket::TimedOut() ? "TIMED_OUT" : "CONNECTION_LOST";
+}
+
 long long HttpClientSocket::Size(const char* filename) {
     _socket = new SocketClient(host, port);
     std::string s = std::string("HEAD ") + filename + " HTTP/1.1\nHost: " + host;
@@ -26,7 +31,20 @@ long long HttpClientSocket::Size(const char* filename) {
     std::string prefix = "content-length:";
     s = _socket->ReceiveLine();
     long long result = -1;
-    while (s != "") {
+    if (s == "") {
+        const char* error = receive_error();
+        _socket->Close();
+        delete _socket;
+        _socket = 0;
+        throw error;
+    }
+    if (s.compare(0, 5, "HTTP/") == 0 && s.size() > 9 && s[9] == '4') {
+        _socket->Close();
+        delete _socket;
+        _socket = 0;
+        throw "FILE_NOT_FOUND";
+    }
+    while (s != "" && s != "\r\n") {   // The empty line ends the headers
         std::transform(s.begin(), s.end(), s.begin(), ::tolower);
         if (s.substr(0, prefix.size()) == prefix) {
             if (1 != sscanf(s.c_str() + prefix.size() + 1, "%lld", &result))
@@ -53,51 +71,69 @@ std::string read_chunked(Socket* sock) {
     std::ostringstream os;
     std::string s;
     int chunk_size = read_int(sock);
+    std::string buffer;
     while (chunk_size > 0) {
        //std::cout << "Chunk size: " << chunk_size << std::endl;
-       char* buffer = new char[chunk_size];
-       sock->RecvBlocking(buffer, chunk_size);
-       os.write(buffer, chunk_size);
+       buffer.resize(chunk_size);
+       if (sock->RecvBlocking(&buffer[0], chunk_size) != chunk_size) throw receive_error();
+       os.write(buffer.data(), chunk_size);
        s = sock->ReceiveLine(); // Should be '\r\n'
        chunk_size = read_int(sock);
     }
     return os.str();
 }
 
-// range_string is a byte-range string!
-std::string HttpClientSocket::RequestRanges(const char* filename, std::string range_string) {
+// Closes and frees the connection of the current request
+void HttpClientSocket::CloseSocket() {
+    _socket->Close();
+    delete _socket;
+    _socket = 0;
+}
+
+std::string HttpClientSocket::Request(const std::string& method, const char* filename, const std::string& headers,
+                                      const std::string& body, int& status, std::string& content_type) {
     _socket = new SocketClient(host, port);
-    _socket->SendLine(std::string("GET ") + filename + " HTTP/1.1\r");
+    _socket->SendLine(method + " " + filename + " HTTP/1.1\r");
     _socket->SendLine("Host: " + host + "\r");
-    _socket->SendLine("Range: bytes=" + range_string + "\r");
+    if (headers != "") _socket->SendBytes(headers);
+    if (body != "") {
+        std::ostringstream length;
+        length << "Content-Length: " << body.size() << "\r";
+        _socket->SendLine(length.str());
+    }
     _socket->SendLine("\r");
+    if (body != "") _socket->SendBytes(body);
 
     long long contentLength = -1;
-    int multipart = 0;
     int chunked = 0;
-    std::string boundary;
-    std::string result = "";
     std::string CONTENT_LENGTH = "content-length:";
     std::string CONTENT_TYPE   = "content-type:";
     std::string TRANSFER_ENCODING = "transfer-encoding:";
 
     // Scan first headers (until the empty line)
     std::string s = _socket->ReceiveLine();
+    status = 0;
+    if (s.compare(0, 5, "HTTP/") == 0 && s.size() >= 12) std::sscanf(s.c_str() + 9, "%d", &status);
+    content_type = "";
     while (s != "\r\n") { // Empty line separates headers from content
+        if (s == "") {
+            const char* error = receive_error();
+            CloseSocket();
+            throw error;
+        }
+        std::string original = s;  // The boundary is case-sensitive
         std::transform(s.begin(), s.end(), s.begin(), ::tolower);
         if (s.substr(0, CONTENT_LENGTH.size()) == CONTENT_LENGTH) {
-            if (1 != sscanf(s.c_str() + CONTENT_LENGTH.size() + 1, "%lld", &contentLength))
+            if (1 != sscanf(s.c_str() + CONTENT_LENGTH.size() + 1, "%lld", &contentLength)) {
+                CloseSocket();
                 throw "UNSUPPORTED_RESPONSE";
+            }
         }
         else if (s.substr(0, CONTENT_TYPE.size()) == CONTENT_TYPE) {
-            // Look for "boundary"
-            int boundaryPos = s.find("boundary=");
-            if (boundaryPos != -1) {
-                multipart = 1;
-                boundary = s.substr(boundaryPos + 9);
-                boundary.resize(boundary.size() - 2); // Trim CRLF from end
-                boundary = std::string("--") + boundary;
-            }
+            std::string::size_type start = original.find_first_not_of(' ', CONTENT_TYPE.size());
+            std::string::size_type end = original.find_last_not_of("\r\n");
+            if (start != std::string::npos && end != std::string::npos && end >= start)
+                content_type = original.substr(start, end - start + 1);
         }
         else if (s.substr(0, TRANSFER_ENCODING.size()) == TRANSFER_ENCODING) {
             if (s.find("chunked") != -1) chunked = 1;
@@ -105,15 +141,47 @@ std::string HttpClientSocket::RequestRanges(const char* filename, std::string ra
         s = _socket->ReceiveLine();
     }
 
-    if (chunked) s = read_chunked(_socket);
-    else if (contentLength > 0) {
-        // Read to the end
-        char* buffer = new char[contentLength];
-        _socket->RecvBlocking(buffer, contentLength);
-        std::string s = std::string(buffer, contentLength);
-        delete[] buffer;
+    s = "";
+    try {
+        if (chunked) s = read_chunked(_socket);
+        else if (contentLength > 0) {
+            // Read to the end
+            s.resize(contentLength);
+            if (_socket->RecvBlocking(&s[0], contentLength) != contentLength) throw receive_error();
+        }
+        else if (contentLength < 0 && method != "HEAD" && status != 204 && status != 304) {
+            // No framing: the body ends with the connection
+            if (!_socket->ReceiveAll(s)) throw receive_error();
+        }
+    }
+    catch (const char*) {
+        CloseSocket();
+        throw;
+    }
+    CloseSocket();
+    return s;
+}
+
+// range_string is a byte-range string!
+std::string HttpClientSocket::RequestRanges(const char* filename, std::string range_string) {
+    int status;
+    std::string content_type;
+    std::string s = Request("GET", filename, "Range: bytes=" + range_string + "\r\n", "", status, content_type);
+    if (status / 100 != 2) throw "REQUEST_FAILED";
+
+    // Look for "boundary"
+    int multipart = 0;
+    std::string boundary;
+    std::string lower = content_type;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    int boundaryPos = lower.find("boundary=");
+    if (boundaryPos != -1) {
+        multipart = 1;
+        boundary = std::string("--") + content_type.substr(boundaryPos + 9);
     }
+
     // In non-multipart requests we're done, otherwise we have to parse
+    std::string result = "";
     if (!multipart) result = s;
     else {
         // Now do the following simple trick to read out content:
@@ -135,10 +203,5 @@ std::string HttpClientSocket::RequestRanges(const char* filename, std::string ra
            result.append(s.c_str() + contentStart, (contentEnd - contentStart));
         }
     }
-
-    _socket->Close();
-    delete _socket;
-    _socket = 0;
     return result;
 }
-
@@ -31,6 +31,15 @@ public:
     
     // Makes a request to figure out the size of the given file
     long long Size(const char* filename);
+
+    // Makes a request and reads the whole response. headers are extra header lines, each ending
+    // with "\r\n". Returns the body, and sets status to the status code and content_type to the
+    // Content-Type header (or ""). Throws a const char* error if no response is received.
+    std::string Request(const std::string& method, const char* filename, const std::string& headers,
+                        const std::string& body, int& status, std::string& content_type);
+
+protected:
+    void CloseSocket();
 };
 
 #endif
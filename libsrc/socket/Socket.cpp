@@ -36,9 +36,16 @@ using namespace std;
 #ifndef MSG_DONTWAIT
     #define MSG_DONTWAIT 0
 #endif
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0    // A peer that went away must not kill the process with SIGPIPE
+#endif
+#ifdef WIN32
+    #define SHUT_RDWR SD_BOTH
+#endif
 
 int Socket::nofSockets_= 0;
 bool Socket::DEBUG = false;
+int Socket::TIMEOUT_MS = 0;
 
 void Socket::Start() {
   if (!nofSockets_) {
@@ -106,6 +113,10 @@ void Socket::Close() {
   	closesocket(s_);
 }
 
+void Socket::Shutdown() {
+  	shutdown(s_, SHUT_RDWR);
+}
+
 std::string Socket::ReceiveBytes() {
   std::string ret;
   char buf[1024];
@@ -139,7 +150,8 @@ int Socket::RecvBlocking(char* buffer, size_t length) {
 
     size_t recv_remaining = length;
     do {
-        size_t recv_this = recv(s_, buffer, recv_remaining, MSG_WAITALL);
+        int recv_this = recv(s_, buffer, recv_remaining, MSG_WAITALL);
+        if (recv_this < 0 && ws_lasterror() == EINTR) continue;
         if (recv_this <= 0) return recv_this;
         if (DEBUG) std::cerr << host << ":" << port << " -> " << "DATA[" << recv_this << " bytes]" << std::endl;
         recv_remaining -= recv_this;
@@ -148,6 +160,40 @@ int Socket::RecvBlocking(char* buffer, size_t length) {
     return length;
 }
 
+bool Socket::ReceiveAll(std::string& data) {
+    char buffer[65536];
+    while (true) {
+        int n = recv(s_, buffer, sizeof(buffer), 0);
+        if (n < 0 && ws_lasterror() == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return true;
+        if (DEBUG) std::cerr << host << ":" << port << " -> " << "DATA[" << n << " bytes]" << std::endl;
+        data.append(buffer, n);
+    }
+}
+
+void Socket::SetTimeout(int milliseconds) {
+#ifdef WIN32
+  DWORD timeout = milliseconds;
+#else
+  timeval timeout;
+  timeout.tv_sec = milliseconds / 1000;
+  timeout.tv_usec = (milliseconds % 1000) * 1000;
+#endif
+  setsockopt(s_, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+  setsockopt(s_, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+bool Socket::TimedOut() {
+  int error = ws_lasterror();
+#ifdef WIN32
+  return error == WSAETIMEDOUT;
+#else
+  // A timed out connect fails with EINPROGRESS
+  return error == EAGAIN || error == EWOULDBLOCK || error == ETIMEDOUT || error == EINPROGRESS;
+#endif
+}
+
 int Socket::Peek(int iterations) {
     char r;
     int result, i;
@@ -192,64 +238,80 @@ std::string Socket::ReceiveLine() {
 void Socket::SendLine(std::string s) {
   if (DEBUG) std::cerr << host << ":" << port << " <- " << s << endl;
   s += '\n';
-  send(s_,s.c_str(),s.length(),0);
+  send(s_,s.c_str(),s.length(),MSG_NOSIGNAL);
 }
 
 void Socket::SendBytes(const std::string& s) {
-  send(s_,s.c_str(),s.length(),0);
+  send(s_,s.c_str(),s.length(),MSG_NOSIGNAL);
 }
 
-/*
-SocketServer::SocketServer(int port, int connections, TypeSocket type) {
-  host = "LOCAL";
-  port = 0;
+bool Socket::SendAll(const char* buffer, size_t length) {
+  while (length > 0) {
+    int sent = send(s_, buffer, length, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      if (sent < 0 && ws_lasterror() == EINTR) continue;
+      return false;
+    }
+    buffer += sent;
+    length -= sent;
+  }
+  return true;
+}
+
+SocketServer::SocketServer(int port, int connections, TypeSocket type, const std::string& address) : Socket() {
+  host = address.empty() ? "LOCAL" : address;
+  this->port = port;
   
   sockaddr_in sa;
 
   memset(&sa, 0, sizeof(sa));
 
   sa.sin_family = PF_INET;             
-  sa.sin_port = htons(port);          
-  s_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (s_ == INVALID_SOCKET) {
-    throw "INVALID_SOCKET";
-  }
+  sa.sin_port = htons(port);
+  sa.sin_addr.s_addr = address.empty() ? htonl(INADDR_ANY) : inet_addr(address.c_str());
 
   if(type==NonBlockingSocket) {
     u_long arg = 1;
     ioctlsocket(s_, FIONBIO, &arg);
   }
 
+  // Allow restarting a server without waiting for the old connections to time out
+  int reuse = 1;
+  setsockopt(s_, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
   // bind the socket to the internet address
   if (bind(s_, (sockaddr *)&sa, sizeof(sockaddr_in)) == SOCKET_ERROR) {
-    closesocket(s_);
-    throw "INVALID_SOCKET";
+    std::string error = ws_strerror(ws_lasterror());
+    if (DEBUG) std::cerr << host << ":" << port << " ~~ Bind FAIL (" << error << ")" << std::endl;
+    throw error;
   }
   
+  if (port == 0) {
+    socklen_t len = sizeof(sa);
+    getsockname(s_, (sockaddr *)&sa, &len);
+    this->port = ntohs(sa.sin_port);
+  }
   listen(s_, connections);                               
+  if (DEBUG) std::cerr << host << ":" << this->port << " ~~ Listening" << std::endl;
 }
 
 Socket* SocketServer::Accept() {
   SOCKET new_sock = accept(s_, 0, 0);
   if (new_sock == INVALID_SOCKET) {
-    int rc = ws_lasterror();
-    if(rc == EWOULDBLOCK) {
-      return 0; // non-blocking call, no request pending
-    }
-    else {
-      throw "INVALID_SOCKET";
-    }
+    return 0; // Non-blocking call with no request pending, or the socket was shut down
   }
 
   Socket* r = new Socket(new_sock);
+  r->host = host;
+  r->port = port;
   return r;
 }
-*/
 
 SocketClient::SocketClient(const std::string& host, int port) : Socket() {
   this->host = host;
   this->port = port;
   if (DEBUG) std::cerr << host << ":" << port << " ~~ Connect ";
+  if (TIMEOUT_MS > 0) SetTimeout(TIMEOUT_MS);
   std::string error;
 
   hostent *he;
@@ -266,7 +328,7 @@ SocketClient::SocketClient(const std::string& host, int port) : Socket() {
   memset(&(addr.sin_zero), 0, 8); 
 
   if (::connect(s_, (sockaddr *) &addr, sizeof(sockaddr))) {
-    error = ws_strerror(ws_lasterror());
+    error = TimedOut() ? "Connection timed out" : ws_strerror(ws_lasterror());
     if (DEBUG) std::cerr << "FAIL (connect: " << error << ")" << std::endl;
     throw error;
   }
@@ -284,9 +346,10 @@ SocketClient::SocketClient(uint32_t ip, uint16_t port) : Socket() {
   this->port = port;
 
   if (DEBUG) std::cerr << host << ":" << port << " ~~ Connect ";
+  if (TIMEOUT_MS > 0) SetTimeout(TIMEOUT_MS);
 
   if (::connect(s_, (sockaddr *) &addr, sizeof(sockaddr))) {
-    std::string error = ws_strerror(ws_lasterror());
+    std::string error = TimedOut() ? "Connection timed out" : ws_strerror(ws_lasterror());
     if (DEBUG) std::cerr << "FAIL (connect: " << error << ")" << std::endl;
     throw error;
   }
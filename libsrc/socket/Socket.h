@@ -1,5 +1,5 @@
 // The file was obtained from http://www.adp-gmbh.ch/win/misc/sockets.html
-// and minor modifications were introduced (DEBUG variable, host field).
+// and minor modifications were introduced (DEBUG variable, host field, SocketServer).
 // The original file was accompanied with the following message
 /* 
    Socket.h
@@ -32,6 +32,7 @@
 
 #ifdef WIN32
     #include <winsock2.h>
+    #include <ws2tcpip.h>
     #define MSG_WAITALL 0
     #define EWOULDBLOCK WSAEWOULDBLOCK
 #else
@@ -63,6 +64,8 @@ class Socket {
 public:
   // THESE ARE USED FOR DEBUGGING PURPOSES
   static bool DEBUG;  // Set to TRUE to enable debug output
+  static int TIMEOUT_MS;  // Timeout of the connect, sends and receives of the client sockets
+                          // created afterwards, in milliseconds. 0 (default) waits forever.
   std::string host;     // Used in debug output mainly. Identifies the target host 
                         // (or LOCAL for a server socket)
   int port;
@@ -79,11 +82,24 @@ public:
   // Returns -1 if no positive response obtained during this time and 1 otherwise.
   int Peek(int iterations=100); 
 
-  // Raw blocking recv
+  // Raw blocking recv. Returns SOCKET_ERROR on error or timeout (see TimedOut).
   int RecvBlocking(char* buffer, size_t length);
+
+  // Receives until the peer closes the connection. Returns false on error or timeout.
+  bool ReceiveAll(std::string& data);
+
+  // Sets the timeout of each send and receive (and connect), in milliseconds. 0 waits forever.
+  void SetTimeout(int milliseconds);
+
+  // True if the last failed operation of the calling thread timed out.
+  static bool TimedOut();
   
   void   Close();
 
+  // Stops both directions of the connection. Unlike Close, this wakes up
+  // a thread blocked in ReceiveLine or Accept on the same socket.
+  void   Shutdown();
+
   // The parameter of SendLine is not a const reference
   // because SendLine modifes the std::string passed.
   void   SendLine (std::string);
@@ -93,8 +109,11 @@ public:
   // (in contrast to SendLine).
   void   SendBytes(const std::string&);
 
+  // Sends the whole buffer, returns false if the connection failed.
+  bool   SendAll(const char* buffer, size_t length);
+
 protected:
-  //friend class SocketServer;
+  friend class SocketServer;
   //friend class SocketSelect;
 
   Socket(SOCKET s);
@@ -117,14 +136,18 @@ public:
   SocketClient(uint32_t ip, uint16_t port);
 };
 
-/*
 class SocketServer : public Socket {
 public:
-  SocketServer(int port, int connections, TypeSocket type=BlockingSocket);
+  // Listens on the given address ("" for all interfaces). Port 0 picks a free port,
+  // which is then stored in the port field.
+  SocketServer(int port, int connections, TypeSocket type=BlockingSocket, const std::string& address="");
 
+  // Returns NULL for a non-blocking socket without pending connections
+  // and when the server socket was shut down.
   Socket* Accept();
 };
 
+/*
 // http://msdn.microsoft.com/library/default.asp?url=/library/en-us/winsock/wsapiref_2tiq.asp
 class SocketSelect {
   public:
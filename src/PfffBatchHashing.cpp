@@ -0,0 +1,215 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffBatchHashing.h"
+#include <stdint.h>
+#include <string.h>
+
+#define L PFFF_HASH_LANES
+
+static inline uint32_t load32_le(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void store32_le(unsigned char* p, uint32_t x) {
+    p[0] = (unsigned char)x;
+    p[1] = (unsigned char)(x >> 8);
+    p[2] = (unsigned char)(x >> 16);
+    p[3] = (unsigned char)(x >> 24);
+}
+
+// ------------- MD5 (RFC 1321) ----------------
+
+static const uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const int MD5_S[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+/**
+ * One MD5 step on all lanes: a = b + rotl(a + f(b, c, d) + x + k, s), followed by the
+ * rotation of the roles of the state words, done by the caller passing them in turn.
+ */
+#define MD5_STEP(f, a, b, c, d, x, k, s) \
+    for (int l = 0; l < L; l++) { \
+        uint32_t t = a[l] + f(b[l], c[l], d[l]) + x[l] + k; \
+        a[l] = b[l] + ((t << s) | (t >> (32 - s))); \
+    }
+#define MD5_F(x, y, z) (((x) & (y)) | (~(x) & (z)))
+#define MD5_G(x, y, z) (((x) & (z)) | ((y) & ~(z)))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+
+/**
+ * Processes one 64-byte block of each lane.
+ */
+static void md5_block(uint32_t a[L], uint32_t b[L], uint32_t c[L], uint32_t d[L], const unsigned char* const block[L]) {
+    uint32_t x[16][L];
+    uint32_t aa[L], bb[L], cc[L], dd[L];
+    for (int l = 0; l < L; l++) {
+        for (int j = 0; j < 16; j++) x[j][l] = load32_le(block[l] + 4*j);
+        aa[l] = a[l]; bb[l] = b[l]; cc[l] = c[l]; dd[l] = d[l];
+    }
+    for (int i = 0; i < 16; i += 4) {
+        MD5_STEP(MD5_F, a, b, c, d, x[i],     MD5_K[i],     MD5_S[i]);
+        MD5_STEP(MD5_F, d, a, b, c, x[i + 1], MD5_K[i + 1], MD5_S[i + 1]);
+        MD5_STEP(MD5_F, c, d, a, b, x[i + 2], MD5_K[i + 2], MD5_S[i + 2]);
+        MD5_STEP(MD5_F, b, c, d, a, x[i + 3], MD5_K[i + 3], MD5_S[i + 3]);
+    }
+    for (int i = 16; i < 32; i += 4) {
+        MD5_STEP(MD5_G, a, b, c, d, x[(5*i + 1) % 16],  MD5_K[i],     MD5_S[i]);
+        MD5_STEP(MD5_G, d, a, b, c, x[(5*i + 6) % 16],  MD5_K[i + 1], MD5_S[i + 1]);
+        MD5_STEP(MD5_G, c, d, a, b, x[(5*i + 11) % 16], MD5_K[i + 2], MD5_S[i + 2]);
+        MD5_STEP(MD5_G, b, c, d, a, x[(5*i + 16) % 16], MD5_K[i + 3], MD5_S[i + 3]);
+    }
+    for (int i = 32; i < 48; i += 4) {
+        MD5_STEP(MD5_H, a, b, c, d, x[(3*i + 5) % 16],  MD5_K[i],     MD5_S[i]);
+        MD5_STEP(MD5_H, d, a, b, c, x[(3*i + 8) % 16],  MD5_K[i + 1], MD5_S[i + 1]);
+        MD5_STEP(MD5_H, c, d, a, b, x[(3*i + 11) % 16], MD5_K[i + 2], MD5_S[i + 2]);
+        MD5_STEP(MD5_H, b, c, d, a, x[(3*i + 14) % 16], MD5_K[i + 3], MD5_S[i + 3]);
+    }
+    for (int i = 48; i < 64; i += 4) {
+        MD5_STEP(MD5_I, a, b, c, d, x[(7*i) % 16],      MD5_K[i],     MD5_S[i]);
+        MD5_STEP(MD5_I, d, a, b, c, x[(7*i + 7) % 16],  MD5_K[i + 1], MD5_S[i + 1]);
+        MD5_STEP(MD5_I, c, d, a, b, x[(7*i + 14) % 16], MD5_K[i + 2], MD5_S[i + 2]);
+        MD5_STEP(MD5_I, b, c, d, a, x[(7*i + 21) % 16], MD5_K[i + 3], MD5_S[i + 3]);
+    }
+    for (int l = 0; l < L; l++) {
+        a[l] += aa[l]; b[l] += bb[l]; c[l] += cc[l]; d[l] += dd[l];
+    }
+}
+
+void md5_lanes(unsigned char* digests, const char* const* data, unsigned long len, int n) {
+    uint32_t a[L], b[L], c[L], d[L];
+    for (int l = 0; l < L; l++) {
+        a[l] = 0x67452301; b[l] = 0xefcdab89; c[l] = 0x98badcfe; d[l] = 0x10325476;
+    }
+    // The last one or two blocks hold the rest of the data and the padding: 0x80, zeroes, bit length
+    unsigned long full_blocks = len / 64;
+    unsigned long tail_blocks = (len % 64) + 9 > 64 ? 2 : 1;
+    unsigned char tail[L][128];
+    uint64_t bits = (uint64_t)len * 8;
+    for (int l = 0; l < L; l++) {
+        memset(tail[l], 0, sizeof(tail[l]));
+        if (l < n) memcpy(tail[l], data[l] + full_blocks*64, len % 64);
+        tail[l][len % 64] = 0x80;
+        for (int i = 0; i < 8; i++) tail[l][tail_blocks*64 - 8 + i] = (unsigned char)(bits >> (8*i));
+    }
+
+    const unsigned char* block[L];
+    for (unsigned long i = 0; i < full_blocks; i++) {
+        // Unused lanes hash their padding block over and over
+        for (int l = 0; l < L; l++) block[l] = l < n ? (const unsigned char*)data[l] + i*64 : tail[l];
+        md5_block(a, b, c, d, block);
+    }
+    for (unsigned long i = 0; i < tail_blocks; i++) {
+        for (int l = 0; l < L; l++) block[l] = tail[l] + i*64;
+        md5_block(a, b, c, d, block);
+    }
+    for (int l = 0; l < n; l++) {
+        store32_le(digests + 16*l, a[l]);
+        store32_le(digests + 16*l + 4, b[l]);
+        store32_le(digests + 16*l + 8, c[l]);
+        store32_le(digests + 16*l + 12, d[l]);
+    }
+}
+
+// ------------- Poly1305 ----------------
+
+// The accumulator is kept in five 26-bit limbs, so that products fit into 64 bits.
+
+void poly1305_lanes(unsigned char* digests, const unsigned char r[16], const unsigned char s[16],
+                    const char* const* data, unsigned long len, int n) {
+    const uint32_t r0 = load32_le(r) & 0x3ffffff;
+    const uint32_t r1 = (load32_le(r + 3) >> 2) & 0x3ffff03;
+    const uint32_t r2 = (load32_le(r + 6) >> 4) & 0x3ffc0ff;
+    const uint32_t r3 = (load32_le(r + 9) >> 6) & 0x3f03fff;
+    const uint32_t r4 = (load32_le(r + 12) >> 8) & 0x00fffff;
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+
+    uint32_t h0[L], h1[L], h2[L], h3[L], h4[L];
+    for (int l = 0; l < L; l++) h0[l] = h1[l] = h2[l] = h3[l] = h4[l] = 0;
+
+    // A final partial chunk is padded with 0x01 and zeroes instead of getting the 2^128 bit
+    unsigned long chunks = (len + 15) / 16;
+    unsigned char tail[L][16];
+    for (int l = 0; l < L; l++) {
+        memset(tail[l], 0, 16);
+        if (l < n && len % 16 != 0) {
+            memcpy(tail[l], data[l] + (chunks - 1)*16, len % 16);
+            tail[l][len % 16] = 1;
+        }
+    }
+
+    for (unsigned long i = 0; i < chunks; i++) {
+        bool partial = i == chunks - 1 && len % 16 != 0;
+        uint32_t hibit = partial ? 0 : (1 << 24);
+        for (int l = 0; l < L; l++) {
+            const unsigned char* m = (partial || l >= n) ? tail[l] : (const unsigned char*)data[l] + i*16;
+            h0[l] += load32_le(m) & 0x3ffffff;
+            h1[l] += (load32_le(m + 3) >> 2) & 0x3ffffff;
+            h2[l] += (load32_le(m + 6) >> 4) & 0x3ffffff;
+            h3[l] += (load32_le(m + 9) >> 6) & 0x3ffffff;
+            h4[l] += (load32_le(m + 12) >> 8) | hibit;
+        }
+        for (int l = 0; l < L; l++) {
+            uint64_t d0 = (uint64_t)h0[l]*r0 + (uint64_t)h1[l]*s4 + (uint64_t)h2[l]*s3 + (uint64_t)h3[l]*s2 + (uint64_t)h4[l]*s1;
+            uint64_t d1 = (uint64_t)h0[l]*r1 + (uint64_t)h1[l]*r0 + (uint64_t)h2[l]*s4 + (uint64_t)h3[l]*s3 + (uint64_t)h4[l]*s2;
+            uint64_t d2 = (uint64_t)h0[l]*r2 + (uint64_t)h1[l]*r1 + (uint64_t)h2[l]*r0 + (uint64_t)h3[l]*s4 + (uint64_t)h4[l]*s3;
+            uint64_t d3 = (uint64_t)h0[l]*r3 + (uint64_t)h1[l]*r2 + (uint64_t)h2[l]*r1 + (uint64_t)h3[l]*r0 + (uint64_t)h4[l]*s4;
+            uint64_t d4 = (uint64_t)h0[l]*r4 + (uint64_t)h1[l]*r3 + (uint64_t)h2[l]*r2 + (uint64_t)h3[l]*r1 + (uint64_t)h4[l]*r0;
+            uint32_t c;
+            c = (uint32_t)(d0 >> 26); h0[l] = (uint32_t)d0 & 0x3ffffff;
+            d1 += c; c = (uint32_t)(d1 >> 26); h1[l] = (uint32_t)d1 & 0x3ffffff;
+            d2 += c; c = (uint32_t)(d2 >> 26); h2[l] = (uint32_t)d2 & 0x3ffffff;
+            d3 += c; c = (uint32_t)(d3 >> 26); h3[l] = (uint32_t)d3 & 0x3ffffff;
+            d4 += c; c = (uint32_t)(d4 >> 26); h4[l] = (uint32_t)d4 & 0x3ffffff;
+            h0[l] += c * 5; c = h0[l] >> 26; h0[l] &= 0x3ffffff;
+            h1[l] += c;
+        }
+    }
+
+    const uint32_t pad0 = load32_le(s), pad1 = load32_le(s + 4), pad2 = load32_le(s + 8), pad3 = load32_le(s + 12);
+    for (int l = 0; l < n; l++) {
+        // Full carry, then h mod 2^130 - 5 by subtracting p if h >= p
+        uint32_t x0 = h0[l], x1 = h1[l], x2 = h2[l], x3 = h3[l], x4 = h4[l], c;
+        c = x1 >> 26; x1 &= 0x3ffffff;
+        x2 += c; c = x2 >> 26; x2 &= 0x3ffffff;
+        x3 += c; c = x3 >> 26; x3 &= 0x3ffffff;
+        x4 += c; c = x4 >> 26; x4 &= 0x3ffffff;
+        x0 += c * 5; c = x0 >> 26; x0 &= 0x3ffffff;
+        x1 += c;
+
+        uint32_t g0 = x0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+        uint32_t g1 = x1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+        uint32_t g2 = x2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+        uint32_t g3 = x3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+        uint32_t g4 = x4 + c - (1 << 26);
+        uint32_t mask = (g4 >> 31) - 1;     // All ones if h >= p
+        x0 = (x0 & ~mask) | (g0 & mask);
+        x1 = (x1 & ~mask) | (g1 & mask);
+        x2 = (x2 & ~mask) | (g2 & mask);
+        x3 = (x3 & ~mask) | (g3 & mask);
+        x4 = (x4 & ~mask) | (g4 & mask);
+
+        // Add s modulo 2^128
+        uint64_t f;
+        f = (uint64_t)(x0 | (x1 << 26)) + pad0;                  store32_le(digests + 16*l, (uint32_t)f);
+        f = (uint64_t)((x1 >> 6) | (x2 << 20)) + pad1 + (f >> 32);  store32_le(digests + 16*l + 4, (uint32_t)f);
+        f = (uint64_t)((x2 >> 12) | (x3 << 14)) + pad2 + (f >> 32); store32_le(digests + 16*l + 8, (uint32_t)f);
+        f = (uint64_t)((x3 >> 18) | (x4 << 8)) + pad3 + (f >> 32);  store32_le(digests + 16*l + 12, (uint32_t)f);
+    }
+}
@@ -0,0 +1,31 @@
+/**
+ * PfffBatchHashing.h: MD5 and Poly1305 of several messages of the same length at once.
+ * The messages are processed in lockstep, one lane per message, in loops over the lanes
+ * that the compiler turns into SIMD code (this file is built with vectorization enabled).
+ * Fingerprints with default options digest only a few dozen bytes each, so computing them
+ * in batches saves most of the per-digest setup and fills the vector units.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffBatchHashing_h__
+#define __PfffBatchHashing_h__
+
+// Maximum number of messages hashed together
+#define PFFF_HASH_LANES 8
+
+/**
+ * Computes the MD5 digests of n <= PFFF_HASH_LANES messages of len bytes each.
+ * The digest of data[i] goes to digests + 16*i.
+ */
+void md5_lanes(unsigned char* digests, const char* const* data, unsigned long len, int n);
+
+/**
+ * Computes the Poly1305 authenticators of n <= PFFF_HASH_LANES messages of len bytes each,
+ * all with the same clamped r and the same s (for Poly1305-AES, s is AES_k(nonce)).
+ * The authenticator of data[i] goes to digests + 16*i.
+ */
+void poly1305_lanes(unsigned char* digests, const unsigned char r[16], const unsigned char s[16],
+                    const char* const* data, unsigned long len, int n);
+
+#endif
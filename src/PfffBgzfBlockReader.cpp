@@ -0,0 +1,275 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffBgzfBlockReader.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using std::ifstream;
+
+// Fixed part of a BGZF block header: the gzip header with FLG.FEXTRA and XLEN
+#define BGZF_HEADER_LEN 12
+// Largest header we read: the fixed part and the 6 bytes of the BC subfield
+#define BGZF_MIN_HEADER_LEN 18
+// Trailer: CRC32 and ISIZE
+#define BGZF_TRAILER_LEN 8
+#define BGZF_MAX_BLOCK_SIZE 65536
+
+static inline unsigned long long get_le(const unsigned char* p, int n) {
+    unsigned long long result = 0;
+    for (int i = n - 1; i >= 0; i--) result = (result << 8) | p[i];
+    return result;
+}
+
+/**
+ * Reads len bytes at offset with a block sequence of its own. Returns false on error.
+ */
+static bool read_range(BlockReader* reader, unsigned long long offset, unsigned long len, char* buffer) {
+    reader->begin_block_sequence(buffer);
+    bool ok = reader->next_block(offset, len);
+    return reader->end_block_sequence() && ok;
+}
+
+/**
+ * Finds the length of the BGZF block in the BC extra subfield of the header.
+ * Returns 0 if this is not a BGZF header.
+ */
+static unsigned long parse_block_size(const unsigned char* header, unsigned long header_len) {
+    if (header_len < BGZF_HEADER_LEN || header[0] != 31 || header[1] != 139 || header[2] != 8 || !(header[3] & 4)) return 0;
+    unsigned long xlen = get_le(header + 10, 2);
+    unsigned long pos = BGZF_HEADER_LEN;
+    while (pos + 4 <= BGZF_HEADER_LEN + xlen && pos + 4 <= header_len) {
+        unsigned long sublen = get_le(header + pos + 2, 2);
+        if (header[pos] == 'B' && header[pos + 1] == 'C' && sublen == 2 && pos + 6 <= header_len)
+            return get_le(header + pos + 4, 2) + 1;
+        pos += 4 + sublen;
+    }
+    return 0;
+}
+
+// ------------- BgzfBlockReader ----------------
+
+BgzfBlockReader::BgzfBlockReader(BlockReader* compressed, const char* index_filename):
+    BlockReader(""), inflated_blocks(0), compressed(compressed), index_filename(index_filename != NULL ? index_filename : "") {
+}
+
+BgzfBlockReader::~BgzfBlockReader() {
+    delete compressed;
+}
+
+string BgzfBlockReader::get_filename() {
+    return compressed->get_filename();
+}
+
+long long BgzfBlockReader::_size() {
+#ifndef HAVE_ZLIB
+    error_message = "BGZF files cannot be read: pfff was built without zlib";
+    return READ_ERROR;
+#else
+    if (compressed->size() < 0) {
+        error_message = compressed->error_message;
+        return compressed->size();
+    }
+    if (!(load_index() || build_index())) return READ_ERROR;
+    return uncompressed_offsets.back();
+#endif
+}
+
+/**
+ * Loads the .gzi index: the number of entries, followed by (compressed, uncompressed) offset pairs
+ * of every block but the first, all as 64-bit little-endian integers.
+ * The blocks after the last listed one are then visited as by build_index.
+ */
+bool BgzfBlockReader::load_index() {
+    if (index_filename == "") return false;
+    ifstream in(index_filename.c_str(), std::ios::binary);
+    unsigned char entry[16];
+    if (!in.read((char*)entry, 8)) return false;
+    unsigned long long n = get_le(entry, 8);
+    compressed_offsets.assign(1, 0);
+    uncompressed_offsets.assign(1, 0);
+    for (unsigned long long i = 0; i < n; i++) {
+        if (!in.read((char*)entry, 16)) return false;
+        unsigned long long c = get_le(entry, 8), u = get_le(entry + 8, 8);
+        if (c <= compressed_offsets.back() || u < uncompressed_offsets.back()) return false;
+        compressed_offsets.push_back(c);
+        uncompressed_offsets.push_back(u);
+    }
+    return scan_blocks();
+}
+
+bool BgzfBlockReader::build_index() {
+    compressed_offsets.assign(1, 0);
+    uncompressed_offsets.assign(1, 0);
+    if (!scan_blocks()) return false;
+    if (compressed_offsets.size() == 1) {
+        error_message = "Not a BGZF file: " + get_filename();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Visits the header and the trailer of every block from the last offsets of the index on,
+ * to the end of the file.
+ */
+bool BgzfBlockReader::scan_blocks() {
+    unsigned long long file_size = compressed->size();
+    unsigned char header[BGZF_MIN_HEADER_LEN], trailer[BGZF_TRAILER_LEN];
+    while (compressed_offsets.back() < file_size) {
+        unsigned long long start = compressed_offsets.back();
+        unsigned long block_len;
+        if (start + BGZF_MIN_HEADER_LEN > file_size || !read_range(compressed, start, BGZF_MIN_HEADER_LEN, (char*)header) ||
+            (block_len = parse_block_size(header, BGZF_MIN_HEADER_LEN)) == 0 || start + block_len > file_size ||
+            !read_range(compressed, start + block_len - BGZF_TRAILER_LEN, BGZF_TRAILER_LEN, (char*)trailer)) {
+            error_message = compressed->error_message != "" ? compressed->error_message : "Not a BGZF file: " + get_filename();
+            return false;
+        }
+        compressed_offsets.push_back(start + block_len);
+        uncompressed_offsets.push_back(uncompressed_offsets.back() + get_le(trailer + 4, 4));
+    }
+    return true;
+}
+
+long BgzfBlockReader::find_block(unsigned long long offset) const {
+    // The last block starting at or before offset, skipping empty blocks
+    return std::upper_bound(uncompressed_offsets.begin(), uncompressed_offsets.end() - 1, offset) - uncompressed_offsets.begin() - 1;
+}
+
+BgzfBlockReader::CachedBlock* BgzfBlockReader::cached(long index) {
+    for (int i = 0; i < cache.size(); i++) {
+        if (cache[i].index == index) return &cache[i];
+    }
+    return NULL;
+}
+
+bool BgzfBlockReader::inflate_block(long index, const char* data, unsigned long len) {
+#ifdef HAVE_ZLIB
+    unsigned long header_len = BGZF_HEADER_LEN + get_le((const unsigned char*)data + 10, 2);
+    unsigned long expected = uncompressed_offsets[index + 1] - uncompressed_offsets[index];
+    if (parse_block_size((const unsigned char*)data, len) != len || header_len + BGZF_TRAILER_LEN > len) {
+        error_message = "Corrupt BGZF block in " + get_filename();
+        return false;
+    }
+    // Reuse the least recently inflated slot
+    if (cache.size() == BGZF_CACHED_BLOCKS) cache.erase(cache.begin());
+    cache.push_back(CachedBlock());
+    CachedBlock& block = cache.back();
+    block.index = index;
+    block.data.resize(expected + 1);
+    
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    bool ok = inflateInit2(&stream, -15) == Z_OK;   // Raw deflate data
+    if (ok) {
+        stream.next_in = (Bytef*)(data + header_len);
+        stream.avail_in = len - header_len - BGZF_TRAILER_LEN;
+        stream.next_out = (Bytef*)&block.data[0];
+        stream.avail_out = expected + 1;
+        ok = inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == expected &&
+             crc32(crc32(0, NULL, 0), (Bytef*)&block.data[0], expected) == get_le((const unsigned char*)data + len - BGZF_TRAILER_LEN, 4);
+        inflateEnd(&stream);
+    }
+    if (!ok) {
+        cache.pop_back();
+        error_message = "Corrupt BGZF block in " + get_filename();
+        return false;
+    }
+    inflated_blocks++;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void BgzfBlockReader::begin_block_sequence(char* buffer) {
+    this->buffer = buffer;
+    requests.clear();
+}
+
+bool BgzfBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    if (size() < 0) return false;
+    Request request;
+    request.target = buffer;
+    request.start = block_start;
+    request.len = block_size;
+    requests.push_back(request);
+    buffer += block_size;
+    return true;
+}
+
+/**
+ * Copies the overlap of the cached blocks with the requests into them, zero-filling beyond the data.
+ */
+void BgzfBlockReader::fill_requests() {
+    unsigned long long data_size = uncompressed_offsets.back();
+    for (int i = 0; i < requests.size(); i++) {
+        Request& r = requests[i];
+        unsigned long long end = r.start + r.len;
+        if (end > data_size) {
+            unsigned long long from = std::max(r.start, data_size);
+            memset(r.target + (from - r.start), 0, end - from);
+            end = data_size;
+        }
+        if (r.start >= end) continue;
+        for (long b = find_block(r.start); b < (long)uncompressed_offsets.size() - 1 && uncompressed_offsets[b] < end; b++) {
+            CachedBlock* block = cached(b);
+            if (block == NULL) continue;
+            unsigned long long from = std::max(r.start, uncompressed_offsets[b]);
+            unsigned long long to = std::min(end, uncompressed_offsets[b + 1]);
+            if (from < to) memcpy(r.target + (from - r.start), &block->data[from - uncompressed_offsets[b]], to - from);
+        }
+    }
+}
+
+/**
+ * Reads the compressed blocks needed by the sequence, BGZF_CACHED_BLOCKS at a time, each time in one
+ * sequence of the compressed reader (so that a BufferingBlockReader below can combine them).
+ * The requests are filled from the cache before and after each batch.
+ */
+bool BgzfBlockReader::end_block_sequence() {
+    if (requests.empty()) return true;
+    unsigned long long data_size = uncompressed_offsets.back();
+    vector<long> needed;
+    for (int i = 0; i < requests.size(); i++) {
+        unsigned long long end = std::min(requests[i].start + requests[i].len, data_size);
+        if (requests[i].start >= end) continue;
+        for (long b = find_block(requests[i].start); b < (long)uncompressed_offsets.size() - 1 && uncompressed_offsets[b] < end; b++) {
+            if (uncompressed_offsets[b + 1] > uncompressed_offsets[b] && cached(b) == NULL) needed.push_back(b);
+        }
+    }
+    std::sort(needed.begin(), needed.end());
+    needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+    
+    fill_requests();
+    vector<char> compressed_data;
+    for (int first = 0; first < needed.size(); first += BGZF_CACHED_BLOCKS) {
+        int last = std::min((int)needed.size(), first + BGZF_CACHED_BLOCKS);
+        unsigned long long total = 0;
+        for (int i = first; i < last; i++) total += compressed_offsets[needed[i] + 1] - compressed_offsets[needed[i]];
+        compressed_data.resize(total);
+        compressed->begin_block_sequence(&compressed_data[0]);
+        bool ok = true;
+        for (int i = first; i < last && ok; i++)
+            ok = compressed->next_block(compressed_offsets[needed[i]], compressed_offsets[needed[i] + 1] - compressed_offsets[needed[i]]);
+        ok = compressed->end_block_sequence() && ok;
+        if (!ok) {
+            error_message = compressed->error_message;
+            return false;
+        }
+        unsigned long long pos = 0;
+        for (int i = first; i < last; i++) {
+            unsigned long len = compressed_offsets[needed[i] + 1] - compressed_offsets[needed[i]];
+            if (!inflate_block(needed[i], &compressed_data[pos], len)) return false;
+            pos += len;
+        }
+        fill_requests();
+    }
+    requests.clear();
+    return true;
+}
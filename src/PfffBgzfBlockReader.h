@@ -0,0 +1,87 @@
+/**
+ * PfffBgzfBlockReader.h: Reading the uncompressed content of BGZF files (BAM, bgzipped VCF, ...)
+ * at random, so that their fingerprints do not depend on how they were compressed.
+ *
+ * A BGZF file is a series of gzip members ("BGZF blocks") of at most 64KB each, whose headers give
+ * their compressed length and whose trailers give their uncompressed length. The reader maps
+ * uncompressed offsets to blocks with an index, loaded from a .gzi file (as written by bgzip -i)
+ * when there is one, and otherwise built from the block headers and trailers, which costs two
+ * small reads per block rather than a decompression of the whole file. Only the blocks holding
+ * requested bytes are then read and inflated, so the cost follows the block count of the sample.
+ *
+ * Needs zlib (HAVE_ZLIB). Without it, every file is reported as unreadable.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffBgzfBlockReader_h__
+#define __PfffBgzfBlockReader_h__
+#include <string>
+#include <vector>
+#include "PfffBlockReader.h"
+
+using std::string;
+using std::vector;
+
+// Number of inflated BGZF blocks kept between block sequences
+#define BGZF_CACHED_BLOCKS 4
+
+class BgzfBlockReader: public BlockReader {
+public:
+    /**
+     * Reads the compressed data from the given reader, which is owned.
+     * If index_filename is given and the file can be read, it is used as the .gzi index.
+     */
+    BgzfBlockReader(BlockReader* compressed, const char* index_filename = NULL);
+    virtual ~BgzfBlockReader();
+    
+    /** The uncompressed size. Loads or builds the index. */
+    long long _size();
+    void begin_block_sequence(char* buffer);
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+    bool end_block_sequence();
+    string get_filename();
+    
+    /** Number of BGZF blocks inflated so far */
+    long inflated_blocks;
+
+protected:
+    BlockReader* compressed;
+    string index_filename;
+    
+    // The index: BGZF block i starts at compressed_offsets[i] and uncompressed_offsets[i].
+    // There is one more entry for the end of the data.
+    vector<unsigned long long> compressed_offsets;
+    vector<unsigned long long> uncompressed_offsets;
+    
+    // Requests of the current sequence, filled in by end_block_sequence
+    struct Request {
+        char* target;
+        unsigned long long start;
+        unsigned long len;
+    };
+    vector<Request> requests;
+    
+    // Recently inflated blocks
+    struct CachedBlock {
+        long index;
+        vector<char> data;
+    };
+    vector<CachedBlock> cache;
+    
+    bool load_index();
+    bool build_index();
+    bool scan_blocks();
+    void fill_requests();
+    
+    /** Index of the block holding the uncompressed offset */
+    long find_block(unsigned long long offset) const;
+    
+    /** The inflated block, or NULL if it is not cached */
+    CachedBlock* cached(long index);
+    
+    /** Inflates the compressed block i into the cache. Returns false on error. */
+    bool inflate_block(long index, const char* data, unsigned long len);
+};
+
+#endif
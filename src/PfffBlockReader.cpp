@@ -6,6 +6,7 @@
 #include <errno.h>
 #include <fstream>
 #include <string.h>
+#include <unistd.h>
 
 using std::ifstream;
 using std::ios;
@@ -24,6 +25,10 @@ bool BlockReader::end_block_sequence() {
     return true;
 }
 
+long long BlockReader::retries() {
+    return 0;
+}
+
 bool BlockReader::read_blocks(unsigned long block_size, unsigned long long* block_indexes, unsigned long n_indexes) {
     for (long i = 0; i < n_indexes; i++) {
         bool success = next_block(block_indexes[i]*block_size, block_size);
@@ -54,15 +59,18 @@ LocalFileBlockReader::~LocalFileBlockReader() {
 #ifdef __MINGW32__
     // Mingws uses struct _stati64 and function _stati64, in place of POSIX's stat64
     #define stat64 _stati64
+    #define fstat64 _fstati64
 #endif
 #ifdef __CYGWIN__
 	// struct stat64 is not used in Cygwin, just use struct stat. It's 64 bit aware.
 	// http://www.cygwin.com/faq/faq.programming.html#faq.programming.stat64
 	#define stat64 stat
+	#define fstat64 fstat
 #endif
 #ifdef __APPLE__
     // stat64 is not used on Darwin, just use struct stat which expands to __DARWIN_STRUCT_STAT64
     #define stat64 stat
+    #define fstat64 fstat
 #endif
 
 long long LocalFileBlockReader::_size() {
@@ -112,6 +120,78 @@ bool LocalFileBlockReader::next_block(unsigned long long block_start, unsigned l
     return true;
 }
 
+// ------------- FdBlockReader -------------
+FdBlockReader::FdBlockReader(int fd, const char* filename):
+    BlockReader(filename), fd(fd) {
+};
+
+long long FdBlockReader::_size() {
+    struct stat64 s;
+    if (fstat64(fd, &s) != 0) {
+        error_message = strerror(errno);
+        return READ_ERROR;
+    }
+    if (!S_ISREG(s.st_mode)) {
+        error_message = "Object ";
+        error_message = error_message + filename + " is not a file.";
+        return NOT_A_FILE;
+    }
+    return s.st_size;
+}
+
+#ifdef __MINGW32__
+// No pread on Windows, emulate it with a seek
+static long long pread(int fd, void* buffer, unsigned long length, unsigned long long offset) {
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) return -1;
+    return read(fd, buffer, length);
+}
+#endif
+
+bool FdBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    unsigned long done = 0;
+    while (done < block_size) {
+        long long r = pread(fd, buffer + done, block_size - done, block_start + done);
+        if (r < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            error_message = "File ";
+            error_message = error_message + filename + " could not be read: " + strerror(errno);
+            return false;
+        }
+        if (r == 0) break; // EOF
+        done += r;
+    }
+    // Fill whatever is beyond the end of file with zeroes
+    if (done < block_size) memset(buffer + done, 0, block_size - done);
+    buffer += block_size;
+    return true;
+}
+
+// ------------- CallbackBlockReader -------------
+CallbackBlockReader::CallbackBlockReader(BlockReadCallback read, void* user_data, long long data_size, const char* filename):
+    BlockReader(filename), read(read), user_data(user_data), data_size(data_size) {
+};
+
+long long CallbackBlockReader::_size() {
+    return data_size;
+}
+
+bool CallbackBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    unsigned long done = 0;
+    while (done < block_size) {
+        long long r = read(user_data, buffer + done, block_size - done, block_start + done);
+        if (r < 0) {
+            error_message = "Read callback failed for ";
+            error_message = error_message + filename;
+            return false;
+        }
+        if (r == 0) break; // End of data
+        done += r;
+    }
+    if (done < block_size) memset(buffer + done, 0, block_size - done);
+    buffer += block_size;
+    return true;
+}
+
 // ----------------- BufferingBlockReader ---------------------
 BufferingBlockReader::BufferingBlockReader(BlockReader* reader, long request_cost, long max_request_size):
     BlockReader(""), reader(reader), request_cost(request_cost), max_request_size(max_request_size) {};
@@ -121,7 +201,9 @@ BufferingBlockReader::~BufferingBlockReader() {
 };
 
 long long BufferingBlockReader::_size() {
-    return reader->_size();
+    long long result = reader->_size();
+    if (result < 0) error_message = reader->error_message;
+    return result;
 }
 
 string BufferingBlockReader::get_filename() {
@@ -44,6 +44,12 @@ public:
         return c_size;
     } 
     
+    /**
+     * Sets the size when it is known already (e.g. from a directory listing), saving the request
+     * made by _size(). Must be called before size().
+     */
+    inline void set_size(long long size) { c_size = size; }
+    
     /** 
      * This tells the block reader that a block sequence will now be read in to a 
      * given buffer. Each next block will be requested using next_block, and the sequence
@@ -82,6 +88,12 @@ public:
      */
     virtual string get_filename();
     
+    /**
+     * Returns the number of requests the reader has repeated so far (e.g. with another connection
+     * after a failure). Wrappers which pass the requests on unchanged return that of the wrapped reader.
+     */
+    virtual long long retries();
+    
     // ----------------- Convenience wrappers ----------------
     /**
      * Regards the file as a sequence of <block_size>-byte sized blocks.
@@ -127,6 +139,42 @@ public:
     bool next_block(unsigned long long block_start, unsigned long block_size);
 };
 
+/**
+ * A BlockReader for an already opened file descriptor (e.g. a file opened by the caller
+ * of the C library). Uses positioned reads, so the file offset of fd is not changed.
+ * The descriptor is not closed by the reader.
+ */
+class FdBlockReader: public BlockReader {
+public:
+    int fd;
+    
+    FdBlockReader(int fd, const char* filename = "");
+    long long _size();
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+};
+
+/**
+ * pread-style function used by CallbackBlockReader: reads up to length bytes
+ * at the given offset into buffer. Must return the number of bytes read
+ * (less than length only at end of data) or a negative value on error.
+ */
+typedef long long (*BlockReadCallback)(void* user_data, char* buffer, unsigned long length, unsigned long long offset);
+
+/**
+ * A BlockReader serving data from a user-provided read function. The size of
+ * the object must be known in advance.
+ */
+class CallbackBlockReader: public BlockReader {
+public:
+    BlockReadCallback read;
+    void* user_data;
+    long long data_size;
+    
+    CallbackBlockReader(BlockReadCallback read, void* user_data, long long data_size, const char* filename = "");
+    long long _size();
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+};
+
 /**
  * Wraps a low-level block reader and buffers multiple block requests into single
  * requests for continuous blocks. The request_cost parameter tells the maximum number of "unneeded"
@@ -3,11 +3,14 @@
  * License:   The terms of use of this software and its source code are defined by the BSD license.
  */
 #include "PfffBlockSampleGenerator.h"
+#include <cmath>
 #include <set>
+#include <string>
 #include <stdint.h>
 #include "MTwister.h"
 using std::multiset;
 using std::set;
+using std::string;
 
 #include <iostream>
 using std::cout;
@@ -55,7 +58,8 @@ void generate_sample(uint32_t key, unsigned long n, unsigned long long min, unsi
 
 // ---------------- PfffBlockSampleGenerator -----------------
 PfffBlockSampleGenerator::PfffBlockSampleGenerator(const PfffOptions* opts): opts(opts) {
-    sample = new unsigned long long[opts->block_count];
+    capacity = pfff_options_max_block_count(opts);
+    sample = new unsigned long long[capacity];
 }
 
 PfffBlockSampleGenerator::~PfffBlockSampleGenerator() {
@@ -67,12 +71,16 @@ PfffBlockSampleGenerator::~PfffBlockSampleGenerator() {
  * sample of blocks (fills the sample array and sample_size variable).
  */
 void PfffBlockSampleGenerator::generate(long long size_in_bytes) {
+    generate(size_in_bytes, opts->block_count);
+}
+
+void PfffBlockSampleGenerator::generate(long long size_in_bytes, unsigned long block_count) {
     // How many blocks are there total in the file?
     unsigned long long size_in_blocks = size_in_bytes/opts->block_size;
     if (size_in_blocks*opts->block_size < size_in_bytes) size_in_blocks++;
     
     // How many blocks will we be reading?
-    sample_size = opts->block_count;
+    sample_size = block_count;
     
     // When sampling *without replacement* we can't request too many blocks. Trim.
     if (opts->without_replacement && (sample_size > size_in_blocks - opts->header_block_count)) {
@@ -82,7 +90,7 @@ void PfffBlockSampleGenerator::generate(long long size_in_bytes) {
         if (sample_size < 0) sample_size = 0;
         if (sample_size > 0) {
             for (long i = opts->header_block_count; i < size_in_blocks; i++) {
-                sample[i] = i;
+                sample[i - opts->header_block_count] = i;
             }
         }
         return;
@@ -98,3 +106,24 @@ void PfffBlockSampleGenerator::generate(long long size_in_bytes) {
     generate_sample(opts->key, sample_size, opts->header_block_count, size_in_blocks, !opts->without_replacement, sample);
 }
 
+double PfffBlockSampleGenerator::entropy_bits(const char* blocks, unsigned long n_blocks, unsigned long block_size) {
+    unsigned long long n = (unsigned long long)n_blocks * block_size;
+    if (n < 2) return 0;
+    
+    // Probability that two bytes of the sample picked at random are equal
+    unsigned long long counts[256] = { 0 };
+    for (unsigned long long i = 0; i < n; i++) counts[(unsigned char)blocks[i]]++;
+    double pairs = 0;
+    for (int c = 0; c < 256; c++) pairs += (double)counts[c] * (counts[c] - 1);
+    double bits_per_byte = pairs > 0 ? -std::log(pairs / ((double)n * (n - 1))) / std::log(2.0) : 8;
+    if (bits_per_byte > 8) bits_per_byte = 8;
+    
+    // A block seen before adds nothing. Single bytes are covered by the estimate above.
+    unsigned long distinct = n_blocks;
+    if (block_size > 1) {
+        set<string> seen;
+        for (unsigned long i = 0; i < n_blocks; i++) seen.insert(string(blocks + i*block_size, block_size));
+        distinct = seen.size();
+    }
+    return bits_per_byte * block_size * distinct;
+}
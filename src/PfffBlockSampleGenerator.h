@@ -18,6 +18,7 @@ public:
     unsigned long sample_size; // The true sample size may be less than opts.block_count
                                // (e.g. when sampling without replacement from a small file
                                // or when header blocks cover the whole file). 
+    unsigned long capacity;    // Size of the sample array (see pfff_options_max_block_count)
     
     PfffBlockSampleGenerator(const PfffOptions* opts);
     
@@ -28,6 +29,21 @@ public:
      * sample of blocks (fills the sample array and sample_size variable).
      */
     void generate(long long size_in_bytes);
+    
+    /**
+     * Same, for a sample of block_count (at most capacity) blocks rather than opts.block_count.
+     * Samples are prefix-stable: the sample of n blocks consists of the first n indices drawn
+     * (the first n distinct ones without replacement), sorted, so it contains the sample of
+     * any smaller count.
+     */
+    void generate(long long size_in_bytes, unsigned long block_count);
+    
+    /**
+     * Estimates the entropy in bits of n_blocks sampled blocks from the byte-level collision
+     * (Renyi order 2) entropy, counting only distinct blocks when blocks are longer than a byte.
+     * Used by the adaptive mode to decide whether the sample is large enough.
+     */
+    static double entropy_bits(const char* blocks, unsigned long n_blocks, unsigned long block_size);
 };
 
 #endif
@@ -3,29 +3,81 @@
  * License:   The terms of use of this software and its source code are defined by the BSD license.
  */
 #include "PfffCLib.h"
-#include <sstream>
 #include <cstring>
+#include <vector>
+#include "output_utils.h"
 #include "PfffHasher.h"
-using std::ostringstream;
+#include "PfffThreadPool.h"
 using std::strncpy;
+using std::vector;
+
+// Number of samples kept in memory by pfffclib_context_digest_files before digesting them
+#define PFFFCLIB_DIGEST_BATCH 256
 
 /**
- * Hashes a single file. Outputs the hash into a given buffer.
- * On success returns 0. On error returns a nonzero value and sets the provided error_message variable (unless it is NULL).
- * If everything is OK except that maybe the output does not fit into the buffer, returns 0 (ERR_NONE).
- * ASSUMES the provided options are valid (i.e. call pfff_options_validate if you are not sure).
- * ASSUMES output != NULL
+ * The context keeps its own copy of the options, as the hasher refers to them by pointer.
  */
-extern "C" int pfffclib_hash_file(const PfffOptions* opts, const char* filename, unsigned long request_cost, char* output, unsigned int output_len, char* error_message, unsigned int error_message_len) {
+struct pfffclib_context {
+    PfffOptions opts;
+    unsigned long request_cost;
+    PfffHasher* hasher;
+    ArrayOutputBuffer output_buffer;
+    ostream out;
+
+    pfffclib_context(const PfffOptions* opts, unsigned long request_cost):
+        opts(*opts), request_cost(request_cost), out(&output_buffer) {
+        hasher = new PfffHasher(&this->opts);
+    }
+
+    ~pfffclib_context() {
+        delete hasher;
+    }
+};
+
+extern "C" pfffclib_context* pfffclib_context_create(const PfffOptions* opts, unsigned long request_cost) {
+    return new pfffclib_context(opts, request_cost);
+}
+
+extern "C" void pfffclib_context_destroy(pfffclib_context* ctx) {
+    delete ctx;
+}
+
+extern "C" int pfffclib_context_hash_file(pfffclib_context* ctx, const char* filename, char* output, unsigned int output_len, char* error_message, unsigned int error_message_len) {
     int result = 0;
-    PfffHasher* hasher = new PfffHasher(opts);
     BlockReader* input_file = new LocalFileBlockReader(filename);
-    if (request_cost > 0) input_file = new BufferingBlockReader(input_file, request_cost);
-    
-    ostringstream out;
+    if (ctx->request_cost > 0) input_file = new BufferingBlockReader(input_file, ctx->request_cost);
+
+    ctx->output_buffer.reset(output, output_len);
+    ctx->out.clear();
+    try {
+        ctx->hasher->hash(ctx->out, input_file);
+        ctx->output_buffer.terminate();
+    }
+    catch(pfff_exception& e) {
+        if (error_message != NULL) 
+            strncpy(error_message, e.what(), error_message_len);
+        if (output_len > 0) output[0] = 0;
+        result = -1;
+    }
+    delete input_file;
+    return result;
+}
+
+/**
+ * Common part of the pfffclib_context_digest_* functions. Takes ownership of input_file.
+ */
+static int digest_input(pfffclib_context* ctx, BlockReader* input_file, unsigned char* digest, unsigned int digest_len,
+                        PfffOptionsSignatureStruct* signature, char* error_message, unsigned int error_message_len) {
+    int result = ctx->hasher->formatter->digest_len();
+    if (ctx->request_cost > 0) input_file = new BufferingBlockReader(input_file, ctx->request_cost);
     try {
-        hasher->hash(out, input_file);
-        strncpy(output, out.str().c_str(), output_len);
+        if (result == 0)
+            throw pfff_exception("The output format does not produce a binary digest.");
+        if (digest_len < result)
+            throw pfff_exception("The digest buffer is too small.");
+        ctx->hasher->read_sample(input_file);
+        ctx->hasher->formatter->output_digest(digest);
+        if (signature != NULL) *signature = ctx->hasher->formatter->signature.values;
     }
     catch(pfff_exception& e) {
         if (error_message != NULL) 
@@ -33,7 +85,129 @@ extern "C" int pfffclib_hash_file(const PfffOptions* opts, const char* filename,
         result = -1;
     }
     delete input_file;
-    delete hasher;
     return result;
 }
 
+extern "C" int pfffclib_context_digest_file(pfffclib_context* ctx, const char* filename, unsigned char* digest, unsigned int digest_len,
+                                            PfffOptionsSignatureStruct* signature, char* error_message, unsigned int error_message_len) {
+    return digest_input(ctx, new LocalFileBlockReader(filename), digest, digest_len, signature, error_message, error_message_len);
+}
+
+extern "C" int pfffclib_context_digest_files(pfffclib_context* ctx, const char* const* filenames, unsigned long n_files,
+                                             unsigned char* digests, unsigned int digest_len, PfffOptionsSignatureStruct* signatures,
+                                             int* results, char* error_messages, unsigned int error_message_len) {
+    PfffOutputFormatter* formatter = ctx->hasher->formatter;
+    int len = formatter->digest_len();
+    int failed = 0;
+    vector<char> samples;
+    vector<long> offsets, data_len;
+    vector<unsigned long> files;
+    vector<const char*> data;
+    vector<unsigned char> batch_digests;
+    for (unsigned long start = 0; start < n_files; start += PFFFCLIB_DIGEST_BATCH) {
+        unsigned long end = start + PFFFCLIB_DIGEST_BATCH < n_files ? start + PFFFCLIB_DIGEST_BATCH : n_files;
+        samples.clear();
+        offsets.clear();
+        data_len.clear();
+        files.clear();
+        for (unsigned long i = start; i < end; i++) {
+            BlockReader* input_file = new LocalFileBlockReader(filenames[i]);
+            if (ctx->request_cost > 0) input_file = new BufferingBlockReader(input_file, ctx->request_cost);
+            char* error_message = error_messages != NULL ? error_messages + i*error_message_len : NULL;
+            results[i] = len;
+            try {
+                if (len == 0)
+                    throw pfff_exception("The output format does not produce a binary digest.");
+                if (digest_len < len)
+                    throw pfff_exception("The digest buffer is too small.");
+                ctx->hasher->read_sample(input_file);
+                offsets.push_back(samples.size());
+                data_len.push_back(formatter->data_len);
+                files.push_back(i);
+                samples.insert(samples.end(), formatter->data, formatter->data + formatter->data_len);
+                if (signatures != NULL) signatures[i] = formatter->signature.values;
+            }
+            catch(pfff_exception& e) {
+                if (error_message != NULL) 
+                    strncpy(error_message, e.what(), error_message_len);
+                results[i] = -1;
+                failed++;
+            }
+            delete input_file;
+        }
+        if (files.empty()) continue;
+        // The samples are only addressed once all of them are in place, as the vector may move
+        data.resize(files.size());
+        for (int j = 0; j < files.size(); j++) data[j] = &samples[0] + offsets[j];
+        batch_digests.resize(files.size() * len);
+        formatter->post_hasher->compute_digests(&batch_digests[0], &data[0], &data_len[0], files.size());
+        for (int j = 0; j < files.size(); j++) memcpy(digests + files[j]*digest_len, &batch_digests[j*len], len);
+    }
+    return failed;
+}
+
+extern "C" int pfffclib_context_digest_fd(pfffclib_context* ctx, int fd, unsigned char* digest, unsigned int digest_len,
+                                          PfffOptionsSignatureStruct* signature, char* error_message, unsigned int error_message_len) {
+    return digest_input(ctx, new FdBlockReader(fd), digest, digest_len, signature, error_message, error_message_len);
+}
+
+extern "C" int pfffclib_context_digest_callback(pfffclib_context* ctx, pfffclib_read_callback read, void* user_data, long long size,
+                                                unsigned char* digest, unsigned int digest_len,
+                                                PfffOptionsSignatureStruct* signature, char* error_message, unsigned int error_message_len) {
+    return digest_input(ctx, new CallbackBlockReader(read, user_data, size), digest, digest_len, signature, error_message, error_message_len);
+}
+
+/**
+ * Hashes a single file. Outputs the hash into a given buffer.
+ * On success returns 0. On error returns a nonzero value and sets the provided error_message variable (unless it is NULL).
+ * If everything is OK except that maybe the output does not fit into the buffer, returns 0 (ERR_NONE).
+ * ASSUMES the provided options are valid (i.e. call pfff_options_validate if you are not sure).
+ * ASSUMES output != NULL
+ */
+extern "C" int pfffclib_hash_file(const PfffOptions* opts, const char* filename, unsigned long request_cost, char* output, unsigned int output_len, char* error_message, unsigned int error_message_len) {
+    pfffclib_context ctx(opts, request_cost);
+    return pfffclib_context_hash_file(&ctx, filename, output, output_len, error_message, error_message_len);
+}
+
+/**
+ * Job for pfffclib_hash_files: hashes the index-th file using the context of the worker thread.
+ */
+class HashFileJob: public PfffJob {
+public:
+    pfffclib_context** contexts;
+    const char* filename;
+    char* output;
+    unsigned int output_len;
+    int* result;
+    char* error_message;
+    unsigned int error_message_len;
+
+    HashFileJob(pfffclib_context** contexts, const char* filename, char* output, unsigned int output_len, int* result, char* error_message, unsigned int error_message_len):
+        contexts(contexts), filename(filename), output(output), output_len(output_len), result(result),
+        error_message(error_message), error_message_len(error_message_len) {}
+
+    void run(int worker) {
+        *result = pfffclib_context_hash_file(contexts[worker], filename, output, output_len, error_message, error_message_len);
+    }
+};
+
+extern "C" int pfffclib_hash_files(const PfffOptions* opts, const char* const* filenames, unsigned long n_files, unsigned long request_cost, int n_threads,
+                                   char* outputs, unsigned int output_len, int* results, char* error_messages, unsigned int error_message_len) {
+    if (n_threads <= 1 || n_files <= 1) n_threads = 0;
+    else if (n_threads > n_files) n_threads = n_files;
+    
+    PfffThreadPool pool(n_threads);
+    vector<pfffclib_context*> contexts(pool.n_workers());
+    for (int i = 0; i < contexts.size(); i++) contexts[i] = new pfffclib_context(opts, request_cost);
+    
+    for (unsigned long i = 0; i < n_files; i++) {
+        char* error_message = (error_messages != NULL) ? error_messages + i*error_message_len : NULL;
+        pool.submit(new HashFileJob(&contexts[0], filenames[i], outputs + i*output_len, output_len, &results[i], error_message, error_message_len));
+    }
+    pool.wait_all();
+    
+    int result = 0;
+    for (unsigned long i = 0; i < n_files; i++) if (results[i] != 0) result = -1;
+    for (int i = 0; i < contexts.size(); i++) delete contexts[i];
+    return result;
+}
@@ -6,6 +6,7 @@
 #ifndef __PfffCLib_h__
 #define __PfffCLib_h__
 #include "PfffOptions.h"
+#include "PfffBlockReader.h"
 
 /**
  * Hashes a single file. Outputs the hash into a given buffer.
@@ -17,4 +18,91 @@
  */
 extern "C" int pfffclib_hash_file(const PfffOptions* opts, const char* filename, unsigned long request_cost, char* output, unsigned int output_len, char* error_message, unsigned int error_message_len);
 
+/**
+ * Opaque hashing context. Keeps a ready-to-use hasher (with its derived keys and
+ * buffers) between calls, so that hashing many files does not repeat the setup work
+ * done by pfffclib_hash_file on each invocation.
+ * A context may be used by a single thread at a time.
+ */
+struct pfffclib_context;
+
+/**
+ * Creates a hashing context for the given options (which are copied).
+ * ASSUMES the provided options are valid (i.e. call pfff_options_validate if you are not sure).
+ * request_cost has the same meaning as in pfffclib_hash_file.
+ */
+extern "C" pfffclib_context* pfffclib_context_create(const PfffOptions* opts, unsigned long request_cost);
+
+/**
+ * Frees the context.
+ */
+extern "C" void pfffclib_context_destroy(pfffclib_context* ctx);
+
+/**
+ * Same as pfffclib_hash_file, using the options and buffers of the given context.
+ * The output is always zero-terminated (and truncated if it does not fit).
+ */
+extern "C" int pfffclib_context_hash_file(pfffclib_context* ctx, const char* filename, char* output, unsigned int output_len, char* error_message, unsigned int error_message_len);
+
+/**
+ * Hashes n_files files. The hash of filenames[i] is written to outputs + i*output_len
+ * and its result code (as returned by pfffclib_hash_file) to results[i].
+ * If error_messages is not NULL, the error message for filenames[i] goes to
+ * error_messages + i*error_message_len.
+ * When n_threads > 1, files are processed by that many threads in parallel.
+ * Returns 0 if all files were hashed successfully, and a nonzero value otherwise.
+ */
+extern "C" int pfffclib_hash_files(const PfffOptions* opts, const char* const* filenames, unsigned long n_files, unsigned long request_cost, int n_threads,
+                                   char* outputs, unsigned int output_len, int* results, char* error_messages, unsigned int error_message_len);
+
+/**
+ * Largest binary digest produced by any of the output formats (poly1305aes and md5 digests are 16 bytes).
+ */
+#define PFFFCLIB_DIGEST_MAX_LEN 16
+
+/**
+ * pread-style read function for pfffclib_context_digest_callback: reads up to length bytes
+ * at offset into buffer, returns the number of bytes read (less than length only at end of data)
+ * or a negative value on error.
+ */
+typedef BlockReadCallback pfffclib_read_callback;
+
+/**
+ * Computes the fingerprint of a local file as raw bytes rather than hex text.
+ * Writes the digest to digest (which must hold digest_len bytes) and, unless NULL, the options
+ * signature (the part that prefixes textual fingerprints) to signature.
+ * Returns the number of digest bytes written, or a negative value on error (including the case where
+ * the output format of the context has no binary digest, i.e. csv and debug, or digest_len is too small).
+ */
+extern "C" int pfffclib_context_digest_file(pfffclib_context* ctx, const char* filename, unsigned char* digest, unsigned int digest_len,
+                                            PfffOptionsSignatureStruct* signature, char* error_message, unsigned int error_message_len);
+
+/**
+ * Same as pfffclib_context_digest_file for n_files files. The samples of the files are read one
+ * file after the other, and then digested together (see PostHasher::compute_digests), which is
+ * several times faster than digesting them one by one for small samples.
+ * The digest of filenames[i] goes to digests + i*digest_len, its signature (unless signatures is NULL)
+ * to signatures[i] and its result (as returned by pfffclib_context_digest_file) to results[i].
+ * If error_messages is not NULL, the error message for filenames[i] goes to error_messages + i*error_message_len.
+ * Returns 0 if all files were digested successfully, and a nonzero value otherwise.
+ */
+extern "C" int pfffclib_context_digest_files(pfffclib_context* ctx, const char* const* filenames, unsigned long n_files,
+                                             unsigned char* digests, unsigned int digest_len, PfffOptionsSignatureStruct* signatures,
+                                             int* results, char* error_messages, unsigned int error_message_len);
+
+/**
+ * Same as pfffclib_context_digest_file, but reads from an open file descriptor (with positioned reads, so
+ * the descriptor offset is left as is). The descriptor is not closed.
+ */
+extern "C" int pfffclib_context_digest_fd(pfffclib_context* ctx, int fd, unsigned char* digest, unsigned int digest_len,
+                                          PfffOptionsSignatureStruct* signature, char* error_message, unsigned int error_message_len);
+
+/**
+ * Same as pfffclib_context_digest_file, but reads the size bytes of data using the given read function,
+ * passing it user_data. Lets callers fingerprint objects that are not files (e.g. in their own storage layer).
+ */
+extern "C" int pfffclib_context_digest_callback(pfffclib_context* ctx, pfffclib_read_callback read, void* user_data, long long size,
+                                                unsigned char* digest, unsigned int digest_len,
+                                                PfffOptionsSignatureStruct* signature, char* error_message, unsigned int error_message_len);
+
 #endif
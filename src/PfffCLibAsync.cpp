@@ -0,0 +1,233 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffCLibAsync.h"
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include "PfffThreadPool.h"
+#ifdef __linux__
+    #include <sys/eventfd.h>
+#endif
+using std::deque;
+using std::map;
+using std::string;
+using std::strncpy;
+
+class AsyncJob;
+
+struct pfffclib_async {
+    PfffOptions opts;
+    pfffclib_async_callback callback;
+    void* callback_data;
+    vector<pfffclib_context*> contexts;  // One per worker thread
+    PfffThreadPool* pool;
+
+    pthread_mutex_t lock;
+    long long last_job_id;
+    map<long long, AsyncJob*> queued;    // Submitted jobs that have not started yet
+    deque<pfffclib_async_result> done;   // Completed results waiting for pfffclib_async_poll
+    int notify_read_fd;                  // eventfd (both ends are the same) or pipe
+    int notify_write_fd;
+
+    /** Stores the result (or passes it to the callback) and wakes the event loop */
+    void complete(const pfffclib_async_result& result);
+
+    /** Makes the notification descriptor readable. Called with the lock held. */
+    void signal();
+
+    /** Makes the notification descriptor non-readable. Called with the lock held. */
+    void clear_signal();
+};
+
+/**
+ * A submitted job. The input is described by one of filename, fd or read.
+ */
+class AsyncJob: public PfffJob {
+public:
+    pfffclib_async* async;
+    long long job_id;
+    void* user_data;
+    bool cancelled;
+
+    string filename;
+    int fd;
+    pfffclib_read_callback read;
+    void* read_data;
+    long long size;
+
+    AsyncJob(pfffclib_async* async, void* user_data):
+        async(async), user_data(user_data), cancelled(false), fd(-1), read(NULL), read_data(NULL), size(0) {}
+
+    void run(int worker) {
+        pfffclib_async_result result;
+        memset(&result, 0, sizeof(result));
+        result.job_id = job_id;
+        result.user_data = user_data;
+
+        pthread_mutex_lock(&async->lock);
+        async->queued.erase(job_id);
+        bool was_cancelled = cancelled;
+        pthread_mutex_unlock(&async->lock);
+
+        if (was_cancelled) {
+            result.status = PFFFCLIB_ASYNC_CANCELLED;
+            strncpy(result.error_message, "Cancelled", PFFFCLIB_ASYNC_ERROR_LEN - 1);
+        }
+        else {
+            pfffclib_context* ctx = async->contexts[worker];
+            int r;
+            if (read != NULL)
+                r = pfffclib_context_digest_callback(ctx, read, read_data, size, result.digest, PFFFCLIB_DIGEST_MAX_LEN,
+                                                     &result.signature, result.error_message, PFFFCLIB_ASYNC_ERROR_LEN - 1);
+            else if (fd >= 0)
+                r = pfffclib_context_digest_fd(ctx, fd, result.digest, PFFFCLIB_DIGEST_MAX_LEN,
+                                               &result.signature, result.error_message, PFFFCLIB_ASYNC_ERROR_LEN - 1);
+            else
+                r = pfffclib_context_digest_file(ctx, filename.c_str(), result.digest, PFFFCLIB_DIGEST_MAX_LEN,
+                                                 &result.signature, result.error_message, PFFFCLIB_ASYNC_ERROR_LEN - 1);
+            if (r < 0) result.status = PFFFCLIB_ASYNC_ERROR;
+            else result.digest_len = r;
+        }
+        async->complete(result);
+    }
+};
+
+// ------------- pfffclib_async ----------------
+
+void pfffclib_async::signal() {
+#ifdef __linux__
+    uint64_t one = 1;
+    if (write(notify_write_fd, &one, sizeof(one)) < 0) {}; // Can only fail on counter overflow
+#else
+    char c = 0;
+    if (write(notify_write_fd, &c, 1) < 0) {};             // A full pipe is readable anyway
+#endif
+}
+
+void pfffclib_async::clear_signal() {
+    char buf[256];
+    while (::read(notify_read_fd, buf, sizeof(buf)) > 0) {};
+}
+
+void pfffclib_async::complete(const pfffclib_async_result& result) {
+    if (callback != NULL) {
+        callback(&result, callback_data);
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    done.push_back(result);
+    if (done.size() == 1) signal();
+    pthread_mutex_unlock(&lock);
+}
+
+// ------------- C interface ----------------
+
+extern "C" pfffclib_async* pfffclib_async_create(const PfffOptions* opts, unsigned long request_cost, int n_threads,
+                                                 pfffclib_async_callback callback, void* callback_data) {
+    if (opts->output_format != PFO_OF_POLY1305AES && opts->output_format != PFO_OF_MD5) return NULL;
+
+    int fds[2];
+#ifdef __linux__
+    fds[0] = fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fds[0] < 0) return NULL;
+#else
+    if (pipe(fds) != 0) return NULL;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+#endif
+
+    pfffclib_async* async = new pfffclib_async();
+    async->opts = *opts;
+    async->callback = callback;
+    async->callback_data = callback_data;
+    async->notify_read_fd = fds[0];
+    async->notify_write_fd = fds[1];
+    async->last_job_id = 0;
+    pthread_mutex_init(&async->lock, NULL);
+
+    if (n_threads < 1) n_threads = 1;
+    async->pool = new PfffThreadPool(n_threads);
+    for (int i = 0; i < async->pool->n_workers(); i++)
+        async->contexts.push_back(pfffclib_context_create(&async->opts, request_cost));
+    return async;
+}
+
+extern "C" void pfffclib_async_destroy(pfffclib_async* async) {
+    pthread_mutex_lock(&async->lock);
+    for (map<long long, AsyncJob*>::iterator j = async->queued.begin(); j != async->queued.end(); j++)
+        j->second->cancelled = true;
+    pthread_mutex_unlock(&async->lock);
+
+    delete async->pool; // Waits for the running jobs
+    for (int i = 0; i < async->contexts.size(); i++) pfffclib_context_destroy(async->contexts[i]);
+    close(async->notify_read_fd);
+    if (async->notify_write_fd != async->notify_read_fd) close(async->notify_write_fd);
+    pthread_mutex_destroy(&async->lock);
+    delete async;
+}
+
+extern "C" int pfffclib_async_fd(pfffclib_async* async) {
+    return async->notify_read_fd;
+}
+
+/**
+ * Registers and queues the job, returns its id.
+ */
+static long long submit(pfffclib_async* async, AsyncJob* job) {
+    pthread_mutex_lock(&async->lock);
+    job->job_id = ++async->last_job_id;
+    async->queued[job->job_id] = job;
+    pthread_mutex_unlock(&async->lock);
+    long long job_id = job->job_id; // The job may be gone once submitted
+    async->pool->submit(job);
+    return job_id;
+}
+
+extern "C" long long pfffclib_async_submit_file(pfffclib_async* async, const char* filename, void* user_data) {
+    AsyncJob* job = new AsyncJob(async, user_data);
+    job->filename = filename;
+    return submit(async, job);
+}
+
+extern "C" long long pfffclib_async_submit_fd(pfffclib_async* async, int fd, void* user_data) {
+    AsyncJob* job = new AsyncJob(async, user_data);
+    job->fd = fd;
+    return submit(async, job);
+}
+
+extern "C" long long pfffclib_async_submit_callback(pfffclib_async* async, pfffclib_read_callback read, void* read_data, long long size, void* user_data) {
+    AsyncJob* job = new AsyncJob(async, user_data);
+    job->read = read;
+    job->read_data = read_data;
+    job->size = size;
+    return submit(async, job);
+}
+
+extern "C" int pfffclib_async_poll(pfffclib_async* async, pfffclib_async_result* results, int max_results) {
+    int n = 0;
+    pthread_mutex_lock(&async->lock);
+    while (n < max_results && !async->done.empty()) {
+        results[n++] = async->done.front();
+        async->done.pop_front();
+    }
+    if (async->done.empty()) async->clear_signal();
+    pthread_mutex_unlock(&async->lock);
+    return n;
+}
+
+extern "C" int pfffclib_async_cancel(pfffclib_async* async, long long job_id) {
+    int result = -1;
+    pthread_mutex_lock(&async->lock);
+    map<long long, AsyncJob*>::iterator j = async->queued.find(job_id);
+    if (j != async->queued.end() && !j->second->cancelled) {
+        j->second->cancelled = true;
+        result = 0;
+    }
+    pthread_mutex_unlock(&async->lock);
+    return result;
+}
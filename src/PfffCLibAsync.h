@@ -0,0 +1,83 @@
+/**
+ * Asynchronous "C" interface to the PFFF hasher, for use from event loops.
+ * Jobs are submitted without blocking and hashed by a pool of worker threads.
+ * Completions are reported either through a callback or by queueing them and making
+ * a file descriptor (an eventfd on Linux, a pipe elsewhere) readable, so that the
+ * descriptor can be added to an epoll/poll/select set.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffCLibAsync_h__
+#define __PfffCLibAsync_h__
+#include "PfffCLib.h"
+
+#define PFFFCLIB_ASYNC_OK         0
+#define PFFFCLIB_ASYNC_ERROR     -1
+#define PFFFCLIB_ASYNC_CANCELLED -2
+
+#define PFFFCLIB_ASYNC_ERROR_LEN 256
+
+/**
+ * Outcome of a single job.
+ */
+struct pfffclib_async_result {
+    long long job_id;           // As returned by pfffclib_async_submit_*
+    void* user_data;            // As given to pfffclib_async_submit_*
+    int status;                 // PFFFCLIB_ASYNC_OK, _ERROR or _CANCELLED
+    int digest_len;             // Number of valid bytes in digest
+    unsigned char digest[PFFFCLIB_DIGEST_MAX_LEN];
+    PfffOptionsSignatureStruct signature;
+    char error_message[PFFFCLIB_ASYNC_ERROR_LEN];
+};
+
+/**
+ * Completion callback. Invoked on one of the worker threads, it must not block for long.
+ */
+typedef void (*pfffclib_async_callback)(const pfffclib_async_result* result, void* callback_data);
+
+/**
+ * Opaque handle of the asynchronous hasher.
+ */
+struct pfffclib_async;
+
+/**
+ * Creates an asynchronous hasher with n_threads workers (at least one is always started).
+ * The options must use a format with a binary digest (poly1305aes or md5), otherwise NULL is returned.
+ * If callback is not NULL, results are passed to it and are not queued for pfffclib_async_poll.
+ */
+extern "C" pfffclib_async* pfffclib_async_create(const PfffOptions* opts, unsigned long request_cost, int n_threads,
+                                                 pfffclib_async_callback callback, void* callback_data);
+
+/**
+ * Cancels all jobs that have not started yet, waits for the running ones and frees everything.
+ */
+extern "C" void pfffclib_async_destroy(pfffclib_async* async);
+
+/**
+ * Returns a descriptor which is readable while completed results are waiting to be polled.
+ * Do not read from it or close it yourself.
+ */
+extern "C" int pfffclib_async_fd(pfffclib_async* async);
+
+/**
+ * Queue a job and return its identifier (a positive number). Never blocks on I/O.
+ * The filename is copied. The fd must stay open and the read function usable until the job completes.
+ */
+extern "C" long long pfffclib_async_submit_file(pfffclib_async* async, const char* filename, void* user_data);
+extern "C" long long pfffclib_async_submit_fd(pfffclib_async* async, int fd, void* user_data);
+extern "C" long long pfffclib_async_submit_callback(pfffclib_async* async, pfffclib_read_callback read, void* read_data, long long size, void* user_data);
+
+/**
+ * Moves up to max_results completed results to the given array. Never blocks.
+ * Returns the number of results stored.
+ */
+extern "C" int pfffclib_async_poll(pfffclib_async* async, pfffclib_async_result* results, int max_results);
+
+/**
+ * Cancels a job which has not started yet. Its result is still delivered, with status PFFFCLIB_ASYNC_CANCELLED.
+ * Returns 0 on success and -1 if the job is unknown, already running or done.
+ */
+extern "C" int pfffclib_async_cancel(pfffclib_async* async, long long job_id);
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffChecker.h"
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+#include "PfffThreadPool.h"
+
+/**
+ * Verification of a single manifest record, run on the thread pool.
+ */
+class CheckJob: public PfffJob {
+public:
+    PfffChecker* checker;
+    PfffManifestRecord record;
+
+    CheckJob(PfffChecker* checker, const PfffManifestRecord& record): checker(checker), record(record) {}
+
+    void run(int worker) {
+        string message;
+        int status = checker->check_record(worker, record, message);
+        checker->report(status, record.path, message);
+    }
+};
+
+// ------------- PfffChecker ----------------
+
+PfffChecker::PfffChecker(const PfffOptions* default_opts, long request_cost, int n_threads, ostream& report):
+    throttle(NULL), default_opts(default_opts), request_cost(request_cost), n_threads(n_threads), out(report) {
+    memset(&summary, 0, sizeof(summary));
+    pthread_mutex_init(&lock, NULL);
+}
+
+PfffChecker::~PfffChecker() {
+    for (int i = 0; i < hashers.size(); i++) delete hashers[i];
+    pthread_mutex_destroy(&lock);
+}
+
+bool PfffChecker::check(PfffManifestReader& manifest) {
+    PfffThreadPool pool(n_threads, 2*n_threads);
+    while (hashers.size() < pool.n_workers()) hashers.push_back(new PfffHasherCache(default_opts));
+
+    PfffManifestRecord record;
+    while (manifest.next(record)) pool.submit(new CheckJob(this, record));
+    pool.wait_all();
+
+    error_message = manifest.error_message;
+    return error_message.empty();
+}
+
+int PfffChecker::check_record(int worker, const PfffManifestRecord& record, string& message) {
+    if (record.path.empty()) {
+        message = "Manifest record has no filename";
+        return PFFF_CHECK_ERROR;
+    }
+    PfffHasher* hasher = hashers[worker]->get(record.has_signature ? &record.signature : NULL, message);
+    if (hasher == NULL) return PFFF_CHECK_ERROR;
+
+    if (access(record.path.c_str(), F_OK) != 0 && errno == ENOENT) return PFFF_CHECK_MISSING;
+
+    BlockReader* input_file = new LocalFileBlockReader(record.path.c_str());
+    if (throttle != NULL) input_file = throttle->wrap(input_file, PfffThrottle::device_key(record.path));
+    if (request_cost > 0) input_file = new BufferingBlockReader(input_file, request_cost);
+    int status = PFFF_CHECK_OK;
+    try {
+        // A changed size is a mismatch already, no need to read anything
+        long long size = input_file->size();
+        if (record.size >= 0 && size >= 0 && size != record.size) status = PFFF_CHECK_MISMATCH;
+        else {
+            hasher->read_sample(input_file);
+            unsigned char digest[16];
+            hasher->formatter->output_digest(digest);
+            if (record.digest.size() != hasher->formatter->digest_len() ||
+                memcmp(record.digest.data(), digest, record.digest.size()) != 0)
+                status = PFFF_CHECK_MISMATCH;
+        }
+    }
+    catch(pfff_exception& e) {
+        message = e.what();
+        status = PFFF_CHECK_ERROR;
+    }
+    delete input_file;
+    return status;
+}
+
+void PfffChecker::report(int status, const string& path, const string& message) {
+    pthread_mutex_lock(&lock);
+    summary.checked++;
+    switch (status) {
+        case PFFF_CHECK_OK:
+            summary.ok++;
+            break;
+        case PFFF_CHECK_MISMATCH:
+            summary.mismatched++;
+            out << "MISMATCH\t" << path << '\n';
+            break;
+        case PFFF_CHECK_MISSING:
+            summary.missing++;
+            out << "MISSING\t" << path << '\n';
+            break;
+        default:
+            summary.errors++;
+            out << "ERROR\t" << path << '\t' << message << '\n';
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void PfffChecker::output_summary(ostream& out) const {
+    out << "# Checked " << summary.checked << " files: "
+        << summary.ok << " ok, "
+        << summary.mismatched << " mismatched, "
+        << summary.missing << " missing, "
+        << summary.errors << " errors" << '\n';
+}
@@ -0,0 +1,89 @@
+/**
+ * PfffChecker.h: Verification of files against a previously written manifest (pfff --check).
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffChecker_h__
+#define __PfffChecker_h__
+#include <ostream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "PfffHasher.h"
+#include "PfffManifest.h"
+#include "PfffThrottle.h"
+
+using std::ostream;
+using std::string;
+using std::vector;
+
+#define PFFF_CHECK_OK         0
+#define PFFF_CHECK_MISMATCH   1
+#define PFFF_CHECK_MISSING    2
+#define PFFF_CHECK_ERROR      3
+
+/**
+ * Counts of the check outcomes.
+ */
+struct PfffCheckSummary {
+    long checked;
+    long ok;
+    long mismatched;
+    long missing;
+    long errors;
+};
+
+/**
+ * Re-fingerprints the local files listed in a manifest and reports those that do not match.
+ * Each record is hashed with the options encoded in its signature (or, for manifests written
+ * with --no-prefix, with the default options given to the constructor).
+ * Files are processed by n_threads workers, with at most 2*n_threads files in flight, so that
+ * the manifest is streamed rather than loaded into memory.
+ *
+ * For each failure a line is written to the report stream:
+ *   MISMATCH<TAB><path>
+ *   MISSING<TAB><path>
+ *   ERROR<TAB><path><TAB><message>
+ */
+class PfffChecker {
+public:
+    PfffCheckSummary summary;
+    string error_message;
+    PfffThrottle* throttle;     // If not NULL, the reads are rate limited by it. Not owned.
+
+    PfffChecker(const PfffOptions* default_opts, long request_cost, int n_threads, ostream& report);
+    ~PfffChecker();
+
+    /**
+     * Verifies all records of the manifest. Returns false if the manifest itself could not be read
+     * (error_message is set then). Records read before the error are still verified.
+     */
+    bool check(PfffManifestReader& manifest);
+
+    /**
+     * Verifies a single record using the hashers of the given worker. Returns one of the PFFF_CHECK_* codes.
+     */
+    int check_record(int worker, const PfffManifestRecord& record, string& message);
+
+    /**
+     * Writes "# Checked N files: ..." to the given stream.
+     */
+    void output_summary(ostream& out) const;
+
+    /** True if every record checked so far matched. */
+    inline bool all_ok() const { return summary.ok == summary.checked; }
+
+    /** Records the outcome of a check and writes out failures. Thread-safe. */
+    void report(int status, const string& path, const string& message);
+
+protected:
+    const PfffOptions* default_opts;
+    long request_cost;
+    int n_threads;
+    ostream& out;
+    pthread_mutex_t lock;
+    vector<PfffHasherCache*> hashers;   // One per worker
+};
+
+#endif
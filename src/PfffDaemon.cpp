@@ -0,0 +1,299 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffDaemon.h"
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <errno.h>
+#include <sys/stat.h>
+#include "output_utils.h"
+using std::ostringstream;
+
+// Length of the hex-encoded options signature
+static const int SIGNATURE_HEX_LEN = 2*sizeof(PfffOptionsSignature);
+
+/**
+ * Removes the trailing "\n" or "\r\n" left by Socket::ReceiveLine.
+ */
+static inline string chomp(const string& line) {
+    string::size_type end = line.size();
+    while (end > 0 && (line[end-1] == '\n' || line[end-1] == '\r')) end--;
+    return line.substr(0, end);
+}
+
+// ------------- PfffResultCache ----------------
+
+PfffResultCache::PfffResultCache(long capacity): hits(0), misses(0), capacity(capacity) {
+    pthread_mutex_init(&lock, NULL);
+}
+
+PfffResultCache::~PfffResultCache() {
+    pthread_mutex_destroy(&lock);
+}
+
+bool PfffResultCache::lookup(const string& key, long long size, long long mtime_ns, unsigned long long inode, string& digest) {
+    bool found = false;
+    pthread_mutex_lock(&lock);
+    map<string, list<Entry>::iterator>::iterator i = index.find(key);
+    if (i != index.end()) {
+        Entry& e = *i->second;
+        if (e.size == size && e.mtime_ns == mtime_ns && e.inode == inode) {
+            digest = e.digest;
+            entries.splice(entries.begin(), entries, i->second); // Now the most recently used
+            found = true;
+        }
+    }
+    if (found) hits++;
+    else misses++;
+    pthread_mutex_unlock(&lock);
+    return found;
+}
+
+void PfffResultCache::insert(const string& key, long long size, long long mtime_ns, unsigned long long inode, const string& digest) {
+    if (capacity <= 0) return;
+    pthread_mutex_lock(&lock);
+    map<string, list<Entry>::iterator>::iterator i = index.find(key);
+    if (i != index.end()) {
+        entries.erase(i->second);
+        index.erase(i);
+    }
+    else if (index.size() >= capacity) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+    Entry e;
+    e.key = key;
+    e.size = size;
+    e.mtime_ns = mtime_ns;
+    e.inode = inode;
+    e.digest = digest;
+    entries.push_front(e);
+    index[key] = entries.begin();
+    pthread_mutex_unlock(&lock);
+}
+
+// ------------- PfffDaemon ----------------
+
+PfffDaemon::PfffDaemon(const string& root, const string& address, int port, int max_jobs, int max_connections,
+                       long cache_size, long request_cost):
+    cache(cache_size), root(root), max_jobs(max_jobs), max_connections(max_connections), request_cost(request_cost),
+    stopping(false), interrupted(0), running_jobs(0) {
+    pfff_options_init(&default_opts, 1);
+    char* resolved = realpath(root.c_str(), NULL);
+    real_root = resolved != NULL ? resolved : root;
+    free(resolved);
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&changed, NULL);
+    server = new SocketServer(port, max_connections, BlockingSocket, address);
+}
+
+PfffDaemon::~PfffDaemon() {
+    delete server;
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&lock);
+}
+
+void PfffDaemon::serve() {
+    while (true) {
+        Socket* socket = server->Accept();
+        if (socket == NULL && interrupted) stop();
+        pthread_mutex_lock(&lock);
+        if (stopping) {
+            pthread_mutex_unlock(&lock);
+            delete socket;
+            break;
+        }
+        if (socket == NULL) {
+            pthread_mutex_unlock(&lock);
+            continue;
+        }
+        if (connections.size() >= max_connections) {
+            pthread_mutex_unlock(&lock);
+            socket->SendLine("ERR Too many connections");
+            delete socket;
+            continue;
+        }
+        connections.insert(socket);
+        pthread_mutex_unlock(&lock);
+
+        ConnectionArg* arg = new ConnectionArg();
+        arg->daemon = this;
+        arg->socket = socket;
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, &PfffDaemon::connection_main, arg) != 0) {
+            pthread_mutex_lock(&lock);
+            connections.erase(socket);
+            pthread_mutex_unlock(&lock);
+            delete socket;
+            delete arg;
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    // Wait for the connection threads to finish
+    pthread_mutex_lock(&lock);
+    while (!connections.empty()) pthread_cond_wait(&changed, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+void PfffDaemon::stop() {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    for (set<Socket*>::iterator c = connections.begin(); c != connections.end(); c++) (*c)->Shutdown();
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+    server->Shutdown();
+}
+
+void PfffDaemon::interrupt() {
+    interrupted = 1;
+    server->Shutdown(); // Wakes up serve(), which does the rest
+}
+
+void* PfffDaemon::connection_main(void* arg) {
+    ConnectionArg* a = (ConnectionArg*)arg;
+    a->daemon->serve_connection(a->socket);
+    delete a;
+    return NULL;
+}
+
+void PfffDaemon::serve_connection(Socket* socket) {
+    PfffHasherCache hashers(&default_opts);
+    while (true) {
+        string line = socket->ReceiveLine();
+        if (line.empty()) break;    // Connection closed
+        string request = chomp(line);
+        if (request == "QUIT") break;
+        socket->SendLine(handle_request(request, hashers));
+    }
+    pthread_mutex_lock(&lock);
+    connections.erase(socket);
+    delete socket;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+}
+
+string PfffDaemon::handle_request(const string& request, PfffHasherCache& hashers) {
+    // HASH <signature> <path>
+    if (request.compare(0, 5, "HASH ") != 0) return "ERR Unknown request";
+    PfffOptionsSignature signature;
+    if (request.size() < 5 + SIGNATURE_HEX_LEN + 2 || request[5 + SIGNATURE_HEX_LEN] != ' ' ||
+        !parse_hex(request.data() + 5, SIGNATURE_HEX_LEN, signature.text))
+        return "ERR Invalid options signature";
+    string path = request.substr(5 + SIGNATURE_HEX_LEN + 1);
+
+    // Confine the request to the root directory
+    string::size_type start = path.find_first_not_of('/');
+    if (start == string::npos) return "ERR Invalid path";
+    path = path.substr(start);
+    if (path == ".." || path.compare(0, 3, "../") == 0 || path.find("/../") != string::npos ||
+        (path.size() >= 3 && path.compare(path.size() - 3, 3, "/..") == 0))
+        return "ERR Path may not contain '..'";
+    path = root + "/" + path;
+    // Symlinks may not lead out of the root either: the resolved path is the one read
+    char* resolved = realpath(path.c_str(), NULL);
+    if (resolved == NULL) return "ERR " + string(strerror(errno));
+    path = resolved;
+    free(resolved);
+    if (real_root != "/" && path.compare(0, real_root.size() + 1, real_root + "/") != 0)
+        return "ERR Path leads out of the root directory";
+
+    string message;
+    PfffHasher* hasher = hashers.get(&signature, message);
+    if (hasher == NULL) return "ERR " + message;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return "ERR " + string(strerror(errno));
+    if (!S_ISREG(st.st_mode)) return "ERR Not a regular file";
+#ifdef __linux__
+    long long mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+    long long mtime_ns = (long long)st.st_mtime * 1000000000LL;
+#endif
+
+    string key = string(signature.text, sizeof(PfffOptionsSignature)) + path;
+    string digest;
+    long long size = st.st_size;
+    if (!cache.lookup(key, size, mtime_ns, st.st_ino, digest)) {
+        // Wait for a free job slot
+        pthread_mutex_lock(&lock);
+        while (running_jobs >= max_jobs && !stopping) pthread_cond_wait(&changed, &lock);
+        running_jobs++;
+        pthread_mutex_unlock(&lock);
+
+        BlockReader* input_file = new LocalFileBlockReader(path.c_str());
+        if (request_cost > 0) input_file = new BufferingBlockReader(input_file, request_cost);
+        try {
+            hasher->read_sample(input_file);
+            unsigned char raw[16];
+            hasher->formatter->output_digest(raw);
+            digest.assign((char*)raw, hasher->formatter->digest_len());
+            size = hasher->formatter->file_size;
+        }
+        catch(pfff_exception& e) {
+            message = e.what();
+        }
+        delete input_file;
+
+        pthread_mutex_lock(&lock);
+        running_jobs--;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&lock);
+
+        if (!message.empty()) return "ERR " + message;
+        cache.insert(key, size, mtime_ns, st.st_ino, digest);
+    }
+
+    ostringstream reply;
+    reply << "OK ";
+    output_hex(reply, digest.data(), digest.size(), true);
+    reply << ' ' << size;
+    return reply.str();
+}
+
+// ------------- PfffDaemonClient ----------------
+
+PfffDaemonClient::PfffDaemonClient(const string& host, int port): n_pending(0) {
+    socket = new SocketClient(host, port);
+}
+
+PfffDaemonClient::~PfffDaemonClient() {
+    socket->SendLine("QUIT");
+    delete socket;
+}
+
+bool PfffDaemonClient::send_request(const PfffOptionsSignature& signature, const string& path) {
+    if (path.find('\n') != string::npos || path.find('\r') != string::npos) {
+        error_message = "Filenames with line breaks can not be sent to pfffd";
+        return false;
+    }
+    ostringstream request;
+    request << "HASH ";
+    signature.print(request);
+    request << ' ' << path;
+    socket->SendLine(request.str());
+    n_pending++;
+    return true;
+}
+
+bool PfffDaemonClient::receive_reply(unsigned char* digest, int digest_len, long long& size) {
+    n_pending--;
+    string reply = chomp(socket->ReceiveLine());
+    if (reply.compare(0, 4, "ERR ") == 0) {
+        error_message = reply.substr(4);
+        return false;
+    }
+    string::size_type space = reply.find(' ', 3);
+    if (reply.compare(0, 3, "OK ") != 0 || space != 3 + 2*digest_len ||
+        !parse_hex(reply.data() + 3, 2*digest_len, (char*)digest)) {
+        error_message = reply.empty() ? "Connection to pfffd lost" : "Invalid reply from pfffd";
+        return false;
+    }
+    size = strtoll(reply.c_str() + space + 1, NULL, 10);
+    return true;
+}
@@ -0,0 +1,148 @@
+/**
+ * PfffDaemon.h: Fingerprint server (pfffd), which computes fingerprints next to the data,
+ * and the matching client used by pfff --pfffd-host.
+ *
+ * The protocol is line-based. The client sends any number of requests
+ *   HASH <options signature in hex> <path>
+ * and the server answers each, in order, with either
+ *   OK <digest in hex> <file size>
+ * or
+ *   ERR <message>
+ * Paths are relative to the root directory of the server and may not contain "..", nor lead out of
+ * the root through symlinks.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffDaemon_h__
+#define __PfffDaemon_h__
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <pthread.h>
+#include <signal.h>
+#include "Socket.h"
+#include "PfffManifest.h"
+
+using std::list;
+using std::map;
+using std::set;
+using std::string;
+
+#define PFFFD_DEFAULT_PORT 7273
+
+/**
+ * LRU cache of computed digests. An entry is only valid while the file keeps
+ * its size, modification time and inode. Thread-safe.
+ */
+class PfffResultCache {
+public:
+    PfffResultCache(long capacity);
+    ~PfffResultCache();
+
+    /** Looks up a digest computed with the given signature for the file in the given state. */
+    bool lookup(const string& key, long long size, long long mtime_ns, unsigned long long inode, string& digest);
+
+    /** Stores a digest, evicting the least recently used entry if the cache is full. */
+    void insert(const string& key, long long size, long long mtime_ns, unsigned long long inode, const string& digest);
+
+    long hits;
+    long misses;
+
+protected:
+    struct Entry {
+        string key;         // Raw signature + path
+        long long size;
+        long long mtime_ns;
+        unsigned long long inode;
+        string digest;
+    };
+    long capacity;
+    list<Entry> entries;    // Most recently used first
+    map<string, list<Entry>::iterator> index;
+    pthread_mutex_t lock;
+};
+
+/**
+ * The server. Each connection is served by its own thread; at most max_jobs
+ * fingerprints are computed at the same time, the others wait.
+ */
+class PfffDaemon {
+public:
+    /** Binds the listening socket. Throws std::string on failure. Port 0 picks a free port. */
+    PfffDaemon(const string& root, const string& address, int port, int max_jobs, int max_connections,
+               long cache_size, long request_cost);
+    ~PfffDaemon();
+
+    /** Accepts and serves connections until stop() is called. */
+    void serve();
+
+    /** Makes serve() return after closing all connections. May be called from any thread. */
+    void stop();
+
+    /** Same as stop(), but async-signal-safe, for use in signal handlers. */
+    void interrupt();
+
+    /** The port actually listened on */
+    inline int port() const { return server->port; }
+
+    /** Computes the reply (without the newline) to a single request line. */
+    string handle_request(const string& request, PfffHasherCache& hashers);
+
+    PfffResultCache cache;
+
+protected:
+    string root;
+    string real_root;   // root with its symlinks resolved, which the files asked for must be under
+    int max_jobs;
+    int max_connections;
+    long request_cost;
+    SocketServer* server;
+    PfffOptions default_opts;      // Needed by the hasher caches, never used as requests always carry a signature
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool stopping;
+    volatile sig_atomic_t interrupted;
+    int running_jobs;
+    set<Socket*> connections;
+
+    struct ConnectionArg {
+        PfffDaemon* daemon;
+        Socket* socket;
+    };
+    static void* connection_main(void* arg);
+    void serve_connection(Socket* socket);
+};
+
+/**
+ * Client side of the protocol. Requests may be pipelined: send several before receiving
+ * the replies, which arrive in the same order.
+ */
+class PfffDaemonClient {
+public:
+    /** Connects to the server. Throws std::string on failure. */
+    PfffDaemonClient(const string& host, int port);
+    ~PfffDaemonClient();
+
+    /** Sends a request. Returns false (setting error_message) if the path can not be sent. */
+    bool send_request(const PfffOptionsSignature& signature, const string& path);
+
+    /**
+     * Receives the reply to the oldest outstanding request into digest (digest_len bytes)
+     * and size. Returns false and sets error_message on an error reply.
+     */
+    bool receive_reply(unsigned char* digest, int digest_len, long long& size);
+
+    /** Number of requests sent and not yet answered */
+    inline long pending() const { return n_pending; }
+
+    string error_message;
+
+protected:
+    SocketClient* socket;
+    long n_pending;
+};
+
+#endif
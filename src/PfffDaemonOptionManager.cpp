@@ -0,0 +1,106 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffDaemonOptionManager.h"
+#include <cstdlib>
+#include <stdio.h>
+#include "PfffDaemon.h"
+
+#define quote_(x) #x        // Used to pass "defined" values into string literals, see http://en.wikipedia.org/w/index.php?title=C_preprocessor&oldid=346873133#Indirectly_quoting_macro_arguments
+#define quote(x) quote_(x)
+
+using std::endl;
+
+// ------------ PfffDaemonOptionManager ---------------
+PfffDaemonOptionManager::PfffDaemonOptionManager(): OptionManager(), TEST_MODE(false) {
+    add_group("Server Options");
+        add_parameterized("root", 'r', NULL, new CharPtrOption(&root, "."), "<dir>",
+            "Directory the requested paths are relative to.\n"
+            "Paths may not leave it with '..'. Default is the\n"
+            "current directory.");
+        add_parameterized("listen", 'l', NULL, new CharPtrOption(&listen_address, "127.0.0.1"), "<address>",
+            "IP address to listen on. Default is 127.0.0.1,\n"
+            "use 0.0.0.0 to accept connections from other hosts.");
+        add_parameterized("port", 'P', NULL, new PositiveLongIntOption(&port, PFFFD_DEFAULT_PORT), "<num>",
+            "Port to listen on. Default is " quote(PFFFD_DEFAULT_PORT) ".");
+        add_parameterized("jobs", 'j', NULL, new PositiveLongIntOption(&jobs, 4), "<num>",
+            "Maximum number of fingerprints computed at the same\n"
+            "time, over all connections. Default is 4.");
+        add_parameterized("max-connections", 'x', NULL, new PositiveLongIntOption(&max_connections, 64), "<num>",
+            "Maximum number of simultaneous client connections.\n"
+            "Default is 64.");
+        add_parameterized("cache-size", 'z', NULL, new PositiveLongIntOption(&cache_size, 100000), "<num>",
+            "Number of computed fingerprints to remember. A\n"
+            "fingerprint is reused while the file keeps its\n"
+            "size, modification time and inode. 0 disables the\n"
+            "cache. Default is 100000.");
+        add_parameterized("request-cost", 'c', NULL, new PositiveLongIntOption(&request_cost, 0), "<num>",
+            "Cost of making a separate data read request, in bytes\n"
+            "(see pfff --help). Default is 0.");
+        add_unparameterized("net-debug", 'G', &net_debug, "Output complete protocol log.");
+        add_unparameterized("help", 'h', &help,
+            "Output this help message to stdout.");
+}
+
+/**
+ * Reads options from command line. On any failure prints error message and dies.
+ */
+void PfffDaemonOptionManager::init_from_cmdline_or_die(int argc, char* const argv[]) {
+    if (!read_from_cmdline(argc, argv)) die_with_error("");
+    validate_or_die();
+}
+
+/**
+ * Dumps a long 'help' message describing all the options to a given ostream.
+ */
+void PfffDaemonOptionManager::print_usage(ostream& out) {
+    const char* USAGE =
+    "Probabilistic Fast File Fingerprinting (PFFF) server - computes fingerprints of\n"
+    "local files on request, so that remote clients (pfff --pfffd-host) only receive\n"
+    "the fingerprints instead of the sampled data.\n"
+    "\n"
+    "Usage: pfffd [options]\n"
+    "\n";
+    out << USAGE;
+    print_option_help(out);
+}
+
+/**
+ * Equivalent to print(message,cerr), exit(2)
+ */
+void PfffDaemonOptionManager::die_with_error(const string& message) {
+    if (TEST_MODE) throw message;
+    *cerr << message << endl;
+    *cerr << "Run the program with the --help option to get usage information." << endl;
+    #ifdef DEBUG
+    while(1) if ('\n' == getchar()) break;
+    #endif
+    exit(2);
+}
+
+bool PfffDaemonOptionManager::validate() {
+    if (help) return true;
+    try {
+        if (parameters.size() > 0)
+            throw (char*)"Error: pfffd takes no parameters.";
+        if (port > 65535)
+            throw (char*)"Error: Invalid port.";
+        if (jobs < 1)
+            throw (char*)"Error: At least one job must be allowed.";
+        if (max_connections < 1)
+            throw (char*)"Error: At least one connection must be allowed.";
+        return true;
+    }
+    catch(char* msg) {
+        error_message = string(msg);
+        return false;
+    }
+}
+
+/**
+ * if (!validate()) die_with_error(error_message)
+ */
+void PfffDaemonOptionManager::validate_or_die() {
+    if (!validate()) die_with_error(error_message);
+}
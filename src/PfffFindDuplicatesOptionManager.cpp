@@ -31,6 +31,12 @@ PfffFindDuplicatesOptionManager::PfffFindDuplicatesOptionManager(): OptionManage
         add_unparameterized("with-size", 'S', &with_size, 
             "Include the size of the file in bytes into the hash.\n");
     add_group("Output Options");
+        add_unparameterized("manifest", 'M', &manifest,
+            "Treat the parameters as manifests written by pfff\n"
+            "(in any of its output modes) and group the files\n"
+            "listed there instead of fingerprinting anything.\n"
+            "Fingerprints computed with different parameters\n"
+            "never match.");
         add_unparameterized("help", 'h', &help, 
             "Output this help message to stdout.");
     add_group("Advanced Options");
@@ -98,6 +104,7 @@ void PfffFindDuplicatesOptionManager::print_usage(ostream& out) {
     "\n"
     "Parameters:\n"
     "    <file1>, <file2>, ...: paths or names of the files to be fingerprinted and compared.\n"
+    "                           With --manifest, the manifest files to be read.\n"
     "\n";
     out << USAGE;
     print_option_help(out);
@@ -39,6 +39,7 @@ public:
     int   fail_on_error;
     int   recursive;
     int   no_symlinks;
+    int   manifest;
 
     int   ftp_given;
     const char* ftp_host;
@@ -20,13 +20,20 @@ FtpBlockReader::~FtpBlockReader() {
 bool FtpBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
     try {
         long long file_size = size();
-        long long chunk_size = file_size - block_start;
+        if (file_size < 0) return false;
+        long long chunk_size = file_size - (long long)block_start;
         if (chunk_size > block_size) chunk_size = block_size;
+        if (chunk_size <= 0) {
+            // Entirely beyond the end of file
+            memset(buffer, 0, block_size);
+            buffer += block_size;
+            return true;
+        }
             	
         SocketClient* sc = ftp_connection->PasvRestRetrX(filename.c_str(), block_start);
     	int v = sc->RecvBlocking(buffer, chunk_size);
         if (v == SOCKET_ERROR) {
-            error_message = ws_strerror(ws_lasterror());
+            error_message = Socket::TimedOut() ? "Timed out" : ws_strerror(ws_lasterror());
             delete sc;
             return false;
         }
@@ -62,6 +69,10 @@ long long FtpBlockReader::_size() {
         error_message = e;
         return BlockReader::READ_ERROR;
     }
+    catch(string& e) {
+        error_message = e;
+        return BlockReader::READ_ERROR;
+    }
 }
 
 
@@ -3,8 +3,12 @@
  * License:   The terms of use of this software and its source code are defined by the BSD license.
  */
 #include "PfffHasher.h"
+#include <algorithm>
+#include <iterator>
+#include <vector>
+using std::vector;
 
-PfffHasher::PfffHasher(const PfffOptions* opts): opts(opts) {
+PfffHasher::PfffHasher(const PfffOptions* opts): opts(opts), stats(NULL) {
     formatter = new PfffOutputFormatter(opts);
     sampler = new PfffBlockSampleGenerator(opts);
 }
@@ -20,17 +24,107 @@ PfffHasher::~PfffHasher() {
  * On error throws pfff_exception with the proper message.
  */
 void PfffHasher::hash(ostream& out, BlockReader* input_file) {
+    if (!tiers.empty()) {
+        hash_tiers(out, input_file);
+        return;
+    }
+    read_sample(input_file);
+    output(out);
+}
+
+void PfffHasher::hash_tiers(ostream& out, BlockReader* input_file) {
+    read_sample(input_file, *std::max_element(tiers.begin(), tiers.end()));
+    
+    // Keep the largest sample, as the formatter's buffer is reused for each tier
+    unsigned long block_size = opts->block_size;
+    char* blocks = formatter->get_content_buffer() + opts->header_block_count * block_size;
+    vector<unsigned long long> full_sample(sampler->sample, sampler->sample + sampler->sample_size);
+    vector<char> full_blocks(blocks, blocks + full_sample.size() * block_size);
+    
+    for (int i = 0; i < tiers.size(); i++) {
+        if (i > 0) out << formatter->record_end();
+        formatter->set_block_count(tiers[i]);
+        if (formatter->file_size > 0) {
+            // The sample of a tier is part of the largest one (see PfffBlockSampleGenerator::generate)
+            long long start = stats != NULL ? pfff_now_ns() : 0;
+            sampler->generate(formatter->file_size, tiers[i]);
+            if (stats != NULL) stats->add_phase(PFFF_PHASE_SAMPLE, start);
+            unsigned long f = 0;
+            for (unsigned long j = 0; j < sampler->sample_size; j++) {
+                while (full_sample[f] != sampler->sample[j]) f++;
+                memcpy(blocks + j*block_size, &full_blocks[(f++)*block_size], block_size);
+            }
+            formatter->set_sample_size(sampler->sample_size);
+            if (opts->output_format == PFO_OF_DEBUG)
+                formatter->set_debug_info(input_file->get_filename(), sampler->sample, sampler->sample_size);
+        }
+        output(out);
+    }
+}
+
+void PfffHasher::output(ostream& out) {
+    if (stats == NULL) {
+        formatter->output_hash(out);
+    }
+    else if (formatter->digest_len() > 0) {
+        long long start = pfff_now_ns();
+        unsigned char digest[16];
+        formatter->output_digest(digest);
+        stats->add_phase(PFFF_PHASE_POST_HASH, start);
+        start = pfff_now_ns();
+        formatter->output_record(out, digest);
+        stats->add_phase(PFFF_PHASE_OUTPUT, start);
+    }
+    else {
+        long long start = pfff_now_ns();
+        formatter->output_hash(out);
+        stats->add_phase(PFFF_PHASE_OUTPUT, start);
+    }
+}
+
+/**
+ * Reads the sample of the given input_file into the formatter, without producing
+ * any output.
+ * On error throws pfff_exception with the proper message.
+ */
+void PfffHasher::read_sample(BlockReader* input_file) {
+    if (!opts->adaptive) {
+        read_sample(input_file, opts->block_count);
+        return;
+    }
+    read_sample(input_file, pfff_options_min_block_count(opts));
+    if (formatter->file_size == 0) {
+        formatter->set_block_count(opts->block_count);
+        // Only the data of the minimum count was cleared: the rest still holds the previous file
+        memset(formatter->data, 0, formatter->data_len);
+        return;
+    }
+    unsigned long max_count = pfff_options_max_block_count(opts);
+    char* blocks = formatter->get_content_buffer() + opts->header_block_count * opts->block_size;
+    // A sample smaller than the count means the whole file is covered already
+    while (sampler->sample_size == formatter->block_count && formatter->block_count < max_count &&
+           PfffBlockSampleGenerator::entropy_bits(blocks, formatter->block_count, opts->block_size) < PFO_ADAPTIVE_TARGET_BITS) {
+        extend_sample(input_file, 2*formatter->block_count < max_count ? 2*formatter->block_count : max_count);
+    }
+}
+
+void PfffHasher::read_sample(BlockReader* input_file, unsigned long block_count) {
+    if (block_count > sampler->capacity) throw pfff_exception("Block count exceeds the size of the sample buffer");
+    
     // Check file size
+    long long start = stats != NULL ? pfff_now_ns() : 0;
     long long size = input_file->size();
+    if (stats != NULL) stats->add_phase(PFFF_PHASE_STAT, start);
     if (size < 0) throw pfff_exception(input_file->error_message);
-    else if (size == 0) {
+    formatter->set_block_count(block_count);
+    if (size == 0) {
         memset(formatter->data, 0, formatter->data_len);
+        formatter->set_file_size(0);
     }
     else {
         // Report file features to the formatter: 
-        // File size
-        if(opts->with_size) 
-            formatter->set_file_size(size);
+        // File size (it only goes into the hash if opts->with_size)
+        formatter->set_file_size(size);
         
         input_file->begin_block_sequence(formatter->get_content_buffer());
     
@@ -42,12 +136,15 @@ void PfffHasher::hash(ostream& out, BlockReader* input_file) {
 
         // Content
         // Generate block sample
-        sampler->generate(size);
+        if (stats != NULL) start = pfff_now_ns();
+        sampler->generate(size, formatter->block_count);
+        if (stats != NULL) stats->add_phase(PFFF_PHASE_SAMPLE, start);
 
         if (!input_file->read_blocks(opts->block_size, sampler->sample, sampler->sample_size))
             throw pfff_exception(input_file->error_message);
 
-        input_file->end_block_sequence();
+        if (!input_file->end_block_sequence())
+            throw pfff_exception(input_file->error_message);
 
         // If the content was too small, pad the remainder of the buffer with zeroes
         formatter->set_sample_size(sampler->sample_size);
@@ -59,7 +156,48 @@ void PfffHasher::hash(ostream& out, BlockReader* input_file) {
     // If we're doing debug output, tell it to the formatter:
     if (opts->output_format == PFO_OF_DEBUG)
         formatter->set_debug_info(input_file->get_filename(), sampler->sample, sampler->sample_size);
+}
 
-    // Finally, output result
-    formatter->output_hash(out);
+void PfffHasher::extend_sample(BlockReader* input_file, unsigned long block_count) {
+    if (block_count > sampler->capacity) throw pfff_exception("Block count exceeds the size of the sample buffer");
+    if (block_count < formatter->block_count) throw pfff_exception("A sample can only be extended");
+    if (formatter->file_size == 0) {
+        formatter->set_block_count(block_count);
+        memset(formatter->data, 0, formatter->data_len);
+        return;
+    }
+    unsigned long block_size = opts->block_size;
+    char* blocks = formatter->get_content_buffer() + opts->header_block_count * block_size;
+    vector<unsigned long long> old_sample(sampler->sample, sampler->sample + sampler->sample_size);
+    long long start = stats != NULL ? pfff_now_ns() : 0;
+    sampler->generate(formatter->file_size, block_count);
+    if (stats != NULL) stats->add_phase(PFFF_PHASE_SAMPLE, start);
+    
+    // The new sample contains the old one (see PfffBlockSampleGenerator::generate): read the rest
+    vector<unsigned long long> added;
+    std::set_difference(sampler->sample, sampler->sample + sampler->sample_size,
+                        old_sample.begin(), old_sample.end(), std::back_inserter(added));
+    vector<char> added_blocks(added.size() * block_size + 1);
+    if (!added.empty()) {
+        input_file->begin_block_sequence(&added_blocks[0]);
+        if (!input_file->read_blocks(block_size, &added[0], added.size()))
+            throw pfff_exception(input_file->error_message);
+        if (!input_file->end_block_sequence())
+            throw pfff_exception(input_file->error_message);
+    }
+    
+    // Merge the old and the added blocks in the (sorted) order of the new sample
+    vector<char> merged(sampler->sample_size * block_size + 1);
+    unsigned long o = 0, a = 0;
+    for (unsigned long i = 0; i < sampler->sample_size; i++) {
+        const char* block;
+        if (o < old_sample.size() && (a == added.size() || old_sample[o] <= added[a])) block = blocks + (o++)*block_size;
+        else block = &added_blocks[(a++)*block_size];
+        memcpy(&merged[i*block_size], block, block_size);
+    }
+    memcpy(blocks, &merged[0], sampler->sample_size * block_size);
+    formatter->set_block_count(block_count);
+    formatter->set_sample_size(sampler->sample_size);
+    if (opts->output_format == PFO_OF_DEBUG)
+        formatter->set_debug_info(input_file->get_filename(), sampler->sample, sampler->sample_size);
 }
@@ -9,14 +9,17 @@
 #include <exception>
 #include <ostream>
 #include <string>
+#include <vector>
 #include "PfffOptions.h"
 #include "PfffBlockReader.h"
 #include "PfffBlockSampleGenerator.h"
 #include "PfffOutputFormatter.h"
+#include "PfffStats.h"
 
 using std::exception;
 using std::ostream;
 using std::string;
+using std::vector;
 
 /**
  * Exception thrown by PfffHasher if something goes wrong.
@@ -42,6 +45,9 @@ public:
     const PfffOptions* opts;
     PfffBlockSampleGenerator* sampler;
     PfffOutputFormatter* formatter;
+    PfffStats* stats;   // If not NULL, the phases of hashing are timed into it. Not owned.
+    vector<unsigned long> tiers;    // If not empty, hash() outputs a fingerprint for each of these
+                                    // block counts (each at most opts->block_count), see hash_tiers.
     
     PfffHasher(const PfffOptions* opts);
     
@@ -53,6 +59,43 @@ public:
      * On error throws pfff_exception with the proper message.
      */
     void hash(ostream& out, BlockReader* input_file);
+    
+    /**
+     * Reads the sample of the given input_file into the formatter, without producing
+     * any output. Follow with formatter->output_hash() or formatter->output_digest().
+     * In the adaptive mode (opts->adaptive), the sample starts at the smallest block count
+     * and is doubled, reading only the added blocks, while its estimated entropy is below
+     * PFO_ADAPTIVE_TARGET_BITS and the largest count is not reached. The count used is left
+     * in formatter->block_count.
+     * On error throws pfff_exception with the proper message.
+     */
+    void read_sample(BlockReader* input_file);
+    
+    /**
+     * Same, for a sample of the given number of blocks (at most pfff_options_max_block_count(opts)).
+     * The fingerprint is the one computed with opts->block_count = block_count.
+     */
+    void read_sample(BlockReader* input_file, unsigned long block_count);
+    
+    /**
+     * After read_sample (or extend_sample) of the same file, grows the sample to the given number of
+     * blocks, reading only the blocks that are not in the current sample. As samples are prefix-stable
+     * (see PfffBlockSampleGenerator::generate), the result is the same as read_sample(input_file, block_count).
+     * On error throws pfff_exception with the proper message.
+     */
+    void extend_sample(BlockReader* input_file, unsigned long block_count);
+
+protected:
+    /**
+     * The tiered version of hash(): reads the sample of the largest tier and picks the smaller samples
+     * from it, so that all fingerprints are computed in a single pass over the file.
+     */
+    void hash_tiers(ostream& out, BlockReader* input_file);
+    
+    /**
+     * Writes out the fingerprint of the sample in the formatter.
+     */
+    void output(ostream& out);
 };
 
 #endif
@@ -0,0 +1,235 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffHedgedBlockReader.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <time.h>
+#include "PfffStats.h"
+
+// ------------- PfffLatencyTracker ----------------
+
+PfffLatencyTracker::PfffLatencyTracker(long long initial_delay_ns):
+    initial_delay_ns(initial_delay_ns), next(0), requests(0), hedged(0), failovers(0), hedge_wins(0) {
+    pthread_mutex_init(&lock, NULL);
+}
+
+PfffLatencyTracker::~PfffLatencyTracker() {
+    pthread_mutex_destroy(&lock);
+}
+
+void PfffLatencyTracker::add(long long latency_ns) {
+    pthread_mutex_lock(&lock);
+    if (latencies.size() < PFFF_LATENCY_WINDOW) latencies.push_back(latency_ns);
+    else latencies[next] = latency_ns;
+    next = (next + 1) % PFFF_LATENCY_WINDOW;
+    pthread_mutex_unlock(&lock);
+}
+
+long long PfffLatencyTracker::percentile(double p) {
+    pthread_mutex_lock(&lock);
+    vector<long long> sorted = latencies;
+    pthread_mutex_unlock(&lock);
+    if (sorted.empty()) return -1;
+    vector<long long>::iterator nth = sorted.begin() + (long)((sorted.size() - 1) * p / 100);
+    std::nth_element(sorted.begin(), nth, sorted.end());
+    return *nth;
+}
+
+long long PfffLatencyTracker::hedge_delay_ns() {
+    pthread_mutex_lock(&lock);
+    bool known = latencies.size() >= PFFF_LATENCY_MIN_SAMPLES;
+    pthread_mutex_unlock(&lock);
+    return known ? percentile(95) : initial_delay_ns;
+}
+
+void PfffLatencyTracker::count(bool hedged, bool failover, bool hedge_won) {
+    pthread_mutex_lock(&lock);
+    requests++;
+    if (hedged) this->hedged++;
+    if (failover) failovers++;
+    if (hedge_won) hedge_wins++;
+    pthread_mutex_unlock(&lock);
+}
+
+void PfffLatencyTracker::output(ostream& out, const string& name) {
+    long long p95 = percentile(95);
+    pthread_mutex_lock(&lock);
+    out << "hedge\t" << name
+        << "\trequests=" << requests
+        << "\thedged=" << hedged
+        << "\thedge_wins=" << hedge_wins
+        << "\tfailovers=" << failovers
+        << "\tp95_us=" << (p95 < 0 ? 0 : p95 / 1000) << '\n';
+    pthread_mutex_unlock(&lock);
+}
+
+// ------------- HedgedBlockReader ----------------
+
+HedgedBlockReader::Shared::Shared(): refs(1), tracker(NULL) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&changed, NULL);
+}
+
+HedgedBlockReader::Shared::~Shared() {
+    delete attempts[0].reader;
+    delete attempts[1].reader;
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&lock);
+}
+
+HedgedBlockReader::HedgedBlockReader(BlockReader* primary, BlockReader* alternate, PfffLatencyTracker* tracker):
+    BlockReader(""), shared(new Shared()), filename(primary->get_filename()), total_size(0), retry_count(0) {
+    shared->tracker = tracker;
+    BlockReader* readers[2] = { primary, alternate };
+    for (int i = 0; i < 2; i++) {
+        Attempt& attempt = shared->attempts[i];
+        attempt.shared = shared;
+        attempt.reader = readers[i];
+        attempt.running = false;
+        attempt.size_only = false;
+        attempt.ok = false;
+        attempt.size = BlockReader::READ_ERROR;
+    }
+}
+
+HedgedBlockReader::~HedgedBlockReader() {
+    // Requests still running free the readers when they are over
+    pthread_mutex_lock(&shared->lock);
+    shared->tracker = NULL;
+    release(shared);
+}
+
+void HedgedBlockReader::release(Shared* shared) {
+    bool last = --shared->refs == 0;
+    pthread_mutex_unlock(&shared->lock);
+    if (last) delete shared;
+}
+
+string HedgedBlockReader::get_filename() {
+    return filename;
+}
+
+long long HedgedBlockReader::retries() {
+    return retry_count;
+}
+
+long long HedgedBlockReader::_size() {
+    int i = run(true);
+    return i < 0 ? BlockReader::READ_ERROR : shared->attempts[i].size;
+}
+
+void HedgedBlockReader::begin_block_sequence(char* buffer) {
+    this->buffer = buffer;
+    requests.clear();
+    total_size = 0;
+}
+
+bool HedgedBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    Request request;
+    request.start = block_start;
+    request.size = block_size;
+    requests.push_back(request);
+    total_size += block_size;
+    return true;
+}
+
+bool HedgedBlockReader::end_block_sequence() {
+    if (requests.empty()) return true;
+    int i = run(false);
+    if (i < 0) return false;
+    if (total_size > 0) memcpy(buffer, &shared->attempts[i].data[0], total_size);
+    return true;
+}
+
+void HedgedBlockReader::start(int i, bool size_only) {
+    Attempt& attempt = shared->attempts[i];
+    attempt.running = true;
+    attempt.ok = false;
+    attempt.size_only = size_only;
+    attempt.requests = requests;
+    attempt.data.resize(size_only ? 0 : total_size);
+    shared->refs++;
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, &HedgedBlockReader::attempt_main, &attempt) != 0) {
+        shared->refs--;
+        attempt.running = false;
+        attempt.ok = false;
+        attempt.error = "Failed to start a thread";
+    }
+    pthread_attr_destroy(&attr);
+}
+
+void* HedgedBlockReader::attempt_main(void* arg) {
+    // The reader, the requests and the data belong to this thread until running is cleared
+    Attempt* attempt = (Attempt*)arg;
+    BlockReader* reader = attempt->reader;
+    long long start = pfff_now_ns();
+    long long size = reader->size();
+    bool ok = size >= 0;
+    if (ok && !attempt->size_only) {
+        reader->begin_block_sequence(attempt->data.empty() ? NULL : &attempt->data[0]);
+        for (int i = 0; ok && i < attempt->requests.size(); i++)
+            ok = reader->next_block(attempt->requests[i].start, attempt->requests[i].size);
+        ok = reader->end_block_sequence() && ok;
+    }
+    long long latency = pfff_now_ns() - start;
+
+    Shared* shared = attempt->shared;
+    pthread_mutex_lock(&shared->lock);
+    attempt->ok = ok;
+    attempt->size = size;
+    attempt->error = ok ? "" : reader->error_message;
+    attempt->running = false;
+    // Replies come in even after a duplicate was used: the slow ones matter most for the percentile
+    if (ok && !attempt->size_only && shared->tracker != NULL) shared->tracker->add(latency);
+    pthread_cond_broadcast(&shared->changed);
+    release(shared);
+    return NULL;
+}
+
+int HedgedBlockReader::run(bool size_only) {
+    PfffLatencyTracker* tracker = shared->tracker;
+    pthread_mutex_lock(&shared->lock);
+    // A slow request of the previous sequence may still be running, start with the other reader then
+    int first = shared->attempts[0].running ? 1 : 0, second = 1 - first;
+    start(first, size_only);
+    bool started_second = false, hedged = false;
+    long long deadline = pfff_now_ns() + tracker->hedge_delay_ns();
+    int winner = -1;
+    while (true) {
+        Attempt& a = shared->attempts[first];
+        Attempt& b = shared->attempts[second];
+        if (!a.running && a.ok) winner = first;
+        else if (started_second && !b.running && b.ok) winner = second;
+        if (winner >= 0) break;
+        bool pending = a.running || (started_second && b.running);
+        if (!pending && started_second) break;  // Both failed
+        if (!started_second && !b.running && (!a.running || pfff_now_ns() >= deadline)) {
+            hedged = a.running;
+            start(second, size_only);
+            started_second = true;
+            continue;
+        }
+        if (!started_second && a.running && !b.running) {
+            // Sleep until the hedge deadline
+            long long wait_ns = std::max(deadline - pfff_now_ns(), 0LL);
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += (until.tv_nsec + wait_ns) / 1000000000LL;
+            until.tv_nsec = (until.tv_nsec + wait_ns) % 1000000000LL;
+            pthread_cond_timedwait(&shared->changed, &shared->lock, &until);
+        }
+        else pthread_cond_wait(&shared->changed, &shared->lock);
+    }
+    if (winner < 0) error_message = shared->attempts[first].error;
+    pthread_mutex_unlock(&shared->lock);
+    if (started_second) retry_count++;
+    tracker->count(hedged, started_second && !hedged, hedged && winner == second);
+    return winner;
+}
@@ -0,0 +1,136 @@
+/**
+ * PfffHedgedBlockReader.h: Hiding the slow replies of a remote server behind duplicate requests.
+ *
+ * A HedgedBlockReader makes each block sequence with a primary reader from a background thread.
+ * When the reply takes longer than the 95th percentile of the recent ones, the same sequence is
+ * made again with an alternate reader (another connection, or another mirror of the files), and the
+ * first complete reply is used. The slower one is left to finish on its own and is only counted in
+ * the latency statistics, so a single stalled server costs about one p95 latency instead of the
+ * whole run. A failed request is retried with the alternate reader at once.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffHedgedBlockReader_h__
+#define __PfffHedgedBlockReader_h__
+#include <ostream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "PfffBlockReader.h"
+
+using std::ostream;
+using std::string;
+using std::vector;
+
+// Number of recent latencies the percentile is computed from
+#define PFFF_LATENCY_WINDOW 1000
+// Below this number of latencies, the initial hedge delay is used
+#define PFFF_LATENCY_MIN_SAMPLES 20
+
+/**
+ * Latencies of the recent requests to a server, and counts of the hedged requests. Thread-safe.
+ */
+class PfffLatencyTracker {
+public:
+    /** initial_delay_ns is the hedge delay used until enough latencies are known. */
+    PfffLatencyTracker(long long initial_delay_ns);
+    ~PfffLatencyTracker();
+
+    void add(long long latency_ns);
+
+    /** The given percentile (0..100) of the recent latencies, or -1 if there are none. */
+    long long percentile(double p);
+
+    /** How long to wait for a reply before making a duplicate request: the 95th percentile. */
+    long long hedge_delay_ns();
+
+    /** Counts a completed request. */
+    void count(bool hedged, bool failover, bool hedge_won);
+
+    /**
+     * Writes the line:
+     *   hedge  <name>  requests=...  hedged=...  hedge_wins=...  failovers=...  p95_us=...
+     * hedge_wins counts the hedged requests answered first by the duplicate.
+     */
+    void output(ostream& out, const string& name);
+
+protected:
+    long long initial_delay_ns;
+    pthread_mutex_t lock;
+    vector<long long> latencies;    // Ring buffer of the last PFFF_LATENCY_WINDOW latencies
+    long next;                      // Where the next latency goes
+    long requests, hedged, failovers, hedge_wins;
+};
+
+/**
+ * A BlockReader making each request with two readers of the same file, as described above.
+ * Both readers must be usable from another thread and must not share a connection with other
+ * readers, as a slow request may still be running after the HedgedBlockReader is destroyed.
+ * NB: The readers are owned, and destroyed once their last request is over. The tracker is not owned.
+ */
+class HedgedBlockReader: public BlockReader {
+public:
+    HedgedBlockReader(BlockReader* primary, BlockReader* alternate, PfffLatencyTracker* tracker);
+    virtual ~HedgedBlockReader();
+
+    long long _size();
+    void begin_block_sequence(char* buffer);
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+    bool end_block_sequence();
+    string get_filename();
+    long long retries();
+
+protected:
+    struct Request {
+        unsigned long long start;
+        unsigned long size;
+    };
+    struct Shared;
+
+    /** A request made with one of the readers, from a background thread */
+    struct Attempt {
+        Shared* shared;
+        BlockReader* reader;
+        bool running;
+        bool size_only;         // Only the size is asked for
+        vector<Request> requests;
+        vector<char> data;
+        bool ok;
+        long long size;
+        string error;
+    };
+
+    /** The state shared with the threads, freed by the last of them or by the reader */
+    struct Shared {
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+        int refs;
+        PfffLatencyTracker* tracker;    // NULL once the reader is destroyed
+        Attempt attempts[2];            // With the primary and the alternate reader
+        Shared();
+        ~Shared();
+    };
+
+    Shared* shared;
+    string filename;
+    vector<Request> requests;
+    unsigned long total_size;
+    long long retry_count;      // Requests made again with the other reader, hedged or failed over
+
+    /**
+     * Makes the current request (the size, or the collected blocks) with one reader, and with the
+     * other one if it is too slow or fails. Returns the index of the attempt which succeeded, or -1.
+     */
+    int run(bool size_only);
+
+    /** Starts an attempt in a new thread. Called with the lock held. */
+    void start(int i, bool size_only);
+
+    static void* attempt_main(void* arg);
+
+    /** Drops a reference to the shared state and unlocks it. Frees it with the last reference. */
+    static void release(Shared* shared);
+};
+
+#endif
@@ -8,52 +8,82 @@
 
 // ------------- HttpBlockReader --------------
 
-HttpBlockReader::HttpBlockReader(HttpClientSocket* http_connection, const char* filename):
+HttpBlockReader::HttpBlockReader(HttpClientSocket* http_connection, const char* filename, bool owns_connection):
     BlockReader(filename),
-    http_connection(http_connection) { };
+    http_connection(http_connection), owns_connection(owns_connection) { };
 
 HttpBlockReader::~HttpBlockReader() {
+    if (owns_connection) delete http_connection;
 }
 
 long long HttpBlockReader::_size() {
     try {
-        return http_connection->Size(filename.c_str());
+        long long result = http_connection->Size(filename.c_str());
+        if (result < 0) error_message = "Size of " + filename + " not reported by the server";
+        return result < 0 ? BlockReader::READ_ERROR : result;
     }
     catch(const char* e) {
         error_message = e;
         return BlockReader::READ_ERROR;
     }
+    catch(string& e) {
+        error_message = e;
+        return BlockReader::READ_ERROR;
+    }
 }
 
 void HttpBlockReader::begin_block_sequence(char* buffer) {
     this->buffer = buffer;
     ranges.str("");
     total_block_size = 0;
+    blocks.clear();
 }
 
 bool HttpBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    // Servers do not return the bytes beyond the end of file, they are zero-filled here instead
+    long long file_size = size();
+    if (file_size < 0) return false;
+    unsigned long available = block_size;
+    if (block_start + block_size > (unsigned long long)file_size)
+        available = block_start < (unsigned long long)file_size ? file_size - block_start : 0;
+    blocks.push_back(Block(available, block_size));
+    if (available == 0) return true;
+
     if ((int)ranges.tellp() != 0) ranges << ","; 
-    ranges << block_start << "-" << (block_start+block_size-1);
-    total_block_size += block_size;
+    ranges << block_start << "-" << (block_start+available-1);
+    total_block_size += available;
     return true;
 }
 
 bool HttpBlockReader::end_block_sequence() {
     // Perform the request
     try {
-         string result = http_connection->RequestRanges(filename.c_str(), ranges.str());
+         string result;
+         if (total_block_size > 0) result = http_connection->RequestRanges(filename.c_str(), ranges.str());
          //std::cout << "Resultsize: " << result.size() << " expected: " << total_block_size << std::endl;
          if (result.size() != total_block_size) {
             throw (const char*)"Inconsistent number of bytes read via HTTP";
          }
          else {
-            memcpy(buffer, result.c_str(), result.size());
+            const char* data = result.data();
+            for (vector<Block>::iterator b = blocks.begin(); b != blocks.end(); b++) {
+                memcpy(buffer, data, b->available);
+                memset(buffer + b->available, 0, b->len - b->available);
+                data += b->available;
+                buffer += b->len;
+            }
+            blocks.clear();
          }
     }
     catch(const char* e) {
         //std::cout << "Here!" << std::endl;
         error_message = e;
-        return BlockReader::READ_ERROR;
+        return false;
+    }
+    catch(string& e) {
+        error_message = e;
+        return false;
     }
+    return true;
 }
 
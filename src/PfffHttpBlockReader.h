@@ -8,19 +8,21 @@
 #define __PfffHttpBlockReader_h__
 #include <string>
 #include <sstream>
+#include <vector>
 #include "HttpSocket.h"
 #include "PfffBlockReader.h"
 
 using std::string;
 using std::ostringstream;
+using std::vector;
 
 /**
  * A BlockReader for files over HTTP.
  */
 class HttpBlockReader: public BlockReader {
 public:
-    // http_connection must be an instance of HttpSocket
-    HttpBlockReader(HttpClientSocket* http_connection, const char* filename);
+    // http_connection must be an instance of HttpSocket. With owns_connection, it is deleted with the reader.
+    HttpBlockReader(HttpClientSocket* http_connection, const char* filename, bool owns_connection = false);
     ~HttpBlockReader();
     long long _size();
     bool next_block(unsigned long long block_start, unsigned long block_size);
@@ -29,8 +31,15 @@ public:
 
 protected:
     HttpClientSocket* http_connection;
+    bool owns_connection;
     ostringstream ranges;
-    long long total_block_size;
+    long long total_block_size;     // Bytes requested, not counting the parts beyond the end of file
+    struct Block {
+        inline Block(unsigned long available, unsigned long len): available(available), len(len) {};
+        unsigned long available;    // Bytes of the block within the file, the rest is zero-filled
+        unsigned long len;
+    };
+    vector<Block> blocks;
 };
 
 
@@ -0,0 +1,564 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffLoopbackServer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::ifstream;
+using std::istringstream;
+using std::ostringstream;
+using std::pair;
+using std::vector;
+
+// Boundary of multipart/byteranges responses. Mixed case, as clients must not change it.
+static const char* MULTIPART_BOUNDARY = "PfffByteRanges";
+
+// Size of the chunks of chunked responses and FTP transfers
+static const unsigned long CHUNK_SIZE = 65536;
+
+/**
+ * Removes the trailing "\n" or "\r\n" left by Socket::ReceiveLine.
+ */
+static inline string chomp(const string& line) {
+    string::size_type end = line.size();
+    while (end > 0 && (line[end-1] == '\n' || line[end-1] == '\r')) end--;
+    return line.substr(0, end);
+}
+
+/**
+ * Returns the size of a regular file, or -1 if there is no such file.
+ */
+static long long regular_file_size(const string& file) {
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    return st.st_size;
+}
+
+/**
+ * Appends length bytes of the file starting at offset to out. Returns false on error.
+ */
+static bool read_range(ifstream& in, unsigned long long offset, unsigned long long length, string& out) {
+    string::size_type start = out.size();
+    out.resize(start + length);
+    in.clear();
+    in.seekg(offset);
+    in.read(&out[start], length);
+    return in.gcount() == (std::streamsize)length;
+}
+
+/**
+ * The entries of a directory, sorted, with the sizes of the regular files and -1 for the
+ * directories. Other entries are left out. Returns false if the directory cannot be read.
+ */
+static bool list_directory(const string& dir, vector<pair<string, long long> >& entries) {
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL) return false;
+    struct dirent* e;
+    while ((e = readdir(d)) != NULL) {
+        string name = e->d_name;
+        if (name == "." || name == "..") continue;
+        struct stat st;
+        if (stat((dir + "/" + name).c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) entries.push_back(std::make_pair(name, -1LL));
+        else if (S_ISREG(st.st_mode)) entries.push_back(std::make_pair(name, (long long)st.st_size));
+    }
+    closedir(d);
+    std::sort(entries.begin(), entries.end());
+    return true;
+}
+
+static bool is_directory(const string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// ------------- PfffLoopbackServer ----------------
+
+PfffLoopbackServer::PfffLoopbackServer(const string& root, long latency_us):
+    root(root), latency_us(latency_us), started(false), stopping(false), n_requests(0) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&changed, NULL);
+    server = new SocketServer(0, 64, BlockingSocket, "127.0.0.1");
+}
+
+PfffLoopbackServer::~PfffLoopbackServer() {
+    stop();
+    delete server;
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&lock);
+}
+
+void PfffLoopbackServer::start() {
+    if (started) return;
+    if (pthread_create(&accept_thread, NULL, &PfffLoopbackServer::accept_main, this) != 0)
+        throw string("Failed to start the server thread");
+    started = true;
+}
+
+void PfffLoopbackServer::stop() {
+    pthread_mutex_lock(&lock);
+    if (stopping) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+    stopping = true;
+    for (set<Socket*>::iterator c = connections.begin(); c != connections.end(); c++) (*c)->Shutdown();
+    pthread_mutex_unlock(&lock);
+    server->Shutdown();
+    if (started) pthread_join(accept_thread, NULL);
+
+    pthread_mutex_lock(&lock);
+    while (!connections.empty()) pthread_cond_wait(&changed, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+long PfffLoopbackServer::requests() {
+    pthread_mutex_lock(&lock);
+    long result = n_requests;
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+void PfffLoopbackServer::begin_reply() {
+    if (latency_us > 0) usleep(latency_us);
+    pthread_mutex_lock(&lock);
+    n_requests++;
+    pthread_mutex_unlock(&lock);
+}
+
+bool PfffLoopbackServer::local_path(const string& path, string& result) {
+    string::size_type start = path.find_first_not_of('/');
+    string relative = start == string::npos ? "" : path.substr(start);
+    if (relative == ".." || relative.compare(0, 3, "../") == 0 || relative.find("/../") != string::npos ||
+        (relative.size() >= 3 && relative.compare(relative.size() - 3, 3, "/..") == 0))
+        return false;
+    result = root + "/" + relative;
+    return true;
+}
+
+void* PfffLoopbackServer::accept_main(void* arg) {
+    PfffLoopbackServer* self = (PfffLoopbackServer*)arg;
+    while (true) {
+        Socket* socket = self->server->Accept();
+        pthread_mutex_lock(&self->lock);
+        if (self->stopping) {
+            pthread_mutex_unlock(&self->lock);
+            delete socket;
+            break;
+        }
+        if (socket == NULL) {
+            pthread_mutex_unlock(&self->lock);
+            continue;
+        }
+        self->connections.insert(socket);
+        pthread_mutex_unlock(&self->lock);
+
+        ConnectionArg* connection = new ConnectionArg();
+        connection->server = self;
+        connection->socket = socket;
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, &PfffLoopbackServer::connection_main, connection) != 0) {
+            pthread_mutex_lock(&self->lock);
+            self->connections.erase(socket);
+            pthread_mutex_unlock(&self->lock);
+            delete socket;
+            delete connection;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    return NULL;
+}
+
+void* PfffLoopbackServer::connection_main(void* arg) {
+    ConnectionArg* connection = (ConnectionArg*)arg;
+    PfffLoopbackServer* self = connection->server;
+    self->serve_connection(connection->socket);
+    pthread_mutex_lock(&self->lock);
+    self->connections.erase(connection->socket);
+    delete connection->socket;
+    pthread_cond_broadcast(&self->changed);
+    pthread_mutex_unlock(&self->lock);
+    delete connection;
+    return NULL;
+}
+
+// ------------- PfffLoopbackHttpServer ----------------
+
+PfffLoopbackHttpServer::PfffLoopbackHttpServer(const string& root, long latency_us, bool chunked, bool webdav):
+    PfffLoopbackServer(root, latency_us), chunked(chunked), webdav(webdav) {
+}
+
+PfffLoopbackHttpServer::~PfffLoopbackHttpServer() {
+    stop(); // Before this object goes, as the connection threads use it
+}
+
+void PfffLoopbackHttpServer::serve_connection(Socket* socket) {
+    while (true) {
+        string request_line = chomp(socket->ReceiveLine());
+        if (request_line.empty()) break;
+        istringstream request(request_line);
+        string method, path, version;
+        request >> method >> path >> version;
+        bool keep_alive = version == "HTTP/1.1";
+
+        // Headers, up to the empty line
+        string range;
+        long long content_length = 0;
+        while (true) {
+            string line = socket->ReceiveLine();
+            if (line.empty()) return;   // Connection closed
+            line = chomp(line);
+            if (line.empty()) break;
+            string::size_type colon = line.find(':');
+            if (colon == string::npos) continue;
+            string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            string::size_type value_start = line.find_first_not_of(' ', colon + 1);
+            string value = value_start == string::npos ? "" : line.substr(value_start);
+            if (name == "range") range = value;
+            else if (name == "content-length") content_length = strtoll(value.c_str(), NULL, 10);
+            else if (name == "connection") {
+                std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+                if (value == "close") keep_alive = false;
+                else if (value == "keep-alive") keep_alive = true;
+            }
+        }
+
+        // The body (of a PROPFIND) is not looked at
+        if (content_length > 0) {
+            string body(content_length, '\0');
+            if (socket->RecvBlocking(&body[0], content_length) != content_length) break;
+        }
+
+        begin_reply();
+        if (!serve_request(socket, method, path, range, keep_alive) || !keep_alive) break;
+    }
+}
+
+bool PfffLoopbackHttpServer::serve_request(Socket* socket, const string& method, const string& path,
+                                           const string& range, bool keep_alive) {
+    string connection_header = keep_alive ? "" : "Connection: close\r\n";
+    if (method == "PROPFIND" && !webdav)
+        return send_response(socket, "405 Method Not Allowed", connection_header + "Allow: GET, HEAD\r\n", "Not allowed\n");
+    if (method != "GET" && method != "HEAD" && method != "PROPFIND")
+        return send_response(socket, "501 Not Implemented", connection_header, "Not implemented\n");
+    string file;
+    if (!local_path(path, file))
+        return send_response(socket, "403 Forbidden", connection_header, "Forbidden\n");
+    if (method != "HEAD" && is_directory(file)) return serve_directory(socket, method, path, file, connection_header);
+    long long size = regular_file_size(file);
+    if (size < 0)
+        return send_response(socket, "404 Not Found", connection_header, "Not found\n");
+
+    if (method == "PROPFIND") {
+        ostringstream body;
+        body << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<D:multistatus xmlns:D=\"DAV:\">\n"
+             << "<D:response><D:href>" << path << "</D:href><D:propstat><D:prop><D:resourcetype/>"
+             << "<D:getcontentlength>" << size << "</D:getcontentlength></D:prop>"
+             << "<D:status>HTTP/1.1 200 OK</D:status></D:propstat></D:response>\n</D:multistatus>\n";
+        return send_response(socket, "207 Multi-Status", connection_header + "Content-Type: application/xml; charset=utf-8\r\n", body.str());
+    }
+
+    if (method == "HEAD") {
+        ostringstream head;
+        head << "HTTP/1.1 200 OK\r\n" << connection_header
+             << "Accept-Ranges: bytes\r\nContent-Length: " << size << "\r\n\r\n";
+        return socket->SendAll(head.str().data(), head.str().size());
+    }
+
+    // Parse "bytes=a-b,c-,-n". Unparseable ranges are ignored (the whole file is sent),
+    // unsatisfiable ones are dropped.
+    vector<pair<unsigned long long, unsigned long long> > ranges;
+    bool valid = range.compare(0, 6, "bytes=") == 0;
+    if (valid) {
+        istringstream specs(range.substr(6));
+        string spec;
+        while (valid && std::getline(specs, spec, ',')) {
+            string::size_type dash = spec.find('-');
+            string first = spec.substr(0, dash), last = dash == string::npos ? "" : spec.substr(dash + 1);
+            if (dash == string::npos || (first.empty() && last.empty()) ||
+                first.find_first_not_of(" 0123456789") != string::npos || last.find_first_not_of(" 0123456789") != string::npos) {
+                valid = false;
+                break;
+            }
+            unsigned long long start, end;
+            if (first.empty()) {    // Suffix: the last n bytes
+                unsigned long long n = strtoull(last.c_str(), NULL, 10);
+                if (n == 0) continue;
+                start = n >= (unsigned long long)size ? 0 : size - n;
+                end = size - 1;
+            }
+            else {
+                start = strtoull(first.c_str(), NULL, 10);
+                end = last.empty() ? size - 1 : strtoull(last.c_str(), NULL, 10);
+                if (end >= (unsigned long long)size) end = size - 1;
+                if (end < start) {
+                    valid = !last.empty();  // A reversed range makes the header invalid
+                    if (!valid) continue;
+                    if (start < (unsigned long long)size) {
+                        valid = false;
+                        break;
+                    }
+                    continue;
+                }
+            }
+            if (start >= (unsigned long long)size) continue;
+            ranges.push_back(std::make_pair(start, end));
+        }
+    }
+
+    ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+    string body;
+    if (!valid) {
+        if (!read_range(in, 0, size, body))
+            return send_response(socket, "500 Internal Server Error", connection_header, "Read error\n");
+        return send_response(socket, "200 OK", connection_header + "Accept-Ranges: bytes\r\n", body);
+    }
+    if (ranges.empty()) {
+        ostringstream headers;
+        headers << connection_header << "Content-Range: bytes */" << size << "\r\n";
+        return send_response(socket, "416 Range Not Satisfiable", headers.str(), "");
+    }
+    ostringstream headers;
+    headers << connection_header;
+    if (ranges.size() == 1) {
+        headers << "Content-Type: application/octet-stream\r\n"
+                << "Content-Range: bytes " << ranges[0].first << "-" << ranges[0].second << "/" << size << "\r\n";
+        if (!read_range(in, ranges[0].first, ranges[0].second - ranges[0].first + 1, body))
+            return send_response(socket, "500 Internal Server Error", connection_header, "Read error\n");
+    }
+    else {
+        headers << "Content-Type: multipart/byteranges; boundary=" << MULTIPART_BOUNDARY << "\r\n";
+        for (int i = 0; i < ranges.size(); i++) {
+            ostringstream part;
+            part << "--" << MULTIPART_BOUNDARY << "\r\n"
+                 << "Content-Type: application/octet-stream\r\n"
+                 << "Content-Range: bytes " << ranges[i].first << "-" << ranges[i].second << "/" << size << "\r\n\r\n";
+            body += part.str();
+            if (!read_range(in, ranges[i].first, ranges[i].second - ranges[i].first + 1, body))
+                return send_response(socket, "500 Internal Server Error", connection_header, "Read error\n");
+            body += "\r\n";
+        }
+        body += string("--") + MULTIPART_BOUNDARY + "--\r\n";
+    }
+    return send_response(socket, "206 Partial Content", headers.str(), body);
+}
+
+bool PfffLoopbackHttpServer::serve_directory(Socket* socket, const string& method, const string& path, const string& dir,
+                                             const string& connection_header) {
+    vector<pair<string, long long> > entries;
+    if (!list_directory(dir, entries))
+        return send_response(socket, "500 Internal Server Error", connection_header, "Read error\n");
+    string base = path[path.size() - 1] == '/' ? path : path + "/";
+    ostringstream body;
+    if (method == "PROPFIND") {
+        body << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<D:multistatus xmlns:D=\"DAV:\">\n"
+             << "<D:response><D:href>" << base << "</D:href><D:propstat><D:prop>"
+             << "<D:resourcetype><D:collection/></D:resourcetype></D:prop>"
+             << "<D:status>HTTP/1.1 200 OK</D:status></D:propstat></D:response>\n";
+        for (int i = 0; i < entries.size(); i++) {
+            bool is_dir = entries[i].second < 0;
+            body << "<D:response><D:href>" << base << entries[i].first << (is_dir ? "/" : "") << "</D:href><D:propstat><D:prop>";
+            if (is_dir) body << "<D:resourcetype><D:collection/></D:resourcetype>";
+            else body << "<D:resourcetype/><D:getcontentlength>" << entries[i].second << "</D:getcontentlength>";
+            body << "</D:prop><D:status>HTTP/1.1 200 OK</D:status></D:propstat></D:response>\n";
+        }
+        body << "</D:multistatus>\n";
+        return send_response(socket, "207 Multi-Status", connection_header + "Content-Type: application/xml; charset=utf-8\r\n", body.str());
+    }
+    // Like the index pages of nginx and Apache: a link to the parent, then one per entry
+    body << "<html>\n<head><title>Index of " << base << "</title></head>\n<body>\n<h1>Index of " << base << "</h1><hr><pre>"
+         << "<a href=\"../\">../</a>\n";
+    for (int i = 0; i < entries.size(); i++) {
+        string name = entries[i].first + (entries[i].second < 0 ? "/" : "");
+        body << "<a href=\"" << name << "\">" << name << "</a>    01-Jan-2010 00:00    ";
+        if (entries[i].second < 0) body << "-";
+        else body << entries[i].second;
+        body << "\n";
+    }
+    body << "</pre><hr></body>\n</html>\n";
+    return send_response(socket, "200 OK", connection_header + "Content-Type: text/html\r\n", body.str());
+}
+
+bool PfffLoopbackHttpServer::send_response(Socket* socket, const char* status, const string& headers, const string& body) {
+    ostringstream head;
+    head << "HTTP/1.1 " << status << "\r\n" << headers;
+    if (chunked) head << "Transfer-Encoding: chunked\r\n\r\n";
+    else head << "Content-Length: " << body.size() << "\r\n\r\n";
+    if (!socket->SendAll(head.str().data(), head.str().size())) return false;
+    if (!chunked) return socket->SendAll(body.data(), body.size());
+
+    for (string::size_type done = 0; done < body.size(); done += CHUNK_SIZE) {
+        string::size_type n = std::min((string::size_type)CHUNK_SIZE, body.size() - done);
+        ostringstream chunk_head;
+        chunk_head << std::hex << n << "\r\n";
+        if (!socket->SendAll(chunk_head.str().data(), chunk_head.str().size()) ||
+            !socket->SendAll(body.data() + done, n) ||
+            !socket->SendAll("\r\n", 2))
+            return false;
+    }
+    return socket->SendAll("0\r\n\r\n", 5);
+}
+
+// ------------- PfffLoopbackFtpServer ----------------
+
+PfffLoopbackFtpServer::PfffLoopbackFtpServer(const string& root, long latency_us, bool mlsd):
+    PfffLoopbackServer(root, latency_us), mlsd(mlsd) {
+}
+
+PfffLoopbackFtpServer::~PfffLoopbackFtpServer() {
+    stop(); // Before this object goes, as the connection threads use it
+}
+
+void* PfffLoopbackFtpServer::transfer_main(void* arg) {
+    Transfer* transfer = (Transfer*)arg;
+    if (transfer->file.empty()) {
+        transfer->completed = transfer->data->SendAll(transfer->listing.data(), transfer->listing.size());
+        transfer->data->Shutdown();
+        return NULL;
+    }
+    ifstream in(transfer->file.c_str(), std::ios::in | std::ios::binary);
+    in.seekg(transfer->offset);
+    vector<char> buffer(CHUNK_SIZE);
+    bool ok = (bool)in;
+    while (ok) {
+        in.read(&buffer[0], CHUNK_SIZE);
+        std::streamsize n = in.gcount();
+        if (n <= 0) break;
+        ok = transfer->data->SendAll(&buffer[0], n);
+    }
+    transfer->completed = ok;
+    transfer->data->Shutdown();     // End of file for the client
+    return NULL;
+}
+
+bool PfffLoopbackFtpServer::finish_transfer(Transfer*& transfer, bool abort) {
+    if (abort) transfer->data->Shutdown();
+    pthread_join(transfer->thread, NULL);
+    bool completed = transfer->completed;
+    delete transfer->data;
+    delete transfer;
+    transfer = NULL;
+    return completed;
+}
+
+void PfffLoopbackFtpServer::serve_connection(Socket* socket) {
+    SocketServer* passive = NULL;
+    Transfer* transfer = NULL;
+    unsigned long long rest = 0;
+    string greeting = "220 pfff loopback FTP server\r\n";
+    socket->SendAll(greeting.data(), greeting.size());
+    while (true) {
+        string line = chomp(socket->ReceiveLine());
+        if (line.empty()) break;
+        string::size_type space = line.find(' ');
+        string command = line.substr(0, space);
+        string argument = space == string::npos ? "" : line.substr(space + 1);
+        std::transform(command.begin(), command.end(), command.begin(), ::toupper);
+        begin_reply();
+
+        // All lines of a reply are sent at once: a client waiting for the first line only
+        // would otherwise hold back the rest by delaying its ACK.
+        ostringstream reply;
+        if (command == "ABOR") {
+            if (transfer == NULL) reply << "225 No transfer to abort.";
+            else {
+                if (!finish_transfer(transfer, true)) reply << "426 Connection closed; transfer aborted.\r\n";
+                reply << "226 Abort successful.";
+            }
+        }
+        else {
+            // Another command ends a transfer that the client read to the end
+            if (transfer != NULL) {
+                finish_transfer(transfer, false);
+                reply << "226 Transfer complete.\r\n";
+            }
+            string file;
+            if (command == "USER") reply << "331 Password required.";
+            else if (command == "PASS") reply << "230 Logged in.";
+            else if (command == "TYPE" || command == "NOOP") reply << "200 OK.";
+            else if (command == "SIZE") {
+                long long size = local_path(argument, file) ? regular_file_size(file) : -1;
+                if (size < 0) reply << "550 No such file.";
+                else reply << "213 " << size;
+            }
+            else if (command == "PASV") {
+                delete passive;
+                passive = NULL;
+                try {
+                    passive = new SocketServer(0, 1, BlockingSocket, "127.0.0.1");
+                    reply << "227 Entering Passive Mode (127,0,0,1," << (passive->port >> 8) << "," << (passive->port & 0xFF) << ").";
+                }
+                catch (string&) {
+                    reply << "425 Can not open data connection.";
+                }
+            }
+            else if (command == "REST") {
+                rest = strtoull(argument.c_str(), NULL, 10);
+                reply << "350 Restarting at " << rest << ".";
+            }
+            else if (command == "MLSD" && !mlsd) reply << "500 Unknown command.";
+            else if (command == "RETR" || command == "MLSD" || command == "LIST") {
+                bool retr = command == "RETR";
+                vector<pair<string, long long> > entries;
+                string dir;
+                if (passive == NULL) reply << "425 Use PASV first.";
+                else if (retr && (!local_path(argument, file) || regular_file_size(file) < 0)) reply << "550 No such file.";
+                else if (!retr && (!local_path(argument, dir) || !list_directory(dir, entries))) reply << "550 No such directory.";
+                else {
+                    Socket* data = passive->Accept();
+                    delete passive;
+                    passive = NULL;
+                    if (data == NULL) reply << "425 Can not open data connection.";
+                    else {
+                        transfer = new Transfer();
+                        transfer->data = data;
+                        transfer->file = retr ? file : "";
+                        ostringstream listing;
+                        if (command == "MLSD") listing << "type=cdir; " << (argument.empty() ? "/" : argument) << "\r\n";
+                        for (int i = 0; i < entries.size(); i++) {
+                            bool is_dir = entries[i].second < 0;
+                            if (command == "MLSD") {
+                                listing << "type=" << (is_dir ? "dir" : "file") << ";";
+                                if (!is_dir) listing << "size=" << entries[i].second << ";";
+                                listing << "modify=20100101000000; " << entries[i].first << "\r\n";
+                            }
+                            else listing << (is_dir ? "drwxr-xr-x 2" : "-rw-r--r-- 1") << " pfff pfff "
+                                         << (is_dir ? 4096 : entries[i].second) << " Jan  1  2010 " << entries[i].first << "\r\n";
+                        }
+                        transfer->listing = listing.str();
+                        transfer->offset = rest;
+                        transfer->completed = false;
+                        if (pthread_create(&transfer->thread, NULL, &PfffLoopbackFtpServer::transfer_main, transfer) != 0) {
+                            delete data;
+                            delete transfer;
+                            transfer = NULL;
+                            reply << "451 Transfer failed.";
+                        }
+                        else reply << (retr ? "150 Opening BINARY mode data connection." : "150 Here comes the directory listing.");
+                    }
+                }
+                rest = 0;
+            }
+            else if (command == "QUIT") reply << "221 Bye.";
+            else reply << "502 Command not implemented.";
+        }
+        reply << "\r\n";
+        if (!socket->SendAll(reply.str().data(), reply.str().size()) || command == "QUIT") break;
+    }
+    if (transfer != NULL) finish_transfer(transfer, true);
+    delete passive;
+}
@@ -0,0 +1,137 @@
+/**
+ * PfffLoopbackServer.h: Minimal HTTP and FTP servers for the tests and benchmarks of the
+ * remote BlockReaders. They serve the files under a root directory on 127.0.0.1, from a
+ * background thread, with a configurable delay before each reply to emulate network latency.
+ *
+ * HTTP: GET and HEAD, HTTP/1.1 persistent connections, byte ranges (a single range is sent as is,
+ *       several as multipart/byteranges), optionally with the chunked transfer encoding.
+ *       Directories are listed as an HTML index on GET, and with WebDAV PROPFIND (Depth 1).
+ * FTP:  USER, PASS, TYPE, SIZE, PASV, REST, RETR, MLSD, LIST, ABOR, NOOP, QUIT. Transfers are made
+ *       from a separate thread, so that ABOR can interrupt them like on a real server.
+ *
+ * Only meant for testing: there is no access control beyond rejecting paths with "..", and names
+ * in listings are not escaped.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffLoopbackServer_h__
+#define __PfffLoopbackServer_h__
+#include <set>
+#include <string>
+#include <pthread.h>
+#include "Socket.h"
+
+using std::set;
+using std::string;
+
+/**
+ * Common part of the servers: the listening socket, the accepting thread and one thread per connection.
+ */
+class PfffLoopbackServer {
+public:
+    /** Binds a free port on 127.0.0.1. Throws std::string on failure. */
+    PfffLoopbackServer(const string& root, long latency_us);
+
+    /** Stops the server if it is still running. */
+    virtual ~PfffLoopbackServer();
+
+    /** Starts accepting connections in a background thread. */
+    void start();
+
+    /** Closes all connections and waits for their threads to finish. */
+    void stop();
+
+    /** The port listened on */
+    inline int port() const { return server->port; }
+
+    /** Number of requests (HTTP requests or FTP commands) served so far */
+    long requests();
+
+protected:
+    string root;
+    long latency_us;
+    SocketServer* server;
+    pthread_t accept_thread;
+    bool started;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool stopping;
+    long n_requests;
+    set<Socket*> connections;
+
+    /** Serves a single connection until the client closes it or the server is stopped. */
+    virtual void serve_connection(Socket* socket) = 0;
+
+    /** Waits for the configured latency and counts the request. */
+    void begin_reply();
+
+    /**
+     * Maps a request path to a local file. Returns false for paths leaving the root.
+     */
+    bool local_path(const string& path, string& result);
+
+    struct ConnectionArg {
+        PfffLoopbackServer* server;
+        Socket* socket;
+    };
+    static void* accept_main(void* arg);
+    static void* connection_main(void* arg);
+};
+
+/**
+ * The HTTP server. With chunked set, all bodies are sent with Transfer-Encoding: chunked.
+ * Without webdav, PROPFIND is refused like on a plain web server.
+ */
+class PfffLoopbackHttpServer: public PfffLoopbackServer {
+public:
+    PfffLoopbackHttpServer(const string& root, long latency_us = 0, bool chunked = false, bool webdav = true);
+    ~PfffLoopbackHttpServer();
+
+protected:
+    bool chunked;
+    bool webdav;
+
+    void serve_connection(Socket* socket);
+
+    /** Answers a single request. Returns false if the connection must be closed. */
+    bool serve_request(Socket* socket, const string& method, const string& path, const string& range, bool keep_alive);
+
+    /** Answers a GET (an HTML index) or a PROPFIND of a directory. */
+    bool serve_directory(Socket* socket, const string& method, const string& path, const string& dir, const string& connection_header);
+
+    /** Sends the status line, the given headers, the framing headers and the body. Returns false on error. */
+    bool send_response(Socket* socket, const char* status, const string& headers, const string& body);
+};
+
+/**
+ * The FTP server. Accepts any user name and password. Without mlsd, MLSD is refused like on
+ * older servers, which only have LIST.
+ */
+class PfffLoopbackFtpServer: public PfffLoopbackServer {
+public:
+    PfffLoopbackFtpServer(const string& root, long latency_us = 0, bool mlsd = true);
+    ~PfffLoopbackFtpServer();
+
+protected:
+    bool mlsd;
+
+    void serve_connection(Socket* socket);
+
+    /** A RETR, MLSD or LIST in progress */
+    struct Transfer {
+        Socket* data;
+        string file;            // The file sent, or "" for a listing
+        string listing;
+        unsigned long long offset;
+        bool completed;
+        pthread_t thread;
+    };
+    static void* transfer_main(void* arg);
+
+    /** Waits for the transfer to end (after interrupting it, if abort is set) and frees it. Returns whether it completed. */
+    bool finish_transfer(Transfer*& transfer, bool abort);
+};
+
+#endif
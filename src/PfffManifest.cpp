@@ -0,0 +1,299 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffManifest.h"
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "output_utils.h"
+using std::ostringstream;
+
+// Length of the hex-encoded options signature
+static const int SIGNATURE_HEX_LEN = 2*sizeof(PfffOptionsSignature);
+
+// ------------- PfffManifestReader ----------------
+
+PfffManifestReader::PfffManifestReader(istream& in):
+    record_number(0), mode(PFO_OM_TEXT), in(in), started(false), digest_len(0) {
+}
+
+bool PfffManifestReader::fail(const string& message) {
+    ostringstream os;
+    os << "Manifest record " << (record_number + 1) << ": " << message;
+    error_message = os.str();
+    return false;
+}
+
+bool PfffManifestReader::signature_to_options(const PfffOptionsSignature& signature, PfffOptions* options) {
+    const PfffOptionsSignatureStruct& v = signature.values;
+    pfff_options_init(options, v.key);
+    options->version = ((unsigned char)v.versionAndOutput) >> 4;
+    options->output_format = v.versionAndOutput & 0x0f;
+    options->block_count = v.block_count;
+    options->block_size = v.block_size;
+    options->header_block_count = v.header_block_count;
+    options->without_replacement = (v.flags >> 1) & 1;
+    options->with_size = v.flags & 1;
+    // The adaptive flag is not needed: an adaptive fingerprint records the block count it used,
+    // and is the plain fingerprint for that count.
+    return pfff_options_validate(options, NULL) != 0;
+}
+
+bool PfffManifestReader::next(PfffManifestRecord& record) {
+    error_message = "";
+    if (!started) {
+        started = true;
+        // Detect the mode by the first character
+        int c = in.peek();
+        if (c == 'P') {
+            // Text manifests start with a hex digit or signature, so 'P' means the binary magic
+            mode = PFO_OM_BINARY;
+            if (!read_binary_header()) return false;
+        }
+        else if (c == '{') mode = PFO_OM_NDJSON;
+        else mode = PFO_OM_TEXT;
+    }
+    if (mode == PFO_OM_BINARY) return next_binary(record);
+
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line[line.size()-1] == '\r') line.resize(line.size()-1);
+        if (line.empty()) continue;
+        bool ok = (mode == PFO_OM_NDJSON) ? parse_ndjson_line(line, record) : parse_text_line(line, record);
+        if (ok) record_number++;
+        return ok;
+    }
+    return false;
+}
+
+// ---- Binary mode ----
+
+static inline uint64_t parse_le(const unsigned char* b, int n) {
+    uint64_t v = 0;
+    for (int i = n - 1; i >= 0; i--) v = (v << 8) | b[i];
+    return v;
+}
+
+bool PfffManifestReader::read_binary_header() {
+    char header[4 + 1 + 1 + sizeof(PfffOptionsSignature)];
+    if (!in.read(header, sizeof(header))) return fail("Truncated binary header");
+    if (string(header, 4) != "PFFF") return fail("Not a pfff manifest");
+    if (header[4] != PFFF_MANIFEST_VERSION) return fail("Unsupported binary manifest version");
+    digest_len = (unsigned char)header[5];
+    memcpy(binary_signature.text, header + 6, sizeof(PfffOptionsSignature));
+    return true;
+}
+
+bool PfffManifestReader::next_binary(PfffManifestRecord& record) {
+    unsigned char len_bytes[4];
+    if (!in.read((char*)len_bytes, 4)) {
+        if (in.gcount() != 0) return fail("Truncated record");
+        return false; // Clean end of input
+    }
+    uint64_t record_len = parse_le(len_bytes, 4);
+    if (record_len < digest_len + 8) return fail("Invalid record length");
+    string data(record_len, '\0');
+    if (!in.read(&data[0], record_len)) return fail("Truncated record");
+
+    record.has_signature = true;
+    record.signature = binary_signature;
+    record.digest = data.substr(0, digest_len);
+    record.size = parse_le((const unsigned char*)data.data() + digest_len, 8);
+    record.path = data.substr(digest_len + 8);
+    record_number++;
+    return true;
+}
+
+// ---- Text mode ----
+
+bool PfffManifestReader::parse_text_line(const string& line, PfffManifestRecord& record) {
+    string::size_type tab = line.find('\t');
+    string fingerprint = line.substr(0, tab);
+    record.path = (tab == string::npos) ? "" : line.substr(tab + 1);
+    record.size = -1;
+
+    string::size_type colon = fingerprint.find(':');
+    record.has_signature = (colon != string::npos);
+    if (record.has_signature) {
+        if (colon != SIGNATURE_HEX_LEN || !parse_hex(fingerprint.data(), colon, record.signature.text))
+            return fail("Invalid options signature");
+        fingerprint = fingerprint.substr(colon + 1);
+    }
+    if (fingerprint.empty()) return fail("Missing digest");
+    record.digest.resize(fingerprint.size()/2);
+    if (!parse_hex(fingerprint.data(), fingerprint.size(), &record.digest[0]))
+        return fail("Invalid digest (CSV and debug outputs can not be read back)");
+    return true;
+}
+
+// ---- NDJSON mode ----
+
+/**
+ * Minimal JSON scanner, sufficient for the flat objects written by PfffOutputFormatter.
+ */
+class JsonScanner {
+public:
+    const string& s;
+    string::size_type pos;
+
+    JsonScanner(const string& s): s(s), pos(0) {}
+
+    inline void skip_space() {
+        while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t')) pos++;
+    }
+
+    inline bool expect(char c) {
+        skip_space();
+        if (pos < s.size() && s[pos] == c) { pos++; return true; }
+        return false;
+    }
+
+    inline bool peek(char c) {
+        skip_space();
+        return pos < s.size() && s[pos] == c;
+    }
+
+    /** Appends the UTF-8 encoding of a code point */
+    static void append_utf8(string& out, unsigned long cp) {
+        if (cp < 0x80) out += (char)cp;
+        else if (cp < 0x800) {
+            out += (char)(0xC0 | (cp >> 6));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000) {
+            out += (char)(0xE0 | (cp >> 12));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+        else {
+            out += (char)(0xF0 | (cp >> 18));
+            out += (char)(0x80 | ((cp >> 12) & 0x3F));
+            out += (char)(0x80 | ((cp >> 6) & 0x3F));
+            out += (char)(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool read_hex4(unsigned long& cp) {
+        if (pos + 4 > s.size()) return false;
+        char* end;
+        string digits = s.substr(pos, 4);
+        cp = strtoul(digits.c_str(), &end, 16);
+        if (end != digits.c_str() + 4) return false;
+        pos += 4;
+        return true;
+    }
+
+    bool read_string(string& out) {
+        if (!expect('"')) return false;
+        out = "";
+        while (pos < s.size()) {
+            char c = s[pos++];
+            if (c == '"') return true;
+            if (c != '\\') { out += c; continue; }
+            if (pos >= s.size()) return false;
+            c = s[pos++];
+            switch (c) {
+                case '"': case '\\': case '/': out += c; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned long cp, low;
+                    if (!read_hex4(cp)) return false;
+                    // Surrogate pair
+                    if (cp >= 0xD800 && cp < 0xDC00 && s.compare(pos, 2, "\\u") == 0) {
+                        pos += 2;
+                        if (!read_hex4(low)) return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default: return false;
+            }
+        }
+        return false;
+    }
+
+    /** Reads a number, true, false or null as raw text */
+    bool read_literal(string& out) {
+        skip_space();
+        string::size_type start = pos;
+        while (pos < s.size() && s[pos] != ',' && s[pos] != '}' && s[pos] != ' ') pos++;
+        out = s.substr(start, pos - start);
+        return !out.empty();
+    }
+};
+
+bool PfffManifestReader::parse_ndjson_line(const string& line, PfffManifestRecord& record) {
+    JsonScanner json(line);
+    record.has_signature = false;
+    record.digest = "";
+    record.size = -1;
+    record.path = "";
+    bool have_digest = false;
+
+    if (!json.expect('{')) return fail("Invalid JSON object");
+    if (!json.expect('}')) {
+        do {
+            string key, value;
+            if (!json.read_string(key) || !json.expect(':')) return fail("Invalid JSON object");
+            if (json.peek('"')) {
+                if (!json.read_string(value)) return fail("Invalid JSON string");
+            }
+            else if (!json.read_literal(value)) return fail("Invalid JSON value");
+
+            if (key == "signature") {
+                if (value.size() != SIGNATURE_HEX_LEN || !parse_hex(value.data(), value.size(), record.signature.text))
+                    return fail("Invalid options signature");
+                record.has_signature = true;
+            }
+            else if (key == "digest") {
+                record.digest.resize(value.size()/2);
+                if (value.empty() || !parse_hex(value.data(), value.size(), &record.digest[0]))
+                    return fail("Invalid digest");
+                have_digest = true;
+            }
+            else if (key == "size") record.size = strtoll(value.c_str(), NULL, 10);
+            else if (key == "path") record.path = value;
+            // Other keys are ignored
+        } while (json.expect(','));
+        if (!json.expect('}')) return fail("Invalid JSON object");
+    }
+    if (!have_digest) return fail("Missing digest");
+    return true;
+}
+
+// ------------- PfffHasherCache ----------------
+
+PfffHasherCache::PfffHasherCache(const PfffOptions* default_opts): default_opts(default_opts) {
+}
+
+PfffHasherCache::~PfffHasherCache() {
+    for (map<string, Entry*>::iterator e = entries.begin(); e != entries.end(); e++) {
+        delete e->second->hasher;
+        delete e->second;
+    }
+}
+
+PfffHasher* PfffHasherCache::get(const PfffOptionsSignature* signature, string& message) {
+    string key = signature != NULL ? string(signature->text, sizeof(PfffOptionsSignature)) : string();
+    map<string, Entry*>::iterator e = entries.find(key);
+    if (e == entries.end()) {
+        Entry* entry = new Entry();
+        bool valid = true;
+        if (signature != NULL) valid = PfffManifestReader::signature_to_options(*signature, &entry->opts);
+        else entry->opts = *default_opts;
+        entry->opts.no_filename = true;
+        entry->opts.output_mode = PFO_OM_TEXT;
+        if (valid && (entry->opts.output_format == PFO_OF_POLY1305AES || entry->opts.output_format == PFO_OF_MD5))
+            entry->hasher = new PfffHasher(&entry->opts);
+        else entry->hasher = NULL;
+        e = entries.insert(make_pair(key, entry)).first;
+    }
+    if (e->second->hasher == NULL) message = "Options signature does not describe a poly1305aes or md5 fingerprint";
+    return e->second->hasher;
+}
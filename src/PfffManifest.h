@@ -0,0 +1,102 @@
+/**
+ * PfffManifest.h: Reading back lists of fingerprints ("manifests") produced by pfff
+ * in any of its output modes.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffManifest_h__
+#define __PfffManifest_h__
+#include <istream>
+#include <map>
+#include <string>
+#include "PfffHasher.h"
+#include "PfffOutputFormatter.h"
+
+using std::istream;
+using std::map;
+using std::string;
+
+/**
+ * A single fingerprint read from a manifest.
+ */
+struct PfffManifestRecord {
+    bool has_signature;             // False for manifests made with --no-prefix
+    PfffOptionsSignature signature;
+    string digest;                  // Raw digest bytes
+    long long size;                 // File size, or -1 if the manifest does not record it (text mode)
+    string path;                    // Empty for manifests made with --no-filename
+};
+
+/**
+ * Reads records from a manifest stream. The format is detected from the first bytes:
+ *  - binary mode (see PfffOutputFormatter::output_header),
+ *  - NDJSON mode (lines starting with '{'),
+ *  - text mode: lines of the form [<signature>:]<hex digest>[<TAB><path>].
+ * CSV and debug outputs are not manifests and are reported as errors.
+ */
+class PfffManifestReader {
+public:
+    string error_message;
+    long record_number;     // Number of records read so far (used in error messages)
+    int mode;               // PFO_OM_TEXT, PFO_OM_BINARY or PFO_OM_NDJSON, known after the first next()
+
+    PfffManifestReader(istream& in);
+
+    /**
+     * Reads the next record. Returns false at the end of input or on error, in which case
+     * error_message is set (it stays empty at a clean end of input).
+     */
+    bool next(PfffManifestRecord& record);
+
+    /**
+     * Converts a signature back to the algorithm options it was made with.
+     * Output options (prefix, filename, mode) are left at their defaults.
+     * Returns false if the signature does not describe valid options.
+     */
+    static bool signature_to_options(const PfffOptionsSignature& signature, PfffOptions* options);
+
+protected:
+    istream& in;
+    bool started;
+
+    // Binary mode header
+    int digest_len;
+    PfffOptionsSignature binary_signature;
+
+    bool read_binary_header();
+    bool next_binary(PfffManifestRecord& record);
+    bool parse_text_line(const string& line, PfffManifestRecord& record);
+    bool parse_ndjson_line(const string& line, PfffManifestRecord& record);
+    bool fail(const string& message);
+};
+
+/**
+ * Hashers for the option sets named by manifest records, created on first use.
+ * Only formats with a binary digest (poly1305aes, md5) are served, and the hashers
+ * do not record filenames.
+ * Not thread-safe: use one instance per thread.
+ */
+class PfffHasherCache {
+public:
+    /** default_opts are used for records without a signature (manifests made with --no-prefix) */
+    PfffHasherCache(const PfffOptions* default_opts);
+    ~PfffHasherCache();
+
+    /**
+     * Returns the hasher for the given signature (NULL for the default options).
+     * If the signature is invalid or has no binary digest, returns NULL and sets message.
+     */
+    PfffHasher* get(const PfffOptionsSignature* signature, string& message);
+
+protected:
+    /** A hasher together with the options it points to */
+    struct Entry {
+        PfffOptions opts;
+        PfffHasher* hasher;
+    };
+    const PfffOptions* default_opts;
+    map<string, Entry*> entries;    // Keyed by the raw signature, "" for the defaults
+};
+
+#endif
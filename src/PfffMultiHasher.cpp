@@ -0,0 +1,146 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffMultiHasher.h"
+#include <algorithm>
+#include <cstring>
+
+// ------------- SampleCacheBlockReader ----------------
+
+SampleCacheBlockReader::SampleCacheBlockReader(BlockReader* reader):
+    BlockReader(reader->get_filename().c_str()), reader(reader), recording(true) {
+}
+
+long long SampleCacheBlockReader::_size() {
+    long long result = reader->size();
+    if (result < 0) error_message = reader->error_message;
+    return result;
+}
+
+bool SampleCacheBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    if (recording) {
+        Range range;
+        range.start = block_start;
+        range.end = block_start + block_size;
+        range.offset = 0;
+        ranges.push_back(range);
+        memset(buffer, 0, block_size);
+        buffer += block_size;
+        return true;
+    }
+    // The last range starting at or before the block
+    Range key;
+    key.start = block_start;
+    vector<Range>::iterator r = std::upper_bound(ranges.begin(), ranges.end(), key);
+    if (r == ranges.begin() || (--r)->end < block_start + block_size) {
+        error_message = "Internal error: a block was not in the read plan";
+        return false;
+    }
+    memcpy(buffer, &data[r->offset + (block_start - r->start)], block_size);
+    buffer += block_size;
+    return true;
+}
+
+void SampleCacheBlockReader::end_recording() {
+    if (!recording) return;
+    recording = false;
+    std::sort(ranges.begin(), ranges.end());
+    vector<Range> merged;
+    unsigned long long total = 0;
+    for (int i = 0; i < ranges.size(); i++) {
+        if (!merged.empty() && ranges[i].start <= merged.back().end) {
+            if (ranges[i].end > merged.back().end) {
+                total += ranges[i].end - merged.back().end;
+                merged.back().end = ranges[i].end;
+            }
+        }
+        else {
+            Range range = ranges[i];
+            range.offset = total;
+            total += range.end - range.start;
+            merged.push_back(range);
+        }
+    }
+    ranges.swap(merged);
+    data.resize(total + 1);
+}
+
+bool SampleCacheBlockReader::fetch() {
+    end_recording();
+    if (ranges.empty()) return true;
+    
+    reader->begin_block_sequence(&data[0]);
+    for (int i = 0; i < ranges.size(); i++) {
+        if (!reader->next_block(ranges[i].start, ranges[i].end - ranges[i].start)) {
+            reader->end_block_sequence();
+            error_message = reader->error_message;
+            return false;
+        }
+    }
+    if (!reader->end_block_sequence()) {
+        error_message = reader->error_message;
+        return false;
+    }
+    return true;
+}
+
+bool SampleCacheBlockReader::next_range(unsigned long long offset, unsigned long long& start, unsigned long long& end) const {
+    // The ranges are disjoint, so ordered by their ends as well
+    int lo = 0, hi = ranges.size();
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ranges[mid].end <= offset) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == ranges.size()) return false;
+    start = ranges[lo].start;
+    end = ranges[lo].end;
+    return true;
+}
+
+void SampleCacheBlockReader::capture(unsigned long long offset, const char* data, unsigned long len) {
+    Range key;
+    key.start = offset;
+    vector<Range>::iterator r = std::upper_bound(ranges.begin(), ranges.end(), key);
+    if (r != ranges.begin()) --r;
+    for (; r != ranges.end() && r->start < offset + len; ++r) {
+        unsigned long long from = r->start > offset ? r->start : offset;
+        unsigned long long to = r->end < offset + len ? r->end : offset + len;
+        if (from < to) memcpy(&this->data[r->offset + (from - r->start)], data + (from - offset), to - from);
+    }
+}
+
+// ------------- PfffMultiHasher ----------------
+
+void PfffMultiHasher::hash(ostream& out, BlockReader* input_file) {
+    SampleCacheBlockReader cache(input_file);
+    plan(&cache);
+    if (!cache.fetch()) throw pfff_exception(cache.error_message);
+    output(out, &cache);
+}
+
+void PfffMultiHasher::plan(SampleCacheBlockReader* cache) {
+    // Each hasher makes its reads on zeroes. The output is discarded, and not timed.
+    ostream null_out(NULL);
+    for (int i = 0; i < hashers.size(); i++) {
+        PfffStats* stats = hashers[i]->stats;
+        hashers[i]->stats = NULL;
+        try {
+            hashers[i]->hash(null_out, cache);
+        }
+        catch (pfff_exception&) {
+            hashers[i]->stats = stats;
+            throw;
+        }
+        hashers[i]->stats = stats;
+    }
+}
+
+void PfffMultiHasher::output(ostream& out, SampleCacheBlockReader* cache) {
+    cache->end_recording();
+    for (int i = 0; i < hashers.size(); i++) {
+        if (i > 0) out << hashers[i-1]->formatter->record_end();
+        hashers[i]->hash(out, cache);
+    }
+}
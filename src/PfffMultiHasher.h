@@ -0,0 +1,89 @@
+/**
+ * PfffMultiHasher.h: Fingerprinting each file with several option sets (keys, formats, block
+ * counts, ...) while reading every needed byte of it only once.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffMultiHasher_h__
+#define __PfffMultiHasher_h__
+#include <ostream>
+#include <vector>
+#include "PfffBlockReader.h"
+#include "PfffHasher.h"
+
+using std::ostream;
+using std::vector;
+
+/**
+ * A BlockReader answering the reads of several hashers from a single pass over another reader.
+ * While recording, reads are answered with zeroes and only noted. fetch() then reads the union of
+ * the noted ranges in one block sequence, after which the same reads are answered from memory.
+ */
+class SampleCacheBlockReader: public BlockReader {
+public:
+    /** The reader is not owned. */
+    SampleCacheBlockReader(BlockReader* reader);
+    
+    /**
+     * Stops recording and merges the recorded ranges where they overlap or touch.
+     * Their data is zero until filled by fetch() or capture().
+     */
+    void end_recording();
+    
+    /**
+     * end_recording(), then reads the ranges from the underlying reader. Returns false on error.
+     */
+    bool fetch();
+    
+    /**
+     * Finds the first range ending after offset. Returns false if there is none.
+     */
+    bool next_range(unsigned long long offset, unsigned long long& start, unsigned long long& end) const;
+    
+    /**
+     * Copies the parts of len bytes of the file, found at offset, which fall into the ranges.
+     * For filling the ranges from a stream instead of with fetch().
+     */
+    void capture(unsigned long long offset, const char* data, unsigned long len);
+    
+    long long _size();
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+
+protected:
+    BlockReader* reader;
+    bool recording;
+    struct Range {
+        unsigned long long start;
+        unsigned long long end;
+        unsigned long long offset;  // Of the data of the range in data
+        inline bool operator<(const Range& other) const { return start < other.start; }
+    };
+    vector<Range> ranges;
+    vector<char> data;
+};
+
+/**
+ * Computes the fingerprints of several hashers for each file (in the order of the hashers),
+ * by running each of them on zeroes first to learn the blocks it needs.
+ * With the adaptive mode, the blocks of the largest sample are read, as zeroes need them all.
+ */
+class PfffMultiHasher {
+public:
+    vector<PfffHasher*> hashers;    // Not owned
+    
+    /**
+     * Writes the fingerprints of all hashers, each but the last followed by formatter->record_end().
+     * On error throws pfff_exception with the proper message.
+     */
+    void hash(ostream& out, BlockReader* input_file);
+    
+    /**
+     * The two halves of hash() around the reading of the data: records the reads of all
+     * hashers into the cache, and computes their fingerprints from it once it has been filled.
+     */
+    void plan(SampleCacheBlockReader* cache);
+    void output(ostream& out, SampleCacheBlockReader* cache);
+};
+
+#endif
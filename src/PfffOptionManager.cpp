@@ -3,6 +3,9 @@
  * License:   The terms of use of this software and its source code are defined by the BSD license.
  */
 #include "PfffOptionManager.h"
+#include "PfffDaemon.h"
+#include "PfffHedgedBlockReader.h"
+#include <climits>
 #include <cstdlib>
 #include <getopt.h> 
 #include <string.h>
@@ -16,6 +19,60 @@ using std::cout;
 using std::endl;
 using std::vector;
 
+/**
+ * Maps a --format value to PFO_OF_*. Returns false if the format is unknown.
+ */
+static bool parse_format(const char* format, unsigned char& output_format) {
+    if (strcmp(format, "poly1305aes") == 0)
+        output_format = PFO_OF_POLY1305AES;
+    else if (strcmp(format, "md5") == 0) 
+        output_format = PFO_OF_MD5;
+    else if (strcmp(format, "csv") == 0) 
+        output_format = PFO_OF_CSV;
+    else if (strcmp(format, "debug") == 0)
+        output_format = PFO_OF_DEBUG;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * Applies the comma-separated overrides of an --also value to a copy of the main options.
+ */
+static PfffOptions parse_also(const PfffOptions& main_options, const string& settings) {
+    PfffOptions result = main_options;
+    string::size_type start = 0;
+    while (start <= settings.size()) {
+        string::size_type end = settings.find(',', start);
+        if (end == string::npos) end = settings.size();
+        string item = settings.substr(start, end - start);
+        string::size_type eq = item.find('=');
+        string name = item.substr(0, eq);
+        string value = eq == string::npos ? "" : item.substr(eq + 1);
+        char* value_end;
+        long number = strtol(value.c_str(), &value_end, 10);
+        bool is_number = !value.empty() && *value_end == '\0';
+        bool is_flag = value.empty() || (is_number && (number == 0 || number == 1));
+        long flag = value.empty() ? 1 : number;
+        
+        if (name == "key" && is_number && number >= PFO_KEY_MIN && number <= PFO_KEY_MAX)
+            result.key = number;
+        else if (name == "format" && parse_format(value.c_str(), result.output_format));
+        else if (name == "block-count" && is_number && number >= PFO_BC_MIN && number <= PFO_BC_MAX)
+            result.block_count = number;
+        else if (name == "block-size" && is_number && number >= PFO_BS_MIN && number <= PFO_BS_MAX)
+            result.block_size = number;
+        else if (name == "with-header" && is_number && number >= PFO_HBC_MIN && number <= PFO_HBC_MAX)
+            result.header_block_count = number;
+        else if (name == "with-size" && is_flag) result.with_size = flag;
+        else if (name == "without-replacement" && is_flag) result.without_replacement = flag;
+        else if (name == "adaptive" && is_flag) result.adaptive = flag;
+        else throw (char*)"Error: --also must be a comma-separated list of settings such as key=2 or format=md5.";
+        start = end + 1;
+    }
+    return result;
+}
+
 // ------------ PfffOptionManager ---------------
 PfffOptionManager::PfffOptionManager(): OptionManager(), TEST_MODE(false) {
     add_group("Basic Algorithm Options");
@@ -41,6 +98,16 @@ PfffOptionManager::PfffOptionManager(): OptionManager(), TEST_MODE(false) {
             "          hex-encoded values\n"
             "  debug - undocumented secret option\n"
             "Default is 'poly1305aes'.");
+        add_parameterized("output-mode", 'm', NULL, new CharPtrOption(&output_mode, "text"), "<mode>",
+            "Specify how the fingerprints are written out:\n"
+            "  text   - one line of text per file\n"
+            "  binary - a compact binary stream: a header with the\n"
+            "          parameter information, followed by a record\n"
+            "          of (digest, file size, filename) per file\n"
+            "  ndjson - one JSON object per line with the fields\n"
+            "          signature, digest, size and path\n"
+            "The binary and ndjson modes need the poly1305aes or md5\n"
+            "format. Default is 'text'.");
         add_unparameterized("no-prefix", 'b', &no_prefix, 
             "Do not prefix the output fingerprint with the encoded \n"
             "parameter information. Makes output smaller by some\n"
@@ -52,7 +119,7 @@ PfffOptionManager::PfffOptionManager(): OptionManager(), TEST_MODE(false) {
         add_unparameterized("help", 'h', &help, 
             "Output this help message to stdout.");
     add_group("Advanced Options");
-        add_parameterized("block-count", 'n', NULL, new BoundedLongIntOption(&block_count, PFO_BC_MIN, PFO_BC_MAX, PFO_BC_DEFAULT), "<num>",
+        add_parameterized("block-count", 'n', &block_count_given, new BoundedLongIntOption(&block_count, PFO_BC_MIN, PFO_BC_MAX, PFO_BC_DEFAULT), "<num>",
             "Number of blocks to sample. Default is " quote(PFO_BC_DEFAULT) ".\n"
             "Maximum is " quote(PFO_BC_MAX) ".");
         add_parameterized("block-size", 's', NULL, new BoundedLongIntOption(&block_size, PFO_BS_MIN, PFO_BS_MAX, PFO_BS_DEFAULT), "<num>",
@@ -61,6 +128,36 @@ PfffOptionManager::PfffOptionManager(): OptionManager(), TEST_MODE(false) {
         add_unparameterized("without-replacement", 'w', &without_replacement,
             "Sample without replacement (default is with\n"
             "replacement, it's faster).");
+        add_unparameterized("adaptive", 'a', &adaptive,
+            "Adapt the number of blocks to the content: start\n"
+            "with a quarter of --block-count and double the\n"
+            "sample while its estimated entropy is below " quote(PFO_ADAPTIVE_TARGET_BITS) " bits,\n"
+            "up to four times --block-count. Saves reads on\n"
+            "high-entropy data and strengthens the fingerprints of\n"
+            "sparse or repetitive files. The count used for each\n"
+            "file is recorded in its prefix, which makes it\n"
+            "incompatible with --no-prefix and the binary mode.");
+        add_parameterized("tiers", 't', &tiers_given, new CharPtrOption(&tiers, ""), "<list>",
+            "Output several fingerprints of each file, one for each\n"
+            "of the comma-separated block counts in <list>, e.g.\n"
+            "8,32,128: a cheap one for triage and stronger ones for\n"
+            "confirmation. The smaller samples are part of the\n"
+            "larger ones, so the file is read once, for the largest\n"
+            "count. Each fingerprint carries its block count in its\n"
+            "prefix, which makes this incompatible with --no-prefix\n"
+            "and the binary mode. Replaces --block-count.");
+        add_parameterized("also", 'A', NULL, new StringListOption(&also), "<settings>",
+            "Also output a fingerprint computed with other\n"
+            "settings, given as comma-separated overrides of the\n"
+            "main ones: key=<num>, format=<format>,\n"
+            "block-count=<num>, block-size=<num>, with-header=<num>,\n"
+            "with-size, without-replacement and adaptive (the last\n"
+            "three take an optional =0 or =1). May be repeated.\n"
+            "The blocks needed by all the fingerprints are read in\n"
+            "one pass, so e.g. -A key=2 -A format=md5 costs about\n"
+            "as much I/O as a single fingerprint. The fingerprints\n"
+            "of each file follow each other, the main one first.\n"
+            "Not supported with the binary mode.");
         add_parameterized("request-cost", 'c', &request_cost_given, new PositiveLongIntOption(&request_cost, 0), "<num>",
             "Cost of making a separate data read request, in bytes.\n"
             "It specifies that whenever the algorithm must request\n"
@@ -75,9 +172,119 @@ PfffOptionManager::PfffOptionManager(): OptionManager(), TEST_MODE(false) {
             "proceed to process all files. When this option is\n"
             "given, pfff will break as soon as any error occurs.");
         add_unparameterized("recursive", 'R', &recursive, 
-            "Recurse into subdirectories. Ignored for FTP access.");
+            "Recurse into subdirectories. On FTP and HTTP servers,\n"
+            "directories are listed with MLSD (or LIST) and with\n"
+            "WebDAV PROPFIND (or the index page of paths ending\n"
+            "with '/').");
         add_unparameterized("no-symlinks", 'L', &no_symlinks,
             "Ignore symlinks.");
+        add_parameterized("flush-every", 'u', &flush_every_given, new PositiveLongIntOption(&flush_every, 0), "<num>",
+            "Flush the output after every <num> fingerprints.\n"
+            "0 means the output is only written out in large\n"
+            "chunks, which is fastest when hashing many files.\n"
+            "Default is 1 when the output is a terminal and 0\n"
+            "otherwise.");
+        add_parameterized("check", 'C', &check_given, new CharPtrOption(&check, ""), "<manifest>",
+            "Instead of fingerprinting the given files, verify\n"
+            "the files listed in <manifest> (the output of an\n"
+            "earlier pfff run in any output mode, '-' for stdin).\n"
+            "Only mismatching, missing and unreadable files are\n"
+            "reported, followed by a summary line. The options\n"
+            "are taken from the manifest, so the manifest must\n"
+            "not be written with --no-prefix unless the same\n"
+            "options are given again.");
+        add_parameterized("threads", 'j', NULL, new PositiveLongIntOption(&threads, 4), "<num>",
+            "Number of files verified in parallel by --check, or\n"
+            "of archive members fingerprinted in parallel by\n"
+            "--tar. Default is 4. Use more for storage that serves many\n"
+            "concurrent requests well (SSDs, RAID, NFS).");
+        add_unparameterized("stats", 'T', &stats,
+            "Collect statistics on where the time goes (stat,\n"
+            "sampling, reads, post-hashing, output), on the bytes\n"
+            "requested and actually read and on how well the reads\n"
+            "were combined (see --request-cost). They are written\n"
+            "to stderr at exit, one tab-separated line per item.");
+        add_parameterized("stats-interval", 'I', &stats_interval_given, new PositiveLongIntOption(&stats_interval, 0), "<sec>",
+            "Also write the statistics to stderr every <sec>\n"
+            "seconds. Implies --stats.");
+        add_parameterized("stats-file", 'O', &stats_file_given, new CharPtrOption(&stats_file, ""), "<file>",
+            "Write the statistics at exit to <file> rather than\n"
+            "to stderr. Implies --stats.");
+        add_parameterized("trace", 'X', &trace_given, new CharPtrOption(&trace, ""), "<file>",
+            "Record every read made from the files (file, offset,\n"
+            "length, start and duration) in a binary trace in\n"
+            "<file>, for inspection and replay with pfff-trace.");
+        add_unparameterized("bgzf", 'Z', &bgzf,
+            "Fingerprint the uncompressed content of BGZF files\n"
+            "(BAM, bgzipped VCF, ...), so that the fingerprints do\n"
+            "not change with recompression. Only the compressed\n"
+            "blocks holding sampled bytes are read and inflated.\n"
+            "The block index is taken from <file>.gzi when there\n"
+            "is one, and is otherwise built from the block headers.");
+        add_unparameterized("tar", 'M', &tar,
+            "Treat the files as tar archives and fingerprint each of\n"
+            "their regular members in place, without extracting\n"
+            "them. The members are named <archive>!<member> in the\n"
+            "output, and a single one may be selected by giving\n"
+            "such a name. The archive headers are read one by one,\n"
+            "then --threads members are fingerprinted at a time,\n"
+            "each reading only its sample. Local archives only.");
+        add_unparameterized("tree", 'V', &tree,
+            "Output one fingerprint for each of the given\n"
+            "directories as a whole: that of a virtual file made\n"
+            "of the sorted listing of the (relative path, size) of\n"
+            "its files, followed by their contents. Only the files\n"
+            "holding sampled blocks are opened, so a tree costs\n"
+            "about --block-count reads, plus a stat of each file,\n"
+            "whatever the number of files. Local directories only.");
+        add_parameterized("schedule", 'Y', NULL, new PositiveLongIntOption(&schedule, 0), "<num>",
+            "Plan the reads of <num> files at a time and make them\n"
+            "in the order of their location on the disk (as told\n"
+            "by FIEMAP, or else in inode order), in one sweep of\n"
+            "the disk head per window, rather than file by file.\n"
+            "Sampled blocks in holes of sparse files are not read.\n"
+            "Pays off on spinning disks. The fingerprints are still\n"
+            "written in the order of the files. Local files only.");
+        add_parameterized("readahead", 'r', NULL, new PositiveLongIntOption(&readahead, 0), "<num>",
+            "While a file is hashed, have the kernel read ahead the\n"
+            "sampled blocks of the next <num> files (posix_fadvise),\n"
+            "so that their reads overlap with the hashing and with\n"
+            "each other even on a single thread. The fingerprints\n"
+            "are written <num> files later than otherwise, in the\n"
+            "same order. Local files only.");
+        add_parameterized("max-iops", 'i', NULL, new PositiveLongIntOption(&max_iops, 0), "<num>",
+            "Make at most <num> read requests per second to each\n"
+            "device (or FTP/HTTP host), so that a scan leaves\n"
+            "room for the other users of the storage. Short bursts\n"
+            "of up to a tenth of a second's worth are allowed.\n"
+            "The limits apply to the requests actually made, after\n"
+            "they are combined (see --request-cost). 0 (default)\n"
+            "means no limit.");
+        add_parameterized("max-bandwidth", 'y', NULL, new PositiveLongIntOption(&max_bandwidth, 0), "<num>",
+            "Read at most <num> bytes per second from each device\n"
+            "(or FTP/HTTP host). 0 (default) means no limit.");
+        add_parameterized("max-latency", 'l', NULL, new PositiveLongIntOption(&max_latency, 0), "<ms>",
+            "Back off while the reads from a device (or host) take\n"
+            "longer than <ms> milliseconds, a sign that the storage\n"
+            "is busy: each slow read doubles a pause made before\n"
+            "the next ones (up to a second), each fast one halves\n"
+            "it. 0 (default) means no backoff.");
+        add_unparameterized("idle", 'q', &idle,
+            "Run in the idle I/O scheduling class (like ionice -c3),\n"
+            "so that the disks serve pfff only when no one else\n"
+            "uses them. Linux only, and only honoured by the CFQ\n"
+            "and BFQ I/O schedulers; a warning is given when the\n"
+            "class cannot be set.");
+        add_unparameterized("tee", 'e', &tee,
+            "Copy stdin to stdout, fingerprinting the data on the\n"
+            "way, e.g. cat file | pfff --tee --size N > copy.\n"
+            "The fingerprint is that of the finished file and goes\n"
+            "to stderr. An optional file argument names the data\n"
+            "in the fingerprint (default '-'). Needs --size. Only\n"
+            "the sampled bytes pass through pfff itself, the rest\n"
+            "is moved by the kernel when stdin or stdout is a pipe.");
+        add_parameterized("size", 'z', &stream_size_given, new BoundedLongIntOption(&stream_size, 0, LONG_MAX, -1), "<num>",
+            "Size of the data given to --tee, in bytes.");
     add_group("Experimental Options");
         add_parameterized("ftp-host", 'F', &ftp_given, new CharPtrOption(&ftp_host, ""), "<hostname>",
             "Interpret all files as absolute paths on the\n"
@@ -85,9 +292,33 @@ PfffOptionManager::PfffOptionManager(): OptionManager(), TEST_MODE(false) {
         add_parameterized("http-host", 'W', &http_given, new CharPtrOption(&http_host, ""), "<hostname>",
             "Interpret all files as absolute paths on the\n"
             "given HTTP host.");
+        add_parameterized("pfffd-host", 'D', &pfffd_given, new CharPtrOption(&pfffd_host, ""), "<hostname>",
+            "Have the fingerprints computed by the pfffd server\n"
+            "running on the given host. Files are paths relative\n"
+            "to the root directory of the server. Only the\n"
+            "fingerprints travel over the network.");
         add_parameterized("port", 'P', &port_given, new PositiveLongIntOption(&port, -1), "<num>",
-            "Port for FTP/HTTP connection. Default is 21 for FTP and 80 for HTTP.");
+            "Port for FTP/HTTP/pfffd connection. Default is 21 for FTP,\n"
+            "80 for HTTP and " quote(PFFFD_DEFAULT_PORT) " for pfffd.");
         add_unparameterized("net-debug", 'G', &net_debug, "Output complete FTP/HTTP protocol log.");
+        add_parameterized("timeout", 'o', NULL, new PositiveLongIntOption(&timeout, 0), "<sec>",
+            "Give up on a connection to the FTP/HTTP/pfffd host\n"
+            "when connecting or sending takes longer than <sec>\n"
+            "seconds, or when no data arrives for <sec> seconds.\n"
+            "The file is then reported as failed. 0 (default)\n"
+            "waits forever.");
+        add_parameterized("hedge", 'g', NULL, new PositiveLongIntOption(&hedge, 0), "<ms>",
+            "Hedge the HTTP requests: when a reply takes longer\n"
+            "than the 95th percentile of the recent ones (<ms>\n"
+            "milliseconds until " quote(PFFF_LATENCY_MIN_SAMPLES) " replies are known), send\n"
+            "the same request again over another connection, to\n"
+            "the --alternate-host if given, and use the first\n"
+            "complete reply. A failed request is sent again at\n"
+            "once. With --stats, the hedged requests are counted.");
+        add_parameterized("alternate-host", 'N', &alternate_host_given, new CharPtrOption(&alternate_host, ""), "<hostname>",
+            "HTTP host (a mirror of --http-host) receiving the\n"
+            "duplicate requests of --hedge. Default is the\n"
+            "--http-host itself.");
         /*add_parameterized("ftp-request-cost", 'c', &ftp_request_cost_given, new PositiveLongIntOption(&ftp_request_cost, 1024000), "<num>",
             "Cost of making a separate data read request, in bytes.\n"
             "It specifies that whenever the algorithm must request\n"
@@ -113,6 +344,10 @@ void PfffOptionManager::print_usage(ostream& out) {
     "using a fast probabilistic method.\n"
     "\n"
     "Usage: pfff [options] <file1> <file2> ...\n"
+    "       pfff [options] --check <manifest>\n"
+    "       pfff [options] --tee --size <bytes> [<name>]\n"
+    "       pfff [options] --tar <archive>[!<member>] ...\n"
+    "       pfff [options] --tree <directory> ...\n"
     "\n"
     "Parameters:\n"
     "    <file1>, <file2>, ...: paths or names of the files to be fingerprinted.\n"
@@ -137,19 +372,61 @@ void PfffOptionManager::die_with_error(const string& message) {
 bool PfffOptionManager::validate() {
     if (help) return true;
     try {
-    	if (parameters.size() == 0)
+    	if (bgzf && (pfffd_given || tee))
+    		throw (char*)"Error: --bgzf is not supported with --pfffd-host and --tee.";
+    	if (tar && (check_given || tee || bgzf || trace_given || http_given || ftp_given || pfffd_given))
+    		throw (char*)"Error: --tar only reads local archives and is not supported with --check, --tee, --bgzf and --trace.";
+    	if (tree && (check_given || tee || bgzf || tar || trace_given || http_given || ftp_given || pfffd_given))
+    		throw (char*)"Error: --tree only reads local directories and is not supported with --check, --tee, --bgzf, --tar and --trace.";
+    	if (schedule > 0 && (check_given || tee || bgzf || tar || tree || http_given || ftp_given || pfffd_given))
+    		throw (char*)"Error: --schedule only reads local files and is not supported with --check, --tee, --bgzf, --tar and --tree.";
+    	if (readahead > 0 && (check_given || tee || bgzf || tar || tree || schedule > 0 || http_given || ftp_given || pfffd_given))
+    		throw (char*)"Error: --readahead only reads local files and is not supported with --check, --tee, --bgzf, --tar, --tree and --schedule.";
+    	if ((max_iops > 0 || max_bandwidth > 0 || max_latency > 0) && pfffd_given)
+    		throw (char*)"Error: --max-iops, --max-bandwidth and --max-latency are not supported with --pfffd-host.";
+    	if (recursive && pfffd_given)
+    		throw (char*)"Error: --recursive is not supported with --pfffd-host: pfffd does not list directories.";
+    	if (hedge > 0 && !http_given)
+    		throw (char*)"Error: --hedge is only supported with --http-host.";
+    	if (alternate_host_given && hedge == 0)
+    		throw (char*)"Error: --alternate-host is only used with --hedge.";
+    	if (tee) {
+    		if (!stream_size_given)
+    			throw (char*)"Error: --tee needs the --size of the data.";
+    		if (parameters.size() > 1)
+    			throw (char*)"Error: --tee takes at most one name for the data.";
+    		if (check_given || http_given || ftp_given || pfffd_given || trace_given)
+    			throw (char*)"Error: --tee is not supported with --check, --trace and remote hosts.";
+    	}
+    	else if (stream_size_given)
+    		throw (char*)"Error: --size is only used with --tee.";
+    	if (parameters.size() == 0 && !check_given && !tee)
     		throw (char*)"Error: No files to process.";
+    	if (parameters.size() > 0 && check_given)
+    		throw (char*)"Error: With --check, files are listed in the manifest only.";
+    	if (check_given && (http_given || ftp_given))
+    		throw (char*)"Error: --check only verifies local files.";
+    	if (threads < 1)
+    		throw (char*)"Error: Number of threads must be at least 1.";
+    	if (stats_interval_given || stats_file_given) stats = 1;
+    	if (stats && check_given)
+    		throw (char*)"Error: --stats is not supported with --check.";
+    	if (trace_given && (check_given || pfffd_given))
+    		throw (char*)"Error: --trace is not supported with --check and --pfffd-host.";
     	if (!key_given) {
             // Previous version: srand ( time(NULL) ); key = rand(); Not intuitive.
             key = 1; 
         }
-        if (http_given && ftp_given)
-            throw (char*)"Error: Both HTTP and FTP may not be requested.";
+        if ((http_given != 0) + (ftp_given != 0) + (pfffd_given != 0) > 1)
+            throw (char*)"Error: Only one of HTTP, FTP and pfffd may be requested.";
+        if (check_given && pfffd_given)
+            throw (char*)"Error: --check only verifies local files.";
         
         // Set default port
         if (!port_given) {
             if (http_given) port = 80;
             else if (ftp_given) port = 21;
+            else if (pfffd_given) port = PFFFD_DEFAULT_PORT;
         }
 
     	// If we're using ftp and haven't specified request_cost, set a 
@@ -158,27 +435,59 @@ bool PfffOptionManager::validate() {
     	
     	// Now fill in the options structure
         pfff_options_init(&options, key);
-    	if (strcmp(format, "poly1305aes") == 0)
-    		options.output_format = PFO_OF_POLY1305AES;
-    	else if (strcmp(format, "md5") == 0) 
-    		options.output_format = PFO_OF_MD5;
-    	else if (strcmp(format, "csv") == 0) 
-    		options.output_format = PFO_OF_CSV;
-    	else if (strcmp(format, "debug") == 0)
-    		options.output_format = PFO_OF_DEBUG;
-    	else
+    	if (!parse_format(format, options.output_format))
     		throw (char*)"Error: Unrecognized output format.";
+    	if (strcmp(output_mode, "text") == 0)
+    		options.output_mode = PFO_OM_TEXT;
+    	else if (strcmp(output_mode, "binary") == 0)
+    		options.output_mode = PFO_OM_BINARY;
+    	else if (strcmp(output_mode, "ndjson") == 0)
+    		options.output_mode = PFO_OM_NDJSON;
+    	else
+    		throw (char*)"Error: Unrecognized output mode.";
         options.block_count = block_count;
         options.block_size = block_size;
         options.header_block_count = header_block_count;
         options.without_replacement = without_replacement;
         options.with_size = with_size;
+        options.adaptive = adaptive;
         options.no_prefix = no_prefix;
         options.no_filename = no_filename;
         
         char* errmsg;
-        if (pfff_options_validate(&options, &errmsg)) return true;
-        else throw errmsg;
+        if (!pfff_options_validate(&options, &errmsg)) throw errmsg;
+        if (pfffd_given && options.output_format != PFO_OF_POLY1305AES && options.output_format != PFO_OF_MD5)
+            throw (char*)"Error: pfffd only computes poly1305aes and md5 fingerprints.";
+        if (pfffd_given && adaptive)
+            throw (char*)"Error: --adaptive is not supported with --pfffd-host.";
+        if (tiers_given) {
+            if (block_count_given || adaptive || check_given || pfffd_given)
+                throw (char*)"Error: --tiers is not supported with --block-count, --adaptive, --check and --pfffd-host.";
+            if (options.output_mode == PFO_OM_BINARY || no_prefix)
+                throw (char*)"Error: --tiers needs the text or NDJSON output mode with the prefix.";
+            tier_counts.clear();
+            const char* p = tiers;
+            while (true) {
+                char* end;
+                long count = strtol(p, &end, 10);
+                if (end == p || count < PFO_BC_MIN || count > PFO_BC_MAX || (*end != ',' && *end != '\0'))
+                    throw (char*)"Error: --tiers must be a comma-separated list of block counts.";
+                tier_counts.push_back(count);
+                if (count > options.block_count || tier_counts.size() == 1) options.block_count = count;
+                if (*end == '\0') break;
+                p = end + 1;
+            }
+        }
+        also_options.clear();
+        if (also.size() > 0) {
+            if (options.output_mode == PFO_OM_BINARY || check_given || pfffd_given)
+                throw (char*)"Error: --also is not supported with the binary mode, --check and --pfffd-host.";
+            for (int i = 0; i < also.size(); i++) {
+                also_options.push_back(parse_also(options, also[i]));
+                if (!pfff_options_validate(&also_options.back(), &errmsg)) throw errmsg;
+            }
+        }
+        return true;
     }
     catch(char* msg) {
         error_message = string(msg);
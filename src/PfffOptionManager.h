@@ -8,9 +8,11 @@
 #define __PfffOptionManager_h__
 #include <iostream>
 #include <stdint.h>
+#include <vector>
 #include "OptionManager.h"
 #include "PfffOptions.h"
 using std::ostream;
+using std::vector;
 
 /**
  * Command-line option parser, with documentation, validation and stuff...
@@ -22,13 +24,21 @@ public:
     bool TEST_MODE;
         
     const char* format;
+    const char* output_mode;
     long  key;
     int   key_given;
     long  block_count;
+    int   block_count_given;
     long  block_size;
     long  header_block_count;
     int   without_replacement;
     int   with_size;
+    int   adaptive;
+    const char* tiers;
+    int   tiers_given;
+    vector<unsigned long> tier_counts;  // Parsed --tiers
+    vector<string> also;
+    vector<PfffOptions> also_options;   // Parsed --also, in the order given
     int   no_prefix;
     int   no_filename;
 
@@ -38,6 +48,30 @@ public:
     int   fail_on_error;
     int   recursive;
     int   no_symlinks;
+    long  flush_every;
+    int   flush_every_given;
+    int   check_given;
+    const char* check;
+    long  threads;
+    int   stats;
+    long  stats_interval;
+    int   stats_interval_given;
+    const char* stats_file;
+    int   stats_file_given;
+    const char* trace;
+    int   trace_given;
+    int   bgzf;
+    int   tar;
+    int   tree;
+    long  schedule;
+    long  readahead;
+    long  max_iops;
+    long  max_bandwidth;
+    long  max_latency;
+    int   idle;
+    int   tee;
+    long  stream_size;
+    int   stream_size_given;
 
     int   ftp_given;
     const char* ftp_host;
@@ -46,8 +80,14 @@ public:
 
     int http_given;
     const char* http_host;
+    int pfffd_given;
+    const char* pfffd_host;
     long  port;
     int   port_given;
+    long  timeout;
+    long  hedge;
+    int   alternate_host_given;
+    const char* alternate_host;
     int   net_debug;
 
     string error_message;
@@ -29,6 +29,14 @@ int pfff_options_validate(PfffOptions* options, char** error_message) {
             options->output_format != PFO_OF_CSV &&
             options->output_format != PFO_OF_DEBUG)
             throw "Error: Unrecognized output format.";
+        if (options->output_mode != PFO_OM_TEXT &&
+            options->output_mode != PFO_OM_BINARY &&
+            options->output_mode != PFO_OM_NDJSON)
+            throw "Error: Unrecognized output mode.";
+        if (options->output_mode != PFO_OM_TEXT && 
+            options->output_format != PFO_OF_POLY1305AES && 
+            options->output_format != PFO_OF_MD5)
+            throw "Error: Binary and NDJSON output modes require the poly1305aes or md5 format.";
         if (options->key < PFO_KEY_MIN || options->key > PFO_KEY_MAX)
             throw "Error: Invalid value for the key.";
         if (options->block_count < PFO_BC_MIN || options->block_count > PFO_BC_MAX)
@@ -37,10 +45,23 @@ int pfff_options_validate(PfffOptions* options, char** error_message) {
             throw "Error: Invalid value for the block size parameter.";
         if (options->header_block_count < PFO_HBC_MIN || options->header_block_count > PFO_HBC_MAX)
             throw "Error: Invalid value for the header block count parameter.";
+        if (options->adaptive && (options->output_mode == PFO_OM_BINARY || options->no_prefix))
+            throw "Error: The adaptive block count needs the text or NDJSON output mode with the prefix.";
         return 1;
     }
-    catch (char* msg) {
-        if (error_message != NULL) (*error_message) = msg;
+    catch (const char* msg) {
+        if (error_message != NULL) (*error_message) = (char*)msg;
         return 0;
     }
 }
+
+unsigned long pfff_options_min_block_count(const PfffOptions* options) {
+    if (!options->adaptive) return options->block_count;
+    return options->block_count >= 4 ? options->block_count / 4 : 1;
+}
+
+unsigned long pfff_options_max_block_count(const PfffOptions* options) {
+    if (!options->adaptive) return options->block_count;
+    unsigned long n = 4UL * options->block_count;
+    return n > PFO_BC_MAX ? PFO_BC_MAX : n;
+}
@@ -20,6 +20,10 @@
 #define PFO_OF_DEBUG    10
 
 #define PFO_OF_DEFAULT PFO_OF_POLY1305AES
+
+#define PFO_OM_TEXT     0
+#define PFO_OM_BINARY   1
+#define PFO_OM_NDJSON   2
 #define PFO_BC_DEFAULT 32
 #define PFO_BC_DEFAULT_SMALL 11
 #define PFO_BS_DEFAULT 1
@@ -34,6 +38,9 @@
 #define PFO_HBC_MIN 0
 #define PFO_HBC_MAX 1048575
 
+// Entropy (in bits) the adaptive mode wants the sampled blocks to carry
+#define PFO_ADAPTIVE_TARGET_BITS 128
+
 struct PfffOptions {
     // Structure version, must be equal to PFO_VERSION
     unsigned char version;
@@ -50,6 +57,27 @@ struct PfffOptions {
     // Output options
  	unsigned char no_prefix;
     unsigned char no_filename;
+    unsigned char output_mode;    // TEXT=0, BINARY=1, NDJSON=2 (see PfffOutputFormatter). 
+                                  // BINARY and NDJSON need a binary digest (POLY1305AES or MD5).
+
+    // Sampling options (kept after the output options so that the older fields keep their offsets)
+    unsigned char adaptive;       // Adapt the block count to the entropy of the sample, see PfffHasher::read_sample.
+                                  // The count used goes into the signature of each fingerprint, so it needs
+                                  // the prefix and a per-record signature (TEXT or NDJSON).
+} __attribute__((packed));
+
+/**
+ * Represents the algorithm options as a short string, usable for recomputing
+ * or validating hashes later (see PfffOptionsSignature in PfffOutputFormatter.h).
+ * TODO:NB: This option-serialization is endian-specific.
+ */
+struct PfffOptionsSignatureStruct {
+    char versionAndOutput;
+    uint32_t key;
+    uint16_t block_count;
+    uint16_t block_size;
+    uint32_t header_block_count;
+    char flags;
 } __attribute__((packed));
 
 extern "C" {
@@ -65,6 +93,13 @@ void pfff_options_init(PfffOptions* options, uint32_t key);
  */
 int pfff_options_validate(PfffOptions* options, char** error_message);
 
+/**
+ * The range of block counts a fingerprint may use: from a quarter to four times block_count
+ * (at most PFO_BC_MAX) in the adaptive mode, just block_count otherwise.
+ */
+unsigned long pfff_options_min_block_count(const PfffOptions* options);
+unsigned long pfff_options_max_block_count(const PfffOptions* options);
+
 }
 
 #endif
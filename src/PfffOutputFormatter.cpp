@@ -11,21 +11,21 @@ using std::endl;
 
 //------------- PfffOutputFormatter -------------
 
-PfffOutputFormatter::PfffOutputFormatter(const PfffOptions* opts): opts(opts) {
+PfffOutputFormatter::PfffOutputFormatter(const PfffOptions* opts): opts(opts), sample_size(0), file_size(0) {
     // hash = [options_signature ':'] hash([<file size>:8] [<header>:?] <content>:?)
     
-    // Initialize memory
-    data_len = (opts->header_block_count + opts->block_count)*opts->block_size;
-    if (opts->with_size) data_len += 8;
-    data = new char[data_len];		
+    // Initialize memory (for the largest block count, in the adaptive mode)
     content_offset = opts->with_size ? 8 : 0;
+    data = new char[(opts->header_block_count + pfff_options_max_block_count(opts))*opts->block_size + content_offset];
+    block_count = opts->block_count;
+    data_len = (opts->header_block_count + block_count)*opts->block_size + content_offset;
     // TODO: Most hashes are usable in an incrementable fashion, and hence would not need
     // to initialize the whole array. This would make code less memory-hungry
     // (however in most cases the array is small-sized and preallocating it might make
     // things faster).
     
-    // Precompute signature
-    if (!opts->no_prefix) signature = PfffOptionsSignature(opts);
+    // Precompute signature (also needed by output_digest users when no_prefix is set)
+    signature = PfffOptionsSignature(opts);
     
     // Initialize post-hasher
     switch(opts->output_format) {
@@ -53,6 +53,27 @@ PfffOutputFormatter::~PfffOutputFormatter() {
 };
 
 
+// Little-endian serialization helpers for the binary output mode
+static inline void output_le32(ostream& out, uint32_t v) {
+    char b[4];
+    for (int i = 0; i < 4; i++) b[i] = (char)(v >> (8*i));
+    out.write(b, 4);
+}
+
+static inline void output_le64(ostream& out, uint64_t v) {
+    char b[8];
+    for (int i = 0; i < 8; i++) b[i] = (char)(v >> (8*i));
+    out.write(b, 8);
+}
+
+void PfffOutputFormatter::output_header(ostream& out) const {
+    if (opts->output_mode != PFO_OM_BINARY) return;
+    out.write("PFFF", 4);
+    out.put((char)PFFF_MANIFEST_VERSION);
+    out.put((char)post_hasher->digest_len());
+    out.write(signature.text, sizeof(PfffOptionsSignature));
+}
+
 /** 
  * Writes out the properly formatted hash.
  * The filename is needed if !opts.no_filename is given.
@@ -60,6 +81,13 @@ PfffOutputFormatter::~PfffOutputFormatter() {
  * it can be null.
  */
 void PfffOutputFormatter::output_hash(ostream& out) const {
+    if (post_hasher->digest_len() > 0) {
+        unsigned char digest[16];
+        output_digest(digest);
+        output_record(out, digest);
+        return;
+    }
+
     // Unless we use the DebugHasher (which outputs filename and hash signature automatically)
     // we need to check for these properties.
     if (opts->output_format != PFO_OF_DEBUG) {
@@ -78,3 +106,37 @@ void PfffOutputFormatter::output_hash(ostream& out) const {
     
 }
 
+void PfffOutputFormatter::output_record(ostream& out, const unsigned char* digest) const {
+    int digest_len = post_hasher->digest_len();
+    if (opts->output_mode == PFO_OM_BINARY) {
+        long path_len = opts->no_filename ? 0 : filename.size();
+        output_le32(out, digest_len + 8 + path_len);
+        out.write((char*)digest, digest_len);
+        output_le64(out, file_size);
+        out.write(filename.data(), path_len);
+    }
+    else if (opts->output_mode == PFO_OM_NDJSON) {
+        out << '{';
+        if (!opts->no_prefix) {
+            out << "\"signature\":\"";
+            signature.print(out);
+            out << "\",";
+        }
+        out << "\"digest\":\"";
+        post_hasher->output_digest(out, digest);
+        out << "\",\"size\":" << file_size;
+        if (!opts->no_filename) {
+            out << ",\"path\":";
+            output_json_string(out, filename.data(), filename.size());
+        }
+        out << '}';
+    }
+    else {
+        if (!opts->no_prefix) {
+            signature.print(out);
+            out << ':';
+        }
+        post_hasher->output_digest(out, digest);
+        if (!opts->no_filename) out << "\t" << filename;
+    }
+}
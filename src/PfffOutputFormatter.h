@@ -13,22 +13,11 @@
 
 using std::string;
 
-/**
- * Represents the algorithm options as a short string, usable for recomputing
- * or validating hashes later.
- * TODO:NB: This option-serialization is endian-specific.
- */
-struct PfffOptionsSignatureStruct {
-    char versionAndOutput;
-    uint32_t key;
-    uint16_t block_count;
-    uint16_t block_size;
-    uint32_t header_block_count;
-    char flags;
-} __attribute__((packed));
+// Version of the binary output mode layout (see PfffOutputFormatter::output_header)
+#define PFFF_MANIFEST_VERSION 1
 
 /**
- * For convenience of access to PfffOptionsSignatureStruct
+ * For convenience of access to PfffOptionsSignatureStruct (see PfffOptions.h)
  */
 union PfffOptionsSignature {
     PfffOptionsSignatureStruct values;
@@ -37,13 +26,15 @@ union PfffOptionsSignature {
     inline PfffOptionsSignature() {};
     inline PfffOptionsSignature(const PfffOptions* opts) {
     	// <options> = [version:output:1][key:4][blockcount:2][blocksize:2][with_header:4][flags:1]
-    	// flags = 000000[without_replacement:1bit][with_size:1bit]
+    	// flags = 00000[adaptive:1bit][without_replacement:1bit][with_size:1bit]
+    	// In the adaptive mode, blockcount is the count used for the particular file: the fingerprint
+    	// is the same as the one computed with that block count and without the adaptive mode.
     	values.versionAndOutput = (char)opts->output_format + (opts->version << 4);
     	values.key = opts->key;
     	values.block_count = opts->block_count;
     	values.block_size =  opts->block_size;
     	values.header_block_count = opts->header_block_count;
-    	values.flags = (opts->without_replacement << 1) + opts->with_size;
+    	values.flags = (opts->adaptive << 2) + (opts->without_replacement << 1) + opts->with_size;
     }
     
     /**
@@ -71,6 +62,8 @@ public:
     PfffOptionsSignature signature;
     string filename;
     long sample_size;
+    long long file_size;
+    long block_count;   // Number of sampled blocks in data: opts->block_count, unless in the adaptive mode
     
     // Data to be hashed
     char* data;
@@ -92,15 +85,33 @@ public:
     inline char* get_content_buffer() {	return data + content_offset; }
     
     /**
-     * If we wish to use file size in hashing, report it to the formatter using this value.
+     * Size of the binary digest produced by output_digest (0 for text-only formats like CSV).
+     */
+    inline int digest_len() const { return post_hasher->digest_len(); }
+    
+    /**
+     * Report the file size to the formatter. It goes into the hash if we wish to use file size in hashing,
+     * and into the records of the binary and NDJSON output modes.
      */
     inline void set_file_size(long long file_size) {
+        this->file_size = file_size;
         if (opts->with_size) {
             uint64_t file_size_64 = (uint64_t)file_size;
             memcpy(data, (void*)&file_size_64, 8);
         }
     }
     
+    /**
+     * In the adaptive mode, sets the number of sampled blocks of the current file
+     * (between pfff_options_min_block_count and pfff_options_max_block_count).
+     * It goes into the signature and determines the length of the hashed data.
+     */
+    inline void set_block_count(long block_count) {
+        this->block_count = block_count;
+        data_len = (opts->header_block_count + block_count)*opts->block_size + content_offset;
+        signature.values.block_count = block_count;
+    }
+    
     /**
      * We also need to know the file name, if the user requested to output these.
      */
@@ -111,10 +122,10 @@ public:
     /**
      * If the size of the sample was less than block_count, tell the formatter to
      * fill the remainder of data with zeroes.
-     * True sample size may not be greater than opts.block_count.
+     * True sample size may not be greater than block_count.
      */
     inline void set_sample_size(long sample_size) {
-        long unfilled = opts->block_count - sample_size;
+        long unfilled = block_count - sample_size;
         this->sample_size = sample_size;
         if (unfilled > 0) {
             // Fill [content + sample_size .. content + block_count)
@@ -141,6 +152,35 @@ public:
      * it can be null.
      */
     void output_hash(ostream& out) const;
+    
+    /**
+     * Writes whatever must precede the fingerprints in the output stream.
+     * Only the binary output mode has a header:
+     *   <magic "PFFF":4> <manifest version:1> <digest length:1> <options signature:14>
+     * after which follow the records:
+     *   <record length (not including this field):4> <digest> <file size:8> <path>
+     * All integers are little-endian.
+     */
+    void output_header(ostream& out) const;
+    
+    /**
+     * Same as output_hash, but for a digest that was computed elsewhere (e.g. by pfffd).
+     * The filename and file size must have been reported to the formatter before.
+     * Only for formats with a binary digest (digest_len() > 0).
+     */
+    void output_record(ostream& out, const unsigned char* digest) const;
+    
+    /**
+     * Separator to write after each output_hash (a newline for the line-based modes).
+     */
+    inline const char* record_end() const { return opts->output_mode == PFO_OM_BINARY ? "" : "\n"; }
+    
+    /**
+     * Writes the raw hash bytes (digest_len() of them) instead of the text representation.
+     */
+    inline void output_digest(unsigned char* digest) const {
+        post_hasher->compute_digest(digest, data, data_len);
+    }
 };
     
 #endif
@@ -4,21 +4,69 @@
  */
 #include "PfffPostHashing.h"
 
+#include <algorithm>
 #include <ostream>
 #include <stdint.h>
 #include <string.h>
+#include <vector>
 
 #include "md5.h"
+#include "PfffBatchHashing.h"
 #include "MTwister.h"
 #include "poly1305aes_any.h"
 #include "output_utils.h"
 
 using std::ostream;
+using std::vector;
 
 #include <iostream>
 using std::cout;
 using std::endl;
 
+// ------------- PostHasher -----------
+
+void PostHasher::output_digest(ostream& out, const unsigned char* digest) const {
+    output_hex(out, (char*)digest, digest_len());
+}
+
+void PostHasher::compute_digests(unsigned char* digests, const char* const* data, const long* data_len, int n) const {
+    for (int i = 0; i < n; i++) compute_digest(digests + i*digest_len(), data[i], data_len[i]);
+}
+
+/**
+ * Orders message indices by length, so that messages of equal length are adjacent.
+ */
+struct LengthOrder {
+    const long* data_len;
+    LengthOrder(const long* data_len): data_len(data_len) {}
+    inline bool operator()(int a, int b) const { return data_len[a] < data_len[b]; }
+};
+
+/**
+ * Splits the messages into groups of up to PFFF_HASH_LANES messages of equal length, and calls
+ * hash_group(group_digests, group_data, len, group_size) for each of them.
+ */
+template <typename HashGroup>
+static void for_each_lane_group(unsigned char* digests, const char* const* data, const long* data_len, int n, HashGroup hash_group) {
+    vector<int> order(n);
+    for (int i = 0; i < n; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), LengthOrder(data_len));
+    const char* group_data[PFFF_HASH_LANES];
+    unsigned char group_digests[16*PFFF_HASH_LANES];
+    int i = 0;
+    while (i < n) {
+        long len = data_len[order[i]];
+        int group_size = 0;
+        while (i + group_size < n && group_size < PFFF_HASH_LANES && data_len[order[i + group_size]] == len) {
+            group_data[group_size] = data[order[i + group_size]];
+            group_size++;
+        }
+        hash_group(group_digests, group_data, len, group_size);
+        for (int j = 0; j < group_size; j++) memcpy(digests + 16*order[i + j], group_digests + 16*j, 16);
+        i += group_size;
+    }
+}
+
 /**
  * On initialization creates a its 32-byte secret key using MTwister.
  * Uses zero for nonce.
@@ -38,22 +86,64 @@ Poly1305AesHasher::Poly1305AesHasher(uint32_t key) {
         memcpy(secret_key + i*4, (char*)&l, 4);
     }
     poly1305aes_clamp(secret_key);
+    
+    // The authenticator of the empty message is AES_k(nonce) itself
+    poly1305aes_authenticate(aes_nonce, secret_key, nonce, nonce, 0);
 }
 
 void Poly1305AesHasher::output_hash(ostream& out, const char* data, long data_len) const {
     unsigned char output[16];
-    poly1305aes_authenticate(output, secret_key, nonce, (unsigned char*)data, data_len);
-    output_hex(out, (char*)output, 16);
+    compute_digest(output, data, data_len);
+    output_digest(out, output);
+}
+
+void Poly1305AesHasher::compute_digest(unsigned char* digest, const char* data, long data_len) const {
+    poly1305aes_authenticate(digest, secret_key, nonce, (unsigned char*)data, data_len);
+}
+
+/**
+ * Hashes a group of equal-length messages with Poly1305 and the precomputed AES of the nonce.
+ */
+struct Poly1305Group {
+    const Poly1305AesHasher* hasher;
+    Poly1305Group(const Poly1305AesHasher* hasher): hasher(hasher) {}
+    inline void operator()(unsigned char* digests, const char* const* data, long len, int n) const {
+        poly1305_lanes(digests, hasher->secret_key + 16, hasher->aes_nonce, data, len, n);
+    }
+};
+
+void Poly1305AesHasher::compute_digests(unsigned char* digests, const char* const* data, const long* data_len, int n) const {
+    for_each_lane_group(digests, data, data_len, n, Poly1305Group(this));
 }
 
 
 // ---------------- Md5Hasher -------------
 
 void Md5Hasher::output_hash(ostream& out, const char* data, long data_len) const {
+    unsigned char output[16];
+    compute_digest(output, data, data_len);
+    output_digest(out, output);
+}
+
+void Md5Hasher::output_digest(ostream& out, const unsigned char* digest) const {
+    output_hex(out, (char*)digest, 16, true); // MD5 digests are conventionally lowercase
+}
+
+void Md5Hasher::compute_digest(unsigned char* digest, const char* data, long data_len) const {
     MD5 md5;
     md5.update(data, data_len);
     md5.finalize();
-    out << md5.hexdigest();
+    md5.rawdigest(digest);
+}
+
+struct Md5Group {
+    inline void operator()(unsigned char* digests, const char* const* data, long len, int n) const {
+        md5_lanes(digests, data, len, n);
+    }
+};
+
+void Md5Hasher::compute_digests(unsigned char* digests, const char* const* data, const long* data_len, int n) const {
+    for_each_lane_group(digests, data, data_len, n, Md5Group());
 }
 
 
@@ -79,7 +169,9 @@ void CsvHasher::output_hash(ostream& out, const char* data, long data_len) const
         cur_offset += opts->header_block_count * opts->block_size;
     }
     
-    for (i = 0; i < opts->block_count-1; i++) {
+    // The block count varies in the adaptive mode
+    long block_count = (data_len - cur_offset) / opts->block_size;
+    for (i = 0; i < block_count-1; i++) {
         output_hex(out, data + cur_offset + i*opts->block_size, opts->block_size);
         out << ",";
     }
@@ -97,17 +189,19 @@ DebugHasher::DebugHasher(const PfffOptions* opts): opts(opts) {
 
 void DebugHasher::output_hash(ostream& out, const char* data, long data_len) const {
     long cur_offset = 0;
+    long block_count = (data_len - (opts->with_size ? 8 : 0)) / opts->block_size - opts->header_block_count;
     if (!opts->no_filename) out << "FILE:\t" << filename << endl;
     if (!opts->no_prefix) {
         out << "SIGNATURE:\t";
         out << "Ver=" << opts->version << ';';
         out << "Out=" << opts->output_format << ';';
         out << "Key=" << opts->key << ';';
-        out << "N="   << opts->block_count << ';';
+        out << "N="   << block_count << ';';
         out << "BSz=" << opts->block_size << ';';
         out << "Hdr=" << opts->header_block_count << ';';
         out << "FSz=" << (opts->with_size ? 'y' : 'n') << ';';
         out << "Rpl=" << (opts->without_replacement ? 'n' : 'y') << ';';
+        if (opts->adaptive) out << "Adp=y;";
         out << endl;
     }
     if (opts->with_size) {
@@ -123,7 +217,7 @@ void DebugHasher::output_hash(ostream& out, const char* data, long data_len) con
         cur_offset += header_size;
         out << endl;
     }
-    long data_size = opts->block_count*opts->block_size;
+    long data_size = block_count*opts->block_size;
     out << "DATA (" << data_size << " bytes):\n";
     output_hex(out, data+cur_offset, data_size);
     out << endl;
@@ -31,6 +31,30 @@ public:
      * between invocations for different files.
      */
     virtual void output_hash(ostream& out, const char* data, long data_len) const = 0;
+    
+    /**
+     * Size in bytes of the binary digest produced by compute_digest, or 0
+     * for hashers that only produce text (e.g. CSV).
+     */
+    virtual int digest_len() const { return 0; }
+    
+    /**
+     * Hashes the given data into digest_len() raw bytes.
+     * output_hash is equivalent to a hex-encoded compute_digest for hashers that support it.
+     */
+    virtual void compute_digest(unsigned char* digest, const char* data, long data_len) const {};
+    
+    /**
+     * Same as compute_digest for n messages: the digest of data[i] (of data_len[i] bytes) goes
+     * to digests + i*digest_len(). Hashers that can, hash messages of equal length together.
+     */
+    virtual void compute_digests(unsigned char* digests, const char* const* data, const long* data_len, int n) const;
+    
+    /**
+     * Writes a digest produced by compute_digest in the text form used by output_hash.
+     */
+    virtual void output_digest(ostream& out, const unsigned char* digest) const;
+    
     virtual ~PostHasher() {};
 };
 
@@ -42,10 +66,14 @@ class Poly1305AesHasher: public PostHasher {
 public:
     unsigned char secret_key[32];
     unsigned char nonce[16];
+    unsigned char aes_nonce[16];    // AES of the nonce under the key, the same for all messages
     
     Poly1305AesHasher(uint32_t key);
     
     void output_hash(ostream& out, const char* data, long data_len) const;
+    inline int digest_len() const { return 16; }
+    void compute_digest(unsigned char* digest, const char* data, long data_len) const;
+    void compute_digests(unsigned char* digests, const char* const* data, const long* data_len, int n) const;
 };
 
 
@@ -55,6 +83,10 @@ public:
 class Md5Hasher: public PostHasher {
 public:
     void output_hash(ostream& out, const char* data, long data_len) const;
+    inline int digest_len() const { return 16; }
+    void compute_digest(unsigned char* digest, const char* data, long data_len) const;
+    void compute_digests(unsigned char* digests, const char* const* data, const long* data_len, int n) const;
+    void output_digest(ostream& out, const unsigned char* digest) const;
 };
 
 
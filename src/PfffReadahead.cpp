@@ -0,0 +1,69 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffReadahead.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+// ------------- PfffReadahead ----------------
+
+PfffReadahead::PfffReadahead(const PfffMultiHasher& hashers):
+    advised_ranges(0), advised_bytes(0), hashers(hashers) {
+}
+
+PfffReadahead::~PfffReadahead() {
+    for (int i = 0; i < files.size(); i++) {
+        delete files[i].cache;
+        delete files[i].reader;
+    }
+}
+
+void PfffReadahead::add(BlockReader* reader) {
+    PlannedFile file;
+    file.reader = reader;
+    file.cache = new SampleCacheBlockReader(reader);
+    try {
+        hashers.plan(file.cache);
+        file.cache->end_recording();
+        advise(reader->get_filename(), file.cache);
+    }
+    catch (pfff_exception& e) {
+        file.error = e.what();
+    }
+    files.push_back(file);
+}
+
+void PfffReadahead::advise(const string& filename, const SampleCacheBlockReader* cache) {
+#ifdef POSIX_FADV_WILLNEED
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return;     // The error is reported when the file is read
+    unsigned long long start, end, offset = 0;
+    while (cache->next_range(offset, start, end)) {
+        // Only a hint: failures do not matter
+        posix_fadvise(fd, start, end - start, POSIX_FADV_WILLNEED);
+        advised_ranges++;
+        advised_bytes += end - start;
+        offset = end;
+    }
+    close(fd);
+#endif
+}
+
+void PfffReadahead::output_next(ostream& out) {
+    PlannedFile file = files.front();
+    files.pop_front();
+    string error = file.error;
+    if (error == "") {
+        try {
+            if (file.cache->fetch()) hashers.output(out, file.cache);
+            else error = file.cache->error_message;
+        }
+        catch (pfff_exception& e) {
+            error = e.what();
+        }
+    }
+    delete file.cache;
+    delete file.reader;
+    if (error != "") throw pfff_exception(error);
+}
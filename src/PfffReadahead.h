@@ -0,0 +1,62 @@
+/**
+ * PfffReadahead.h: Overlapping the storage latency of the next files with the hashing of the current one.
+ *
+ * Files are planned (with PfffMultiHasher::plan) as soon as they are added, and the kernel is asked
+ * to start reading the sampled ranges into the page cache (posix_fadvise WILLNEED). The files are
+ * hashed some files later, in the order they were added, by which time their blocks are in flight
+ * or cached. This helps even with a single thread, as the kernel does the reads asynchronously.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffReadahead_h__
+#define __PfffReadahead_h__
+#include <deque>
+#include <ostream>
+#include <string>
+#include "PfffBlockReader.h"
+#include "PfffMultiHasher.h"
+
+using std::deque;
+using std::ostream;
+using std::string;
+
+class PfffReadahead {
+public:
+    long advised_ranges;        // Ranges the kernel was asked to read ahead
+    long long advised_bytes;
+
+    /** The hashers are not owned. */
+    PfffReadahead(const PfffMultiHasher& hashers);
+    ~PfffReadahead();
+
+    /**
+     * Plans the reads of a local file and starts reading them ahead. reader reads the file
+     * (possibly through other BlockReaders) and is owned.
+     */
+    void add(BlockReader* reader);
+
+    /** Number of files added and not yet output */
+    inline int size() const { return files.size(); }
+
+    /**
+     * Reads the oldest file and writes its fingerprints, each but the last followed by
+     * formatter->record_end(), then forgets the file. On error throws pfff_exception.
+     */
+    void output_next(ostream& out);
+
+protected:
+    PfffMultiHasher hashers;
+
+    struct PlannedFile {
+        BlockReader* reader;
+        SampleCacheBlockReader* cache;
+        string error;
+    };
+    deque<PlannedFile> files;
+
+    /** Asks the kernel to read the ranges of the cache from the named file. */
+    void advise(const string& filename, const SampleCacheBlockReader* cache);
+};
+
+#endif
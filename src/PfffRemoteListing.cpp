@@ -0,0 +1,498 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffRemoteListing.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <sstream>
+
+using std::istringstream;
+using std::ostringstream;
+using std::set;
+
+// The properties asked for with PROPFIND
+static const char* PROPFIND_BODY =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<D:propfind xmlns:D=\"DAV:\"><D:prop><D:resourcetype/><D:getcontentlength/></D:prop></D:propfind>\n";
+
+// ------------- Helpers ----------------
+
+static string lowercase(string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+static string trim(const string& s) {
+    string::size_type start = s.find_first_not_of(" \t\r\n");
+    if (start == string::npos) return "";
+    return s.substr(start, s.find_last_not_of(" \t\r\n") - start + 1);
+}
+
+/** The lines of a listing, without their line ends and without the empty ones. */
+static vector<string> split_lines(const string& listing) {
+    vector<string> result;
+    istringstream in(listing);
+    string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[line.size() - 1] == '\r') line.resize(line.size() - 1);
+        if (!line.empty()) result.push_back(line);
+    }
+    return result;
+}
+
+static bool parse_size(const string& s, long long& size) {
+    if (s.empty() || s.find_first_not_of("0123456789") != string::npos) return false;
+    size = strtoll(s.c_str(), NULL, 10);
+    return true;
+}
+
+/** The path without its trailing '/', except for the root. */
+static string without_slash(const string& path) {
+    string::size_type end = path.find_last_not_of('/');
+    return end == string::npos ? "/" : path.substr(0, end + 1);
+}
+
+static string join(const string& dir, const string& name) {
+    if (!name.empty() && name[0] == '/') return name;
+    string base = without_slash(dir);
+    return base == "/" ? base + name : base + "/" + name;
+}
+
+static string basename(const string& path) {
+    string p = without_slash(path);
+    string::size_type slash = p.rfind('/');
+    return slash == string::npos ? p : p.substr(slash + 1);
+}
+
+/** Replaces the XML/HTML character entities of names. */
+static string decode_entities(const string& s) {
+    static const char* entities[][2] = { {"&amp;", "&"}, {"&lt;", "<"}, {"&gt;", ">"}, {"&quot;", "\""}, {"&apos;", "'"}, {"&#39;", "'"} };
+    string result;
+    for (string::size_type i = 0; i < s.size(); i++) {
+        bool replaced = false;
+        if (s[i] == '&') {
+            for (int e = 0; e < sizeof(entities) / sizeof(entities[0]); e++) {
+                if (s.compare(i, strlen(entities[e][0]), entities[e][0]) == 0) {
+                    result += entities[e][1];
+                    i += strlen(entities[e][0]) - 1;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if (!replaced) result += s[i];
+    }
+    return result;
+}
+
+static bool is_month(const string& s) {
+    static const char* months = "jan feb mar apr may jun jul aug sep oct nov dec ";
+    return s.size() == 3 && strstr(months, (lowercase(s) + " ").c_str()) != NULL;
+}
+
+static bool by_path(const PfffRemoteEntry& a, const PfffRemoteEntry& b) {
+    return a.path < b.path;
+}
+
+// ------------- FtpRemoteLister ----------------
+
+FtpRemoteLister::FtpRemoteLister(const string& host, int port): host(host), port(port), connection(NULL), mlsd(true) {
+}
+
+FtpRemoteLister::~FtpRemoteLister() {
+    delete connection;
+}
+
+void FtpRemoteLister::connect() {
+    if (connection != NULL) return;
+    connection = new FtpClientSocket(host, port);
+    try {
+        string response = connection->AnonymousLogin();
+        if (response[0] != '2') throw "ANONYMOUS_LOGIN_FAILED";
+    }
+    catch (...) {
+        delete connection;
+        connection = NULL;
+        throw;
+    }
+}
+
+string FtpRemoteLister::command(const string& line) {
+    string response = connection->SendCommand(line);
+    while (response == "426" || response == "226") response = connection->GetResponse();
+    return response;
+}
+
+bool FtpRemoteLister::list(const string& dir, vector<PfffRemoteEntry>& entries) {
+    vector<PfffRemoteEntry> found;
+    try {
+        connect();
+        string listing, response;
+        bool parsed = false;
+        if (mlsd) {
+            response = connection->PasvList("MLSD " + dir, listing);
+            if (response[0] == '1') parsed = parse_mlsd(listing, found);
+            // Not implemented, or not understood
+            else if (response == "500" || response == "502" || response == "504") mlsd = false;
+        }
+        if (!mlsd) {
+            response = connection->PasvList("LIST " + dir, listing);
+            if (response[0] == '1') parsed = parse_list(listing, found);
+        }
+        if (response[0] == '1' && !parsed) {
+            error_message = "Unsupported directory listing";
+            return false;
+        }
+
+        // A file is not listed, or is listed alone: tell it from a directory holding a file of the same name by its size
+        bool alone = response[0] == '1' && found.size() == 1 && found[0].type == PfffRemoteEntry::REGULAR &&
+                     (found[0].path == dir || found[0].path == basename(dir));
+        if (response[0] != '1' || alone) {
+            string error = trim(connection->lastResponseLine);
+            long long size;
+            if (command("SIZE " + dir) == "213" && sscanf(connection->lastResponseLine.c_str() + 4, "%lld", &size) == 1) {
+                entries.push_back(PfffRemoteEntry(PfffRemoteEntry::REGULAR, dir, size));
+                return true;
+            }
+            if (!alone) {
+                error_message = error;
+                return false;
+            }
+        }
+    }
+    catch (const char* e) {
+        error_message = e;
+        delete connection;
+        connection = NULL;
+        return false;
+    }
+    catch (string& e) {
+        error_message = e;
+        delete connection;
+        connection = NULL;
+        return false;
+    }
+    for (int i = 0; i < found.size(); i++) {
+        found[i].path = join(dir, found[i].path);
+        entries.push_back(found[i]);
+    }
+    return true;
+}
+
+bool FtpRemoteLister::parse_mlsd(const string& listing, vector<PfffRemoteEntry>& entries) {
+    vector<string> lines = split_lines(listing);
+    for (int i = 0; i < lines.size(); i++) {
+        // type=file;size=123;modify=20100101000000; name
+        string::size_type space = lines[i].find(' ');
+        if (space == string::npos) return false;
+        string name = lines[i].substr(space + 1);
+        istringstream facts(lowercase(lines[i].substr(0, space)));
+        string fact, type;
+        long long size = -1;
+        while (std::getline(facts, fact, ';')) {
+            if (fact.compare(0, 5, "type=") == 0) type = fact.substr(5);
+            else if (fact.compare(0, 5, "size=") == 0 && !parse_size(fact.substr(5), size)) return false;
+        }
+        if (type == "file") entries.push_back(PfffRemoteEntry(PfffRemoteEntry::REGULAR, name, size));
+        else if (type == "dir") entries.push_back(PfffRemoteEntry(PfffRemoteEntry::DIRECTORY, name));
+        else if (type.compare(0, 13, "os.unix=slink") == 0 || type == "os.unix=symlink")
+            entries.push_back(PfffRemoteEntry(PfffRemoteEntry::SYMLINK, name));
+        else if (type.empty()) return false;
+        // cdir, pdir and special files are left out
+    }
+    return true;
+}
+
+bool FtpRemoteLister::parse_list(const string& listing, vector<PfffRemoteEntry>& entries) {
+    vector<string> lines = split_lines(listing);
+    for (int i = 0; i < lines.size(); i++) {
+        const string& line = lines[i];
+        if (line.compare(0, 6, "total ") == 0) continue;
+
+        // The fields, with their positions, as the name may contain spaces
+        vector<string> fields;
+        vector<string::size_type> starts;
+        string::size_type pos = 0;
+        while ((pos = line.find_first_not_of(' ', pos)) != string::npos) {
+            string::size_type end = line.find(' ', pos);
+            starts.push_back(pos);
+            fields.push_back(line.substr(pos, end == string::npos ? string::npos : end - pos));
+            pos = end;
+        }
+
+        if (isdigit(line[0])) {
+            // DOS: 01-01-10  12:00AM       <DIR>          name
+            //      01-01-10  12:00AM                 1234 name
+            if (fields.size() < 4) return false;
+            string name = line.substr(starts[3]);
+            long long size;
+            if (fields[2] == "<DIR>") entries.push_back(PfffRemoteEntry(PfffRemoteEntry::DIRECTORY, name));
+            else if (parse_size(fields[2], size)) entries.push_back(PfffRemoteEntry(PfffRemoteEntry::REGULAR, name, size));
+            else return false;
+            continue;
+        }
+
+        // Unix: -rw-r--r-- 1 owner group 1234 Jan  1  2010 name
+        // The group, and on some servers the link count, may be missing: look for the date
+        int month = -1;
+        for (int f = 2; f + 3 < fields.size() && month < 0; f++) {
+            long long day;
+            if (is_month(fields[f]) && parse_size(fields[f + 1], day)) month = f;
+        }
+        long long size;
+        if (month < 0 || !parse_size(fields[month - 1], size)) return false;
+        string name = line.substr(starts[month + 3]);
+        if (name == "." || name == "..") continue;
+        if (line[0] == 'd') entries.push_back(PfffRemoteEntry(PfffRemoteEntry::DIRECTORY, name));
+        else if (line[0] == '-') entries.push_back(PfffRemoteEntry(PfffRemoteEntry::REGULAR, name, size));
+        else if (line[0] == 'l') {
+            string::size_type arrow = name.find(" -> ");
+            entries.push_back(PfffRemoteEntry(PfffRemoteEntry::SYMLINK, name.substr(0, arrow)));
+        }
+        // Devices, pipes and sockets are left out
+    }
+    return true;
+}
+
+// ------------- HttpRemoteLister ----------------
+
+HttpRemoteLister::HttpRemoteLister(const string& host, int port): http(host, port), webdav(true) {
+}
+
+bool HttpRemoteLister::list(const string& dir, vector<PfffRemoteEntry>& entries) {
+    int status;
+    string content_type, body;
+    try {
+        if (webdav) {
+            body = http.Request("PROPFIND", dir.c_str(), "Depth: 1\r\nContent-Type: application/xml; charset=utf-8\r\n",
+                                PROPFIND_BODY, status, content_type);
+            if (status == 207) {
+                vector<PfffRemoteEntry> found;
+                if (!parse_propfind(body, found)) {
+                    error_message = "Unsupported PROPFIND reply";
+                    return false;
+                }
+                string self = without_slash(dir);
+                for (int i = 0; i < found.size(); i++) {
+                    if (without_slash(found[i].path) != self) entries.push_back(found[i]);
+                    else if (found[i].type != PfffRemoteEntry::DIRECTORY) {
+                        // A file
+                        entries.push_back(PfffRemoteEntry(PfffRemoteEntry::REGULAR, dir, found[i].size));
+                        return true;
+                    }
+                }
+                return true;
+            }
+            // A web server without WebDAV
+            if (status == 400 || status == 403 || status == 405 || status == 501) webdav = false;
+            else {
+                ostringstream error;
+                error << "PROPFIND failed with status " << status;
+                error_message = error.str();
+                return false;
+            }
+        }
+
+        // Only a directory has an index page, and its path should end with '/' (or be redirected to it)
+        if (dir.empty() || dir[dir.size() - 1] != '/') {
+            entries.push_back(PfffRemoteEntry(PfffRemoteEntry::REGULAR, dir));
+            return true;
+        }
+        body = http.Request("GET", dir.c_str(), "", "", status, content_type);
+        if (status != 200 || lowercase(content_type).find("html") == string::npos) {
+            ostringstream error;
+            error << "No index page (status " << status << ")";
+            error_message = error.str();
+            return false;
+        }
+        vector<PfffRemoteEntry> found;
+        parse_autoindex(body, found);
+        for (int i = 0; i < found.size(); i++) {
+            found[i].path = dir + found[i].path;
+            entries.push_back(found[i]);
+        }
+        return true;
+    }
+    catch (const char* e) {
+        error_message = e;
+        return false;
+    }
+    catch (string& e) {
+        error_message = e;
+        return false;
+    }
+}
+
+bool HttpRemoteLister::parse_propfind(const string& xml, vector<PfffRemoteEntry>& entries) {
+    // Whatever the namespace prefixes, only the local names of the elements are looked at
+    bool multistatus = false, in_response = false, collection = false;
+    string href;
+    long long size = -1;
+    string::size_type pos = 0;
+    while ((pos = xml.find('<', pos)) != string::npos) {
+        if (xml.compare(pos, 4, "<!--") == 0) {
+            pos = xml.find("-->", pos);
+            if (pos == string::npos) break;
+            continue;
+        }
+        string::size_type end = xml.find('>', pos);
+        if (end == string::npos) break;
+        string tag = xml.substr(pos + 1, end - pos - 1);
+        pos = end + 1;
+        if (tag.empty() || tag[0] == '?' || tag[0] == '!') continue;
+        bool closing = tag[0] == '/';
+        bool empty = tag[tag.size() - 1] == '/';
+        string name = tag.substr(closing ? 1 : 0);
+        name = lowercase(name.substr(0, name.find_first_of(" \t\r\n/")));
+        string::size_type colon = name.rfind(':');
+        if (colon != string::npos) name = name.substr(colon + 1);
+        string text = empty || closing ? "" : trim(decode_entities(xml.substr(pos, xml.find('<', pos) - pos)));
+
+        if (name == "multistatus") multistatus = true;
+        else if (name == "response" && !closing) {
+            in_response = true;
+            collection = false;
+            href = "";
+            size = -1;
+        }
+        else if (name == "response" && in_response) {
+            in_response = false;
+            // Absolute URLs are cut down to their paths
+            string::size_type scheme = href.find("://");
+            if (scheme != string::npos) {
+                string::size_type path = href.find('/', scheme + 3);
+                href = path == string::npos ? "/" : href.substr(path);
+            }
+            if (href.empty()) continue;
+            if (collection) {
+                if (href[href.size() - 1] != '/') href += '/';
+                entries.push_back(PfffRemoteEntry(PfffRemoteEntry::DIRECTORY, href));
+            }
+            else entries.push_back(PfffRemoteEntry(PfffRemoteEntry::REGULAR, href, size));
+        }
+        else if (!in_response || closing) continue;
+        else if (name == "href" && href.empty()) href = text;
+        else if (name == "collection") collection = true;
+        else if (name == "getcontentlength" && !parse_size(text, size)) size = -1;
+    }
+    return multistatus;
+}
+
+void HttpRemoteLister::parse_autoindex(const string& html, vector<PfffRemoteEntry>& entries) {
+    string lower = lowercase(html);
+    set<string> seen;   // Apache links the icons too
+    string::size_type pos = 0;
+    while ((pos = lower.find("<a ", pos)) != string::npos) {
+        string::size_type end = lower.find('>', pos);
+        if (end == string::npos) break;
+        string::size_type attribute = lower.find("href=", pos);
+        pos = end;
+        if (attribute == string::npos || attribute > end) continue;
+        attribute += 5;
+        string::size_type value_end;
+        if (html[attribute] == '"' || html[attribute] == '\'') {
+            char quote = html[attribute++];
+            value_end = html.find(quote, attribute);
+        }
+        else value_end = html.find_first_of(" \t\r\n>", attribute);
+        if (value_end == string::npos || value_end > end) continue;
+        string href = decode_entities(html.substr(attribute, value_end - attribute));
+
+        // Only the names in this directory: not the parent, the sorting links or other sites
+        if (href.empty() || href[0] == '?' || href[0] == '#' || href[0] == '/' || href == "./" || href == "../" ||
+            href.find(':') != string::npos || href.find('?') != string::npos || href.find('#') != string::npos)
+            continue;
+        string::size_type slash = href.find('/');
+        if (slash != string::npos && slash != href.size() - 1) continue;
+        if (!seen.insert(href).second) continue;
+        entries.push_back(PfffRemoteEntry(slash == string::npos ? PfffRemoteEntry::REGULAR : PfffRemoteEntry::DIRECTORY, href));
+    }
+}
+
+// ------------- PfffRemoteWalker ----------------
+
+PfffRemoteWalker::PfffRemoteWalker(PfffRemoteLister* lister, const vector<string>& roots, long max_pending):
+    lister(lister), roots(roots), max_pending(max_pending), started(false), done(false), stopping(false) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&changed, NULL);
+    started = max_pending > 0 && pthread_create(&thread, NULL, &PfffRemoteWalker::walk_main, this) == 0;
+    if (!started) {
+        this->max_pending = 0;
+        walk();
+        done = true;
+    }
+}
+
+PfffRemoteWalker::~PfffRemoteWalker() {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+    if (started) pthread_join(thread, NULL);
+    delete lister;
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&lock);
+}
+
+bool PfffRemoteWalker::next(PfffRemoteEntry& entry) {
+    pthread_mutex_lock(&lock);
+    while (queue.empty() && !done) pthread_cond_wait(&changed, &lock);
+    bool result = !queue.empty();
+    if (result) {
+        entry = queue.front();
+        queue.pop_front();
+        pthread_cond_broadcast(&changed);
+    }
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+bool PfffRemoteWalker::push(const PfffRemoteEntry& entry) {
+    pthread_mutex_lock(&lock);
+    while (!stopping && max_pending > 0 && queue.size() >= max_pending) pthread_cond_wait(&changed, &lock);
+    bool result = !stopping;
+    if (result) {
+        queue.push_back(entry);
+        pthread_cond_broadcast(&changed);
+    }
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+void PfffRemoteWalker::walk() {
+    for (int i = 0; i < roots.size(); i++)
+        if (!walk(roots[i], true)) break;
+}
+
+bool PfffRemoteWalker::walk(const string& dir, bool root) {
+    vector<PfffRemoteEntry> entries;
+    if (!lister->list(dir, entries)) {
+        // A root may be a file on a server which can not tell, fetching it will tell the error otherwise
+        if (root) return push(PfffRemoteEntry(PfffRemoteEntry::REGULAR, dir));
+        PfffRemoteEntry failed(PfffRemoteEntry::FAILED, dir);
+        failed.error = lister->error_message;
+        return push(failed);
+    }
+    std::sort(entries.begin(), entries.end(), by_path);
+    for (int i = 0; i < entries.size(); i++) {
+        if (entries[i].type != PfffRemoteEntry::DIRECTORY) {
+            if (!push(entries[i])) return false;
+        }
+        else if (entries[i].path != dir && !walk(entries[i].path, false)) return false;
+    }
+    return true;
+}
+
+void* PfffRemoteWalker::walk_main(void* arg) {
+    PfffRemoteWalker* self = (PfffRemoteWalker*)arg;
+    self->walk();
+    pthread_mutex_lock(&self->lock);
+    self->done = true;
+    pthread_cond_broadcast(&self->changed);
+    pthread_mutex_unlock(&self->lock);
+    return NULL;
+}
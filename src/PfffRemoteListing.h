@@ -0,0 +1,155 @@
+/**
+ * PfffRemoteListing.h: Walking directory trees on FTP and HTTP servers, for --recursive.
+ *
+ * Directories are listed with MLSD on FTP (LIST on servers without it), and with WebDAV PROPFIND
+ * on HTTP (the HTML index page of the directory on servers without it). The listings give the
+ * sizes of the files, which are passed to the block readers so that they do not ask for them with
+ * SIZE or HEAD. A PfffRemoteWalker lists the directories from a background thread, over its own
+ * connection, so that the listing goes on while the files found so far are fingerprinted.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffRemoteListing_h__
+#define __PfffRemoteListing_h__
+#include <deque>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "FtpSocket.h"
+#include "HttpSocket.h"
+
+using std::deque;
+using std::string;
+using std::vector;
+
+// Number of files found by the walker and not yet fingerprinted, above which the listing waits
+#define PFFF_REMOTE_QUEUE_SIZE 10000
+
+/**
+ * A file or directory found on the server.
+ */
+struct PfffRemoteEntry {
+    enum Type { REGULAR, DIRECTORY, SYMLINK, FAILED };
+
+    inline PfffRemoteEntry(): type(REGULAR), size(-1) {}
+    inline PfffRemoteEntry(Type type, const string& path, long long size = -1): type(type), path(path), size(size) {}
+
+    Type type;
+    string path;        // Name from the listing, or full path on the server once listed by a PfffRemoteLister
+    long long size;     // -1 if not known
+    string error;       // Why the directory could not be listed, for FAILED entries
+};
+
+/**
+ * Lists directories on a server. Not thread-safe: each thread needs its own lister.
+ */
+class PfffRemoteLister {
+public:
+    string error_message;
+
+    virtual ~PfffRemoteLister() {}
+
+    /**
+     * Adds the entries of the directory dir to entries, with their full paths. If dir turns out to
+     * be a file, it is added alone, with its own path. Returns false on error.
+     */
+    virtual bool list(const string& dir, vector<PfffRemoteEntry>& entries) = 0;
+};
+
+/**
+ * Lists directories over an anonymous FTP connection of its own, made on the first listing.
+ */
+class FtpRemoteLister: public PfffRemoteLister {
+public:
+    FtpRemoteLister(const string& host, int port);
+    ~FtpRemoteLister();
+
+    bool list(const string& dir, vector<PfffRemoteEntry>& entries);
+
+    /** Adds the entries of an MLSD listing (RFC 3659), without "." and "..". Returns false if a line is not understood. */
+    static bool parse_mlsd(const string& listing, vector<PfffRemoteEntry>& entries);
+
+    /** Adds the entries of a LIST listing in the Unix "ls -l" or in the DOS format. Returns false if a line is not understood. */
+    static bool parse_list(const string& listing, vector<PfffRemoteEntry>& entries);
+
+protected:
+    string host;
+    int port;
+    FtpClientSocket* connection;
+    bool mlsd;              // Cleared once the server refused MLSD
+
+    /** Logs in, unless done already. Throws a const char* or a string on errors. */
+    void connect();
+
+    /** Sends a command and returns the response code, skipping the end of a previous transfer. */
+    string command(const string& line);
+};
+
+/**
+ * Lists directories over HTTP. Directories without WebDAV can only be listed when their path ends with '/'.
+ * Paths are kept URL-encoded, as they are sent back in requests.
+ */
+class HttpRemoteLister: public PfffRemoteLister {
+public:
+    HttpRemoteLister(const string& host, int port);
+
+    bool list(const string& dir, vector<PfffRemoteEntry>& entries);
+
+    /**
+     * Adds the entries of a PROPFIND multistatus reply, with the paths of their hrefs, including the
+     * directory listed. Directories get a trailing '/'. Returns false if it is not a multistatus reply.
+     */
+    static bool parse_propfind(const string& xml, vector<PfffRemoteEntry>& entries);
+
+    /**
+     * Adds the entries of an HTML index page: its links to the names in the same directory, as
+     * given by nginx, Apache and lighttpd. Directories end with '/'. Sizes are not known.
+     */
+    static void parse_autoindex(const string& html, vector<PfffRemoteEntry>& entries);
+
+protected:
+    HttpClientSocket http;
+    bool webdav;            // Cleared once the server refused PROPFIND
+};
+
+/**
+ * Walks the given roots depth first, entries of each directory in the order of their names, from a
+ * background thread. Files and symlinks are passed on as they are found, directories are entered.
+ * Roots which cannot be listed are passed on as files, directories which cannot be listed as FAILED.
+ * NB: The lister is owned.
+ */
+class PfffRemoteWalker {
+public:
+    /** With max_pending <= 0, or if no thread can be started, the whole tree is listed at once. */
+    PfffRemoteWalker(PfffRemoteLister* lister, const vector<string>& roots, long max_pending = PFFF_REMOTE_QUEUE_SIZE);
+    ~PfffRemoteWalker();
+
+    /** Waits for the next entry. Returns false once all of them were given. */
+    bool next(PfffRemoteEntry& entry);
+
+protected:
+    PfffRemoteLister* lister;
+    vector<string> roots;
+    long max_pending;
+    pthread_t thread;
+    bool started;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    deque<PfffRemoteEntry> queue;
+    bool done;              // The walk is over
+    bool stopping;          // The walker is being destroyed
+
+    /** Lists all roots. */
+    void walk();
+
+    /** Lists a directory and its subdirectories. Returns false once stopping. */
+    bool walk(const string& dir, bool root);
+
+    /** Adds an entry to the queue, waiting while it is full. Returns false once stopping. */
+    bool push(const PfffRemoteEntry& entry);
+
+    static void* walk_main(void* arg);
+};
+
+#endif
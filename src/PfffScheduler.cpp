@@ -0,0 +1,258 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffScheduler.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#include <sys/ioctl.h>
+#endif
+
+#define UNKNOWN_POSITION (~0ULL)
+// Extents asked for in each FIEMAP call
+#define FIEMAP_BATCH 64
+
+/**
+ * The extents reported by FIEMAP, in logical order. Those without a reliable physical location
+ * (delayed allocation, inline data, ...) get UNKNOWN_POSITION. Returns false if FIEMAP is not supported.
+ */
+static bool get_fiemap(int fd, vector<PfffExtent>& extents) {
+    extents.clear();
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+    vector<char> buffer(sizeof(struct fiemap) + FIEMAP_BATCH * sizeof(struct fiemap_extent));
+    struct fiemap* map = (struct fiemap*)&buffer[0];
+    unsigned long long start = 0;
+    while (true) {
+        memset(&buffer[0], 0, buffer.size());
+        map->fm_start = start;
+        map->fm_length = FIEMAP_MAX_OFFSET - start;
+        map->fm_extent_count = FIEMAP_BATCH;
+        if (ioctl(fd, FS_IOC_FIEMAP, map) < 0) return false;
+        if (map->fm_mapped_extents == 0) return true;
+        for (unsigned int i = 0; i < map->fm_mapped_extents; i++) {
+            const struct fiemap_extent& e = map->fm_extents[i];
+            PfffExtent extent;
+            extent.logical = e.fe_logical;
+            extent.length = e.fe_length;
+            extent.physical = e.fe_flags & (FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE)
+                              ? UNKNOWN_POSITION : e.fe_physical;
+            extents.push_back(extent);
+            start = e.fe_logical + e.fe_length;
+            if (e.fe_flags & FIEMAP_EXTENT_LAST) return true;
+        }
+    }
+#else
+    return false;
+#endif
+}
+
+/**
+ * The ranges of the file holding data, by SEEK_DATA and SEEK_HOLE, or the whole file where these are
+ * not supported. Unlike FIEMAP without syncing, they also see data not yet written out.
+ */
+static void get_data_ranges(int fd, unsigned long long size, vector<PfffExtent>& ranges) {
+    ranges.clear();
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    off_t pos = 0;
+    while ((unsigned long long)pos < size) {
+        off_t data = lseek(fd, pos, SEEK_DATA);
+        if (data < 0) {
+            if (errno == ENXIO) return;     // Only a hole up to the end
+            break;
+        }
+        off_t hole = lseek(fd, data, SEEK_HOLE);
+        if (hole < 0) break;
+        if ((unsigned long long)data >= size) return;
+        PfffExtent range;
+        range.logical = data;
+        range.length = std::min((unsigned long long)hole, size) - data;
+        range.physical = UNKNOWN_POSITION;
+        ranges.push_back(range);
+        pos = hole;
+    }
+    if ((unsigned long long)pos >= size) return;
+    ranges.clear();
+#endif
+    if (size == 0) return;
+    PfffExtent whole = { 0, UNKNOWN_POSITION, size };
+    ranges.push_back(whole);
+}
+
+// ------------- PfffScheduler ----------------
+
+PfffScheduler::PfffScheduler(const PfffMultiHasher& hashers, long request_cost):
+    bytes_read(0), hole_bytes(0), reads(0), physical_order(false), hashers(hashers), request_cost(request_cost),
+    head_device(0), head_position(0) {
+}
+
+PfffScheduler::~PfffScheduler() {
+    clear();
+}
+
+bool PfffScheduler::map_file(int fd, unsigned long long size, vector<PfffExtent>& extents) {
+    vector<PfffExtent> data, map;
+    get_data_ranges(fd, size, data);
+    bool mapped = get_fiemap(fd, map);
+    extents.clear();
+    int m = 0;
+    for (int i = 0; i < data.size(); i++) {
+        unsigned long long pos = data[i].logical, end = data[i].logical + data[i].length;
+        while (pos < end) {
+            while (m < map.size() && map[m].logical + map[m].length <= pos) m++;
+            PfffExtent extent;
+            extent.logical = pos;
+            if (m < map.size() && map[m].logical <= pos) {
+                // Within a mapped extent
+                extent.length = std::min(end, map[m].logical + map[m].length) - pos;
+                extent.physical = map[m].physical == UNKNOWN_POSITION ? UNKNOWN_POSITION : map[m].physical + (pos - map[m].logical);
+            }
+            else {
+                // Not mapped (yet): up to the next extent
+                extent.length = (m < map.size() ? std::min(end, map[m].logical) : end) - pos;
+                extent.physical = UNKNOWN_POSITION;
+            }
+            extents.push_back(extent);
+            pos += extent.length;
+        }
+    }
+    return mapped;
+}
+
+void PfffScheduler::add(BlockReader* reader) {
+    ScheduledFile file;
+    file.reader = reader;
+    file.cache = new SampleCacheBlockReader(reader);
+    try {
+        hashers.plan(file.cache);
+    }
+    catch (pfff_exception& e) {
+        file.error = e.what();
+    }
+    file.cache->end_recording();
+    files.push_back(file);
+}
+
+void PfffScheduler::clear() {
+    for (int i = 0; i < files.size(); i++) {
+        delete files[i].cache;
+        delete files[i].reader;
+    }
+    files.clear();
+}
+
+bool PfffScheduler::physical_less(const Piece& a, const Piece& b) {
+    if (a.device != b.device) return a.device < b.device;
+    if (a.physical != b.physical) return a.physical < b.physical;
+    // Unknown locations: by inode and offset
+    if (a.inode != b.inode) return a.inode < b.inode;
+    return a.logical < b.logical;
+}
+
+bool PfffScheduler::inode_less(const Piece& a, const Piece& b) {
+    if (a.device != b.device) return a.device < b.device;
+    if (a.inode != b.inode) return a.inode < b.inode;
+    return a.logical < b.logical;
+}
+
+bool PfffScheduler::plan_pieces(int i, vector<Piece>& pieces) {
+    ScheduledFile& file = files[i];
+    string filename = file.reader->get_filename();
+    unsigned long long size = file.cache->size();
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat s;
+    if (fd < 0 || fstat(fd, &s) != 0) {
+        file.error = filename + ": " + strerror(errno);
+        if (fd >= 0) close(fd);
+        return true;
+    }
+    vector<PfffExtent> extents;
+    bool mapped = map_file(fd, size, extents);
+    close(fd);
+
+    // Intersect the sampled ranges (clipped to the file, beyond it they stay zero) with the extents
+    unsigned long long start, end, offset = 0;
+    int e = 0;
+    while (file.cache->next_range(offset, start, end) && start < size) {
+        offset = end;
+        if (end > size) end = size;
+        unsigned long long covered = 0;
+        for (; e < extents.size() && extents[e].logical < end; e++) {
+            unsigned long long extent_end = extents[e].logical + extents[e].length;
+            if (extent_end <= start) continue;
+            Piece piece;
+            piece.file = i;
+            piece.device = s.st_dev;
+            piece.inode = s.st_ino;
+            piece.logical = std::max(start, extents[e].logical);
+            piece.length = std::min(end, extent_end) - piece.logical;
+            piece.physical = extents[e].physical == UNKNOWN_POSITION ? UNKNOWN_POSITION : extents[e].physical + (piece.logical - extents[e].logical);
+            pieces.push_back(piece);
+            covered += piece.length;
+            if (extent_end > end) break;    // The extent continues into the next range
+        }
+        hole_bytes += (end - start) - covered;
+    }
+    return mapped;
+}
+
+void PfffScheduler::read() {
+    vector<Piece> pieces;
+    physical_order = true;
+    for (int i = 0; i < files.size(); i++) {
+        if (files[i].error == "" && !plan_pieces(i, pieces)) physical_order = false;
+    }
+    if (physical_order) {
+        // An elevator sweep, starting from where the previous one ended
+        std::sort(pieces.begin(), pieces.end(), physical_less);
+        Piece head;
+        head.device = head_device;
+        head.physical = head_position;
+        head.inode = 0;
+        head.logical = 0;
+        std::rotate(pieces.begin(), std::lower_bound(pieces.begin(), pieces.end(), head, physical_less), pieces.end());
+    }
+    else std::sort(pieces.begin(), pieces.end(), inode_less);
+
+    vector<char> buffer;
+    for (int first = 0; first < pieces.size(); ) {
+        // Join the following pieces of the same file lying close by, both in the file and on the device
+        int last = first + 1;
+        unsigned long long end = pieces[first].logical + pieces[first].length;
+        while (last < pieces.size() && pieces[last].file == pieces[first].file && pieces[last].logical >= end &&
+               pieces[last].logical - end <= (unsigned long long)request_cost &&
+               (pieces[first].physical == UNKNOWN_POSITION) == (pieces[last].physical == UNKNOWN_POSITION) &&
+               (pieces[first].physical == UNKNOWN_POSITION ||
+                pieces[last].physical - pieces[first].physical == pieces[last].logical - pieces[first].logical)) {
+            end = pieces[last].logical + pieces[last].length;
+            last++;
+        }
+        ScheduledFile& file = files[pieces[first].file];
+        unsigned long long start = pieces[first].logical;
+        if (file.error == "") {
+            buffer.resize(end - start);
+            file.reader->begin_block_sequence(&buffer[0]);
+            bool ok = file.reader->next_block(start, end - start);
+            if (file.reader->end_block_sequence() && ok) file.cache->capture(start, &buffer[0], end - start);
+            else file.error = file.reader->error_message;
+            bytes_read += end - start;
+            reads++;
+        }
+        if (pieces[last - 1].physical != UNKNOWN_POSITION) {
+            head_device = pieces[last - 1].device;
+            head_position = pieces[last - 1].physical + pieces[last - 1].length;
+        }
+        first = last;
+    }
+}
+
+void PfffScheduler::output(int i, ostream& out) {
+    if (files[i].error != "") throw pfff_exception(files[i].error);
+    hashers.output(out, files[i].cache);
+}
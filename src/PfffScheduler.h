@@ -0,0 +1,108 @@
+/**
+ * PfffScheduler.h: Ordering the reads of a window of local files by their location on the disk.
+ *
+ * Within a file the sample is read in offset order, but from one file to the next the reads follow
+ * the order the files were given in, which makes a disk head sweep back and forth. The scheduler
+ * instead collects the read plans of a window of files (with PfffMultiHasher::plan), finds where
+ * their data lies on the device (FIEMAP, or the inode order where it is not supported), and issues
+ * all reads in one elevator sweep, continuing from where the previous window ended. Sampled ranges
+ * falling into holes of sparse files (SEEK_DATA/SEEK_HOLE) are left zero without any I/O.
+ * The fingerprints are then computed from the read data, in the order the files were added.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffScheduler_h__
+#define __PfffScheduler_h__
+#include <ostream>
+#include <string>
+#include <vector>
+#include "PfffBlockReader.h"
+#include "PfffMultiHasher.h"
+
+using std::ostream;
+using std::string;
+using std::vector;
+
+/**
+ * A part of a file with data, and where it starts on the device.
+ */
+struct PfffExtent {
+    unsigned long long logical;
+    unsigned long long physical;
+    unsigned long long length;
+};
+
+class PfffScheduler {
+public:
+    // Counters, for the statistics and the tests
+    long long bytes_read;       // Read from the files
+    long long hole_bytes;       // Sampled, but left zero as they lie in holes
+    long reads;                 // Reads made (after joining neighbouring ranges)
+    bool physical_order;        // Whether the last window could be ordered by physical location
+
+    /**
+     * The hashers are not owned. Ranges of a file separated by at most request_cost bytes
+     * (and contiguous on the device) are read together.
+     */
+    PfffScheduler(const PfffMultiHasher& hashers, long request_cost = 0);
+    ~PfffScheduler();
+
+    /**
+     * Adds a local file to the window, planning its reads. reader reads the file (possibly through
+     * a TracingBlockReader and a MonitoringBlockReader), and is owned.
+     */
+    void add(BlockReader* reader);
+
+    /** Number of files in the window */
+    inline int size() const { return files.size(); }
+
+    /** Makes the reads of all the files in the window. Failures are kept with their files. */
+    void read();
+
+    /**
+     * Writes the fingerprints of the i-th file of the window, each but the last followed by
+     * formatter->record_end(). If the file could not be planned or read, throws pfff_exception.
+     */
+    void output(int i, ostream& out);
+
+    /** Empties the window */
+    void clear();
+
+    /**
+     * Finds the extents of a file with data, with their physical locations where FIEMAP gives them
+     * (and otherwise physical set to ~0ULL). Returns false if FIEMAP is not supported.
+     * Holes are left out as far as SEEK_DATA and SEEK_HOLE tell them.
+     */
+    static bool map_file(int fd, unsigned long long size, vector<PfffExtent>& extents);
+
+protected:
+    PfffMultiHasher hashers;
+    long request_cost;
+    unsigned long long head_device;     // Where the last sweep ended
+    unsigned long long head_position;
+
+    struct ScheduledFile {
+        BlockReader* reader;
+        SampleCacheBlockReader* cache;
+        string error;
+    };
+    vector<ScheduledFile> files;
+
+    // A range to be read
+    struct Piece {
+        int file;
+        unsigned long long device;
+        unsigned long long inode;
+        unsigned long long physical;    // ~0ULL if unknown
+        unsigned long long logical;
+        unsigned long long length;
+    };
+    static bool physical_less(const Piece& a, const Piece& b);
+    static bool inode_less(const Piece& a, const Piece& b);
+
+    /** Adds the pieces of the sampled ranges of the file which hold data. Returns false if FIEMAP failed. */
+    bool plan_pieces(int i, vector<Piece>& pieces);
+};
+
+#endif
@@ -0,0 +1,156 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffSimulatedBlockReader.h"
+#include <cstring>
+
+// Built-in profiles. The figures are typical rather than measured on any particular device.
+static const PfffStorageProfile PROFILES[] = {
+    //  name    open_ns    request_ns  seek_ns   seek_ns_per_gb  bytes_per_s  batched
+    { "hdd",    500000,    100000,     4000000,  8000,           150000000,   false },
+    { "ssd",    20000,     80000,      0,        0,              500000000,   false },
+    { "nfs",    500000,    500000,     0,        0,              110000000,   false },
+    { "http",   30000000,  30000000,   0,        0,              12500000,    true  }
+};
+
+// Files are placed on the device at multiples of this
+static const unsigned long long ALLOCATION_UNIT = 4096;
+
+/**
+ * FNV-1a hash of the filename, so that each file gets its own content.
+ */
+static unsigned long long hash_filename(const string& filename) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (string::size_type i = 0; i < filename.size(); i++) {
+        h ^= (unsigned char)filename[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * The splitmix64 finalizer: a cheap, well-mixing function of a 64 bit value.
+ */
+static inline unsigned long long mix64(unsigned long long z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// ------------- PfffSimulatedStorage ----------------
+
+PfffSimulatedStorage::PfffSimulatedStorage(const PfffStorageProfile& profile, unsigned long long seed):
+    profile(profile), seed(seed), next_position(0), head(0) {
+    reset();
+}
+
+bool PfffSimulatedStorage::find_profile(const string& name, PfffStorageProfile& profile) {
+    for (int i = 0; i < sizeof(PROFILES)/sizeof(PROFILES[0]); i++) {
+        if (name == PROFILES[i].name) {
+            profile = PROFILES[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+void PfffSimulatedStorage::reset() {
+    elapsed_ns = 0;
+    opens = 0;
+    requests = 0;
+    seeks = 0;
+    bytes = 0;
+    head = 0;
+}
+
+void PfffSimulatedStorage::open(const string& filename, long long file_size) {
+    opens++;
+    elapsed_ns += profile.open_ns;
+    if (file_size >= 0 && file_positions.find(filename) == file_positions.end()) {
+        file_positions[filename] = next_position;
+        next_position += (file_size + ALLOCATION_UNIT - 1) / ALLOCATION_UNIT * ALLOCATION_UNIT;
+    }
+}
+
+void PfffSimulatedStorage::charge(unsigned long long position, unsigned long long length) {
+    long long cost = profile.request_ns + (long long)(length * 1e9 / profile.bytes_per_s);
+    if (position != head) {
+        unsigned long long distance = position > head ? position - head : head - position;
+        cost += profile.seek_ns + (long long)(profile.seek_ns_per_gb * (distance / 1073741824.0));
+        seeks++;
+    }
+    head = position + length;
+    elapsed_ns += cost;
+    requests++;
+    bytes += length;
+}
+
+void PfffSimulatedStorage::read(const string& filename, unsigned long long offset, unsigned long long length) {
+    charge(file_positions[filename] + offset, length);
+}
+
+void PfffSimulatedStorage::read_batch(const string& filename, unsigned long long bytes, unsigned long long end_offset) {
+    elapsed_ns += profile.request_ns + (long long)(bytes * 1e9 / profile.bytes_per_s);
+    head = file_positions[filename] + end_offset;
+    requests++;
+    this->bytes += bytes;
+}
+
+void PfffSimulatedStorage::fill(const string& filename, unsigned long long offset, char* buffer, unsigned long length) const {
+    unsigned long long key = seed * 0x9E3779B97F4A7C15ULL ^ hash_filename(filename);
+    unsigned long long word_index = offset / 8;
+    int skip = offset % 8;
+    unsigned long done = 0;
+    while (done < length) {
+        unsigned long long word = mix64(key + word_index);
+        for (int i = skip; i < 8 && done < length; i++) buffer[done++] = (char)(word >> (8*i));
+        skip = 0;
+        word_index++;
+    }
+}
+
+// ------------- SimulatedBlockReader ----------------
+
+SimulatedBlockReader::SimulatedBlockReader(PfffSimulatedStorage* storage, const char* filename, long long file_size):
+    BlockReader(filename), storage(storage), file_size(file_size), batch_bytes(0), batch_end(0) {
+};
+
+long long SimulatedBlockReader::_size() {
+    storage->open(filename, file_size);
+    if (file_size < 0) {
+        error_message = "File ";
+        error_message = error_message + filename + " does not exist.";
+        return NOT_FOUND;
+    }
+    return file_size;
+}
+
+void SimulatedBlockReader::begin_block_sequence(char* buffer) {
+    this->buffer = buffer;
+    batch_bytes = 0;
+    batch_end = 0;
+}
+
+bool SimulatedBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    if (size() < 0) return false;
+    unsigned long long available = (unsigned long long)file_size > block_start ? file_size - block_start : 0;
+    unsigned long n = available < block_size ? (unsigned long)available : block_size;
+    storage->fill(filename, block_start, buffer, n);
+    if (n < block_size) memset(buffer + n, 0, block_size - n);
+    buffer += block_size;
+
+    if (storage->profile.batched) {
+        batch_bytes += n;
+        if (block_start + n > batch_end) batch_end = block_start + n;
+    }
+    else storage->read(filename, block_start, n);
+    return true;
+}
+
+bool SimulatedBlockReader::end_block_sequence() {
+    if (storage->profile.batched && batch_bytes > 0) storage->read_batch(filename, batch_bytes, batch_end);
+    batch_bytes = 0;
+    batch_end = 0;
+    return true;
+}
@@ -0,0 +1,105 @@
+/**
+ * PfffSimulatedBlockReader.h: A BlockReader over simulated storage, which serves deterministic
+ * content and models the time the reads would take on a given kind of device.
+ * Used by the tests and pfff-bench to compare reader strategies without real hardware.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffSimulatedBlockReader_h__
+#define __PfffSimulatedBlockReader_h__
+#include <map>
+#include <string>
+#include "PfffBlockReader.h"
+
+using std::map;
+using std::string;
+
+/**
+ * Cost model of a storage device. A request of n bytes at position p costs
+ *   request_ns + n / bytes_per_s
+ * plus, if p is not where the previous request ended, seek_ns + seek_ns_per_gb * distance.
+ * Files are laid out one after another on the device, in the order they are first opened.
+ */
+struct PfffStorageProfile {
+    const char* name;
+    long long open_ns;          // Opening a file and querying its size
+    long long request_ns;       // Fixed cost of each request: command overhead or network round-trip
+    long long seek_ns;          // Extra cost of a request that does not continue the previous one
+    long long seek_ns_per_gb;   // Further seek cost per GB of distance (HDD arm travel)
+    long long bytes_per_s;      // Transfer rate
+    bool batched;               // All requests of a block sequence are sent as one (HTTP multi-range)
+};
+
+/**
+ * A simulated device: the cost model, the layout of the files and the modeled clock.
+ * Shared by the SimulatedBlockReaders of a run, so that the time of a whole scan
+ * (including the seeks between files) is modeled. Not thread-safe.
+ */
+class PfffSimulatedStorage {
+public:
+    PfffStorageProfile profile;
+    unsigned long long seed;    // Determines the content of the files
+
+    // Modeled totals
+    long long elapsed_ns;
+    long long opens;
+    long long requests;
+    long long seeks;
+    long long bytes;
+
+    PfffSimulatedStorage(const PfffStorageProfile& profile, unsigned long long seed = 1);
+
+    /**
+     * Finds one of the built-in profiles: "hdd", "ssd", "nfs" or "http".
+     * Returns false if there is no such profile.
+     */
+    static bool find_profile(const string& name, PfffStorageProfile& profile);
+
+    /** Charges the opening of a file and assigns it a place on the device. */
+    void open(const string& filename, long long file_size);
+
+    /** Charges a single request for the given bytes of an opened file. */
+    void read(const string& filename, unsigned long long offset, unsigned long long length);
+
+    /** Charges a batched request, transferring bytes in total and ending at the given position. */
+    void read_batch(const string& filename, unsigned long long bytes, unsigned long long end_offset);
+
+    /** Resets the modeled clock and totals, keeping the file layout. */
+    void reset();
+
+    /**
+     * Fills the buffer with the content of the given file at the given offset.
+     * The content only depends on the seed, the filename and the offset.
+     */
+    void fill(const string& filename, unsigned long long offset, char* buffer, unsigned long length) const;
+
+protected:
+    map<string, unsigned long long> file_positions;
+    unsigned long long next_position;   // Where the next new file is placed
+    unsigned long long head;            // Where the last request ended
+
+    void charge(unsigned long long position, unsigned long long length);
+};
+
+/**
+ * A BlockReader for a file of the given size on a PfffSimulatedStorage.
+ * A negative size simulates a missing file.
+ * Nothing is actually waited for: the modeled time is accumulated in storage->elapsed_ns.
+ */
+class SimulatedBlockReader: public BlockReader {
+public:
+    SimulatedBlockReader(PfffSimulatedStorage* storage, const char* filename, long long file_size);
+
+    long long _size();
+    void begin_block_sequence(char* buffer);
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+    bool end_block_sequence();
+protected:
+    PfffSimulatedStorage* storage;
+    long long file_size;
+    unsigned long long batch_bytes;     // Bytes queued in the current batched request
+    unsigned long long batch_end;
+};
+
+#endif
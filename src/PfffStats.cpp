@@ -0,0 +1,197 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffStats.h"
+#include <cstring>
+#include <iomanip>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+long long pfff_now_ns() {
+#ifdef _WIN32
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (long long)(counter.QuadPart * (1e9 / frequency.QuadPart));
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (long long)t.tv_sec * 1000000000LL + t.tv_nsec;
+#endif
+}
+
+// ------------- PfffHistogram ----------------
+
+PfffHistogram::PfffHistogram(): count(0), total_ns(0), max_ns(0) {
+    memset(buckets, 0, sizeof(buckets));
+}
+
+void PfffHistogram::add(long long ns) {
+    if (ns < 0) ns = 0;
+    int bucket = 0;
+    while (bucket < PFFF_HISTOGRAM_BUCKETS - 1 && (ns >> bucket) != 0) bucket++;
+    buckets[bucket]++;
+    count++;
+    total_ns += ns;
+    if (ns > max_ns) max_ns = ns;
+}
+
+long long PfffHistogram::quantile(double q) const {
+    if (count == 0) return 0;
+    long long rank = (long long)(q * count);
+    if (rank >= count) rank = count - 1;
+    long long seen = 0;
+    for (int i = 0; i < PFFF_HISTOGRAM_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            long long upper = 1LL << i;
+            return upper < max_ns ? upper : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+void PfffHistogram::output(ostream& out) const {
+    out << "count=" << count
+        << "\ttotal_s=" << total_ns * 1e-9
+        << "\tmean_us=" << (count > 0 ? total_ns * 1e-3 / count : 0.0)
+        << "\tp50_us=" << quantile(0.5) * 1e-3
+        << "\tp99_us=" << quantile(0.99) * 1e-3
+        << "\tmax_us=" << max_ns * 1e-3
+        << "\thist=";
+    bool first = true;
+    for (int i = 0; i < PFFF_HISTOGRAM_BUCKETS; i++) {
+        if (buckets[i] == 0) continue;
+        if (!first) out << ',';
+        out << i << ':' << buckets[i];
+        first = false;
+    }
+}
+
+// ------------- PfffStats ----------------
+
+PfffStats::PfffStats(): files(0), failed_files(0), start_ns(pfff_now_ns()) {
+}
+
+const char* PfffStats::phase_name(int phase) {
+    switch (phase) {
+        case PFFF_PHASE_STAT:       return "stat";
+        case PFFF_PHASE_SAMPLE:     return "sample";
+        case PFFF_PHASE_POST_HASH:  return "post_hash";
+        case PFFF_PHASE_OUTPUT:     return "output";
+        default:                    return "unknown";
+    }
+}
+
+void PfffStats::output(ostream& out) const {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(6);
+
+    out << "# pfff stats\n";
+    out << "files\ttotal\tcount=" << files << "\tfailed=" << failed_files
+        << "\telapsed_s=" << (pfff_now_ns() - start_ns) * 1e-9 << '\n';
+    for (map<string, PfffReaderStats>::const_iterator r = readers.begin(); r != readers.end(); r++) {
+        out << "reader\t" << r->first
+            << "\trequests=" << r->second.requests
+            << "\tbytes=" << r->second.bytes
+            << "\terrors=" << r->second.errors
+            << "\tretries=" << r->second.retries << '\n';
+    }
+    for (int i = 0; i < PFFF_N_PHASES; i++) {
+        out << "time\t" << phase_name(i) << '\t';
+        phases[i].output(out);
+        out << '\n';
+    }
+    for (map<string, PfffReaderStats>::const_iterator r = readers.begin(); r != readers.end(); r++) {
+        out << "time\t" << r->first << ".next_block\t";
+        r->second.next_block.output(out);
+        out << '\n';
+        out << "time\t" << r->first << ".end_block_sequence\t";
+        r->second.end_block_sequence.output(out);
+        out << '\n';
+    }
+
+    // How many blocks were served by each physical read
+    map<string, PfffReaderStats>::const_iterator logical = readers.find("logical");
+    map<string, PfffReaderStats>::const_iterator physical = readers.find("physical");
+    if (logical != readers.end() && physical != readers.end()) {
+        out << "coalescing\tbuffering\tblocks=" << logical->second.requests
+            << "\trequests=" << physical->second.requests
+            << "\tratio=" << (physical->second.requests > 0 ? (double)logical->second.requests / physical->second.requests : 0.0)
+            << "\textra_bytes=" << physical->second.bytes - logical->second.bytes << '\n';
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+// ------------- MonitoringBlockReader ----------------
+
+MonitoringBlockReader::MonitoringBlockReader(BlockReader* reader, PfffStats* stats, const string& level):
+    BlockReader(""), reader(reader), stats(&stats->reader(level)) {};
+
+MonitoringBlockReader::~MonitoringBlockReader() {
+    delete reader;
+}
+
+long long MonitoringBlockReader::_size() {
+    long long retries = reader->retries();
+    long long result = reader->size();
+    stats->retries += reader->retries() - retries;
+    if (result < 0) {
+        error_message = reader->error_message;
+        stats->errors++;
+    }
+    return result;
+}
+
+string MonitoringBlockReader::get_filename() {
+    return reader->get_filename();
+}
+
+long long MonitoringBlockReader::retries() {
+    return reader->retries();
+}
+
+void MonitoringBlockReader::begin_block_sequence(char* buffer) {
+    reader->begin_block_sequence(buffer);
+}
+
+bool MonitoringBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    long long start = pfff_now_ns();
+    long long retries = reader->retries();
+    bool result = reader->next_block(block_start, block_size);
+    stats->next_block.add(pfff_now_ns() - start);
+    stats->requests++;
+    stats->retries += reader->retries() - retries;
+
+    // Only the part within the file is actually read
+    long long file_size = size();
+    long long bytes = block_size;
+    if (file_size >= 0 && (long long)block_start + bytes > file_size)
+        bytes = file_size > (long long)block_start ? file_size - (long long)block_start : 0;
+    stats->bytes += bytes;
+
+    if (!result) {
+        error_message = reader->error_message;
+        stats->errors++;
+    }
+    return result;
+}
+
+bool MonitoringBlockReader::end_block_sequence() {
+    long long start = pfff_now_ns();
+    long long retries = reader->retries();
+    bool result = reader->end_block_sequence();
+    stats->end_block_sequence.add(pfff_now_ns() - start);
+    stats->retries += reader->retries() - retries;
+    if (!result) {
+        error_message = reader->error_message;
+        stats->errors++;
+    }
+    return result;
+}
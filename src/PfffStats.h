@@ -0,0 +1,136 @@
+/**
+ * PfffStats.h: Counters and latency histograms describing where the time of a pfff run goes (pfff --stats).
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffStats_h__
+#define __PfffStats_h__
+#include <map>
+#include <ostream>
+#include <string>
+#include "PfffBlockReader.h"
+
+using std::map;
+using std::ostream;
+using std::string;
+
+// Phases of fingerprinting a single file, timed by PfffHasher
+#define PFFF_PHASE_STAT         0   // BlockReader::size(): opening and stat-ing the file
+#define PFFF_PHASE_SAMPLE       1   // Generation of the block sample
+#define PFFF_PHASE_POST_HASH    2   // Hashing of the sampled data into a digest
+#define PFFF_PHASE_OUTPUT       3   // Formatting of the fingerprint
+#define PFFF_N_PHASES           4
+
+// Number of histogram buckets. Bucket i counts durations of [2^(i-1), 2^i) nanoseconds.
+#define PFFF_HISTOGRAM_BUCKETS  48
+
+/**
+ * Returns nanoseconds from an arbitrary starting point (a monotonic clock).
+ */
+long long pfff_now_ns();
+
+/**
+ * Latency histogram with power-of-two buckets.
+ */
+class PfffHistogram {
+public:
+    long long count;
+    long long total_ns;
+    long long max_ns;
+    long long buckets[PFFF_HISTOGRAM_BUCKETS];
+
+    PfffHistogram();
+
+    void add(long long ns);
+
+    /**
+     * Returns the upper bound (in nanoseconds) of the bucket containing the given
+     * quantile (0..1) of the values, or 0 if there are no values.
+     */
+    long long quantile(double q) const;
+
+    /**
+     * Writes count=...<TAB>total_s=...<TAB>...<TAB>hist=<bucket>:<count>,... with the
+     * empty buckets left out.
+     */
+    void output(ostream& out) const;
+};
+
+/**
+ * Accounting of the requests made to one level of a BlockReader stack.
+ * On the "logical" level each request is a block asked for by the hasher, on the
+ * "physical" level it is a read actually made from the file (after BufferingBlockReader
+ * coalesced neighbouring blocks).
+ */
+struct PfffReaderStats {
+    long long requests;     // next_block() calls
+    long long bytes;        // Bytes covered by those calls, not counting the part beyond the end of file
+    long long errors;       // Failed size(), next_block() and end_block_sequence() calls
+    long long retries;      // Requests repeated by the readers below (the duplicates and failovers of --hedge)
+    PfffHistogram next_block;
+    PfffHistogram end_block_sequence;
+
+    PfffReaderStats(): requests(0), bytes(0), errors(0), retries(0) {};
+};
+
+/**
+ * Statistics of a whole run. Not thread-safe: use one instance per thread.
+ *
+ * output() writes one line per item, with tab-separated fields: the kind of the item,
+ * its name and a number of key=value pairs, e.g.
+ *   files    total     count=120  failed=0  elapsed_s=0.051
+ *   reader   logical   requests=...  bytes=...  errors=0  retries=0
+ *   time     stat      count=120  total_s=...  mean_us=...  p50_us=...  p99_us=...  max_us=...  hist=...
+ *   coalescing  buffering  blocks=...  requests=...  ratio=...
+ */
+class PfffStats {
+public:
+    long long files;
+    long long failed_files;
+    long long start_ns;
+    PfffHistogram phases[PFFF_N_PHASES];
+    map<string, PfffReaderStats> readers;
+
+    PfffStats();
+
+    /** Records the duration of a phase that started at start_ns (a pfff_now_ns() value). */
+    inline void add_phase(int phase, long long start_ns) {
+        phases[phase].add(pfff_now_ns() - start_ns);
+    }
+
+    /** Statistics of the reader level with the given name, created on first use. */
+    inline PfffReaderStats& reader(const string& name) {
+        return readers[name];
+    }
+
+    /** Writes the statistics in the format described above, preceded by a "# pfff stats" line. */
+    void output(ostream& out) const;
+
+    /** Name of a PFFF_PHASE_* value, as used by output() */
+    static const char* phase_name(int phase);
+};
+
+/**
+ * A BlockReader that passes all calls to another one and accounts for them in a
+ * PfffReaderStats. Stack two of these around a BufferingBlockReader to see how well
+ * it coalesced the requests.
+ * NB: On destructor, MonitoringBlockReader will destroy the wrapped reader too.
+ */
+class MonitoringBlockReader: public BlockReader {
+public:
+    MonitoringBlockReader(BlockReader* reader, PfffStats* stats, const string& level);
+    virtual ~MonitoringBlockReader();
+
+    long long _size();
+    void begin_block_sequence(char* buffer);
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+    bool end_block_sequence();
+    string get_filename();
+    long long retries();
+protected:
+    BlockReader* reader;
+    PfffReaderStats* stats;
+};
+
+#endif
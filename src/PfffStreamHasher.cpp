@@ -0,0 +1,130 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     // splice()
+#endif
+#include "PfffStreamHasher.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sstream>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+using std::ostringstream;
+using std::vector;
+
+// Buffer for the read() and write() path
+#define TEE_BUFFER_SIZE 65536
+
+// Largest amount moved by a single splice()
+#define TEE_SPLICE_SIZE (1 << 20)
+
+/**
+ * Only knows the size of the stream. The hashers read nothing from it directly.
+ */
+class StreamSizeBlockReader: public BlockReader {
+public:
+    long long stream_size;
+    
+    StreamSizeBlockReader(const string& filename, long long stream_size):
+        BlockReader(filename.c_str()), stream_size(stream_size) {}
+    
+    long long _size() { return stream_size; }
+    bool next_block(unsigned long long block_start, unsigned long block_size) {
+        error_message = "A stream cannot be read at random";
+        return false;
+    }
+};
+
+/**
+ * Writes all len bytes, retrying on partial writes. Returns false on error.
+ */
+static bool write_all(int fd, const char* data, unsigned long len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+PfffStreamHasher::PfffStreamHasher(PfffMultiHasher* hashers, long long size, const string& filename):
+    position(0), hashers(hashers), size(size) {
+    if (size < 0) throw pfff_exception("The size of the stream must be given");
+    size_reader = new StreamSizeBlockReader(filename, size);
+    cache = new SampleCacheBlockReader(size_reader);
+    hashers->plan(cache);
+    cache->end_recording();
+}
+
+PfffStreamHasher::~PfffStreamHasher() {
+    delete cache;
+    delete size_reader;
+}
+
+void PfffStreamHasher::update(const char* data, unsigned long len) {
+    cache->capture(position, data, len);
+    position += len;
+}
+
+void PfffStreamHasher::finish(ostream& out) {
+    if (position != size) {
+        ostringstream message;
+        message << "The stream was " << position << " bytes long, not " << size << " as given";
+        throw pfff_exception(message.str());
+    }
+    hashers->output(out, cache);
+}
+
+bool PfffStreamHasher::tee(int in_fd, int out_fd) {
+    vector<char> buffer(TEE_BUFFER_SIZE);
+#ifdef SPLICE_F_MOVE
+    bool can_splice = true;
+#else
+    bool can_splice = false;
+#endif
+    while (true) {
+        unsigned long long start, end;
+        bool sampled = cache->next_range(position, start, end);
+        unsigned long n = TEE_BUFFER_SIZE;
+        if (can_splice) {
+#ifdef SPLICE_F_MOVE
+            if (!sampled || start > position) {
+                // Not sampled: let the kernel move the data
+                unsigned long long gap = sampled ? start - position : TEE_SPLICE_SIZE;
+                ssize_t moved = splice(in_fd, NULL, out_fd, NULL, gap < TEE_SPLICE_SIZE ? gap : TEE_SPLICE_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (moved > 0) {
+                    position += moved;
+                    continue;
+                }
+                if (moved == 0) return true;
+                if (errno == EINTR) continue;
+                if (errno != EINVAL && errno != ENOSYS) {
+                    error_message = string("Failed to copy the stream: ") + strerror(errno);
+                    return false;
+                }
+                // Neither descriptor is a pipe
+                can_splice = false;
+            }
+            else if (end - position < n) n = end - position;
+#endif
+        }
+        ssize_t got = read(in_fd, &buffer[0], n);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            error_message = string("Failed to read the stream: ") + strerror(errno);
+            return false;
+        }
+        if (got == 0) return true;
+        update(&buffer[0], got);
+        if (!write_all(out_fd, &buffer[0], got)) {
+            error_message = string("Failed to write the stream: ") + strerror(errno);
+            return false;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+/**
+ * PfffStreamHasher.h: Fingerprinting data as it streams past, e.g. while it is being copied,
+ * instead of reading the finished file again. The size must be known in advance, as the sample
+ * depends on it. The fingerprints are those a LocalFileBlockReader would give on the whole data.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffStreamHasher_h__
+#define __PfffStreamHasher_h__
+#include <ostream>
+#include <string>
+#include "PfffMultiHasher.h"
+
+using std::ostream;
+using std::string;
+
+/**
+ * Keeps the sampled bytes of a stream of the given size for the hashers of a PfffMultiHasher
+ * (which may hold a single hasher).
+ */
+class PfffStreamHasher {
+public:
+    unsigned long long position;    // Number of bytes seen so far
+    string error_message;
+    
+    /**
+     * The hashers must stay valid while the stream is hashed. The filename goes into the fingerprints.
+     * On error (an invalid size) throws pfff_exception with the proper message.
+     */
+    PfffStreamHasher(PfffMultiHasher* hashers, long long size, const string& filename);
+    ~PfffStreamHasher();
+    
+    /**
+     * Passes the next len bytes of the stream.
+     */
+    void update(const char* data, unsigned long len);
+    
+    /**
+     * Writes the fingerprints, as PfffMultiHasher::hash would. Throws pfff_exception if the stream
+     * was not exactly as long as announced.
+     */
+    void finish(ostream& out);
+    
+    /**
+     * Copies in_fd to out_fd until the end of in_fd, passing the data to update().
+     * The bytes which are not sampled are moved with splice() where possible (one of the
+     * descriptors must be a pipe), without being copied through user space; only the sampled
+     * ranges are read and written. Otherwise falls back to read() and write().
+     * Returns false on an I/O error and sets error_message.
+     */
+    bool tee(int in_fd, int out_fd);
+
+protected:
+    PfffMultiHasher* hashers;
+    long long size;
+    BlockReader* size_reader;
+    SampleCacheBlockReader* cache;
+};
+
+#endif
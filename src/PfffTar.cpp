@@ -0,0 +1,408 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffTar.h"
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <sys/stat.h>
+#include "PfffThreadPool.h"
+
+using std::ostringstream;
+
+// Fields of a tar header: offset and length
+#define TAR_NAME        0,   100
+#define TAR_SIZE        124, 12
+#define TAR_CHECKSUM    148, 8
+#define TAR_TYPE        156
+#define TAR_MAGIC       257
+#define TAR_PREFIX      345, 155
+
+/**
+ * Reads len bytes at offset with a block sequence of its own. Returns false on error.
+ */
+static bool read_range(BlockReader* reader, unsigned long long offset, unsigned long len, char* buffer) {
+    reader->begin_block_sequence(buffer);
+    bool ok = reader->next_block(offset, len);
+    return reader->end_block_sequence() && ok;
+}
+
+/**
+ * A header field as a string, up to the first NUL.
+ */
+static string get_string(const unsigned char* header, int offset, int len) {
+    const char* field = (const char*)header + offset;
+    return string(field, strnlen(field, len));
+}
+
+/**
+ * Parses a numeric field: octal digits, possibly surrounded by spaces and NULs,
+ * or the GNU base-256 encoding (the top bit of the first byte set). Returns false if it is malformed.
+ */
+static bool get_number(const unsigned char* header, int offset, int len, unsigned long long& result) {
+    const unsigned char* field = header + offset;
+    result = 0;
+    if (field[0] & 0x80) {
+        if (field[0] != 0x80) return false;     // Negative, or too large for us
+        for (int i = 1; i < len; i++) {
+            if (result >> 56) return false;
+            result = (result << 8) | field[i];
+        }
+        return true;
+    }
+    int i = 0;
+    while (i < len && field[i] == ' ') i++;
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) result = (result << 3) | (field[i] - '0');
+    for (; i < len; i++) {
+        if (field[i] != ' ' && field[i] != '\0') return false;
+    }
+    return true;
+}
+
+/**
+ * Verifies the header checksum, computed with the checksum field taken as spaces.
+ * Some old implementations summed signed chars, so both sums are accepted.
+ */
+static bool valid_checksum(const unsigned char* header) {
+    unsigned long long expected;
+    if (!get_number(header, TAR_CHECKSUM, expected)) return false;
+    long unsigned_sum = 0, signed_sum = 0;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        bool in_field = i >= 148 && i < 156;
+        unsigned_sum += in_field ? ' ' : header[i];
+        signed_sum += in_field ? ' ' : (signed char)header[i];
+    }
+    return expected == (unsigned long long)unsigned_sum || expected == (unsigned long long)signed_sum;
+}
+
+static bool is_zero_block(const unsigned char* header) {
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        if (header[i] != 0) return false;
+    }
+    return true;
+}
+
+/**
+ * Takes the path and size records out of a pax extended header ("<length> <key>=<value>\n" each).
+ */
+static void parse_pax(const string& data, string& path, long long& size) {
+    string::size_type pos = 0;
+    while (pos < data.size()) {
+        char* end;
+        long length = strtol(data.c_str() + pos, &end, 10);
+        string::size_type key = end - data.c_str() + 1;
+        if (length <= 0 || *end != ' ' || pos + length > data.size() || data[pos + length - 1] != '\n') return;
+        string::size_type eq = data.find('=', key);
+        if (eq != string::npos && eq < pos + length) {
+            string name = data.substr(key, eq - key);
+            string value = data.substr(eq + 1, pos + length - 1 - (eq + 1));
+            if (name == "path") path = value;
+            else if (name == "size") size = strtoll(value.c_str(), NULL, 10);
+        }
+        pos += length;
+    }
+}
+
+// ------------- PfffTarIndex ----------------
+
+bool PfffTarIndex::read(BlockReader* archive) {
+    members.clear();
+    long long archive_size = archive->size();
+    if (archive_size < 0) {
+        error_message = archive->error_message;
+        return false;
+    }
+    string archive_name = archive->get_filename();
+    unsigned char header[TAR_BLOCK_SIZE];
+    unsigned long long offset = 0;
+    string long_name, pax_path;     // Given by the extended headers for the next member
+    long long pax_size = -1;
+    while (offset < (unsigned long long)archive_size) {
+        if (offset + TAR_BLOCK_SIZE > (unsigned long long)archive_size) {
+            error_message = "Truncated tar archive: " + archive_name;
+            return false;
+        }
+        if (!read_range(archive, offset, TAR_BLOCK_SIZE, (char*)header)) {
+            error_message = archive->error_message;
+            return false;
+        }
+        // A zero block marks the end of the archive
+        if (is_zero_block(header)) return true;
+        unsigned long long size;
+        if (!valid_checksum(header) || !get_number(header, TAR_SIZE, size)) {
+            ostringstream message;
+            if (offset == 0) message << "Not a tar archive: " << archive_name;
+            else message << "Corrupt tar header at offset " << offset << " of " << archive_name;
+            error_message = message.str();
+            return false;
+        }
+        char type = header[TAR_TYPE];
+        bool extended = type == 'L' || type == 'K' || type == 'x' || type == 'g';
+        if (!extended && pax_size >= 0) size = pax_size;
+        unsigned long long data_offset = offset + TAR_BLOCK_SIZE;
+        if (data_offset + size > (unsigned long long)archive_size) {
+            error_message = "Truncated tar archive: " + archive_name;
+            return false;
+        }
+
+        if (type == 'L' || type == 'x') {
+            if (size > TAR_MAX_EXTENDED_HEADER) {
+                error_message = "Extended tar header too long in " + archive_name;
+                return false;
+            }
+            string data(size, '\0');
+            if (size > 0 && !read_range(archive, data_offset, size, &data[0])) {
+                error_message = archive->error_message;
+                return false;
+            }
+            if (type == 'L') long_name = data.substr(0, strnlen(data.c_str(), data.size()));
+            else parse_pax(data, pax_path, pax_size);
+        }
+        else if (!extended) {
+            string name;
+            if (pax_path != "") name = pax_path;
+            else if (long_name != "") name = long_name;
+            else {
+                name = get_string(header, TAR_NAME);
+                // The ustar prefix (GNU tar uses the field for other things)
+                if (memcmp(header + TAR_MAGIC, "ustar\0", 6) == 0 && header[345] != '\0')
+                    name = get_string(header, TAR_PREFIX) + "/" + name;
+            }
+            // Regular and contiguous files; old archives mark directories with a trailing slash only
+            if ((type == '0' || type == '\0' || type == '7') && name != "" && name[name.size() - 1] != '/') {
+                PfffTarMember member;
+                member.name = name;
+                member.offset = data_offset;
+                member.size = size;
+                members.push_back(member);
+            }
+            long_name = "";
+            pax_path = "";
+            pax_size = -1;
+        }
+        // Links, directories and the like have no data, but their size field may still be set
+        if (type == '1' || type == '2' || type == '5') size = 0;
+        offset = data_offset + (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+    }
+    // Archives may also end without the zero blocks
+    return true;
+}
+
+long PfffTarIndex::find(const string& name) const {
+    for (long i = (long)members.size() - 1; i >= 0; i--) {
+        if (members[i].name == name) return i;
+    }
+    return -1;
+}
+
+// ------------- TarMemberBlockReader ----------------
+
+TarMemberBlockReader::TarMemberBlockReader(BlockReader* archive, const PfffTarMember& member, const string& archive_name):
+    BlockReader(""), archive(archive), member(member) {
+    filename = archive_name + "!" + member.name;
+}
+
+long long TarMemberBlockReader::_size() {
+    if (archive->size() < 0) {
+        error_message = archive->error_message;
+        return archive->size();
+    }
+    return member.size;
+}
+
+void TarMemberBlockReader::begin_block_sequence(char* buffer) {
+    this->buffer = buffer;
+    requests.clear();
+}
+
+bool TarMemberBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    if (size() < 0) return false;
+    Request request;
+    request.target = buffer;
+    request.start = block_start;
+    request.len = block_size;
+    request.available = block_start >= member.size ? 0 :
+                        member.size - block_start < block_size ? (unsigned long)(member.size - block_start) : block_size;
+    requests.push_back(request);
+    buffer += block_size;
+    return true;
+}
+
+/**
+ * Reads the parts of the requests within the member in one sequence of the archive reader
+ * (so that a BufferingBlockReader below can combine them), then copies them into place.
+ */
+bool TarMemberBlockReader::end_block_sequence() {
+    unsigned long long total = 0;
+    for (int i = 0; i < requests.size(); i++) total += requests[i].available;
+    if (total > 0) {
+        data.resize(total);
+        archive->begin_block_sequence(&data[0]);
+        bool ok = true;
+        for (int i = 0; i < requests.size() && ok; i++) {
+            if (requests[i].available > 0) ok = archive->next_block(member.offset + requests[i].start, requests[i].available);
+        }
+        ok = archive->end_block_sequence() && ok;
+        if (!ok) {
+            error_message = archive->error_message;
+            requests.clear();
+            return false;
+        }
+    }
+    unsigned long long pos = 0;
+    for (int i = 0; i < requests.size(); i++) {
+        Request& r = requests[i];
+        if (r.available > 0) memcpy(r.target, &data[pos], r.available);
+        if (r.available < r.len) memset(r.target + r.available, 0, r.len - r.available);
+        pos += r.available;
+    }
+    requests.clear();
+    return true;
+}
+
+// ------------- PfffTarHasher ----------------
+
+/**
+ * Fingerprinting of a single member, run on the thread pool.
+ */
+class TarMemberJob: public PfffJob {
+public:
+    PfffTarHasher* tar_hasher;
+    long index;
+
+    TarMemberJob(PfffTarHasher* tar_hasher, long index): tar_hasher(tar_hasher), index(index) {}
+
+    void run(int worker) {
+        tar_hasher->hash_member(worker, index);
+    }
+};
+
+PfffTarHasher::PfffTarHasher(const vector<const PfffOptions*>& options, const vector<unsigned long>& tiers, int n_threads, long request_cost):
+    stats(NULL), throttle(NULL), members_hashed(0), members_failed(0), options(options), tiers(tiers), n_threads(n_threads), request_cost(request_cost),
+    next_output(0), out(NULL), errors(NULL) {
+    pthread_mutex_init(&lock, NULL);
+}
+
+PfffTarHasher::~PfffTarHasher() {
+    close_archives();
+    for (int i = 0; i < worker_hashers.size(); i++) {
+        for (int j = 0; j < worker_hashers[i].hashers.size(); j++) delete worker_hashers[i].hashers[j];
+    }
+    pthread_mutex_destroy(&lock);
+}
+
+void PfffTarHasher::split_name(const string& name, string& archive_name, string& member_name) {
+    struct stat s;
+    archive_name = name;
+    member_name = "";
+    if (stat(name.c_str(), &s) == 0) return;
+    for (string::size_type pos = name.find('!'); pos != string::npos; pos = name.find('!', pos + 1)) {
+        if (stat(name.substr(0, pos).c_str(), &s) == 0 && !S_ISDIR(s.st_mode)) {
+            archive_name = name.substr(0, pos);
+            member_name = name.substr(pos + 1);
+            return;
+        }
+    }
+}
+
+BlockReader* PfffTarHasher::open_archive(const string& filename) {
+    BlockReader* archive = new LocalFileBlockReader(filename.c_str());
+    if (stats != NULL) archive = new MonitoringBlockReader(archive, stats, "physical");
+    if (throttle != NULL) archive = throttle->wrap(archive, PfffThrottle::device_key(filename));
+    if (request_cost > 0) archive = new BufferingBlockReader(archive, request_cost);
+    return archive;
+}
+
+void PfffTarHasher::close_archives() {
+    for (int i = 0; i < worker_archives.size(); i++) delete worker_archives[i];
+    worker_archives.clear();
+}
+
+bool PfffTarHasher::hash(ostream& out, ostream& errors, const string& archive_name, const string& member_name) {
+    this->archive_name = archive_name;
+    this->out = &out;
+    this->errors = &errors;
+
+    PfffTarIndex index;
+    BlockReader* archive = open_archive(archive_name);
+    bool ok = index.read(archive);
+    delete archive;
+    if (!ok) {
+        errors << "Error: " << index.error_message << '\n';
+        return false;
+    }
+    if (member_name != "") {
+        long i = index.find(member_name);
+        if (i < 0) {
+            errors << "Error: No member " << member_name << " in " << archive_name << '\n';
+            return false;
+        }
+        members.assign(1, index.members[i]);
+    }
+    else members.swap(index.members);
+
+    Result empty = { false, false, "" };
+    results.assign(members.size(), empty);
+    next_output = 0;
+    long failed = members_failed;
+    {
+        PfffThreadPool pool(stats != NULL ? 0 : n_threads, 2*n_threads);
+        while (worker_hashers.size() < pool.n_workers()) {
+            worker_hashers.push_back(PfffMultiHasher());
+            for (int i = 0; i < options.size(); i++) {
+                PfffHasher* hasher = new PfffHasher(options[i]);
+                if (i == 0) hasher->tiers = tiers;
+                worker_hashers.back().hashers.push_back(hasher);
+            }
+        }
+        worker_archives.assign(pool.n_workers(), (BlockReader*)NULL);
+        for (long i = 0; i < members.size(); i++) pool.submit(new TarMemberJob(this, i));
+        pool.wait_all();
+    }
+    close_archives();
+    members.clear();
+    results.clear();
+    return members_failed == failed;
+}
+
+void PfffTarHasher::hash_member(int worker, long index) {
+    if (worker_archives[worker] == NULL) worker_archives[worker] = open_archive(archive_name);
+    BlockReader* input_file = new TarMemberBlockReader(worker_archives[worker], members[index], archive_name);
+    if (stats != NULL) input_file = new MonitoringBlockReader(input_file, stats, "logical");
+
+    PfffMultiHasher& multi_hasher = worker_hashers[worker];
+    ostringstream fingerprint;
+    bool ok = true;
+    string text;
+    try {
+        for (int i = 0; i < multi_hasher.hashers.size(); i++) multi_hasher.hashers[i]->stats = stats;
+        if (multi_hasher.hashers.size() == 1) multi_hasher.hashers[0]->hash(fingerprint, input_file);
+        else multi_hasher.hash(fingerprint, input_file);
+        fingerprint << multi_hasher.hashers.back()->formatter->record_end();
+        text = fingerprint.str();
+    }
+    catch(pfff_exception& e) {
+        ok = false;
+        text = e.what();
+    }
+    delete input_file;
+    complete(index, ok, text);
+}
+
+void PfffTarHasher::complete(long index, bool ok, const string& text) {
+    pthread_mutex_lock(&lock);
+    members_hashed++;
+    if (!ok) members_failed++;
+    results[index].done = true;
+    results[index].ok = ok;
+    results[index].text = text;
+    while (next_output < results.size() && results[next_output].done) {
+        Result& result = results[next_output];
+        if (result.ok) *out << result.text;
+        else *errors << "Error: " << result.text << '\n';
+        string().swap(result.text);
+        next_output++;
+    }
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,159 @@
+/**
+ * PfffTar.h: Fingerprinting the members of tar archives in place, without extracting them.
+ *
+ * The archive is indexed by reading the 512-byte header of each member and seeking over its data
+ * to the next header, so the index costs one small read per member. Each regular member is then
+ * presented to PfffHasher as a file of its own by a TarMemberBlockReader, which translates the
+ * offsets into the archive: fingerprinting a member reads its sample only, as for any other file.
+ * The v7, ustar, GNU (long names) and pax (path and size records) formats are understood.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffTar_h__
+#define __PfffTar_h__
+#include <ostream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "PfffBlockReader.h"
+#include "PfffHasher.h"
+#include "PfffMultiHasher.h"
+#include "PfffStats.h"
+#include "PfffThrottle.h"
+
+using std::ostream;
+using std::string;
+using std::vector;
+
+#define TAR_BLOCK_SIZE 512
+// Longest GNU long name or pax extended header we are willing to read
+#define TAR_MAX_EXTENDED_HEADER 1048576
+
+/**
+ * A regular file stored in a tar archive.
+ */
+struct PfffTarMember {
+    string name;
+    unsigned long long offset;  // Of the data in the archive
+    unsigned long long size;
+};
+
+/**
+ * The regular members of a tar archive, in archive order. Directories, links, devices and
+ * the like are skipped.
+ */
+class PfffTarIndex {
+public:
+    vector<PfffTarMember> members;
+    string error_message;
+
+    /**
+     * Reads the headers of the archive. Returns false (with error_message set) if the archive
+     * is not a tar archive, is truncated or cannot be read.
+     */
+    bool read(BlockReader* archive);
+
+    /** Index of the last member of the given name (the current one, if it was appended several times), or -1 */
+    long find(const string& name) const;
+};
+
+/**
+ * A BlockReader presenting a member of a tar archive as a file. Reads beyond the end of the member
+ * are zero-filled rather than passed on, so they never see the following headers.
+ * The filename is archive_name!member_name.
+ */
+class TarMemberBlockReader: public BlockReader {
+public:
+    /** The archive reader is not owned, so that it can be reused for the following members. */
+    TarMemberBlockReader(BlockReader* archive, const PfffTarMember& member, const string& archive_name);
+
+    long long _size();
+    void begin_block_sequence(char* buffer);
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+    bool end_block_sequence();
+
+protected:
+    BlockReader* archive;
+    PfffTarMember member;
+
+    // Requests of the current sequence, filled in by end_block_sequence
+    struct Request {
+        char* target;
+        unsigned long long start;
+        unsigned long len;
+        unsigned long available;    // Bytes of the request within the member
+    };
+    vector<Request> requests;
+    vector<char> data;
+};
+
+/**
+ * Fingerprints the members of tar archives on n_threads workers (pfff --tar). The fingerprints
+ * are written out in archive order, each named archive!member, whatever order they finish in.
+ * Each worker has its own hashers, one per option set (the first one with the given tiers),
+ * and its own reader of the archive.
+ */
+class PfffTarHasher {
+public:
+    PfffStats* stats;   // If not NULL, reads and hashing phases are accounted in it and the members
+                        // are hashed one at a time, as PfffStats is not thread-safe. Not owned.
+    PfffThrottle* throttle; // If not NULL, the reads of the archives are rate limited by it. Not owned.
+    long members_hashed;    // Members fingerprinted so far, including those that failed
+    long members_failed;
+
+    PfffTarHasher(const vector<const PfffOptions*>& options, const vector<unsigned long>& tiers, int n_threads, long request_cost);
+    virtual ~PfffTarHasher();
+
+    /**
+     * Fingerprints the regular members of the archive, or only the one named member_name if that is
+     * not empty. Each fingerprint is followed by formatter->record_end(). Failures are written to
+     * errors as "Error: ..." lines. Returns false if the archive could not be indexed or any member failed.
+     */
+    bool hash(ostream& out, ostream& errors, const string& archive_name, const string& member_name = "");
+
+    /**
+     * Splits a name given as archive!member. A name which is an existing file is an archive as a whole,
+     * otherwise it is split at the first '!' preceded by the name of an existing file.
+     */
+    static void split_name(const string& name, string& archive_name, string& member_name);
+
+    /** Fingerprints a member with the hashers and the archive reader of the given worker. Called by the jobs. */
+    void hash_member(int worker, long index);
+
+protected:
+    vector<const PfffOptions*> options;
+    vector<unsigned long> tiers;
+    int n_threads;
+    long request_cost;
+
+    vector<PfffMultiHasher> worker_hashers;
+    vector<BlockReader*> worker_archives;   // Opened on first use for the current archive
+
+    // State of the current hash() call
+    string archive_name;
+    vector<PfffTarMember> members;
+    struct Result {
+        bool done;
+        bool ok;
+        string text;    // The fingerprints, or the error message
+    };
+    vector<Result> results;
+    long next_output;
+    ostream* out;
+    ostream* errors;
+    pthread_mutex_t lock;
+
+    /**
+     * Opens the archive: a LocalFileBlockReader, with accounting of the physical reads with stats,
+     * rate limiting by the throttle and a BufferingBlockReader for the request cost.
+     */
+    virtual BlockReader* open_archive(const string& filename);
+
+    /** Records the result of a member and writes out those which are next in archive order. */
+    void complete(long index, bool ok, const string& text);
+
+    void close_archives();
+};
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffThreadPool.h"
+
+// ------------- PfffThreadPool ----------------
+
+PfffThreadPool::PfffThreadPool(int n_threads, long max_pending):
+    max_pending(max_pending), pending(0), stopping(false) {
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&job_available, NULL);
+    pthread_cond_init(&job_done, NULL);
+    if (n_threads <= 0) return;
+
+    // Arguments must stay at fixed addresses while the threads are running
+    worker_args.resize(n_threads);
+    threads.resize(n_threads);
+    for (int i = 0; i < n_threads; i++) {
+        worker_args[i].pool = this;
+        worker_args[i].worker = i;
+        pthread_create(&threads[i], NULL, &PfffThreadPool::worker_main, &worker_args[i]);
+    }
+}
+
+PfffThreadPool::~PfffThreadPool() {
+    wait_all();
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&job_available);
+    pthread_mutex_unlock(&lock);
+    for (int i = 0; i < threads.size(); i++) pthread_join(threads[i], NULL);
+    pthread_cond_destroy(&job_done);
+    pthread_cond_destroy(&job_available);
+    pthread_mutex_destroy(&lock);
+}
+
+void PfffThreadPool::submit(PfffJob* job) {
+    if (threads.size() == 0) {
+        job->run(0);
+        delete job;
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    while (max_pending > 0 && pending >= max_pending)
+        pthread_cond_wait(&job_done, &lock);
+    queue.push_back(job);
+    pending++;
+    pthread_cond_signal(&job_available);
+    pthread_mutex_unlock(&lock);
+}
+
+void PfffThreadPool::wait_all() {
+    pthread_mutex_lock(&lock);
+    while (pending > 0) pthread_cond_wait(&job_done, &lock);
+    pthread_mutex_unlock(&lock);
+}
+
+void* PfffThreadPool::worker_main(void* arg) {
+    WorkerArg* a = (WorkerArg*)arg;
+    a->pool->work(a->worker);
+    return NULL;
+}
+
+void PfffThreadPool::work(int worker) {
+    pthread_mutex_lock(&lock);
+    while (true) {
+        while (queue.empty() && !stopping) pthread_cond_wait(&job_available, &lock);
+        if (queue.empty()) break; // Stopping and nothing left to do
+        PfffJob* job = queue.front();
+        queue.pop_front();
+        pthread_mutex_unlock(&lock);
+
+        job->run(worker);
+        delete job;
+
+        pthread_mutex_lock(&lock);
+        pending--;
+        pthread_cond_broadcast(&job_done);
+    }
+    pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,75 @@
+/**
+ * PfffThreadPool.h: A minimal fixed-size pool of worker threads.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffThreadPool_h__
+#define __PfffThreadPool_h__
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+using std::deque;
+using std::vector;
+
+/**
+ * A unit of work for the PfffThreadPool.
+ * The pool deletes the job after run() returns.
+ */
+class PfffJob {
+public:
+    virtual ~PfffJob() {};
+
+    /**
+     * Performs the work. worker is the index (0..n_threads-1) of the thread
+     * running the job, so that callers may keep per-thread state
+     * (e.g. one PfffHasher per worker) in a plain array.
+     */
+    virtual void run(int worker) = 0;
+};
+
+/**
+ * Runs submitted jobs on a fixed number of threads in FIFO order.
+ * With n_threads == 0 no threads are started and submit() runs each job
+ * immediately in the calling thread (as worker 0).
+ * When max_pending > 0, submit() blocks while that many jobs are queued
+ * or running, which bounds the number of I/O requests in flight.
+ */
+class PfffThreadPool {
+public:
+    PfffThreadPool(int n_threads, long max_pending = 0);
+
+    /** Waits for all submitted jobs to finish and stops the threads */
+    ~PfffThreadPool();
+
+    /** Queues a job. The pool takes ownership of the object. */
+    void submit(PfffJob* job);
+
+    /** Blocks until every job submitted so far has finished */
+    void wait_all();
+
+    /** Number of distinct worker indices that may be passed to PfffJob::run */
+    inline int n_workers() const { return threads.size() > 0 ? threads.size() : 1; }
+
+protected:
+    vector<pthread_t> threads;
+    deque<PfffJob*> queue;
+    long max_pending;
+    long pending;       // Queued + running jobs
+    bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t  job_available;
+    pthread_cond_t  job_done;
+
+    struct WorkerArg {
+        PfffThreadPool* pool;
+        int worker;
+    };
+    vector<WorkerArg> worker_args;
+
+    static void* worker_main(void* arg);
+    void work(int worker);
+};
+
+#endif
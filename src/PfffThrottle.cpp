@@ -0,0 +1,205 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffThrottle.h"
+#include <iomanip>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "PfffStats.h"
+
+using std::ostringstream;
+
+// ------------- PfffRateLimiter ----------------
+
+PfffRateLimiter::PfffRateLimiter(const PfffThrottleSettings& settings):
+    requests(0), waited_ns(0), backoffs(0), settings(settings), last_ns(pfff_now_ns()),
+    pause_ns(0) {
+    // Start with full buckets
+    request_tokens = request_capacity();
+    byte_tokens = settings.max_bytes_per_s * PFFF_BURST_NS * 1e-9;
+    pthread_mutex_init(&lock, NULL);
+}
+
+double PfffRateLimiter::request_capacity() const {
+    double capacity = settings.max_iops * PFFF_BURST_NS * 1e-9;
+    return capacity < 1 ? 1 : capacity;
+}
+
+PfffRateLimiter::~PfffRateLimiter() {
+    pthread_mutex_destroy(&lock);
+}
+
+/**
+ * Refills the buckets for the time elapsed and takes the tokens of the request, going into debt if
+ * there are not enough of them. The request waits until the debt would be paid back, plus the backoff
+ * pause. As the tokens are taken before waiting, concurrent requests queue up behind each other.
+ */
+void PfffRateLimiter::acquire(unsigned long bytes) {
+    pthread_mutex_lock(&lock);
+    long long now = pfff_now_ns();
+    double elapsed_s = (now - last_ns) * 1e-9;
+    last_ns = now;
+    long long wait_ns = 0;
+    if (settings.max_iops > 0) {
+        double capacity = request_capacity();
+        request_tokens += elapsed_s * settings.max_iops;
+        if (request_tokens > capacity) request_tokens = capacity;
+        request_tokens -= 1;
+        if (request_tokens < 0) wait_ns = (long long)(-request_tokens / settings.max_iops * 1e9);
+    }
+    if (settings.max_bytes_per_s > 0) {
+        double capacity = settings.max_bytes_per_s * PFFF_BURST_NS * 1e-9;
+        byte_tokens += elapsed_s * settings.max_bytes_per_s;
+        if (byte_tokens > capacity) byte_tokens = capacity;
+        byte_tokens -= bytes;
+        if (byte_tokens < 0) {
+            long long byte_wait_ns = (long long)(-byte_tokens / settings.max_bytes_per_s * 1e9);
+            if (byte_wait_ns > wait_ns) wait_ns = byte_wait_ns;
+        }
+    }
+    wait_ns += pause_ns;
+    requests++;
+    waited_ns += wait_ns;
+    pthread_mutex_unlock(&lock);
+    if (wait_ns >= 1000) usleep(wait_ns / 1000);
+}
+
+void PfffRateLimiter::completed(long long latency_ns) {
+    if (settings.max_latency_ns <= 0) return;
+    pthread_mutex_lock(&lock);
+    if (latency_ns > settings.max_latency_ns) {
+        backoffs++;
+        pause_ns = pause_ns * 2 > latency_ns ? pause_ns * 2 : latency_ns;
+        if (pause_ns > PFFF_MAX_BACKOFF_NS) pause_ns = PFFF_MAX_BACKOFF_NS;
+    }
+    else {
+        pause_ns /= 2;
+        if (pause_ns < 1000) pause_ns = 0;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+long long PfffRateLimiter::backoff_ns() {
+    pthread_mutex_lock(&lock);
+    long long result = pause_ns;
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+// ------------- ThrottledBlockReader ----------------
+
+ThrottledBlockReader::ThrottledBlockReader(BlockReader* reader, PfffRateLimiter* limiter):
+    BlockReader(""), reader(reader), limiter(limiter), slowest_ns(0) {
+}
+
+ThrottledBlockReader::~ThrottledBlockReader() {
+    delete reader;
+}
+
+string ThrottledBlockReader::get_filename() {
+    return reader->get_filename();
+}
+
+long long ThrottledBlockReader::retries() {
+    return reader->retries();
+}
+
+long long ThrottledBlockReader::_size() {
+    long long result = reader->size();
+    if (result < 0) error_message = reader->error_message;
+    return result;
+}
+
+void ThrottledBlockReader::begin_block_sequence(char* buffer) {
+    slowest_ns = 0;
+    reader->begin_block_sequence(buffer);
+}
+
+bool ThrottledBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    limiter->acquire(block_size);
+    long long start = pfff_now_ns();
+    bool result = reader->next_block(block_start, block_size);
+    long long latency = pfff_now_ns() - start;
+    limiter->completed(latency);
+    if (latency > slowest_ns) slowest_ns = latency;
+    if (!result) error_message = reader->error_message;
+    return result;
+}
+
+bool ThrottledBlockReader::end_block_sequence() {
+    long long start = pfff_now_ns();
+    bool result = reader->end_block_sequence();
+    long long latency = pfff_now_ns() - start;
+    // Readers which batch their requests (HTTP) make them here: count that as one more request
+    if (latency > slowest_ns) limiter->completed(latency);
+    if (!result) error_message = reader->error_message;
+    return result;
+}
+
+// ------------- PfffThrottle ----------------
+
+PfffThrottle::PfffThrottle(const PfffThrottleSettings& settings): settings(settings) {
+    pthread_mutex_init(&lock, NULL);
+}
+
+PfffThrottle::~PfffThrottle() {
+    for (map<string, PfffRateLimiter*>::iterator i = limiters.begin(); i != limiters.end(); i++) delete i->second;
+    pthread_mutex_destroy(&lock);
+}
+
+PfffRateLimiter* PfffThrottle::limiter(const string& key) {
+    pthread_mutex_lock(&lock);
+    PfffRateLimiter*& result = limiters[key];
+    if (result == NULL) result = new PfffRateLimiter(settings);
+    pthread_mutex_unlock(&lock);
+    return result;
+}
+
+BlockReader* PfffThrottle::wrap(BlockReader* reader, const string& key) {
+    return new ThrottledBlockReader(reader, limiter(key));
+}
+
+string PfffThrottle::device_key(const string& filename) {
+    struct stat s;
+    if (stat(filename.c_str(), &s) != 0) return filename;
+    ostringstream key;
+    key << "device:" << (unsigned long long)s.st_dev;
+    return key.str();
+}
+
+void PfffThrottle::output(ostream& out) {
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(6);
+    pthread_mutex_lock(&lock);
+    for (map<string, PfffRateLimiter*>::iterator i = limiters.begin(); i != limiters.end(); i++) {
+        out << "throttle\t" << i->first
+            << "\trequests=" << i->second->requests
+            << "\twaited_s=" << i->second->waited_ns * 1e-9
+            << "\tbackoffs=" << i->second->backoffs
+            << "\tbackoff_s=" << i->second->backoff_ns() * 1e-9 << '\n';
+    }
+    pthread_mutex_unlock(&lock);
+    out.flags(flags);
+    out.precision(precision);
+}
+
+// ------------- I/O priority ----------------
+
+// From linux/ioprio.h, which is not installed everywhere
+#define PFFF_IOPRIO_CLASS_SHIFT 13
+#define PFFF_IOPRIO_CLASS_IDLE  3
+#define PFFF_IOPRIO_WHO_PROCESS 1
+
+bool pfff_set_idle_io_priority() {
+#if defined(__linux__) && defined(SYS_ioprio_set)
+    return syscall(SYS_ioprio_set, PFFF_IOPRIO_WHO_PROCESS, 0, PFFF_IOPRIO_CLASS_IDLE << PFFF_IOPRIO_CLASS_SHIFT) == 0;
+#else
+    return false;
+#endif
+}
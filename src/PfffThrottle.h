@@ -0,0 +1,133 @@
+/**
+ * PfffThrottle.h: Keeping background scans from starving the other users of the storage.
+ *
+ * The reads made from each device (or remote host) pass through a shared rate limiter: token
+ * buckets capping the requests and the bytes per second, and an adaptive backoff which inserts a
+ * pause before each request while the observed request latency is above a threshold (doubling
+ * the pause while it stays there, halving it once it is below), so that a scan slows down by
+ * itself when the storage gets busy. The process may also be put in the idle I/O class.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffThrottle_h__
+#define __PfffThrottle_h__
+#include <map>
+#include <ostream>
+#include <string>
+#include <pthread.h>
+#include "PfffBlockReader.h"
+
+using std::map;
+using std::ostream;
+using std::string;
+
+// Longest pause inserted by the backoff before a request
+#define PFFF_MAX_BACKOFF_NS 1000000000LL
+// The buckets hold this much of their rate, which is the largest burst allowed
+#define PFFF_BURST_NS 100000000LL
+
+/**
+ * Limits of the reads from one device or host. 0 means no limit.
+ */
+struct PfffThrottleSettings {
+    double max_iops;
+    double max_bytes_per_s;
+    long long max_latency_ns;   // Threshold of the adaptive backoff
+};
+
+/**
+ * The rate limiter of one device or host, shared by all the readers of it. Thread-safe.
+ */
+class PfffRateLimiter {
+public:
+    // Counters, for the statistics
+    long long requests;
+    long long waited_ns;    // Total time requests were held back
+    long long backoffs;     // Requests found slower than max_latency_ns
+
+    PfffRateLimiter(const PfffThrottleSettings& settings);
+    ~PfffRateLimiter();
+
+    /** Waits until a request of the given number of bytes may be made. */
+    void acquire(unsigned long bytes);
+
+    /** Reports the latency of a request made, for the adaptive backoff. */
+    void completed(long long latency_ns);
+
+    /** The current pause before each request */
+    long long backoff_ns();
+
+protected:
+    PfffThrottleSettings settings;
+    pthread_mutex_t lock;
+    long long last_ns;          // When the buckets were last refilled
+    double request_tokens;      // May go negative: requests wait until the debt is paid back
+    double byte_tokens;
+    long long pause_ns;
+
+    /** Size of the request bucket: at least one request */
+    double request_capacity() const;
+};
+
+/**
+ * A BlockReader passing each request through a rate limiter before making it with another reader.
+ * Wrap it around the reader which makes the actual requests (below any BufferingBlockReader),
+ * so that the limits apply to what is really asked of the storage.
+ * NB: On destructor, ThrottledBlockReader will destroy the wrapped reader too. The limiter is not owned.
+ */
+class ThrottledBlockReader: public BlockReader {
+public:
+    ThrottledBlockReader(BlockReader* reader, PfffRateLimiter* limiter);
+    virtual ~ThrottledBlockReader();
+
+    long long _size();
+    void begin_block_sequence(char* buffer);
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+    bool end_block_sequence();
+    string get_filename();
+    long long retries();
+
+protected:
+    BlockReader* reader;
+    PfffRateLimiter* limiter;
+    long long slowest_ns;   // Longest next_block() of the sequence
+};
+
+/**
+ * The rate limiters of a run, one per device or host, created on first use. Thread-safe.
+ */
+class PfffThrottle {
+public:
+    PfffThrottle(const PfffThrottleSettings& settings);
+    ~PfffThrottle();
+
+    /** The limiter of the given device or host */
+    PfffRateLimiter* limiter(const string& key);
+
+    /** Wraps the reader into a ThrottledBlockReader with the limiter of the given key. */
+    BlockReader* wrap(BlockReader* reader, const string& key);
+
+    /** The key of the device holding a local file ("device:<number>"), or the filename if it cannot be found. */
+    static string device_key(const string& filename);
+
+    /**
+     * Writes one line per device or host:
+     *   throttle  <key>  requests=...  waited_s=...  backoffs=...  backoff_s=...
+     */
+    void output(ostream& out);
+
+protected:
+    PfffThrottleSettings settings;
+    map<string, PfffRateLimiter*> limiters;
+    pthread_mutex_t lock;
+};
+
+/**
+ * Puts the process in the idle I/O scheduling class (ioprio_set), where it is served only when
+ * no one else uses the disk. Only on Linux, and only honoured by some I/O schedulers (CFQ, BFQ).
+ * Threads started afterwards inherit the class. Returns false if it could not be set.
+ */
+bool pfff_set_idle_io_priority();
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffTrace.h"
+#include <cstdio>
+#include <cstring>
+#include "PfffStats.h"
+
+static const char TRACE_MAGIC[4] = { 'P', 'F', 'T', 'R' };
+
+// Longest file name accepted when reading a trace, to fail early on garbage
+static const unsigned long long MAX_FILENAME_LEN = 1 << 20;
+
+// ------------- PfffTraceWriter ----------------
+
+PfffTraceWriter::PfffTraceWriter(ostream& out): events(0), out(out), last_start_ns(pfff_now_ns()) {
+    out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    out.put((char)PFFF_TRACE_VERSION);
+}
+
+void PfffTraceWriter::write_varint(unsigned long long value) {
+    while (value >= 0x80) {
+        out.put((char)(0x80 | (value & 0x7F)));
+        value >>= 7;
+    }
+    out.put((char)value);
+}
+
+void PfffTraceWriter::record(const string& filename, unsigned long long offset, unsigned long length,
+                             long long start_ns, long long duration_ns, bool failed) {
+    if (events == 0 || filename != current_file) {
+        out.put('F');
+        write_varint(filename.size());
+        out.write(filename.data(), filename.size());
+        current_file = filename;
+    }
+    out.put('R');
+    write_varint(offset);
+    write_varint(length);
+    write_varint(start_ns > last_start_ns ? start_ns - last_start_ns : 0);
+    write_varint(duration_ns > 0 ? duration_ns : 0);
+    out.put(failed ? 1 : 0);
+    if (start_ns > last_start_ns) last_start_ns = start_ns;
+    events++;
+}
+
+// ------------- PfffTraceReader ----------------
+
+PfffTraceReader::PfffTraceReader(istream& in): in(in), last_start_ns(0) {
+    char header[sizeof(TRACE_MAGIC) + 1];
+    if (!in.read(header, sizeof(header)) || memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0)
+        error_message = "Not a pfff trace";
+    else if (header[sizeof(TRACE_MAGIC)] != PFFF_TRACE_VERSION)
+        error_message = "Unsupported trace version";
+}
+
+bool PfffTraceReader::read_varint(unsigned long long& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF) return false;
+        value |= (unsigned long long)(c & 0x7F) << shift;
+        if ((c & 0x80) == 0) return true;
+    }
+    return false;
+}
+
+bool PfffTraceReader::next(PfffTraceEvent& event) {
+    if (!error_message.empty()) return false;
+    while (true) {
+        int type = in.get();
+        if (type == EOF) return false;
+        if (type == 'F') {
+            unsigned long long len;
+            if (!read_varint(len) || len > MAX_FILENAME_LEN) break;
+            current_file.resize(len);
+            if (len > 0 && !in.read(&current_file[0], len)) break;
+        }
+        else if (type == 'R') {
+            unsigned long long offset, length, start_delta, duration;
+            if (!read_varint(offset) || !read_varint(length) || !read_varint(start_delta) || !read_varint(duration)) break;
+            int flags = in.get();
+            if (flags == EOF) break;
+            last_start_ns += start_delta;
+            event.filename = current_file;
+            event.offset = offset;
+            event.length = length;
+            event.start_ns = last_start_ns;
+            event.duration_ns = duration;
+            event.failed = (flags & 1) != 0;
+            return true;
+        }
+        else break;
+    }
+    error_message = "Truncated or corrupt trace";
+    return false;
+}
+
+// ------------- TracingBlockReader ----------------
+
+TracingBlockReader::TracingBlockReader(BlockReader* reader, PfffTraceWriter* trace):
+    BlockReader(""), reader(reader), trace(trace) {};
+
+TracingBlockReader::~TracingBlockReader() {
+    delete reader;
+}
+
+long long TracingBlockReader::_size() {
+    long long result = reader->size();
+    if (result < 0) error_message = reader->error_message;
+    return result;
+}
+
+string TracingBlockReader::get_filename() {
+    return reader->get_filename();
+}
+
+long long TracingBlockReader::retries() {
+    return reader->retries();
+}
+
+void TracingBlockReader::begin_block_sequence(char* buffer) {
+    reader->begin_block_sequence(buffer);
+}
+
+bool TracingBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    long long start = pfff_now_ns();
+    bool result = reader->next_block(block_start, block_size);
+    trace->record(reader->get_filename(), block_start, block_size, start, pfff_now_ns() - start, !result);
+    if (!result) error_message = reader->error_message;
+    return result;
+}
+
+bool TracingBlockReader::end_block_sequence() {
+    bool result = reader->end_block_sequence();
+    if (!result) error_message = reader->error_message;
+    return result;
+}
@@ -0,0 +1,110 @@
+/**
+ * PfffTrace.h: Recording of the reads made by pfff (pfff --trace), for export and replay with pfff-trace.
+ *
+ * A trace is the magic "PFTR" and a version byte, followed by records, each starting with a type byte:
+ *   'F' <len> <name>                   - the following reads are from the file with the given name
+ *   'R' <offset> <length> <start delta> <duration> <flags>
+ *                                      - a read; start delta is the time since the start of the previous
+ *                                        read (since the start of the trace for the first), flags is 1 if
+ *                                        the read failed
+ * Numbers are unsigned LEB128 varints, times are in nanoseconds.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffTrace_h__
+#define __PfffTrace_h__
+#include <istream>
+#include <ostream>
+#include <string>
+#include "PfffBlockReader.h"
+
+using std::istream;
+using std::ostream;
+using std::string;
+
+#define PFFF_TRACE_VERSION 1
+
+/**
+ * A single read from a trace. start_ns is relative to the start of the trace.
+ */
+struct PfffTraceEvent {
+    string filename;
+    unsigned long long offset;
+    unsigned long length;
+    long long start_ns;
+    long long duration_ns;
+    bool failed;
+};
+
+/**
+ * Writes a trace. Not thread-safe.
+ */
+class PfffTraceWriter {
+public:
+    /** Writes the trace header. Times are counted from the construction of the writer. */
+    PfffTraceWriter(ostream& out);
+
+    /** Records a read that started at start_ns (a pfff_now_ns() value) */
+    void record(const string& filename, unsigned long long offset, unsigned long length,
+                long long start_ns, long long duration_ns, bool failed);
+
+    long long events;
+
+protected:
+    ostream& out;
+    long long last_start_ns;
+    string current_file;
+
+    void write_varint(unsigned long long value);
+};
+
+/**
+ * Reads a trace written by PfffTraceWriter.
+ */
+class PfffTraceReader {
+public:
+    /** Reads the trace header, setting error_message if it is not valid. */
+    PfffTraceReader(istream& in);
+
+    /**
+     * Reads the next event. Returns false at the end of the trace, or on error
+     * (error_message is set then).
+     */
+    bool next(PfffTraceEvent& event);
+
+    string error_message;
+
+protected:
+    istream& in;
+    long long last_start_ns;
+    string current_file;
+
+    bool read_varint(unsigned long long& value);
+};
+
+/**
+ * A BlockReader that passes all calls to another one and records each next_block() in a trace.
+ * It is meant to wrap the reader that accesses the file, under any BufferingBlockReader,
+ * so that the trace shows the reads actually made.
+ * NB: Readers that defer the transfer to end_block_sequence() (HTTP) have their requests
+ * recorded with the time needed to queue them only.
+ * NB: On destructor, TracingBlockReader will destroy the wrapped reader too.
+ */
+class TracingBlockReader: public BlockReader {
+public:
+    TracingBlockReader(BlockReader* reader, PfffTraceWriter* trace);
+    virtual ~TracingBlockReader();
+
+    long long _size();
+    void begin_block_sequence(char* buffer);
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+    bool end_block_sequence();
+    string get_filename();
+    long long retries();
+protected:
+    BlockReader* reader;
+    PfffTraceWriter* trace;
+};
+
+#endif
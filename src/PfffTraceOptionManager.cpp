@@ -0,0 +1,103 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffTraceOptionManager.h"
+#include <cstdlib>
+#include <stdio.h>
+
+using std::endl;
+
+// ------------ PfffTraceOptionManager ---------------
+PfffTraceOptionManager::PfffTraceOptionManager(): OptionManager(), TEST_MODE(false) {
+    add_group("Options");
+        add_unparameterized("chrome", 'c', &chrome,
+            "Convert the trace to the Chrome trace event format\n"
+            "(JSON), for chrome://tracing or Perfetto, on stdout.");
+        add_unparameterized("replay", 'r', &replay,
+            "Make the reads of the trace again and report how\n"
+            "long they take compared to the recording.");
+        add_parameterized("map", 'm', &map_given, new CharPtrOption(&map, ""), "<from>=<to>",
+            "When replaying, read the files with the path prefix\n"
+            "<from> from <to> instead, e.g. /mnt/nfs=/mnt/ssd.");
+        add_unparameterized("paced", 'p', &paced,
+            "When replaying, start each read no sooner than it\n"
+            "was started in the recording. By default the reads\n"
+            "are made back to back.");
+        add_unparameterized("cold", 'C', &cold,
+            "Before replaying, ask the OS to drop the cached\n"
+            "data of the files (where supported).");
+        add_parameterized("output", 'o', &output_given, new CharPtrOption(&output, ""), "<file>",
+            "When replaying, record the replayed reads as a new\n"
+            "trace in <file>.");
+        add_unparameterized("help", 'h', &help,
+            "Output this help message to stdout.");
+}
+
+/**
+ * Reads options from command line. On any failure prints error message and dies.
+ */
+void PfffTraceOptionManager::init_from_cmdline_or_die(int argc, char* const argv[]) {
+    if (!read_from_cmdline(argc, argv)) die_with_error("");
+    validate_or_die();
+}
+
+/**
+ * Dumps a long 'help' message describing all the options to a given ostream.
+ */
+void PfffTraceOptionManager::print_usage(ostream& out) {
+    const char* USAGE =
+    "Reads an I/O trace recorded with pfff --trace. By default the reads are listed\n"
+    "as tab-separated lines of file, offset, length, start and duration (in\n"
+    "microseconds) and status.\n"
+    "\n"
+    "Usage: pfff-trace [options] <trace>\n"
+    "\n";
+    out << USAGE;
+    print_option_help(out);
+}
+
+/**
+ * Equivalent to print(message,cerr), exit(2)
+ */
+void PfffTraceOptionManager::die_with_error(const string& message) {
+    if (TEST_MODE) throw message;
+    *cerr << message << endl;
+    *cerr << "Run the program with the --help option to get usage information." << endl;
+    #ifdef DEBUG
+    while(1) if ('\n' == getchar()) break;
+    #endif
+    exit(2);
+}
+
+bool PfffTraceOptionManager::validate() {
+    if (help) return true;
+    try {
+        if (parameters.size() != 1)
+            throw (char*)"Error: Exactly one trace file must be given.";
+        if (chrome && replay)
+            throw (char*)"Error: Only one of --chrome and --replay may be given.";
+        if (!replay && (map_given || paced || cold || output_given))
+            throw (char*)"Error: --map, --paced, --cold and --output only apply to --replay.";
+        if (map_given) {
+            string m = map;
+            string::size_type eq = m.find('=');
+            if (eq == string::npos || eq == 0)
+                throw (char*)"Error: --map must be given as <from>=<to>.";
+            map_from = m.substr(0, eq);
+            map_to = m.substr(eq + 1);
+        }
+        return true;
+    }
+    catch(char* msg) {
+        error_message = string(msg);
+        return false;
+    }
+}
+
+/**
+ * if (!validate()) die_with_error(error_message)
+ */
+void PfffTraceOptionManager::validate_or_die() {
+    if (!validate()) die_with_error(error_message);
+}
@@ -0,0 +1,65 @@
+/**
+ * PfffTraceOptionManager.h: Class for managing the command-line options to the pfff-trace tool.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffTraceOptionManager_h__
+#define __PfffTraceOptionManager_h__
+#include <iostream>
+#include "OptionManager.h"
+using std::ostream;
+
+/**
+ * Command-line option parser for pfff-trace.
+ */
+struct PfffTraceOptionManager: public OptionManager {
+public:
+    // Used to disable "exit(2)" in die_with_error. Instead, makes the
+    // procedure throw a string.
+    bool TEST_MODE;
+
+    int   chrome;
+    int   replay;
+    const char* map;
+    int   map_given;
+    int   paced;
+    int   cold;
+    const char* output;
+    int   output_given;
+    int   help;
+
+    string error_message;
+    string map_from;    // The two halves of --map
+    string map_to;
+
+    PfffTraceOptionManager();
+
+    /**
+     * Reads options from command line. On any failure prints error message and dies.
+     */
+    void init_from_cmdline_or_die(int argc, char* const argv[]);
+
+    /**
+     * Dumps a long 'help' message describing all the options to a given ostream.
+     */
+    void print_usage(ostream& out);
+
+    /**
+     * Equivalent to print(message,cerr), exit(2)
+     */
+    void die_with_error(const string& message);
+
+    /**
+     * Returns true if options are valid. Otherwise returns false and sets the
+     * error_message field.
+     */
+    bool validate();
+
+    /**
+     * if (!validate()) die_with_error(error_message)
+     */
+    void validate_or_die();
+};
+
+#endif
@@ -0,0 +1,180 @@
+/**
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include "PfffTreeBlockReader.h"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <sstream>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef __MINGW32__
+ #define lstat stat
+ #define S_ISLNK(m) 0
+#endif
+
+using std::ostringstream;
+
+/**
+ * A piece of a request falling into one file.
+ */
+struct TreePiece {
+    long file;
+    unsigned long long offset;  // In the file
+    unsigned long len;
+    char* target;
+    inline bool operator<(const TreePiece& other) const {
+        return file < other.file || (file == other.file && offset < other.offset);
+    }
+};
+
+// ------------- VirtualTreeBlockReader ----------------
+
+VirtualTreeBlockReader::VirtualTreeBlockReader(const char* root, bool no_symlinks):
+    BlockReader(root), files_opened(0), no_symlinks(no_symlinks) {
+}
+
+bool VirtualTreeBlockReader::walk(const string& directory, vector<pair<string, unsigned long long> >& files) {
+    string path = directory == "" ? filename : filename + "/" + directory;
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL) {
+        error_message = path + ": " + strerror(errno);
+        return false;
+    }
+    vector<string> names;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) names.push_back(entry->d_name);
+    }
+    closedir(dir);
+
+    for (int i = 0; i < names.size(); i++) {
+        string relative = directory == "" ? names[i] : directory + "/" + names[i];
+        string full = filename + "/" + relative;
+        struct stat s;
+        if (lstat(full.c_str(), &s) != 0) {
+            error_message = full + ": " + strerror(errno);
+            return false;
+        }
+        if (S_ISLNK(s.st_mode)) {
+            // Dangling links are left out like the other non-files
+            if (no_symlinks || stat(full.c_str(), &s) != 0 || S_ISDIR(s.st_mode)) continue;
+        }
+        if (S_ISDIR(s.st_mode)) {
+            if (!walk(relative, files)) return false;
+        }
+        else if (S_ISREG(s.st_mode)) files.push_back(std::make_pair(relative, (unsigned long long)s.st_size));
+    }
+    return true;
+}
+
+long long VirtualTreeBlockReader::_size() {
+    struct stat s;
+    if (stat(filename.c_str(), &s) != 0) {
+        error_message = filename + ": " + strerror(errno);
+        return NOT_FOUND;
+    }
+    if (!S_ISDIR(s.st_mode)) {
+        error_message = "Object " + filename + " is not a directory.";
+        return NOT_A_FILE;
+    }
+    vector<pair<string, unsigned long long> > files;
+    if (!walk("", files)) return READ_ERROR;
+    std::sort(files.begin(), files.end());
+
+    ostringstream out;
+    for (int i = 0; i < files.size(); i++) out << files[i].first << '\0' << files[i].second << '\n';
+    listing = out.str();
+    paths.clear();
+    file_offsets.assign(1, listing.size());
+    for (int i = 0; i < files.size(); i++) {
+        paths.push_back(files[i].first);
+        file_offsets.push_back(file_offsets.back() + files[i].second);
+    }
+    return file_offsets.back();
+}
+
+long VirtualTreeBlockReader::find_file(unsigned long long offset) const {
+    // The last file starting at or before offset, skipping empty files
+    return std::upper_bound(file_offsets.begin(), file_offsets.end() - 1, offset) - file_offsets.begin() - 1;
+}
+
+void VirtualTreeBlockReader::begin_block_sequence(char* buffer) {
+    this->buffer = buffer;
+    requests.clear();
+}
+
+bool VirtualTreeBlockReader::next_block(unsigned long long block_start, unsigned long block_size) {
+    if (size() < 0) return false;
+    Request request;
+    request.target = buffer;
+    request.start = block_start;
+    request.len = block_size;
+    requests.push_back(request);
+    buffer += block_size;
+    return true;
+}
+
+/**
+ * Serves the listing from memory, zero-fills beyond the end, and splits the rest into pieces
+ * of files. Each file holding pieces is then opened once and read in one block sequence.
+ */
+bool VirtualTreeBlockReader::end_block_sequence() {
+    unsigned long long contents_start = file_offsets.front(), end = file_offsets.back();
+    vector<TreePiece> pieces;
+    for (int i = 0; i < requests.size(); i++) {
+        Request& r = requests[i];
+        unsigned long long pos = r.start, request_end = r.start + r.len;
+        if (pos < contents_start) {
+            unsigned long long to = std::min(request_end, contents_start);
+            memcpy(r.target, listing.data() + pos, to - pos);
+            pos = to;
+        }
+        if (request_end > end) {
+            unsigned long long from = std::max(r.start, end);
+            memset(r.target + (from - r.start), 0, request_end - from);
+            request_end = end;
+        }
+        for (long f = pos < request_end ? find_file(pos) : 0; pos < request_end; f++) {
+            unsigned long long to = std::min(request_end, file_offsets[f + 1]);
+            if (to > pos) {
+                TreePiece piece = { f, pos - file_offsets[f], (unsigned long)(to - pos), r.target + (pos - r.start) };
+                pieces.push_back(piece);
+            }
+            pos = to;
+        }
+    }
+    requests.clear();
+    std::sort(pieces.begin(), pieces.end());
+
+    vector<char> data;
+    for (int first = 0; first < pieces.size(); ) {
+        int last = first;
+        unsigned long long total = 0;
+        while (last < pieces.size() && pieces[last].file == pieces[first].file) total += pieces[last++].len;
+
+        LocalFileBlockReader file((filename + "/" + paths[pieces[first].file]).c_str());
+        files_opened++;
+        if (file.size() < 0) {
+            error_message = file.error_message;
+            return false;
+        }
+        data.resize(total);
+        file.begin_block_sequence(&data[0]);
+        bool ok = true;
+        for (int i = first; i < last && ok; i++) ok = file.next_block(pieces[i].offset, pieces[i].len);
+        if (!(file.end_block_sequence() && ok)) {
+            error_message = file.error_message;
+            return false;
+        }
+        unsigned long long pos = 0;
+        for (int i = first; i < last; i++) {
+            memcpy(pieces[i].target, &data[pos], pieces[i].len);
+            pos += pieces[i].len;
+        }
+        first = last;
+    }
+    return true;
+}
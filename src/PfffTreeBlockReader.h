@@ -0,0 +1,65 @@
+/**
+ * PfffTreeBlockReader.h: A whole directory tree seen as a single file, for dataset-level fingerprints.
+ *
+ * The virtual file is a listing of the regular files of the tree, sorted by relative path, with
+ * their sizes, followed by their contents concatenated in the same order. A prefix-sum index maps
+ * the offsets of the virtual file to the files, so a fingerprint of the tree opens and reads only
+ * the files its sampled blocks fall into: about block_count reads, whatever the number of files.
+ * Building the listing needs a stat of every file, but no reads.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#ifndef __PfffTreeBlockReader_h__
+#define __PfffTreeBlockReader_h__
+#include <string>
+#include <utility>
+#include <vector>
+#include "PfffBlockReader.h"
+
+using std::pair;
+using std::string;
+using std::vector;
+
+/**
+ * Each line of the listing is <relative path>'\0'<size in decimal>'\n', paths separated by '/'.
+ * Symbolic links to files are followed, unless no_symlinks is set; links to directories are not,
+ * so that the walk cannot loop. Other special files are left out.
+ */
+class VirtualTreeBlockReader: public BlockReader {
+public:
+    VirtualTreeBlockReader(const char* root, bool no_symlinks = false);
+
+    /** The size of the virtual file. Walks the tree. */
+    long long _size();
+    void begin_block_sequence(char* buffer);
+    bool next_block(unsigned long long block_start, unsigned long block_size);
+    bool end_block_sequence();
+
+    // The tree, filled in by size()
+    string listing;
+    vector<string> paths;                       // Relative to the root, sorted
+    vector<unsigned long long> file_offsets;    // Start of each file in the virtual file, followed by its size
+
+    /** Number of files opened so far to serve reads */
+    long files_opened;
+
+protected:
+    bool no_symlinks;
+
+    // Requests of the current sequence, filled in by end_block_sequence
+    struct Request {
+        char* target;
+        unsigned long long start;
+        unsigned long len;
+    };
+    vector<Request> requests;
+
+    /** Adds the files under the given directory (relative to the root, "" for the root itself). */
+    bool walk(const string& directory, vector<pair<string, unsigned long long> >& files);
+
+    /** Index of the file holding the virtual offset, which must lie within the contents */
+    long find_file(unsigned long long offset) const;
+};
+
+#endif
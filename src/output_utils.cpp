@@ -3,19 +3,163 @@
  * License:   The terms of use of this software and its source code are defined by the BSD license.
  */
 #include "output_utils.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
 
-// Array used by output_hex
+// Arrays used by format_hex
 static const char* hex_chars = "0123456789ABCDEF";
+static const char* hex_chars_lower = "0123456789abcdef";
 
 /**
- * Outputs given binary data in hex bytewise.
+ * Table of two hex characters for each byte value, so that a byte is encoded
+ * with a single lookup instead of two shifts/masks and two stream writes.
+ */
+struct HexTable {
+    char pairs[256][2];
+    HexTable(const char* digits) {
+        for (int i = 0; i < 256; i++) {
+            pairs[i][0] = digits[i >> 4];
+            pairs[i][1] = digits[i & 0x0f];
+        }
+    }
+};
+static const HexTable hex_table(hex_chars);
+static const HexTable hex_table_lower(hex_chars_lower);
+
+/**
+ * Writes 2*buffer_len hex characters for the given binary data to dst.
  */
-void output_hex(ostream& out, const char* buffer, long long buffer_len) {
+char* format_hex(char* dst, const char* buffer, long long buffer_len, bool lowercase) {
+    const HexTable& table = lowercase ? hex_table_lower : hex_table;
     for (long long i = 0; i < buffer_len; i++) {
-        char a = (buffer[i] >> 4) & 0x0f;
-        char b = (buffer[i] & 0x0f);
-        out << hex_chars[a] << hex_chars[b];
-        // TODO: It could be cool to do something like out << hex << (int)buffer[i]
-        // but somehow it doesn't work as required.
+        memcpy(dst, table.pairs[(unsigned char)buffer[i]], 2);
+        dst += 2;
+    }
+    return dst;
+}
+
+/**
+ * Outputs given binary data in hex bytewise.
+ * Data is encoded in chunks into a local buffer, which then goes to the stream in one write.
+ */
+void output_hex(ostream& out, const char* buffer, long long buffer_len, bool lowercase) {
+    const long long CHUNK = 512;
+    char text[2*CHUNK];
+    while (buffer_len > 0) {
+        long long n = buffer_len < CHUNK ? buffer_len : CHUNK;
+        format_hex(text, buffer, n, lowercase);
+        out.write(text, 2*n);
+        buffer += n;
+        buffer_len -= n;
     }
 }
+
+/**
+ * Value of a hex digit or -1
+ */
+static inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/**
+ * Decodes text_len hex characters from text into text_len/2 bytes of output.
+ */
+bool parse_hex(const char* text, long long text_len, char* output) {
+    if (text_len % 2 != 0) return false;
+    for (long long i = 0; i < text_len; i += 2) {
+        int a = hex_value(text[i]);
+        int b = hex_value(text[i+1]);
+        if (a < 0 || b < 0) return false;
+        *output++ = (char)((a << 4) | b);
+    }
+    return true;
+}
+
+/**
+ * Outputs a string as a quoted JSON string literal.
+ * Bytes >= 0x80 are passed through as is (file names are expected to be UTF-8).
+ */
+void output_json_string(ostream& out, const char* str, long long str_len) {
+    out << '"';
+    const char* run = str; // Start of the current run of characters needing no escaping
+    for (long long i = 0; i < str_len; i++) {
+        unsigned char c = str[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        out.write(run, str + i - run);
+        run = str + i + 1;
+        switch (c) {
+            case '"':  out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default: {
+                char text[2];
+                format_hex(text, (const char*)&c, 1, true);
+                out << "\\u00";
+                out.write(text, 2);
+            }
+        }
+    }
+    out.write(run, str + str_len - run);
+    out << '"';
+}
+
+// ------------- FdOutputBuffer -------------
+
+FdOutputBuffer::FdOutputBuffer(int fd, long buffer_size): fd(fd), buffer_size(buffer_size) {
+    buffer = new char[buffer_size];
+    setp(buffer, buffer + buffer_size);
+}
+
+FdOutputBuffer::~FdOutputBuffer() {
+    sync();
+    delete[] buffer;
+}
+
+bool FdOutputBuffer::write_buffer() {
+    char* p = pbase();
+    while (p < pptr()) {
+        ssize_t written = write(fd, p, pptr() - p);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += written;
+    }
+    setp(buffer, buffer + buffer_size);
+    return true;
+}
+
+FdOutputBuffer::int_type FdOutputBuffer::overflow(int_type c) {
+    if (!write_buffer()) return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize FdOutputBuffer::xsputn(const char* s, std::streamsize n) {
+    std::streamsize done = 0;
+    while (done < n) {
+        std::streamsize space = epptr() - pptr();
+        if (space == 0) {
+            if (!write_buffer()) return done;
+            continue;
+        }
+        std::streamsize chunk = (n - done) < space ? (n - done) : space;
+        memcpy(pptr(), s + done, chunk);
+        pbump(chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+int FdOutputBuffer::sync() {
+    return write_buffer() ? 0 : -1;
+}
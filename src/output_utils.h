@@ -7,11 +7,80 @@
 #ifndef __output_utils_h__
 #define __output_utils_h__
 #include<ostream>
+#include<streambuf>
 using std::ostream;
+using std::streambuf;
 
 /**
- * Outputs given binary data in hex bytewise.
+ * Outputs given binary data in hex bytewise (uppercase unless lowercase is set).
  */
-extern void output_hex(ostream& out, const char* buffer, long long buffer_len);
+extern void output_hex(ostream& out, const char* buffer, long long buffer_len, bool lowercase = false);
+
+/**
+ * Writes 2*buffer_len hex characters for the given binary data to dst (no terminating zero).
+ * Returns the pointer just past the written characters.
+ */
+extern char* format_hex(char* dst, const char* buffer, long long buffer_len, bool lowercase = false);
+
+/**
+ * Decodes text_len hex characters (either case) from text into text_len/2 bytes of output.
+ * Returns false if text_len is odd or a non-hex character is found.
+ */
+extern bool parse_hex(const char* text, long long text_len, char* output);
+
+/**
+ * Outputs a string as a quoted JSON string literal, escaping as necessary.
+ */
+extern void output_json_string(ostream& out, const char* str, long long str_len);
+
+/**
+ * A streambuf writing into a fixed caller-provided char array.
+ * Output that does not fit is dropped (the stream then reports failure),
+ * and the array is always kept zero-terminated.
+ * Lets the C library format hashes straight into the user's buffer
+ * without the allocations of an ostringstream.
+ */
+class ArrayOutputBuffer: public streambuf {
+public:
+    inline ArrayOutputBuffer(): array(NULL) {}
+
+    /** Starts writing from the beginning of the given array */
+    inline void reset(char* array, unsigned int array_len) {
+        this->array = array;
+        if (array_len == 0) setp(array, array);
+        else setp(array, array + array_len - 1);
+    }
+
+    /** Zero-terminates whatever was written so far */
+    inline void terminate() {
+        if (array != NULL && epptr() != array) *pptr() = 0;
+    }
+protected:
+    char* array;
+};
+
+/**
+ * A streambuf collecting output in a large buffer and passing it to write(2)
+ * on the given file descriptor only when the buffer is full or the stream is flushed.
+ * Used in place of cout, which (when synchronized with stdio and flushed with endl
+ * after every line) costs a system call per fingerprint.
+ */
+class FdOutputBuffer: public streambuf {
+public:
+    FdOutputBuffer(int fd, long buffer_size = 1 << 16);
+    ~FdOutputBuffer();
+
+protected:
+    int fd;
+    char* buffer;
+    long buffer_size;
+
+    /** Writes out the buffer contents, returns false on error */
+    bool write_buffer();
+
+    int_type overflow(int_type c);
+    std::streamsize xsputn(const char* s, std::streamsize n);
+    int sync();
+};
 
 #endif
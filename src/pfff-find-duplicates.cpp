@@ -4,6 +4,7 @@
  * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
  * License:   The terms of use of this software and its source code are defined by the BSD license.
  */
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include "file_utils.h"
@@ -12,8 +13,10 @@
 #include "PfffHttpBlockReader.h"
 #include "PfffHasher.h"
 #include "PfffFindDuplicatesOptionManager.h"
+#include "PfffManifest.h"
 #include <stdlib.h>
 
+using std::ifstream;
 using std::ostringstream;
 
 /**
@@ -147,11 +150,48 @@ public:
     	delete input_file;
     	return result;
     }
+    
+    /**
+     * Groups the records of a manifest written by pfff.
+     * Returns false on error, true on success.
+     */
+    bool process_manifest(const string& filename) {
+        ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+        if (!in) {
+            cerr << "Error: Failed to open file " << filename << endl;
+            return false;
+        }
+        PfffManifestReader reader(in);
+        PfffManifestRecord record;
+        while (reader.next(record)) {
+            // Records made with different options must not match, hence the signature is part of the key
+            string key = record.has_signature ? string(record.signature.text, sizeof(PfffOptionsSignature)) : string();
+            dup_tracker.process_entry(key + record.digest, record.path);
+        }
+        if (!reader.error_message.empty()) {
+            cerr << "Error: " << filename << ": " << reader.error_message << endl;
+            return false;
+        }
+        return true;
+    }
 };
 
 int main(int argc, char* argv[]) {
     PfffFindDuplicatesAppEngine* engine = new PfffFindDuplicatesAppEngine();
     engine->init(argc, argv);
+    if (engine->option_manager.manifest) {
+        bool success = true;
+        vector<char*>& manifests = engine->option_manager.parameters;
+        for (vector<char*>::iterator i = manifests.begin(); i != manifests.end(); i++) {
+            if (!engine->process_manifest(*i)) {
+                success = false;
+                if (engine->option_manager.fail_on_error) break;
+            }
+        }
+        engine->quit();
+        delete engine;
+        return success ? 0 : 1;
+    }
     bool recursive = engine->option_manager.recursive && !engine->option_manager.ftp_given;
     bool success = process_files(engine->option_manager.parameters, recursive, engine->option_manager.no_symlinks, engine->option_manager.fail_on_error, engine);
     engine->quit();
@@ -0,0 +1,175 @@
+/**
+ * pfff-trace.cpp: Main file of the pfff-trace tool, which lists, exports and replays
+ * I/O traces recorded with pfff --trace.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "PfffBlockReader.h"
+#include "PfffStats.h"
+#include "PfffTrace.h"
+#include "PfffTraceOptionManager.h"
+#include "output_utils.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::ifstream;
+using std::ofstream;
+using std::vector;
+
+/**
+ * Writes the reads as tab-separated lines of file, offset, length, start_us, duration_us, status.
+ */
+static bool dump(PfffTraceReader& trace) {
+    PfffTraceEvent event;
+    cout << std::fixed << std::setprecision(3);
+    while (trace.next(event)) {
+        cout << event.filename << '\t' << event.offset << '\t' << event.length << '\t'
+             << event.start_ns * 1e-3 << '\t' << event.duration_ns * 1e-3 << '\t'
+             << (event.failed ? "failed" : "ok") << '\n';
+    }
+    return trace.error_message.empty();
+}
+
+/**
+ * Writes the reads as "complete" events of the Chrome trace event format.
+ */
+static bool export_chrome(PfffTraceReader& trace) {
+    PfffTraceEvent event;
+    cout << std::fixed << std::setprecision(3);
+    cout << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    while (trace.next(event)) {
+        if (!first) cout << ',';
+        first = false;
+        cout << "\n{\"name\":\"read\",\"cat\":\"io\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+             << ",\"ts\":" << event.start_ns * 1e-3
+             << ",\"dur\":" << event.duration_ns * 1e-3
+             << ",\"args\":{\"file\":";
+        output_json_string(cout, event.filename.data(), event.filename.size());
+        cout << ",\"offset\":" << event.offset
+             << ",\"length\":" << event.length
+             << ",\"failed\":" << (event.failed ? "true" : "false") << "}}";
+    }
+    cout << "\n]}\n";
+    return trace.error_message.empty();
+}
+
+/**
+ * Asks the OS to forget the cached data of the file.
+ */
+static void drop_cache(const string& path) {
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+#endif
+}
+
+/**
+ * Makes the reads of the trace again, with the same reader pfff uses for local files.
+ */
+static bool replay(PfffTraceReader& trace, PfffTraceOptionManager& om, PfffTraceWriter* output) {
+    long long reads = 0, bytes = 0, errors = 0;
+    long long recorded_io_ns = 0, replayed_io_ns = 0, recorded_span_ns = 0;
+    LocalFileBlockReader* file = NULL;
+    string current_path;
+    vector<char> buffer;
+
+    long long replay_start = pfff_now_ns();
+    PfffTraceEvent event;
+    while (trace.next(event)) {
+        string path = event.filename;
+        if (om.map_given && path.compare(0, om.map_from.size(), om.map_from) == 0)
+            path = om.map_to + path.substr(om.map_from.size());
+        if (file == NULL || path != current_path) {
+            delete file;
+            if (om.cold) drop_cache(path);
+            file = new LocalFileBlockReader(path.c_str());
+            current_path = path;
+        }
+        if (om.paced) {
+            long long wait_ns = replay_start + event.start_ns - pfff_now_ns();
+            if (wait_ns > 0) usleep(wait_ns / 1000);
+        }
+        if (buffer.size() < event.length) buffer.resize(event.length);
+
+        long long start = pfff_now_ns();
+        bool ok = file->size() >= 0;
+        if (ok && event.length > 0) {
+            file->begin_block_sequence(&buffer[0]);
+            ok = file->next_block(event.offset, event.length) && file->end_block_sequence();
+        }
+        long long duration = pfff_now_ns() - start;
+        if (output != NULL) output->record(path, event.offset, event.length, start, duration, !ok);
+
+        reads++;
+        if (ok) bytes += event.length;
+        else errors++;
+        recorded_io_ns += event.duration_ns;
+        replayed_io_ns += duration;
+        recorded_span_ns = event.start_ns + event.duration_ns;
+    }
+    long long replayed_span_ns = pfff_now_ns() - replay_start;
+    delete file;
+
+    cout << std::fixed << std::setprecision(6);
+    cout << "replay\ttotal\treads=" << reads << "\tbytes=" << bytes << "\terrors=" << errors
+         << "\trecorded_io_s=" << recorded_io_ns * 1e-9 << "\treplayed_io_s=" << replayed_io_ns * 1e-9
+         << "\trecorded_span_s=" << recorded_span_ns * 1e-9 << "\treplayed_span_s=" << replayed_span_ns * 1e-9 << '\n';
+    return trace.error_message.empty();
+}
+
+int main(int argc, char* argv[]) {
+    PfffTraceOptionManager option_manager;
+    option_manager.init_from_cmdline_or_die(argc, argv);
+    if (option_manager.help) {
+        option_manager.print_usage(cout);
+        return 0;
+    }
+
+    const string trace_name = option_manager.parameters[0];
+    ifstream trace_file(trace_name.c_str(), std::ios::in | std::ios::binary);
+    if (!trace_file) {
+        cerr << "Error: Failed to open " << trace_name << endl;
+        return 1;
+    }
+    PfffTraceReader trace(trace_file);
+
+    bool success;
+    if (option_manager.chrome) success = export_chrome(trace);
+    else if (option_manager.replay) {
+        ofstream output_file;
+        PfffTraceWriter* output = NULL;
+        if (option_manager.output_given) {
+            output_file.open(option_manager.output, std::ios::out | std::ios::binary);
+            if (!output_file) {
+                cerr << "Error: Failed to create " << option_manager.output << endl;
+                return 1;
+            }
+            output = new PfffTraceWriter(output_file);
+        }
+        success = replay(trace, option_manager, output);
+        delete output;
+        if (output_file.is_open()) {
+            output_file.close();
+            if (!output_file) {
+                cerr << "Error: Failed to write " << option_manager.output << endl;
+                success = false;
+            }
+        }
+    }
+    else success = dump(trace);
+
+    if (!trace.error_message.empty()) cerr << "Error: " << trace_name << ": " << trace.error_message << endl;
+    return success ? 0 : 1;
+}
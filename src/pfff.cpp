@@ -4,15 +4,37 @@
  * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
  * License:   The terms of use of this software and its source code are defined by the BSD license.
  */
+#include <deque>
+#include <fstream>
 #include <iostream>
 #include "file_utils.h"
 #include "PfffBlockReader.h"
+#include "PfffBgzfBlockReader.h"
 #include "PfffFtpBlockReader.h"
 #include "PfffHttpBlockReader.h"
+#include "PfffChecker.h"
+#include "PfffDaemon.h"
 #include "PfffHasher.h"
+#include "PfffHedgedBlockReader.h"
+#include "PfffMultiHasher.h"
 #include "PfffOptionManager.h"
+#include "PfffReadahead.h"
+#include "PfffRemoteListing.h"
+#include "PfffScheduler.h"
+#include "PfffStreamHasher.h"
+#include "PfffTar.h"
+#include "PfffThrottle.h"
+#include "PfffTreeBlockReader.h"
+#include "PfffTrace.h"
+#include "output_utils.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+using std::deque;
+
+// Number of requests sent to pfffd before waiting for the first reply, to hide the network latency
+#define PFFFD_PIPELINE_DEPTH 64
 
 /**
  * A convenience class, wrapping the main application logic (implementing the FileProcessor interface)
@@ -22,9 +44,26 @@ public:
     PfffOptionManager option_manager;
     FtpClientSocket* ftp_connection;
     HttpClientSocket* http_connection;
+    PfffDaemonClient* pfffd_connection;
+    deque<string> pfffd_pending;    // Files sent to pfffd and not yet answered
     PfffHasher* hasher;
+    PfffMultiHasher multi_hasher;   // With --also: hasher, followed by one hasher per --also
+    PfffTarHasher* tar_hasher;      // With --tar
+    PfffScheduler* scheduler;       // With --schedule
+    PfffReadahead* readahead;       // With --readahead
+    PfffThrottle* throttle;         // With --max-iops, --max-bandwidth or --max-latency
+    PfffLatencyTracker* hedge_tracker;  // With --hedge
+    long long known_size;   // Size of the next remote file from the directory listing, or -1
+    FdOutputBuffer* output_buffer;
+    ostream* out;
+    long unflushed_count;   // Fingerprints written since the last flush
+    PfffStats* stats;
+    long long stats_reported_ns;    // When the statistics were last written out
+    std::ofstream trace_file;
+    PfffTraceWriter* trace;
 
-    PfffAppEngine(): ftp_connection(NULL), hasher(NULL) {}
+    PfffAppEngine(): ftp_connection(NULL), pfffd_connection(NULL), hasher(NULL), tar_hasher(NULL), scheduler(NULL), readahead(NULL), throttle(NULL), hedge_tracker(NULL), known_size(-1), output_buffer(NULL), out(NULL), unflushed_count(0),
+        stats(NULL), stats_reported_ns(0), trace(NULL) {}
     
     /**
      * Should be called to initialize application.
@@ -42,6 +81,8 @@ public:
     	}
     	
     	// Initialize network connection, if necessary
+    	Socket::TIMEOUT_MS = option_manager.timeout * 1000;
+    	if (option_manager.hedge > 0) hedge_tracker = new PfffLatencyTracker(option_manager.hedge * 1000000LL);
     	if (option_manager.ftp_given || option_manager.http_given) {
     		if (option_manager.net_debug) Socket::DEBUG = true;
             if (option_manager.ftp_given) {
@@ -63,50 +104,461 @@ public:
                 http_connection = new HttpClientSocket(option_manager.http_host, option_manager.port);
             }
    	    }
+    	if (option_manager.pfffd_given) {
+    		if (option_manager.net_debug) Socket::DEBUG = true;
+    		try {
+    			pfffd_connection = new PfffDaemonClient(option_manager.pfffd_host, option_manager.port);
+    		}
+    		catch (string& error) {
+    			cerr << "Connection to pfffd failed: " << error << endl;
+    			exit(1);
+    		}
+    	}
+    	
+    	// Before any thread is started, so that they inherit the class
+    	if (option_manager.idle && !pfff_set_idle_io_priority())
+    		cerr << "Warning: Failed to set the idle I/O priority" << endl;
+    	if (option_manager.max_iops > 0 || option_manager.max_bandwidth > 0 || option_manager.max_latency > 0) {
+    		PfffThrottleSettings settings;
+    		settings.max_iops = option_manager.max_iops;
+    		settings.max_bytes_per_s = option_manager.max_bandwidth;
+    		settings.max_latency_ns = option_manager.max_latency * 1000000LL;
+    		throttle = new PfffThrottle(settings);
+    	}
     	
     	// Initialize hasher
     	hasher = new PfffHasher(&option_manager.options);    	
+    	hasher->tiers = option_manager.tier_counts;
+    	if (option_manager.stats) {
+    		stats = new PfffStats();
+    		stats_reported_ns = stats->start_ns;
+    		hasher->stats = stats;
+    	}
+    	if (option_manager.also_options.size() > 0) {
+    		multi_hasher.hashers.push_back(hasher);
+    		for (int i = 0; i < option_manager.also_options.size(); i++) {
+    			PfffHasher* also_hasher = new PfffHasher(&option_manager.also_options[i]);
+    			also_hasher->stats = stats;
+    			multi_hasher.hashers.push_back(also_hasher);
+    		}
+    	}
+    	if (option_manager.tar) {
+    		vector<const PfffOptions*> tar_options(1, &option_manager.options);
+    		for (int i = 0; i < option_manager.also_options.size(); i++) tar_options.push_back(&option_manager.also_options[i]);
+    		tar_hasher = new PfffTarHasher(tar_options, option_manager.tier_counts, option_manager.threads, option_manager.request_cost);
+    		tar_hasher->stats = stats;
+    		tar_hasher->throttle = throttle;
+    	}
+    	if (option_manager.schedule > 0 || option_manager.readahead > 0) {
+    		PfffMultiHasher planned = multi_hasher;
+    		if (planned.hashers.empty()) planned.hashers.push_back(hasher);
+    		if (option_manager.schedule > 0) scheduler = new PfffScheduler(planned, option_manager.request_cost);
+    		else readahead = new PfffReadahead(planned);
+    	}
+    	if (option_manager.trace_given) {
+    		trace_file.open(option_manager.trace, std::ios::out | std::ios::binary);
+    		if (!trace_file) {
+    			cerr << "Error: Failed to create trace " << option_manager.trace << endl;
+    			exit(1);
+    		}
+    		trace = new PfffTraceWriter(trace_file);
+    	}
+    	
+    	// Initialize output
+    	if (!option_manager.flush_every_given) 
+    		option_manager.flush_every = isatty(STDOUT_FILENO) ? 1 : 0;
+    	// With --tee, stdout carries the data
+    	output_buffer = new FdOutputBuffer(option_manager.tee ? STDERR_FILENO : STDOUT_FILENO);
+    	out = new ostream(output_buffer);
+    	if (!option_manager.check_given) hasher->formatter->output_header(*out);
     }
     
     void quit() {
+    	out->flush();
+    	if (stats != NULL) {
+    		output_stats();
+    		delete stats;
+    	}
+    	if (trace != NULL) {
+    		delete trace;
+    		trace_file.close();
+    		if (!trace_file) cerr << "Error: Failed to write trace " << option_manager.trace << endl;
+    	}
+    	delete out;
+    	delete output_buffer;
     	delete hasher;
+    	for (int i = 1; i < multi_hasher.hashers.size(); i++) delete multi_hasher.hashers[i];
+    	delete tar_hasher;
+    	delete scheduler;
+    	delete readahead;
+    	delete throttle;
+    	delete hedge_tracker;
     	if (option_manager.ftp_given) delete ftp_connection;
         if (option_manager.http_given) delete http_connection;
+        delete pfffd_connection;
+    }
+    
+    /**
+     * Writes the statistics to the --stats-file, or to stderr.
+     */
+    void output_stats() {
+    	if (option_manager.stats_file_given) {
+    		std::ofstream stats_file(option_manager.stats_file);
+    		output_stats(stats_file);
+    		if (!stats_file) cerr << "Error: Failed to write statistics to " << option_manager.stats_file << endl;
+    	}
+    	else output_stats(cerr);
+    }
+    
+    /**
+     * Writes the statistics, followed by those of the throttling and of the hedged requests.
+     */
+    void output_stats(ostream& out) {
+    	stats->output(out);
+    	if (throttle != NULL) throttle->output(out);
+    	if (hedge_tracker != NULL) hedge_tracker->output(out, option_manager.http_host);
+    }
+    
+    /**
+     * Called after each file processed. Writes out the statistics every --stats-interval seconds.
+     */
+    void file_done(bool success) {
+    	if (stats == NULL) return;
+    	stats->files++;
+    	if (!success) stats->failed_files++;
+    	if (option_manager.stats_interval > 0) {
+    		long long now = pfff_now_ns();
+    		if (now - stats_reported_ns >= option_manager.stats_interval * 1000000000LL) {
+    			output_stats(cerr);
+    			stats_reported_ns = now;
+    		}
+    	}
+    }
+    
+    /**
+     * Called after each fingerprint written out.
+     */
+    void record_done() {
+    	*out << hasher->formatter->record_end();
+    	if (option_manager.flush_every > 0 && ++unflushed_count >= option_manager.flush_every) {
+    		out->flush();
+    		unflushed_count = 0;
+    	}
+    }
+    
+    /**
+     * The key of the rate limiter of a file: its FTP/HTTP host or its local device.
+     */
+    string throttle_key(const string& filename) {
+    	if (option_manager.ftp_given) return string("ftp:") + option_manager.ftp_host;
+    	if (option_manager.http_given) return string("http:") + option_manager.http_host;
+    	return PfffThrottle::device_key(filename);
+    }
+    
+    /**
+     * Gives a reader of a remote file the size found in the directory listing, if any.
+     */
+    BlockReader* remote_reader(BlockReader* reader) {
+    	if (known_size >= 0) reader->set_size(known_size);
+    	return reader;
+    }
+    
+    /**
+     * Implements --recursive for FTP and HTTP: fingerprints the files found under the given paths,
+     * while the directories are listed from another connection.
+     * Returns false on any error.
+     */
+    bool process_remote_files(const vector<char*>& roots) {
+    	PfffRemoteLister* lister;
+    	if (option_manager.ftp_given) lister = new FtpRemoteLister(option_manager.ftp_host, option_manager.port);
+    	else lister = new HttpRemoteLister(option_manager.http_host, option_manager.port);
+    	PfffRemoteWalker walker(lister, vector<string>(roots.begin(), roots.end()));
+    	bool result = true;
+    	PfffRemoteEntry entry;
+    	while (walker.next(entry)) {
+    		bool current_result = true;
+    		if (entry.type == PfffRemoteEntry::FAILED) {
+    			cerr << "Error: " << entry.path << ": " << entry.error << endl;
+    			file_done(false);
+    			current_result = false;
+    		}
+    		else if (entry.type == PfffRemoteEntry::SYMLINK && option_manager.no_symlinks)
+    			cerr << "Note: ignoring symlink " << entry.path << endl;
+    		else {
+    			// The size of a symlink in the listing is that of the link
+    			known_size = entry.type == PfffRemoteEntry::REGULAR ? entry.size : -1;
+    			current_result = process_file(entry.path);
+    			known_size = -1;
+    		}
+    		if (!current_result) {
+    			result = false;
+    			if (option_manager.fail_on_error) {
+    				cerr << "Note: some files might have been left unprocessed." << endl;
+    				break;
+    			}
+    		}
+    	}
+    	return result;
     }
     
     /**
      * Returns false on error, true on success.
      */
     bool process_file(const string& filename) {
+    	if (option_manager.pfffd_given) {
+    		if (!pfffd_connection->send_request(hasher->formatter->signature, filename)) {
+    			cerr << "Error: " << pfffd_connection->error_message << endl;
+    			file_done(false);
+    			return false;
+    		}
+    		pfffd_pending.push_back(filename);
+    		return pfffd_pending.size() < PFFFD_PIPELINE_DEPTH || receive_pfffd_reply();
+    	}
+    	
+    	if (option_manager.tar) return process_archive(filename);
+    	if (scheduler != NULL) return schedule_file(filename);
+    	if (readahead != NULL) return read_ahead(filename);
+    	
     	bool result = true;
     	BlockReader* input_file;
     	if (option_manager.ftp_given) 
-    		input_file = new FtpBlockReader(ftp_connection, filename.c_str());
+    		input_file = remote_reader(new FtpBlockReader(ftp_connection, filename.c_str()));
+    	else if (option_manager.http_given && hedge_tracker != NULL) {
+    		// Each reader has its own connection, as a slow request may outlive the file
+    		const char* alternate_host = option_manager.alternate_host_given ? option_manager.alternate_host : option_manager.http_host;
+    		input_file = new HedgedBlockReader(
+    				remote_reader(new HttpBlockReader(new HttpClientSocket(option_manager.http_host, option_manager.port), filename.c_str(), true)),
+    				remote_reader(new HttpBlockReader(new HttpClientSocket(alternate_host, option_manager.port), filename.c_str(), true)),
+    				hedge_tracker);
+    	}
     	else if (option_manager.http_given)
-            input_file = new HttpBlockReader(http_connection, filename.c_str());
+            input_file = remote_reader(new HttpBlockReader(http_connection, filename.c_str()));
+        else if (option_manager.tree)
+    		input_file = new VirtualTreeBlockReader(filename.c_str(), option_manager.no_symlinks);
         else
     		input_file = new LocalFileBlockReader(filename.c_str());
     		
+    	if (trace != NULL) input_file = new TracingBlockReader(input_file, trace);
+    	// With --stats, account for the reads made from the file and for the blocks requested by the hasher
+    	if (stats != NULL) input_file = new MonitoringBlockReader(input_file, stats, "physical");
+    	// Above the monitor, so that the time spent waiting is not taken for read latency
+    	if (throttle != NULL) input_file = throttle->wrap(input_file, throttle_key(filename));
     	if (option_manager.request_cost > 0) input_file = new BufferingBlockReader(input_file, option_manager.request_cost);
+    	if (option_manager.bgzf) {
+    		bool local = !option_manager.ftp_given && !option_manager.http_given;
+    		input_file = new BgzfBlockReader(input_file, local ? (filename + ".gzi").c_str() : NULL);
+    	}
+    	if (stats != NULL) input_file = new MonitoringBlockReader(input_file, stats, "logical");
     	
     	try {
-    		hasher->hash(cout, input_file);
-    		cout << endl;
+    		if (multi_hasher.hashers.empty()) hasher->hash(*out, input_file);
+    		else multi_hasher.hash(*out, input_file);
+    		record_done();
     	}
     	catch(pfff_exception& e) {
     		cerr << "Error: " << e.what() << endl;
     		result = false;
     	}
     	delete input_file;
+    	file_done(result);
+    	return result;
+    }
+    
+    /**
+     * Implements --schedule: adds the file to the window, and processes the window once it is full.
+     * Returns false on error.
+     */
+    bool schedule_file(const string& filename) {
+    	BlockReader* input_file = new LocalFileBlockReader(filename.c_str());
+    	if (trace != NULL) input_file = new TracingBlockReader(input_file, trace);
+    	if (stats != NULL) input_file = new MonitoringBlockReader(input_file, stats, "physical");
+    	if (throttle != NULL) input_file = throttle->wrap(input_file, PfffThrottle::device_key(filename));
+    	scheduler->add(input_file);
+    	return scheduler->size() < option_manager.schedule || finish_scheduled_files();
+    }
+    
+    /**
+     * Reads the files of the --schedule window and outputs their fingerprints.
+     * Returns false on any error.
+     */
+    bool finish_scheduled_files() {
+    	bool result = true;
+    	scheduler->read();
+    	for (int i = 0; i < scheduler->size(); i++) {
+    		bool success = true;
+    		try {
+    			scheduler->output(i, *out);
+    			record_done();
+    		}
+    		catch(pfff_exception& e) {
+    			cerr << "Error: " << e.what() << endl;
+    			success = false;
+    		}
+    		file_done(success);
+    		result = result && success;
+    	}
+    	scheduler->clear();
+    	return result;
+    }
+    
+    /**
+     * Implements --readahead: starts reading the file ahead, and outputs the file added
+     * --readahead files before it. Returns false on error.
+     */
+    bool read_ahead(const string& filename) {
+    	BlockReader* input_file = new LocalFileBlockReader(filename.c_str());
+    	if (trace != NULL) input_file = new TracingBlockReader(input_file, trace);
+    	if (stats != NULL) input_file = new MonitoringBlockReader(input_file, stats, "physical");
+    	if (throttle != NULL) input_file = throttle->wrap(input_file, PfffThrottle::device_key(filename));
+    	if (option_manager.request_cost > 0) input_file = new BufferingBlockReader(input_file, option_manager.request_cost);
+    	readahead->add(input_file);
+    	return readahead->size() <= option_manager.readahead || output_read_ahead();
+    }
+    
+    /**
+     * Outputs the oldest file added with read_ahead. Returns false on error.
+     */
+    bool output_read_ahead() {
+    	bool result = true;
+    	try {
+    		readahead->output_next(*out);
+    		record_done();
+    	}
+    	catch(pfff_exception& e) {
+    		cerr << "Error: " << e.what() << endl;
+    		result = false;
+    	}
+    	file_done(result);
     	return result;
     }
+    
+    /**
+     * Implements --tar: outputs the fingerprints of the members of an archive, or of the one
+     * member selected with archive!member. Returns false on any error.
+     */
+    bool process_archive(const string& name) {
+    	string archive, member;
+    	PfffTarHasher::split_name(name, archive, member);
+    	long hashed = tar_hasher->members_hashed, failed = tar_hasher->members_failed;
+    	bool result = tar_hasher->hash(*out, cerr, archive, member);
+    	hashed = tar_hasher->members_hashed - hashed;
+    	failed = tar_hasher->members_failed - failed;
+    	// Each member counts as a file; an archive which could not be indexed as a failed one
+    	if (hashed == 0 && !result) file_done(false);
+    	for (long i = 0; i < hashed; i++) file_done(i >= failed);
+    	if (option_manager.flush_every > 0) out->flush();
+    	return result;
+    }
+    
+    /**
+     * Implements --tee: copies stdin to stdout and outputs the fingerprint of the data.
+     * Returns false on error.
+     */
+    bool tee_stream() {
+    	PfffMultiHasher single;
+    	PfffMultiHasher* hashers = &multi_hasher;
+    	if (multi_hasher.hashers.empty()) {
+    		single.hashers.push_back(hasher);
+    		hashers = &single;
+    	}
+    	string name = option_manager.parameters.empty() ? "-" : option_manager.parameters[0];
+    	bool result = true;
+    	try {
+    		PfffStreamHasher stream(hashers, option_manager.stream_size, name);
+    		if (!stream.tee(STDIN_FILENO, STDOUT_FILENO)) throw pfff_exception(stream.error_message);
+    		stream.finish(*out);
+    		record_done();
+    	}
+    	catch(pfff_exception& e) {
+    		cerr << "Error: " << e.what() << endl;
+    		result = false;
+    	}
+    	file_done(result);
+    	return result;
+    }
+    
+    /**
+     * Outputs the fingerprint for the oldest request sent to pfffd.
+     * Returns false on error, true on success.
+     */
+    bool receive_pfffd_reply() {
+    	string filename = pfffd_pending.front();
+    	pfffd_pending.pop_front();
+    	unsigned char digest[16];
+    	long long size;
+    	if (!pfffd_connection->receive_reply(digest, hasher->formatter->digest_len(), size)) {
+    		cerr << "Error: " << filename << ": " << pfffd_connection->error_message << endl;
+    		file_done(false);
+    		return false;
+    	}
+    	long long start = pfff_now_ns();
+    	hasher->formatter->set_file_size(size);
+    	if (!option_manager.no_filename) hasher->formatter->set_filename(filename);
+    	hasher->formatter->output_record(*out, digest);
+    	if (stats != NULL) stats->add_phase(PFFF_PHASE_OUTPUT, start);
+    	record_done();
+    	file_done(true);
+    	return true;
+    }
+    
+    /**
+     * Outputs the fingerprints still expected from pfffd.
+     * Returns false on any error.
+     */
+    bool finish_pfffd_requests() {
+    	bool result = true;
+    	while (!pfffd_pending.empty()) result = receive_pfffd_reply() && result;
+    	return result;
+    }
+    
+    /**
+     * Implements --check: verifies the files listed in the manifest.
+     * Returns false on any mismatch or error.
+     */
+    bool check_manifest() {
+    	const string manifest_name = option_manager.check;
+    	std::ifstream manifest_file;
+    	if (manifest_name != "-") {
+    		manifest_file.open(manifest_name.c_str(), std::ios::in | std::ios::binary);
+    		if (!manifest_file) {
+    			cerr << "Error: Failed to open manifest " << manifest_name << endl;
+    			return false;
+    		}
+    	}
+    	PfffManifestReader manifest(manifest_name == "-" ? std::cin : manifest_file);
+    	PfffChecker checker(&option_manager.options, option_manager.request_cost, option_manager.threads, *out);
+    	checker.throttle = throttle;
+    	bool success = checker.check(manifest);
+    	if (!success) cerr << "Error: " << manifest_name << ": " << checker.error_message << endl;
+    	checker.output_summary(*out);
+    	return success && checker.all_ok();
+    }
 };
 
 int main(int argc, char* argv[]) {
     PfffAppEngine* engine = new PfffAppEngine();
     engine->init(argc, argv);
-    bool recursive = engine->option_manager.recursive && !engine->option_manager.ftp_given;
-    bool success = process_files(engine->option_manager.parameters, recursive, engine->option_manager.no_symlinks, engine->option_manager.fail_on_error, engine);
+    if (engine->option_manager.check_given) {
+        bool success = engine->check_manifest();
+        engine->quit();
+        delete engine;
+        return success ? 0 : 1;
+    }
+    if (engine->option_manager.tee) {
+        bool success = engine->tee_stream();
+        engine->quit();
+        delete engine;
+        return success ? 0 : 1;
+    }
+    // With --tree, directories are fingerprinted as a whole rather than recursed into
+    bool recursive = engine->option_manager.recursive && !engine->option_manager.tree;
+    bool remote = engine->option_manager.ftp_given || engine->option_manager.http_given;
+    bool success;
+    if (recursive && remote) success = engine->process_remote_files(engine->option_manager.parameters);
+    else success = process_files(engine->option_manager.parameters, recursive && !remote, engine->option_manager.no_symlinks, engine->option_manager.fail_on_error, engine);
+    if (engine->option_manager.pfffd_given) success = engine->finish_pfffd_requests() && success;
+    if (engine->scheduler != NULL) success = engine->finish_scheduled_files() && success;
+    while (engine->readahead != NULL && engine->readahead->size() > 0) success = engine->output_read_ahead() && success;
     engine->quit();
     delete engine;
     return success ? 0: 1;
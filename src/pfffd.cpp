@@ -0,0 +1,56 @@
+/**
+ * pfffd.cpp: Main file of the pfff fingerprint server.
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include <iostream>
+#include <signal.h>
+#include <stdlib.h>
+#include "PfffDaemon.h"
+#include "PfffDaemonOptionManager.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+
+static PfffDaemon* daemon_instance = NULL;
+
+/**
+ * SIGINT/SIGTERM handler: closes the connections and lets main() finish.
+ */
+static void handle_stop_signal(int) {
+    if (daemon_instance != NULL) daemon_instance->interrupt();
+}
+
+int main(int argc, char* argv[]) {
+    PfffDaemonOptionManager option_manager;
+    option_manager.init_from_cmdline_or_die(argc, argv);
+    if (option_manager.help) {
+        option_manager.print_usage(cout);
+        return 0;
+    }
+    if (option_manager.net_debug) Socket::DEBUG = true;
+
+    try {
+        daemon_instance = new PfffDaemon(option_manager.root, option_manager.listen_address, option_manager.port,
+                                         option_manager.jobs, option_manager.max_connections,
+                                         option_manager.cache_size, option_manager.request_cost);
+    }
+    catch (string& error) {
+        cerr << "Error: Failed to listen on " << option_manager.listen_address << ":" << option_manager.port
+             << ": " << error << endl;
+        return 1;
+    }
+#ifndef WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    signal(SIGINT, handle_stop_signal);
+    signal(SIGTERM, handle_stop_signal);
+
+    cerr << "pfffd: serving " << option_manager.root << " on " << option_manager.listen_address << ":" << daemon_instance->port() << endl;
+    daemon_instance->serve();
+    cerr << "pfffd: stopped (" << daemon_instance->cache.hits << " cache hits, " << daemon_instance->cache.misses << " misses)" << endl;
+    delete daemon_instance;
+    return 0;
+}
@@ -0,0 +1,569 @@
+/**
+ * pfff-bench.cpp: End-to-end benchmark of pfff.
+ *
+ * Generates synthetic file trees of several file count/size mixes and fingerprints them
+ * with each BlockReader, timing the phases of PfffHasher::read_sample separately:
+ *   open      - creating the reader and querying the file size
+ *   sample    - PfffBlockSampleGenerator::generate
+ *   read      - reading the header and the sampled blocks
+ *   posthash-<format> - computing the digest of the sample
+ *   posthash-<format>-batch - the same for the samples of all files of the mix at once,
+ *               with PostHasher::compute_digests
+ *   output    - formatting the fingerprint (written to /dev/null)
+ * Runs are made with a warm page cache and, unless --warm-only is given, with a cold one
+ * (the files are dropped from the cache with posix_fadvise before the run).
+ * The simulated readers sim-<profile> and sim-<profile>-buffering (profiles hdd, ssd, nfs, http)
+ * read no files; they are run once per run with cache "sim" and add a "modeled" phase: the time
+ * the reads would take on the modeled device.
+ * The remote readers http, http-buffering and ftp read the files through a loopback HTTP or FTP
+ * server started by pfff-bench itself, optionally delaying each reply by --latency.
+ *
+ * Results go to stdout as tab-separated values, one line per (mix, cache, reader, run, phase),
+ * so that they can be collected and compared between commits:
+ *   label  mix  cache  reader  run  phase  files  seconds
+ *
+ * Copyright: 2009-2010, Konstantin Tretyakov, Pjotr Prins, Swen Laur
+ * License:   The terms of use of this software and its source code are defined by the BSD license.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "MTwister.h"
+#include "OptionManager.h"
+#include "PfffBlockReader.h"
+#include "PfffBlockSampleGenerator.h"
+#include "PfffFtpBlockReader.h"
+#include "PfffHttpBlockReader.h"
+#include "PfffLoopbackServer.h"
+#include "PfffOutputFormatter.h"
+#include "PfffSimulatedBlockReader.h"
+#include "output_utils.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::ifstream;
+using std::ofstream;
+using std::ostream;
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+#define quote_(x) #x
+#define quote(x) quote_(x)
+
+#ifdef __MINGW32__
+    #define mkdir(path, mode) mkdir(path)
+#endif
+
+// ------------- Options ----------------
+
+/**
+ * Command-line options of pfff-bench.
+ */
+struct BenchOptionManager: public OptionManager {
+public:
+    const char* dir;
+    const char* mixes;
+    const char* readers;
+    const char* label;
+    long  scale;
+    long  runs;
+    long  block_count;
+    long  block_size;
+    long  request_cost;
+    long  latency;
+    int   warm_only;
+    int   quick;
+    int   help;
+
+    BenchOptionManager() {
+        add_group("Benchmark Options");
+            add_parameterized("dir", 'd', NULL, new CharPtrOption(&dir, "pfff-bench-data"), "<dir>",
+                "Directory for the generated file trees. They are\n"
+                "reused by later runs. Default is 'pfff-bench-data'.");
+            add_parameterized("mixes", 'm', NULL, new CharPtrOption(&mixes, "small,mixed,large"), "<list>",
+                "Comma-separated file mixes to run:\n"
+                "  small - 5000 files of 4 KB\n"
+                "  mixed - 400 files of 1 KB, 64 KB, 1 MB and 8 MB\n"
+                "  large - 4 files of 256 MB\n"
+                "Default is all of them.");
+            add_parameterized("readers", 'r', NULL, new CharPtrOption(&readers, "local,fd,buffering,callback"), "<list>",
+                "Comma-separated BlockReaders to run. Default is\n"
+                "'local,fd,buffering,callback'. Simulated storage is\n"
+                "sim-<profile> or sim-<profile>-buffering, where\n"
+                "<profile> is hdd, ssd, nfs or http. The remote readers\n"
+                "http, http-buffering and ftp go through a loopback\n"
+                "server.");
+            add_parameterized("scale", 'x', NULL, new PositiveLongIntOption(&scale, 100), "<percent>",
+                "Scale the file counts and sizes. Default is 100.");
+            add_parameterized("runs", 'N', NULL, new PositiveLongIntOption(&runs, 3), "<num>",
+                "Number of runs of each configuration. Default is 3.");
+            add_parameterized("label", 'l', NULL, new CharPtrOption(&label, "-"), "<text>",
+                "Value of the first output column, e.g. a commit id.");
+            add_unparameterized("warm-only", 'W', &warm_only,
+                "Skip the cold page cache runs.");
+            add_unparameterized("quick", 'q', &quick,
+                "Smoke test: --scale 1 --runs 1 --warm-only.");
+            add_unparameterized("help", 'h', &help,
+                "Output this help message to stdout.");
+        add_group("Fingerprint Options");
+            add_parameterized("block-count", 'n', NULL, new BoundedLongIntOption(&block_count, PFO_BC_MIN, PFO_BC_MAX, PFO_BC_DEFAULT), "<num>",
+                "Number of blocks to sample. Default is " quote(PFO_BC_DEFAULT) ".");
+            add_parameterized("block-size", 's', NULL, new BoundedLongIntOption(&block_size, PFO_BS_MIN, PFO_BS_MAX, PFO_BS_DEFAULT), "<num>",
+                "Size of each block in bytes. Default is " quote(PFO_BS_DEFAULT) ".");
+            add_parameterized("request-cost", 'c', NULL, new PositiveLongIntOption(&request_cost, 65536), "<num>",
+                "Request cost of the buffering readers. Default is 65536.");
+            add_parameterized("latency", 'L', NULL, new BoundedLongIntOption(&latency, 0, 10000000, 0), "<usec>",
+                "Delay of each reply of the loopback servers. Default is 0.");
+    }
+};
+
+// ------------- Utilities ----------------
+
+/**
+ * Seconds from an arbitrary starting point.
+ */
+static inline double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static vector<string> split(const string& s, char separator) {
+    vector<string> result;
+    string::size_type start = 0, end;
+    do {
+        end = s.find(separator, start);
+        string item = s.substr(start, end == string::npos ? string::npos : end - start);
+        if (!item.empty()) result.push_back(item);
+        start = end + 1;
+    } while (end != string::npos);
+    return result;
+}
+
+/**
+ * pread-based callback for the 'callback' reader.
+ */
+static long long pread_callback(void* user_data, char* buffer, unsigned long length, unsigned long long offset) {
+    int fd = *(int*)user_data;
+    unsigned long done = 0;
+    while (done < length) {
+        ssize_t r = pread(fd, buffer + done, length - done, offset + done);
+        if (r < 0) return -1;
+        if (r == 0) break;
+        done += r;
+    }
+    return done;
+}
+
+// ------------- File trees ----------------
+
+/**
+ * A set of files with given sizes.
+ */
+struct FileMix {
+    string name;
+    vector<long long> sizes;
+    vector<string> files;   // Filled in by generate_tree
+};
+
+static FileMix make_mix(const string& name, long scale) {
+    FileMix mix;
+    mix.name = name;
+    const long long KB = 1024, MB = 1024*KB;
+    if (name == "small") {
+        long n = 5000 * scale / 100;
+        for (long i = 0; i < (n > 0 ? n : 1); i++) mix.sizes.push_back(4*KB);
+    }
+    else if (name == "mixed") {
+        const long long sizes[] = { 1*KB, 64*KB, 1*MB, 8*MB };
+        long n = 400 * scale / 100;
+        for (long i = 0; i < (n > 4 ? n : 4); i++) mix.sizes.push_back(sizes[i % 4]);
+    }
+    else if (name == "large") {
+        long long size = 256*MB * scale / 100;
+        for (long i = 0; i < 4; i++) mix.sizes.push_back(size > 0 ? size : 1);
+    }
+    return mix;
+}
+
+/**
+ * Creates the files of the mix under dir/<mix name>/, unless a previous run already did
+ * or create is false (then only the file names are filled in).
+ * The content is pseudo-random, seeded by the file index.
+ * Returns false on error.
+ */
+static bool generate_tree(const string& dir, FileMix& mix, bool create) {
+    string mix_dir = dir + "/" + mix.name;
+    if (!create) {
+        for (int i = 0; i < mix.sizes.size(); i++) {
+            ostringstream file;
+            file << mix_dir << "/" << (i / 1000) << "/file" << i << ".dat";
+            mix.files.push_back(file.str());
+        }
+        return true;
+    }
+    mkdir(dir.c_str(), 0755);
+    mkdir(mix_dir.c_str(), 0755);
+
+    // The description file tells whether the tree matches the requested mix
+    ostringstream description;
+    for (int i = 0; i < mix.sizes.size(); i++) description << mix.sizes[i] << '\n';
+    string description_file = mix_dir + "/MIX";
+    ifstream existing(description_file.c_str());
+    ostringstream existing_description;
+    existing_description << existing.rdbuf();
+    bool reuse = existing && existing_description.str() == description.str();
+
+    const long CHUNK = 1 << 20;
+    char* buffer = new char[CHUNK];
+    double start = now();
+    long long total = 0;
+    bool result = true;
+    for (int i = 0; i < mix.sizes.size() && result; i++) {
+        // At most 1000 files per directory
+        ostringstream subdir, file;
+        subdir << mix_dir << "/" << (i / 1000);
+        file << subdir.str() << "/file" << i << ".dat";
+        mix.files.push_back(file.str());
+        if (reuse) continue;
+        if (i % 1000 == 0) mkdir(subdir.str().c_str(), 0755);
+
+        int fd = open(file.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            cerr << "Error: Failed to create " << file.str() << ": " << strerror(errno) << endl;
+            result = false;
+            break;
+        }
+        MTwister mtwist;
+        mtwist.seed(i + 1);
+        for (long long written = 0; written < mix.sizes[i]; ) {
+            long n = (mix.sizes[i] - written < CHUNK) ? (long)(mix.sizes[i] - written) : CHUNK;
+            for (long j = 0; j + 4 <= n; j += 4) {
+                uint32_t r = mtwist.random_uint32();
+                memcpy(buffer + j, &r, 4);
+            }
+            if (write(fd, buffer, n) != n) {
+                cerr << "Error: Failed to write " << file.str() << ": " << strerror(errno) << endl;
+                result = false;
+                break;
+            }
+            written += n;
+        }
+        fdatasync(fd);  // Pages must be clean for posix_fadvise(DONTNEED) to drop them
+        close(fd);
+        total += mix.sizes[i];
+    }
+    delete[] buffer;
+    if (result && !reuse) {
+        ofstream(description_file.c_str()) << description.str();
+        cerr << "# Generated mix '" << mix.name << "': " << mix.sizes.size() << " files, "
+             << total << " bytes in " << (now() - start) << " s" << endl;
+    }
+    return result;
+}
+
+/**
+ * Drops the files of the mix from the page cache.
+ */
+static void drop_cache(const FileMix& mix) {
+#ifdef POSIX_FADV_DONTNEED
+    for (int i = 0; i < mix.files.size(); i++) {
+        int fd = open(mix.files[i].c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+// ------------- Benchmark ----------------
+
+/**
+ * Accumulated time of each phase over a run.
+ */
+struct PhaseTimes {
+    double open, sample, read, posthash_poly, posthash_md5, output;
+    double posthash_poly_batch, posthash_md5_batch;
+    double modeled;     // Modeled I/O time of the simulated readers
+    long files;
+};
+
+/**
+ * Tells whether the reader kind is sim-<profile>[-buffering], filling in the profile if so.
+ */
+static bool simulated_profile(const string& kind, PfffStorageProfile& profile) {
+    if (kind.compare(0, 4, "sim-") != 0) return false;
+    string name = kind.substr(4);
+    const string suffix = "-buffering";
+    if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+        name = name.substr(0, name.size() - suffix.size());
+    return PfffSimulatedStorage::find_profile(name, profile);
+}
+
+static inline bool is_remote(const string& kind) {
+    return kind == "http" || kind == "http-buffering" || kind == "ftp";
+}
+
+/**
+ * A loopback server serving the whole file system and a connection to it, for the remote readers.
+ */
+struct RemoteConnection {
+    PfffLoopbackServer* server;
+    HttpClientSocket* http;
+    FtpClientSocket* ftp;
+    string cwd;     // Relative file names are sent as absolute paths
+
+    RemoteConnection(const string& kind, long latency): server(NULL), http(NULL), ftp(NULL) {
+        char buffer[4096];
+        if (getcwd(buffer, sizeof(buffer)) != NULL) cwd = buffer;
+        if (kind == "ftp") {
+            server = new PfffLoopbackFtpServer("", latency);
+            server->start();
+            ftp = new FtpClientSocket("127.0.0.1", server->port());
+            ftp->AnonymousLogin();
+            ftp->SendCommand("TYPE I");
+        }
+        else {
+            server = new PfffLoopbackHttpServer("", latency);
+            server->start();
+            http = new HttpClientSocket("127.0.0.1", server->port());
+        }
+    }
+    ~RemoteConnection() {
+        delete http;
+        delete ftp;
+        delete server;
+    }
+    string path(const string& filename) {
+        return filename[0] == '/' ? filename : cwd + "/" + filename;
+    }
+};
+
+/**
+ * Creates the reader of the given kind. fd receives the descriptor to close afterwards, or -1.
+ * Simulated readers read from the given storage, remote ones through the given connection.
+ */
+static BlockReader* make_reader(const string& kind, const string& filename, long long size, long request_cost, int* fd,
+                                PfffSimulatedStorage* storage, RemoteConnection* remote) {
+    *fd = -1;
+    if (storage != NULL) {
+        BlockReader* reader = new SimulatedBlockReader(storage, filename.c_str(), size);
+        if (kind.find("-buffering") != string::npos) reader = new BufferingBlockReader(reader, request_cost);
+        return reader;
+    }
+    if (remote != NULL) {
+        string path = remote->path(filename);
+        if (remote->ftp != NULL) return new FtpBlockReader(remote->ftp, path.c_str());
+        BlockReader* reader = new HttpBlockReader(remote->http, path.c_str());
+        if (kind == "http-buffering") reader = new BufferingBlockReader(reader, request_cost);
+        return reader;
+    }
+    if (kind == "local") return new LocalFileBlockReader(filename.c_str());
+    if (kind == "buffering") return new BufferingBlockReader(new LocalFileBlockReader(filename.c_str()), request_cost);
+    *fd = open(filename.c_str(), O_RDONLY);
+    if (kind == "fd") return new FdBlockReader(*fd, filename.c_str());
+    if (kind == "callback") {
+        struct stat st;
+        long long size = (*fd >= 0 && fstat(*fd, &st) == 0) ? st.st_size : -1;
+        return new CallbackBlockReader(pread_callback, fd, size, filename.c_str());
+    }
+    return NULL;
+}
+
+/**
+ * Fingerprints all files of the mix, timing each phase. Returns false on error.
+ */
+static bool run_mix(const PfffOptions& opts, const FileMix& mix, const string& reader_kind, long request_cost,
+                    long latency, ostream& null_out, PhaseTimes& times) {
+    PfffOutputFormatter formatter(&opts);
+    Md5Hasher md5;
+    Poly1305AesHasher poly(opts.key);
+    vector<string> samples;     // For the batched post-hashing
+    PfffBlockSampleGenerator sampler(&opts);
+    unsigned char digest[16];
+    memset(&times, 0, sizeof(times));
+    PfffStorageProfile profile;
+    PfffSimulatedStorage* storage = simulated_profile(reader_kind, profile) ? new PfffSimulatedStorage(profile) : NULL;
+    RemoteConnection* remote = NULL;
+    if (is_remote(reader_kind)) {
+        try {
+            remote = new RemoteConnection(reader_kind, latency);
+        }
+        catch (string& e) {
+            cerr << "Error: " << e << endl;
+            return false;
+        }
+        catch (const char* e) {
+            cerr << "Error: " << e << endl;
+            return false;
+        }
+    }
+
+    for (int i = 0; i < mix.files.size(); i++) {
+        double t0 = now();
+        int fd;
+        BlockReader* reader = make_reader(reader_kind, mix.files[i], mix.sizes[i], request_cost, &fd, storage, remote);
+        long long size = reader->size();
+        double t1 = now();
+        if (size < 0) {
+            cerr << "Error: " << reader->error_message << endl;
+            delete reader;
+            if (fd >= 0) close(fd);
+            delete storage;
+            delete remote;
+            return false;
+        }
+        formatter.set_file_size(size);
+        sampler.generate(size);
+        double t2 = now();
+        reader->begin_block_sequence(formatter.get_content_buffer());
+        bool ok = (opts.header_block_count == 0 || reader->read_header(opts.block_size, opts.header_block_count)) &&
+                  reader->read_blocks(opts.block_size, sampler.sample, sampler.sample_size);
+        ok = reader->end_block_sequence() && ok;
+        formatter.set_sample_size(sampler.sample_size);
+        double t3 = now();
+        if (!ok) {
+            cerr << "Error: " << reader->error_message << endl;
+            delete reader;
+            if (fd >= 0) close(fd);
+            delete storage;
+            delete remote;
+            return false;
+        }
+        formatter.output_digest(digest);
+        double t4 = now();
+        md5.compute_digest(digest, formatter.data, formatter.data_len);
+        double t5 = now();
+        samples.push_back(string(formatter.data, formatter.data_len));
+        formatter.set_filename(mix.files[i]);
+        formatter.output_hash(null_out);
+        null_out << '\n';
+        double t6 = now();
+        delete reader;
+        if (fd >= 0) close(fd);
+
+        times.open += t1 - t0;
+        times.sample += t2 - t1;
+        times.read += t3 - t2;
+        times.posthash_poly += t4 - t3;
+        times.posthash_md5 += t5 - t4;
+        times.output += t6 - t5;
+        times.files++;
+    }
+    if (storage != NULL) times.modeled = storage->elapsed_ns * 1e-9;
+
+    vector<const char*> data(samples.size());
+    vector<long> data_len(samples.size());
+    vector<unsigned char> digests(16*samples.size() + 16);
+    for (int i = 0; i < samples.size(); i++) {
+        data[i] = samples[i].data();
+        data_len[i] = samples[i].size();
+    }
+    if (!samples.empty()) {
+        double t0 = now();
+        poly.compute_digests(&digests[0], &data[0], &data_len[0], samples.size());
+        double t1 = now();
+        md5.compute_digests(&digests[0], &data[0], &data_len[0], samples.size());
+        double t2 = now();
+        times.posthash_poly_batch = t1 - t0;
+        times.posthash_md5_batch = t2 - t1;
+    }
+    delete storage;
+    delete remote;
+    null_out.flush();
+    return true;
+}
+
+static void output_row(const string& label, const FileMix& mix, const char* cache, const string& reader,
+                       int run, const char* phase, long files, double seconds) {
+    cout << label << '\t' << mix.name << '\t' << cache << '\t' << reader << '\t' << run << '\t'
+         << phase << '\t' << files << '\t' << seconds << '\n';
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptionManager om;
+    if (!om.read_from_cmdline(argc, argv)) return 2;
+    if (om.help) {
+        cout << "Usage: pfff-bench [options]\n\n";
+        om.print_option_help(cout);
+        return 0;
+    }
+    if (om.quick) {
+        om.scale = 1;
+        om.runs = 1;
+        om.warm_only = 1;
+    }
+
+    PfffOptions opts;
+    pfff_options_init(&opts, 1);
+    opts.block_count = om.block_count;
+    opts.block_size = om.block_size;
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    FdOutputBuffer null_buffer(null_fd);
+    ostream null_out(&null_buffer);
+
+    vector<string> mix_names = split(om.mixes, ',');
+    vector<string> readers = split(om.readers, ',');
+    bool real_files = false;    // Whether any reader reads the generated files
+    for (int r = 0; r < readers.size(); r++) {
+        PfffStorageProfile profile;
+        if (simulated_profile(readers[r], profile)) continue;
+        if (readers[r] != "local" && readers[r] != "fd" && readers[r] != "buffering" && readers[r] != "callback" && !is_remote(readers[r])) {
+            cerr << "Error: Unknown reader " << readers[r] << endl;
+            return 2;
+        }
+        real_files = true;
+    }
+    cout << "label\tmix\tcache\treader\trun\tphase\tfiles\tseconds\n";
+    bool success = true;
+    for (int m = 0; m < mix_names.size() && success; m++) {
+        FileMix mix = make_mix(mix_names[m], om.scale);
+        if (mix.sizes.empty()) {
+            cerr << "Error: Unknown mix " << mix_names[m] << endl;
+            return 2;
+        }
+        if (!generate_tree(om.dir, mix, real_files)) return 1;
+
+        for (int cold = om.warm_only ? 0 : 1; cold >= 0 && success; cold--) {
+            for (int r = 0; r < readers.size() && success; r++) {
+                PfffStorageProfile profile;
+                bool simulated = simulated_profile(readers[r], profile);
+                if (simulated && cold) continue;   // There is no cache to speak of
+                const char* cache = simulated ? "sim" : (cold ? "cold" : "warm");
+                for (int run = 1; run <= om.runs && success; run++) {
+                    PhaseTimes t;
+                    if (cold) drop_cache(mix);
+                    else if (run == 1 && !simulated) run_mix(opts, mix, readers[r], om.request_cost, om.latency, null_out, t); // Warm up
+                    if (!(success = run_mix(opts, mix, readers[r], om.request_cost, om.latency, null_out, t))) break;
+                    output_row(om.label, mix, cache, readers[r], run, "open", t.files, t.open);
+                    output_row(om.label, mix, cache, readers[r], run, "sample", t.files, t.sample);
+                    output_row(om.label, mix, cache, readers[r], run, "read", t.files, t.read);
+                    output_row(om.label, mix, cache, readers[r], run, "posthash-poly1305aes", t.files, t.posthash_poly);
+                    output_row(om.label, mix, cache, readers[r], run, "posthash-md5", t.files, t.posthash_md5);
+                    output_row(om.label, mix, cache, readers[r], run, "posthash-poly1305aes-batch", t.files, t.posthash_poly_batch);
+                    output_row(om.label, mix, cache, readers[r], run, "posthash-md5-batch", t.files, t.posthash_md5_batch);
+                    output_row(om.label, mix, cache, readers[r], run, "output", t.files, t.output);
+                    output_row(om.label, mix, cache, readers[r], run, "total", t.files,
+                               t.open + t.sample + t.read + t.posthash_poly + t.output);
+                    if (simulated) output_row(om.label, mix, cache, readers[r], run, "modeled", t.files, t.modeled);
+                    cout.flush();
+                }
+            }
+        }
+    }
+    return success ? 0 : 1;
+}
@@ -24,3 +24,20 @@ TEST(TestHexOutput) {
                            "\xf1\xf2\xf3\xf4\xf5\xf6\xf7\xf8\xf9\xfa\xfb\xfc\xfd\xfe\xff", 31));
 }
 
+TEST(TestHexOutputLowercaseAndLong) {
+    ostringstream os;
+    output_hex(os, "\xAB\xCD\xEF\x01", 4, true);
+    CHECK_EQUAL("abcdef01", os.str());
+    
+    // Longer than the internal chunk used by output_hex
+    string data(1500, '\x5a');
+    data[1499] = '\xff';
+    string expected;
+    for (int i = 0; i < 1499; i++) expected += "5A";
+    expected += "FF";
+    CHECK_EQUAL(expected, encode_hex(data.data(), data.size()));
+    
+    char text[8];
+    CHECK(format_hex(text, "\x12\x34\x56\x78", 4) == text + 8);
+    CHECK_ARRAY_EQUAL("12345678", text, 8);
+}
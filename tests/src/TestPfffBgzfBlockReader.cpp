@@ -0,0 +1,110 @@
+// Test of reading BGZF files. TestPfffBgzf.in.gz holds TestPfffBgzf.in in 9 blocks
+// of 700 uncompressed bytes (the last one shorter), followed by the empty EOF block.
+#include "config.h"
+#include "PfffBgzfBlockReader.h"
+#include "PfffHasher.h"
+#include <sstream>
+
+using std::ostringstream;
+
+namespace TestPfffBgzfBlockReader {
+
+static const string PLAIN = string(DATA_DIR) + "TestPfffBgzf.in";
+static const string COMPRESSED = string(DATA_DIR) + "TestPfffBgzf.in.gz";
+static const string INDEX = string(DATA_DIR) + "TestPfffBgzf.in.gz.gzi";
+
+/**
+ * Fingerprint without the filename.
+ */
+static string fingerprint(PfffHasher& hasher, BlockReader* reader) {
+    ostringstream out;
+    hasher.hash(out, reader);
+    return out.str().substr(0, out.str().find('\t'));
+}
+
+#ifdef HAVE_ZLIB
+
+TEST(TestBgzfContent) {
+    PfffOptions opts;
+    for (int variant = 0; variant < 5; variant++) {
+        pfff_options_init(&opts, variant + 1);
+        if (variant == 1) opts.block_size = 1000;       // Blocks spanning BGZF blocks
+        if (variant == 2) {
+            opts.header_block_count = 3;
+            opts.with_size = 1;
+        }
+        if (variant == 3) {
+            opts.block_count = 1000;                    // Covers the whole file
+            opts.without_replacement = 1;
+        }
+        if (variant == 4) opts.block_size = 5000;       // Beyond the end of the data
+        PfffHasher hasher(&opts);
+        LocalFileBlockReader plain(PLAIN.c_str());
+        string expected = fingerprint(hasher, &plain);
+        for (int indexed = 0; indexed < 2; indexed++) {
+            for (int buffered = 0; buffered < 2; buffered++) {
+                BlockReader* compressed = new LocalFileBlockReader(COMPRESSED.c_str());
+                if (buffered) compressed = new BufferingBlockReader(compressed, 100000);
+                BgzfBlockReader reader(compressed, indexed ? INDEX.c_str() : NULL);
+                CHECK_EQUAL(expected, fingerprint(hasher, &reader));
+                CHECK_EQUAL(plain.size(), reader.size());
+            }
+        }
+    }
+}
+
+TEST(TestBgzfInflatesSampledBlocksOnly) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 1);
+    opts.block_count = 2;
+    opts.block_size = 10;
+    PfffHasher hasher(&opts);
+    BgzfBlockReader reader(new LocalFileBlockReader(COMPRESSED.c_str()), INDEX.c_str());
+    fingerprint(hasher, &reader);
+    CHECK(reader.inflated_blocks >= 1);
+    CHECK(reader.inflated_blocks <= 4);
+    
+    // Reads at random, beyond the cache, and beyond the end
+    char buffer[2000];
+    reader.begin_block_sequence(buffer);
+    CHECK(reader.next_block(6000, 100));
+    CHECK(reader.next_block(0, 10));
+    CHECK(reader.next_block(1390, 20));
+    CHECK(reader.next_block(2800, 10));
+    CHECK(reader.next_block(3500, 10));
+    CHECK(reader.next_block(4200, 10));
+    CHECK(reader.end_block_sequence());
+    LocalFileBlockReader plain(PLAIN.c_str());
+    char expected[2000];
+    plain.begin_block_sequence(expected);
+    plain.next_block(6000, 100);
+    plain.next_block(0, 10);
+    plain.next_block(1390, 20);
+    plain.next_block(2800, 10);
+    plain.next_block(3500, 10);
+    plain.next_block(4200, 10);
+    plain.end_block_sequence();
+    CHECK_ARRAY_EQUAL(expected, buffer, 160);
+}
+
+TEST(TestBgzfErrors) {
+    BgzfBlockReader plain(new LocalFileBlockReader(PLAIN.c_str()));
+    CHECK(plain.size() < 0);
+    CHECK(plain.error_message != "");
+    BgzfBlockReader missing(new LocalFileBlockReader((string(DATA_DIR) + "NonExistentFile").c_str()));
+    CHECK(missing.size() < 0);
+    // A bad index is ignored
+    BgzfBlockReader bad_index(new LocalFileBlockReader(COMPRESSED.c_str()), PLAIN.c_str());
+    CHECK_EQUAL(6016, bad_index.size());
+}
+
+#else
+
+TEST(TestBgzfWithoutZlib) {
+    BgzfBlockReader reader(new LocalFileBlockReader(COMPRESSED.c_str()));
+    CHECK(reader.size() < 0);
+}
+
+#endif
+
+}
@@ -1,5 +1,7 @@
 // Tests basic properties of generate_sample
 #include "config.h"
+#include "PfffBlockSampleGenerator.h"
+#include <algorithm>
 
 // Defined in PfffBlockSampleGenerator.cpp, but not normally exported outside
 extern void generate_sample(uint32_t key, unsigned long n, unsigned long long min, unsigned long long max, bool with_replacement, unsigned long long* buffer);
@@ -52,3 +54,58 @@ TEST_FILEFIXTURE("TestPfffBlockSampleGenerator.out", TestPfffBlockSampleGenerato
     test_generate_sample(this,1,1000,0,2000000000,true,false,false);
     test_generate_sample(this,1,1000,1,5000,true,true,false);
 }
+
+// The adaptive mode relies on larger samples containing the smaller ones
+TEST(TestPfffBlockSampleGeneratorPrefixStable) {
+    for (int without_replacement = 0; without_replacement < 2; without_replacement++) {
+        PfffOptions opts;
+        pfff_options_init(&opts, 7);
+        opts.adaptive = 1;
+        opts.without_replacement = without_replacement;
+        opts.header_block_count = 2;
+        PfffBlockSampleGenerator small(&opts), large(&opts);
+        CHECK_EQUAL(pfff_options_max_block_count(&opts), small.capacity);
+        for (unsigned long n = 1; n < 128; n *= 2) {
+            small.generate(100, n);
+            large.generate(100, 2*n);
+            CHECK_EQUAL(n, small.sample_size);
+            CHECK(std::includes(large.sample, large.sample + large.sample_size, small.sample, small.sample + small.sample_size));
+        }
+        // A fixed-count sample is the adaptive one of the same count
+        PfffOptions fixed_opts = opts;
+        fixed_opts.adaptive = 0;
+        fixed_opts.block_count = 16;
+        PfffBlockSampleGenerator fixed(&fixed_opts);
+        fixed.generate(100);
+        small.generate(100, 16);
+        CHECK_ARRAY_EQUAL(fixed.sample, small.sample, 16);
+    }
+    // Without replacement from a small file: all blocks after the header
+    PfffOptions opts;
+    pfff_options_init(&opts, 7);
+    opts.without_replacement = 1;
+    opts.header_block_count = 2;
+    PfffBlockSampleGenerator sampler(&opts);
+    sampler.generate(5);
+    unsigned long long expected[] = { 2, 3, 4 };
+    CHECK_EQUAL(3, sampler.sample_size);
+    CHECK_ARRAY_EQUAL(expected, sampler.sample, 3);
+}
+
+TEST(TestPfffBlockSampleGeneratorEntropy) {
+    char zeros[64] = { 0 };
+    CHECK_CLOSE(0.0, PfffBlockSampleGenerator::entropy_bits(zeros, 64, 1), 1e-9);
+    CHECK_CLOSE(0.0, PfffBlockSampleGenerator::entropy_bits(zeros, 1, 1), 1e-9);
+    char all[256];
+    for (int i = 0; i < 256; i++) all[i] = (char)i;
+    CHECK_CLOSE(8*256.0, PfffBlockSampleGenerator::entropy_bits(all, 256, 1), 1e-9);
+    // Two equally likely values: about one bit per byte
+    char two[64];
+    for (int i = 0; i < 64; i++) two[i] = i % 2;
+    double bits = PfffBlockSampleGenerator::entropy_bits(two, 64, 1);
+    CHECK(bits > 60 && bits < 70);
+    // Repeated blocks count once
+    char repeated[64];
+    for (int i = 0; i < 64; i++) repeated[i] = all[i % 16];
+    CHECK(PfffBlockSampleGenerator::entropy_bits(repeated, 4, 16) < PfffBlockSampleGenerator::entropy_bits(all, 4, 16) / 4);
+}
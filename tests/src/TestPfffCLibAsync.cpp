@@ -0,0 +1,129 @@
+// Test of the asynchronous C interface: results must match the synchronous ones,
+// the completion descriptor must become readable, and queued jobs must be cancellable.
+#include "config.h"
+#include "PfffCLibAsync.h"
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+
+namespace TestPfffCLibAsync {
+
+const int   NUM_DATA = 4;
+const char* DATA[] = {
+    "TestPfffHasherOnFiles1.in",
+    "TestPfffHasherOnFiles2.in",
+    "TestPfffOptions.in",
+    "NonExistentFile"
+};
+
+// A read callback which blocks until released, used to keep the single worker busy
+struct Gate {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool open;
+};
+
+long long gated_read(void* user_data, char* buffer, unsigned long length, unsigned long long offset) {
+    Gate* g = (Gate*)user_data;
+    pthread_mutex_lock(&g->lock);
+    while (!g->open) pthread_cond_wait(&g->cond, &g->lock);
+    pthread_mutex_unlock(&g->lock);
+    memset(buffer, 'x', length);
+    return length;
+}
+
+TEST(TestPfffCLibAsyncResults) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 3);
+    opts.block_count = 50;
+
+    // Expected values from the synchronous interface
+    unsigned char expected[NUM_DATA][PFFFCLIB_DIGEST_MAX_LEN];
+    int expected_result[NUM_DATA];
+    pfffclib_context* ctx = pfffclib_context_create(&opts, 0);
+    for (int i = 0; i < NUM_DATA; i++) {
+        string path = string(DATA_DIR) + DATA[i];
+        expected_result[i] = pfffclib_context_digest_file(ctx, path.c_str(), expected[i], PFFFCLIB_DIGEST_MAX_LEN, NULL, NULL, 0);
+    }
+    pfffclib_context_destroy(ctx);
+
+    pfffclib_async* async = pfffclib_async_create(&opts, 0, 2, NULL, NULL);
+    CHECK(async != NULL);
+    long long ids[NUM_DATA];
+    for (int i = 0; i < NUM_DATA; i++) {
+        string path = string(DATA_DIR) + DATA[i];
+        ids[i] = pfffclib_async_submit_file(async, path.c_str(), (void*)(long)i);
+        CHECK(ids[i] > 0);
+    }
+
+    int received = 0;
+    while (received < NUM_DATA) {
+        struct pollfd p;
+        p.fd = pfffclib_async_fd(async);
+        p.events = POLLIN;
+        CHECK_EQUAL(1, poll(&p, 1, 10000));
+        pfffclib_async_result results[2];
+        int n = pfffclib_async_poll(async, results, 2);
+        for (int j = 0; j < n; j++) {
+            long i = (long)results[j].user_data;
+            CHECK_EQUAL(ids[i], results[j].job_id);
+            if (expected_result[i] < 0) CHECK_EQUAL(PFFFCLIB_ASYNC_ERROR, results[j].status);
+            else {
+                CHECK_EQUAL(PFFFCLIB_ASYNC_OK, results[j].status);
+                CHECK_EQUAL(16, results[j].digest_len);
+                CHECK_ARRAY_EQUAL(expected[i], results[j].digest, 16);
+            }
+        }
+        received += n;
+    }
+    // Everything was consumed, so the descriptor must not be readable anymore
+    struct pollfd p;
+    p.fd = pfffclib_async_fd(async);
+    p.events = POLLIN;
+    CHECK_EQUAL(0, poll(&p, 1, 0));
+    pfffclib_async_destroy(async);
+
+    // Formats without a binary digest are refused
+    opts.output_format = PFO_OF_CSV;
+    CHECK(pfffclib_async_create(&opts, 0, 1, NULL, NULL) == NULL);
+}
+
+TEST(TestPfffCLibAsyncCancel) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 3);
+    Gate gate;
+    pthread_mutex_init(&gate.lock, NULL);
+    pthread_cond_init(&gate.cond, NULL);
+    gate.open = false;
+
+    pfffclib_async* async = pfffclib_async_create(&opts, 0, 1, NULL, NULL);
+    long long blocking = pfffclib_async_submit_callback(async, gated_read, &gate, 1000, NULL);
+    long long queued = pfffclib_async_submit_file(async, (string(DATA_DIR) + DATA[0]).c_str(), NULL);
+    CHECK_EQUAL(0, pfffclib_async_cancel(async, queued));
+    CHECK_EQUAL(-1, pfffclib_async_cancel(async, queued));   // Already cancelled
+    CHECK_EQUAL(-1, pfffclib_async_cancel(async, 12345));    // Unknown
+
+    pthread_mutex_lock(&gate.lock);
+    gate.open = true;
+    pthread_cond_broadcast(&gate.cond);
+    pthread_mutex_unlock(&gate.lock);
+
+    int received = 0;
+    while (received < 2) {
+        struct pollfd p;
+        p.fd = pfffclib_async_fd(async);
+        p.events = POLLIN;
+        CHECK_EQUAL(1, poll(&p, 1, 10000));
+        pfffclib_async_result result;
+        while (pfffclib_async_poll(async, &result, 1) == 1) {
+            if (result.job_id == blocking) CHECK_EQUAL(PFFFCLIB_ASYNC_OK, result.status);
+            else CHECK_EQUAL(PFFFCLIB_ASYNC_CANCELLED, result.status);
+            received++;
+        }
+    }
+    pfffclib_async_destroy(async);
+    pthread_cond_destroy(&gate.cond);
+    pthread_mutex_destroy(&gate.lock);
+}
+
+};
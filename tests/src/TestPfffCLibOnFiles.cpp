@@ -3,6 +3,14 @@
 #include "config.h"
 #include "PfffCLib.h"
 #include "MTwister.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "output_utils.h"
+#include "PfffOutputFormatter.h"
+
+// Defined in TestHexOutput.cpp
+extern string encode_hex(const char* in, int len);
 
 namespace TestPfffCLibOnFiles {
 
@@ -82,4 +90,159 @@ TEST_FILEFIXTURE("TestPfffHasherOnFiles.out", TestPfffHasherOnFiles) {
     }
 }
 
+// The context and batch entry points must give the same results as pfffclib_hash_file
+TEST(TestPfffCLibContextAndBatch) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 42);
+    opts.block_count = 100;
+    opts.with_size = true;
+    
+    const char* filenames[NUM_DATA + 1];
+    string paths[NUM_DATA + 1];
+    for (int i = 0; i < NUM_DATA; i++) paths[i] = string(DATA_DIR) + DATA[i];
+    paths[NUM_DATA] = string(DATA_DIR) + "NonExistentFile";
+    for (int i = 0; i <= NUM_DATA; i++) filenames[i] = paths[i].c_str();
+    
+    char expected[NUM_DATA + 1][256];
+    int expected_result[NUM_DATA + 1];
+    for (int i = 0; i <= NUM_DATA; i++)
+        expected_result[i] = pfffclib_hash_file(&opts, filenames[i], 0, expected[i], 256, NULL, 0);
+    CHECK_EQUAL(0, expected_result[0]);
+    CHECK(expected_result[NUM_DATA] != 0);
+    
+    // Context, reused across files
+    pfffclib_context* ctx = pfffclib_context_create(&opts, 1024);
+    for (int i = 0; i <= NUM_DATA; i++) {
+        char output[256];
+        int result = pfffclib_context_hash_file(ctx, filenames[i], output, 256, NULL, 0);
+        CHECK_EQUAL(expected_result[i], result);
+        if (result == 0) CHECK_EQUAL(expected[i], output);
+    }
+    // Truncated output is still zero-terminated
+    char short_output[8];
+    CHECK_EQUAL(0, pfffclib_context_hash_file(ctx, filenames[0], short_output, 8, NULL, 0));
+    CHECK_EQUAL(string(expected[0]).substr(0, 7), short_output);
+    // And so is the output of a failure, left empty
+    memset(short_output, 'x', 8);
+    CHECK(pfffclib_context_hash_file(ctx, filenames[NUM_DATA], short_output, 8, NULL, 0) != 0);
+    CHECK_EQUAL("", short_output);
+    pfffclib_context_destroy(ctx);
+    
+    // Batch, sequential and parallel
+    int n_threads[] = { 1, 3 };
+    for (int t = 0; t < 2; t++) {
+        char outputs[NUM_DATA + 1][256];
+        char errors[NUM_DATA + 1][256];
+        int results[NUM_DATA + 1];
+        int result = pfffclib_hash_files(&opts, filenames, NUM_DATA + 1, 0, n_threads[t], &outputs[0][0], 256, results, &errors[0][0], 256);
+        CHECK(result != 0);
+        for (int i = 0; i <= NUM_DATA; i++) {
+            CHECK_EQUAL(expected_result[i], results[i]);
+            if (results[i] == 0) CHECK_EQUAL(expected[i], outputs[i]);
+        }
+        CHECK(strlen(errors[NUM_DATA]) > 0);
+        CHECK_EQUAL(0, pfffclib_hash_files(&opts, filenames, NUM_DATA, 0, n_threads[t], &outputs[0][0], 256, results, NULL, 0));
+    }
+}
+
+// Serves data from a string for pfffclib_context_digest_callback
+long long read_from_string(void* user_data, char* buffer, unsigned long length, unsigned long long offset) {
+    const string* data = (const string*)user_data;
+    if (offset >= data->size()) return 0;
+    if (offset + length > data->size()) length = data->size() - offset;
+    memcpy(buffer, data->data() + offset, length);
+    return length;
+}
+
+// Binary digests must match the textual fingerprints, whatever the input source
+TEST(TestPfffCLibDigest) {
+    PfffOptions opts;
+    const int FORMATS[] = { PFO_OF_POLY1305AES, PFO_OF_MD5 };
+    for (int f = 0; f < 2; f++) {
+        pfff_options_init(&opts, 7);
+        opts.output_format = FORMATS[f];
+        opts.with_size = true;
+        opts.header_block_count = 2;
+        opts.no_prefix = 1;
+        opts.no_filename = 1;
+        pfffclib_context* ctx = pfffclib_context_create(&opts, 0);
+        for (int i = 0; i < NUM_DATA; i++) {
+            string path = string(DATA_DIR) + DATA[i];
+            char text[256];
+            CHECK_EQUAL(0, pfffclib_context_hash_file(ctx, path.c_str(), text, 256, NULL, 0));
+            string expected(text);
+            for (int j = 0; j < expected.size(); j++) expected[j] = toupper(expected[j]);
+            
+            unsigned char digest[PFFFCLIB_DIGEST_MAX_LEN];
+            PfffOptionsSignature signature;
+            CHECK_EQUAL(16, pfffclib_context_digest_file(ctx, path.c_str(), digest, sizeof(digest), &signature.values, NULL, 0));
+            CHECK_EQUAL(expected, encode_hex((char*)digest, 16));
+            PfffOptionsSignature expected_signature(&opts);
+            CHECK_ARRAY_EQUAL(expected_signature.text, signature.text, sizeof(PfffOptionsSignature));
+            
+            int fd = open(path.c_str(), O_RDONLY);
+            memset(digest, 0, 16);
+            CHECK_EQUAL(16, pfffclib_context_digest_fd(ctx, fd, digest, sizeof(digest), NULL, NULL, 0));
+            CHECK_EQUAL(expected, encode_hex((char*)digest, 16));
+            close(fd);
+            
+            ifstream in(path.c_str(), ios::binary);
+            string contents((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+            memset(digest, 0, 16);
+            CHECK_EQUAL(16, pfffclib_context_digest_callback(ctx, read_from_string, &contents, contents.size(), digest, sizeof(digest), NULL, NULL, 0));
+            CHECK_EQUAL(expected, encode_hex((char*)digest, 16));
+        }
+        pfffclib_context_destroy(ctx);
+    }
+    
+    // Errors: missing file, too small buffer, no digest for csv
+    char error[256];
+    unsigned char digest[PFFFCLIB_DIGEST_MAX_LEN];
+    pfff_options_init(&opts, 7);
+    pfffclib_context* ctx = pfffclib_context_create(&opts, 0);
+    CHECK(pfffclib_context_digest_file(ctx, "NonExistentFile", digest, sizeof(digest), NULL, error, 256) < 0);
+    CHECK(pfffclib_context_digest_file(ctx, (string(DATA_DIR) + DATA[0]).c_str(), digest, 8, NULL, NULL, 0) < 0);
+    pfffclib_context_destroy(ctx);
+    opts.output_format = PFO_OF_CSV;
+    ctx = pfffclib_context_create(&opts, 0);
+    CHECK(pfffclib_context_digest_file(ctx, (string(DATA_DIR) + DATA[0]).c_str(), digest, sizeof(digest), NULL, error, 256) < 0);
+    pfffclib_context_destroy(ctx);
+}
+
+// The batch of digests must match the digests of single files, failures included
+TEST(TestPfffCLibDigestBatch) {
+    PfffOptions opts;
+    const int FORMATS[] = { PFO_OF_POLY1305AES, PFO_OF_MD5 };
+    for (int f = 0; f < 2; f++) {
+        pfff_options_init(&opts, 3);
+        opts.output_format = FORMATS[f];
+        opts.with_size = f;
+        pfffclib_context* ctx = pfffclib_context_create(&opts, 0);
+        // Repeated so that the lanes get filled, with a missing file in the middle
+        const int N = 3*NUM_DATA + 1;
+        vector<string> paths;
+        for (int i = 0; i < N; i++) paths.push_back(i == NUM_DATA ? string("NonExistentFile") : string(DATA_DIR) + DATA[i % NUM_DATA]);
+        vector<const char*> filenames;
+        for (int i = 0; i < N; i++) filenames.push_back(paths[i].c_str());
+        unsigned char digests[N*16];
+        PfffOptionsSignatureStruct signatures[N];
+        int results[N];
+        char errors[N*64];
+        CHECK(pfffclib_context_digest_files(ctx, &filenames[0], N, digests, 16, signatures, results, errors, 64) != 0);
+        for (int i = 0; i < N; i++) {
+            unsigned char digest[16];
+            if (i == NUM_DATA) {
+                CHECK(results[i] < 0);
+                CHECK(strlen(errors + i*64) > 0);
+                continue;
+            }
+            CHECK_EQUAL(16, results[i]);
+            CHECK_EQUAL(16, pfffclib_context_digest_file(ctx, filenames[i], digest, 16, NULL, NULL, 0));
+            CHECK_ARRAY_EQUAL(digest, digests + i*16, 16);
+            CHECK_EQUAL(opts.block_count, signatures[i].block_count);
+        }
+        pfffclib_context_destroy(ctx);
+    }
+}
+
 };
@@ -0,0 +1,61 @@
+// Test of manifest verification (pfff --check)
+#include "config.h"
+#include "PfffChecker.h"
+#include "PfffBlockReader.h"
+#include <sstream>
+
+using std::istringstream;
+using std::ostringstream;
+
+namespace TestPfffChecker {
+
+TEST(TestPfffChecker) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 7);
+    opts.block_count = 30;
+    opts.output_mode = PFO_OM_NDJSON;
+
+    // Manifest of two good files, a changed one and a missing one
+    PfffHasher hasher(&opts);
+    ostringstream manifest;
+    string good1 = string(DATA_DIR) + "TestPfffOptions.in";
+    string good2 = string(DATA_DIR) + "TestPfffHasherOnFiles2.in";
+    LocalFileBlockReader r1(good1.c_str());
+    hasher.hash(manifest, &r1);
+    manifest << hasher.formatter->record_end();
+    LocalFileBlockReader r2(good2.c_str());
+    hasher.hash(manifest, &r2);
+    manifest << hasher.formatter->record_end();
+    manifest << "{\"digest\":\"00000000000000000000000000000000\",\"path\":\"" << good1 << "\"}\n";
+    manifest << "{\"digest\":\"00000000000000000000000000000000\",\"path\":\"" << DATA_DIR << "NonExistentFile\"}\n";
+    manifest << "{\"digest\":\"00000000000000000000000000000000\",\"size\":5,\"path\":\"" << good1 << "\"}\n";
+
+    for (int threads = 1; threads <= 3; threads += 2) {
+        istringstream in(manifest.str());
+        PfffManifestReader reader(in);
+        ostringstream report;
+        // Records without a signature are checked with these options
+        PfffChecker checker(&opts, 0, threads, report);
+        CHECK(checker.check(reader));
+        CHECK_EQUAL(5, checker.summary.checked);
+        CHECK_EQUAL(2, checker.summary.ok);
+        CHECK_EQUAL(2, checker.summary.mismatched);
+        CHECK_EQUAL(1, checker.summary.missing);
+        CHECK_EQUAL(0, checker.summary.errors);
+        CHECK(!checker.all_ok());
+        CHECK(report.str().find("MISSING\t" + string(DATA_DIR) + "NonExistentFile\n") != string::npos);
+        CHECK(report.str().find("MISMATCH\t" + good1 + "\n") != string::npos);
+        CHECK(report.str().find(good2) == string::npos);
+    }
+
+    // A broken manifest is reported after checking what could be read
+    istringstream broken("{\"digest\":\"zz\"}\n");
+    PfffManifestReader reader(broken);
+    ostringstream report;
+    PfffChecker checker(&opts, 0, 1, report);
+    CHECK(!checker.check(reader));
+    CHECK(checker.error_message != "");
+    CHECK_EQUAL(0, checker.summary.checked);
+}
+
+};
@@ -0,0 +1,114 @@
+// Test of pfffd and its client over the loopback interface
+#include "config.h"
+#include "PfffDaemon.h"
+#include "PfffBlockReader.h"
+#include <unistd.h>
+
+namespace TestPfffDaemon {
+
+void* serve_main(void* daemon) {
+    ((PfffDaemon*)daemon)->serve();
+    return NULL;
+}
+
+TEST(TestPfffDaemon) {
+    PfffDaemon daemon(DATA_DIR, "127.0.0.1", 0, 2, 4, 100, 0);
+    CHECK(daemon.port() > 0);
+    pthread_t server_thread;
+    pthread_create(&server_thread, NULL, serve_main, &daemon);
+
+    PfffOptions opts;
+    pfff_options_init(&opts, 5);
+    opts.block_count = 40;
+    opts.output_format = PFO_OF_MD5;
+    PfffHasher hasher(&opts);
+    const char* files[] = { "TestPfffOptions.in", "/TestPfffHasherOnFiles2.in", "TestPfffOptions.in" };
+
+    {
+        PfffDaemonClient client("127.0.0.1", daemon.port());
+        // Pipelined requests, including failing ones
+        for (int i = 0; i < 3; i++) CHECK(client.send_request(hasher.formatter->signature, files[i]));
+        CHECK(client.send_request(hasher.formatter->signature, "NonExistentFile"));
+        CHECK(client.send_request(hasher.formatter->signature, "../data/TestPfffOptions.in"));
+        CHECK(!client.send_request(hasher.formatter->signature, "a\nb"));
+        CHECK_EQUAL(5, client.pending());
+
+        for (int i = 0; i < 3; i++) {
+            unsigned char digest[16], expected[16];
+            long long size;
+            CHECK(client.receive_reply(digest, 16, size));
+            LocalFileBlockReader reader((string(DATA_DIR) + files[i]).c_str());
+            hasher.read_sample(&reader);
+            hasher.formatter->output_digest(expected);
+            CHECK_ARRAY_EQUAL(expected, digest, 16);
+            CHECK_EQUAL(hasher.formatter->file_size, size);
+        }
+        unsigned char digest[16];
+        long long size;
+        CHECK(!client.receive_reply(digest, 16, size));
+        CHECK(client.error_message != "");
+        CHECK(!client.receive_reply(digest, 16, size));
+        CHECK(client.error_message.find("..") != string::npos);
+        CHECK_EQUAL(0, client.pending());
+    }
+    // The repeated file was served from the cache
+    CHECK_EQUAL(1, daemon.cache.hits);
+
+    daemon.stop();
+    pthread_join(server_thread, NULL);
+}
+
+TEST(TestPfffDaemonConfinement) {
+    // A symlink within the root may only point within it
+    string inside = string(DATA_DIR) + "TestPfffDaemonInside.lnk", outside = string(DATA_DIR) + "TestPfffDaemonOutside.lnk";
+    unlink(inside.c_str());
+    unlink(outside.c_str());
+    CHECK_EQUAL(0, symlink("TestPfffOptions.in", inside.c_str()));
+    CHECK_EQUAL(0, symlink("../src/main.cpp", outside.c_str()));
+    PfffDaemon daemon(DATA_DIR, "127.0.0.1", 0, 2, 4, 100, 0);
+    pthread_t server_thread;
+    pthread_create(&server_thread, NULL, serve_main, &daemon);
+
+    PfffOptions opts;
+    pfff_options_init(&opts, 5);
+    opts.output_format = PFO_OF_MD5;
+    PfffHasher hasher(&opts);
+    {
+        PfffDaemonClient client("127.0.0.1", daemon.port());
+        unsigned char digest[16];
+        long long size;
+        CHECK(client.send_request(hasher.formatter->signature, "TestPfffDaemonInside.lnk"));
+        CHECK(client.receive_reply(digest, 16, size));
+        CHECK(client.send_request(hasher.formatter->signature, "TestPfffDaemonOutside.lnk"));
+        CHECK(!client.receive_reply(digest, 16, size));
+        CHECK_EQUAL("Path leads out of the root directory", client.error_message);
+    }
+    {
+        // An empty line is answered, not taken for the end of the connection
+        SocketClient socket("127.0.0.1", daemon.port());
+        socket.SendLine("");
+        CHECK_EQUAL("ERR Unknown request\n", socket.ReceiveLine());
+        socket.SendLine("QUIT");
+    }
+
+    daemon.stop();
+    pthread_join(server_thread, NULL);
+    unlink(inside.c_str());
+    unlink(outside.c_str());
+}
+
+TEST(TestPfffResultCache) {
+    PfffResultCache cache(2);
+    string digest;
+    cache.insert("a", 1, 1, 1, "A");
+    cache.insert("b", 1, 1, 1, "B");
+    CHECK(cache.lookup("a", 1, 1, 1, digest));     // "b" is now the least recently used
+    CHECK_EQUAL("A", digest);
+    CHECK(!cache.lookup("a", 1, 2, 1, digest));    // Modified file
+    cache.insert("c", 1, 1, 1, "C");
+    CHECK(!cache.lookup("b", 1, 1, 1, digest));
+    CHECK(cache.lookup("c", 1, 1, 1, digest));
+    CHECK_EQUAL("C", digest);
+}
+
+};
@@ -44,10 +44,12 @@ class MemoryBlockReader: public BlockReader {
 public:	
     const char* mem;
     long len;
+    long blocks_read;
     
-    MemoryBlockReader(const char* mem, long len): BlockReader("MEMORY"), mem(mem), len(len) {};
+    MemoryBlockReader(const char* mem, long len): BlockReader("MEMORY"), mem(mem), len(len), blocks_read(0) {};
     
     bool next_block(unsigned long long block_start, unsigned long block_size) {
+        blocks_read++;
         // Beginning of each requested block MUST fall into existing space
         CHECK(block_start < len);
         if (block_start + block_size > len) {
@@ -180,4 +182,129 @@ TEST(TestBlockReaderWithBuffering) {
     delete ba;
 }
 
+TEST(TestPfffHasherAdaptive) {
+    const long LEN = 100000;
+    char* zeros = new char[LEN];
+    char* noise = new char[LEN];
+    memset(zeros, 0, LEN);
+    MTwister mtwist;
+    mtwist.seed(42);
+    for (long i = 0; i < LEN; i++) noise[i] = (char)mtwist.random_uint32();
+    
+    for (int block_size = 1; block_size <= 16; block_size *= 16) {
+        PfffOptions opts;
+        pfff_options_init(&opts, 3);
+        opts.block_size = block_size;
+        opts.adaptive = 1;
+        PfffHasher adaptive(&opts);
+        
+        // Sparse data gets the largest sample, random data a smaller one
+        MemoryBlockReader zeros_reader(zeros, LEN), noise_reader(noise, LEN);
+        adaptive.read_sample(&zeros_reader);
+        CHECK_EQUAL(4*PFO_BC_DEFAULT, adaptive.formatter->block_count);
+        CHECK_EQUAL(4*PFO_BC_DEFAULT, adaptive.formatter->signature.values.block_count);
+        adaptive.read_sample(&noise_reader);
+        long noise_count = adaptive.formatter->block_count;
+        CHECK(noise_count <= PFO_BC_DEFAULT);
+        if (block_size > 1) CHECK_EQUAL(PFO_BC_DEFAULT / 4, noise_count);
+        unsigned char adaptive_digest[16];
+        adaptive.formatter->output_digest(adaptive_digest);
+        
+        // The fingerprint is the plain one for the count used
+        PfffOptions fixed_opts = opts;
+        fixed_opts.adaptive = 0;
+        fixed_opts.block_count = noise_count;
+        PfffHasher fixed(&fixed_opts);
+        fixed.read_sample(&noise_reader);
+        unsigned char fixed_digest[16];
+        fixed.formatter->output_digest(fixed_digest);
+        CHECK_ARRAY_EQUAL(fixed_digest, adaptive_digest, 16);
+    }
+    
+    // A small file is covered before the largest count
+    PfffOptions opts;
+    pfff_options_init(&opts, 3);
+    opts.adaptive = 1;
+    opts.without_replacement = 1;
+    PfffHasher hasher(&opts);
+    MemoryBlockReader small(zeros, 20);
+    hasher.read_sample(&small);
+    CHECK_EQUAL(32, hasher.formatter->block_count);
+    CHECK_EQUAL(20, hasher.formatter->sample_size);
+    delete[] zeros;
+    delete[] noise;
+}
+
+TEST(TestPfffHasherAdaptiveEmptyFile) {
+    const long LEN = 100000;
+    char* noise = new char[LEN];
+    MTwister mtwist;
+    mtwist.seed(42);
+    for (long i = 0; i < LEN; i++) noise[i] = (char)mtwist.random_uint32();
+    PfffOptions opts;
+    pfff_options_init(&opts, 3);
+    opts.adaptive = 1;
+    MemoryBlockReader noise_reader(noise, LEN), empty_reader(noise, 0);
+    
+    // The fingerprint of an empty file does not depend on the file hashed before it
+    PfffHasher fresh(&opts);
+    fresh.read_sample(&empty_reader);
+    unsigned char expected[16];
+    fresh.formatter->output_digest(expected);
+    PfffHasher used(&opts);
+    used.read_sample(&noise_reader);
+    used.read_sample(&empty_reader);
+    unsigned char actual[16];
+    used.formatter->output_digest(actual);
+    CHECK_ARRAY_EQUAL(expected, actual, 16);
+    
+    // Nor when the sample of the empty file is extended
+    used.read_sample(&noise_reader);
+    used.read_sample(&empty_reader, pfff_options_min_block_count(&opts));
+    used.extend_sample(&empty_reader, opts.block_count);
+    used.formatter->output_digest(actual);
+    CHECK_ARRAY_EQUAL(expected, actual, 16);
+    delete[] noise;
+}
+
+TEST(TestPfffHasherTiers) {
+    const char* text = DATA[7];
+    long len = DATA_LEN[7];
+    const unsigned long TIERS[] = { 2, 8, 4 };
+    for (int without_replacement = 0; without_replacement < 2; without_replacement++) {
+        PfffOptions opts;
+        pfff_options_init(&opts, 5);
+        opts.block_count = 8;
+        opts.without_replacement = without_replacement;
+        opts.header_block_count = 1;
+        
+        // One fingerprint per tier, as if computed separately, from a single pass
+        PfffHasher tiered(&opts);
+        tiered.tiers.assign(TIERS, TIERS + 3);
+        MemoryBlockReader reader(text, len);
+        ostringstream tiered_out, separate_out;
+        tiered.hash(tiered_out, &reader);
+        CHECK_EQUAL(1 + 8, reader.blocks_read);
+        for (int i = 0; i < 3; i++) {
+            PfffOptions tier_opts = opts;
+            tier_opts.block_count = TIERS[i];
+            PfffHasher hasher(&tier_opts);
+            MemoryBlockReader tier_reader(text, len);
+            if (i > 0) separate_out << '\n';
+            hasher.hash(separate_out, &tier_reader);
+        }
+        CHECK_EQUAL(separate_out.str(), tiered_out.str());
+        
+        // A later tier reuses the reads of an earlier one
+        PfffHasher progressive(&opts);
+        MemoryBlockReader progressive_reader(text, len);
+        progressive.read_sample(&progressive_reader, 2);
+        progressive.extend_sample(&progressive_reader, 8);
+        CHECK(progressive_reader.blocks_read <= 1 + 8);
+        ostringstream progressive_out;
+        progressive.formatter->output_hash(progressive_out);
+        CHECK_EQUAL(separate_out.str().substr(separate_out.str().find('\n') + 1, progressive_out.str().size()), progressive_out.str());
+    }
+}
+
 }
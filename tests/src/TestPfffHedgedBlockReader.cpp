@@ -0,0 +1,133 @@
+// Test of the hedged requests and of the network timeouts
+#include "config.h"
+#include "PfffHedgedBlockReader.h"
+#include "PfffHttpBlockReader.h"
+#include "PfffLoopbackServer.h"
+#include "PfffHasher.h"
+#include "PfffStats.h"
+#include <sstream>
+
+using std::ostringstream;
+
+namespace TestPfffHedgedBlockReader {
+
+static const char* FILE_NAME = "TestPfffOptions.in";
+
+/** Fingerprint of a file read with the given reader (which is deleted), without the filename, or "" on failure. */
+static string fingerprint(PfffHasher& hasher, BlockReader* reader) {
+    ostringstream out;
+    try {
+        hasher.hash(out, reader);
+    }
+    catch (pfff_exception&) {
+        delete reader;
+        return "";
+    }
+    delete reader;
+    return out.str().substr(0, out.str().find('\t'));
+}
+
+static BlockReader* http_reader(const PfffLoopbackServer& server, const char* file) {
+    return new HttpBlockReader(new HttpClientSocket("127.0.0.1", server.port()), (string("/") + file).c_str(), true);
+}
+
+TEST(TestLatencyTracker) {
+    PfffLatencyTracker tracker(5000000);
+    CHECK_EQUAL(-1, tracker.percentile(95));
+    for (int i = 1; i <= 100; i++) {
+        tracker.add(i * 1000);
+        if (i < PFFF_LATENCY_MIN_SAMPLES) CHECK_EQUAL(5000000, tracker.hedge_delay_ns());
+    }
+    CHECK_EQUAL(95000, tracker.percentile(95));
+    CHECK_EQUAL(95000, tracker.hedge_delay_ns());
+    CHECK_EQUAL(50000, tracker.percentile(50));
+    // Only the last PFFF_LATENCY_WINDOW latencies count
+    for (int i = 0; i < PFFF_LATENCY_WINDOW; i++) tracker.add(7);
+    CHECK_EQUAL(7, tracker.percentile(95));
+
+    tracker.count(true, false, true);
+    tracker.count(false, true, false);
+    ostringstream out;
+    tracker.output(out, "host");
+    CHECK_EQUAL("hedge\thost\trequests=2\thedged=1\thedge_wins=1\tfailovers=1\tp95_us=0\n", out.str());
+}
+
+TEST(TestHedge) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 3);
+    opts.block_count = 40;
+    opts.block_size = 7;
+    PfffHasher hasher(&opts);
+    string expected = fingerprint(hasher, new LocalFileBlockReader((string(DATA_DIR) + FILE_NAME).c_str()));
+
+    PfffLoopbackHttpServer slow(DATA_DIR, 500000), fast(DATA_DIR);
+    slow.start();
+    fast.start();
+    PfffLatencyTracker tracker(20000000);
+
+    // The slow server is given up for the fast one after 20ms, for the size and for the blocks
+    long long start = pfff_now_ns();
+    CHECK_EQUAL(expected, fingerprint(hasher, new HedgedBlockReader(http_reader(slow, FILE_NAME), http_reader(fast, FILE_NAME), &tracker)));
+    CHECK(pfff_now_ns() - start < 400000000LL);
+    ostringstream out;
+    tracker.output(out, "slow");
+    CHECK(out.str().find("\thedged=1\thedge_wins=1\t") != string::npos);
+
+    // Without delays, the primary answers
+    PfffLatencyTracker quick(1000000000LL);
+    CHECK_EQUAL(expected, fingerprint(hasher, new HedgedBlockReader(http_reader(fast, FILE_NAME), http_reader(slow, FILE_NAME), &quick)));
+    ostringstream quick_out;
+    quick.output(quick_out, "fast");
+    CHECK(quick_out.str().find("\trequests=2\thedged=0\thedge_wins=0\tfailovers=0\t") != string::npos);
+    CHECK(quick.percentile(95) > 0);
+
+    slow.stop();
+    fast.stop();
+}
+
+TEST(TestFailover) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 3);
+    PfffHasher hasher(&opts);
+    string file = string(DATA_DIR) + FILE_NAME;
+    string expected = fingerprint(hasher, new LocalFileBlockReader(file.c_str()));
+
+    // A failed request is sent to the alternate reader at once
+    PfffLatencyTracker tracker(1000000000LL);
+    long long start = pfff_now_ns();
+    PfffStats stats;
+    BlockReader* reader = new HedgedBlockReader(new LocalFileBlockReader((string(DATA_DIR) + "NonExistentFile").c_str()),
+                                                new LocalFileBlockReader(file.c_str()), &tracker);
+    reader = new MonitoringBlockReader(reader, &stats, "physical");
+    CHECK_EQUAL(expected, fingerprint(hasher, reader));
+    CHECK(pfff_now_ns() - start < 500000000LL);
+    ostringstream out;
+    tracker.output(out, "local");
+    CHECK(out.str().find("\thedged=0\thedge_wins=0\tfailovers=2\t") != string::npos);
+    // Both failovers are repeated requests for --stats
+    CHECK_EQUAL(2, stats.reader("physical").retries);
+    CHECK_EQUAL(0, stats.reader("physical").errors);
+
+    // Both failing
+    reader = new HedgedBlockReader(new LocalFileBlockReader((string(DATA_DIR) + "NonExistentFile").c_str()),
+                                   new LocalFileBlockReader((string(DATA_DIR) + "NonExistentFile").c_str()), &tracker);
+    CHECK(reader->size() < 0);
+    CHECK(reader->error_message != "");
+    delete reader;
+}
+
+TEST(TestTimeout) {
+    PfffLoopbackHttpServer server(DATA_DIR, 1000000);
+    server.start();
+    Socket::TIMEOUT_MS = 100;
+    HttpClientSocket http("127.0.0.1", server.port());
+    long long start = pfff_now_ns();
+    HttpBlockReader reader(&http, (string("/") + FILE_NAME).c_str());
+    CHECK(reader.size() < 0);
+    CHECK_EQUAL("TIMED_OUT", reader.error_message);
+    CHECK(pfff_now_ns() - start < 900000000LL);
+    Socket::TIMEOUT_MS = 0;
+    server.stop();
+}
+
+}
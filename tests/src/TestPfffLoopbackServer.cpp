@@ -0,0 +1,101 @@
+// Test of the remote BlockReaders against the loopback HTTP and FTP servers
+#include "config.h"
+#include "PfffLoopbackServer.h"
+#include "PfffHttpBlockReader.h"
+#include "PfffFtpBlockReader.h"
+#include "PfffHasher.h"
+#include "FtpSocket.h"
+#include "PfffStats.h"
+#include <sstream>
+
+using std::ostringstream;
+
+namespace TestPfffLoopbackServer {
+
+static const char* FILES[] = { "TestPfffOptions.in", "TestPfffHasherOnFiles1.in", "TestPfffHasherOnFiles2.in" };
+static const int N_FILES = 3;
+
+/**
+ * Fingerprint of a file read with the given reader (which is deleted), without the filename, or "" on failure.
+ */
+static string fingerprint(PfffHasher& hasher, BlockReader* reader) {
+    ostringstream out;
+    try {
+        hasher.hash(out, reader);
+    }
+    catch (pfff_exception&) {
+        delete reader;
+        return "";
+    }
+    delete reader;
+    return out.str().substr(0, out.str().find('\t'));
+}
+
+static string local_fingerprint(PfffHasher& hasher, const char* file) {
+    return fingerprint(hasher, new LocalFileBlockReader((string(DATA_DIR) + file).c_str()));
+}
+
+TEST(TestLoopbackHttp) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 3);
+    opts.block_count = 40;
+    opts.block_size = 7;
+    PfffHasher hasher(&opts);
+
+    for (int chunked = 0; chunked < 2; chunked++) {
+        PfffLoopbackHttpServer server(DATA_DIR, 0, chunked);
+        server.start();
+        CHECK(server.port() > 0);
+        HttpClientSocket http("127.0.0.1", server.port());
+        for (int i = 0; i < N_FILES; i++) {
+            string expected = local_fingerprint(hasher, FILES[i]);
+            CHECK(expected != "");
+            string path = string("/") + FILES[i];
+            // All blocks in one multipart/byteranges request
+            CHECK_EQUAL(expected, fingerprint(hasher, new HttpBlockReader(&http, path.c_str())));
+            // Coalesced into a single range
+            CHECK_EQUAL(expected, fingerprint(hasher, new BufferingBlockReader(new HttpBlockReader(&http, path.c_str()), 1000000000)));
+        }
+        HttpBlockReader missing(&http, "/NonExistentFile");
+        CHECK(missing.size() < 0);
+        CHECK(missing.error_message != "");
+        HttpBlockReader outside(&http, "/../data/TestPfffOptions.in");
+        CHECK(outside.size() < 0);
+        server.stop();
+    }
+}
+
+TEST(TestLoopbackFtp) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 3);
+    opts.block_count = 10;
+    opts.block_size = 30;
+    PfffHasher hasher(&opts);
+
+    PfffLoopbackFtpServer server(DATA_DIR);
+    server.start();
+    FtpClientSocket ftp("127.0.0.1", server.port());
+    CHECK_EQUAL("230", ftp.AnonymousLogin());
+    CHECK_EQUAL("200", ftp.SendCommand("TYPE I"));
+    for (int i = 0; i < N_FILES; i++) {
+        string expected = local_fingerprint(hasher, FILES[i]);
+        CHECK_EQUAL(expected, fingerprint(hasher, new FtpBlockReader(&ftp, FILES[i])));
+    }
+    FtpBlockReader missing(&ftp, "NonExistentFile");
+    CHECK(missing.size() < 0);
+    CHECK(missing.error_message != "");
+    // The control connection is still usable after the failure
+    CHECK_EQUAL(local_fingerprint(hasher, FILES[0]), fingerprint(hasher, new FtpBlockReader(&ftp, FILES[0])));
+}
+
+TEST(TestLoopbackLatency) {
+    PfffLoopbackHttpServer server(DATA_DIR, 20000);
+    server.start();
+    HttpClientSocket http("127.0.0.1", server.port());
+    long long start = pfff_now_ns();
+    CHECK(http.Size("/TestPfffOptions.in") > 0);
+    CHECK(pfff_now_ns() - start >= 20000000LL);
+    CHECK_EQUAL(1, server.requests());
+}
+
+}
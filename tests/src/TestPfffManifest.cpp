@@ -0,0 +1,112 @@
+// Test that the records written in each output mode are read back by PfffManifestReader
+#include "config.h"
+#include "PfffManifest.h"
+#include "PfffHasher.h"
+#include "PfffBlockReader.h"
+#include <sstream>
+
+using std::istringstream;
+using std::ostringstream;
+
+namespace TestPfffManifest {
+
+const int   NUM_DATA = 3;
+const char* DATA[] = {
+    "TestPfffHasherOnFiles1.in",
+    "TestPfffHasherOnFiles2.in",
+    "TestPfffOptions.in"
+};
+
+/**
+ * Writes a manifest of the test files with the given options, reads it back and compares.
+ */
+void check_round_trip(const PfffOptions& opts) {
+    PfffHasher hasher(&opts);
+    ostringstream out;
+    hasher.formatter->output_header(out);
+    unsigned char digests[NUM_DATA][16];
+    long long sizes[NUM_DATA];
+    for (int i = 0; i < NUM_DATA; i++) {
+        string path = string(DATA_DIR) + DATA[i];
+        LocalFileBlockReader reader(path.c_str());
+        hasher.hash(out, &reader);
+        out << hasher.formatter->record_end();
+        hasher.formatter->output_digest(digests[i]);
+        sizes[i] = hasher.formatter->file_size;
+    }
+
+    istringstream in(out.str());
+    PfffManifestReader reader(in);
+    PfffManifestRecord record;
+    for (int i = 0; i < NUM_DATA; i++) {
+        CHECK(reader.next(record));
+        CHECK_EQUAL("", reader.error_message);
+        CHECK_EQUAL((int)opts.output_mode, reader.mode);
+        CHECK_EQUAL(16, (int)record.digest.size());
+        CHECK_ARRAY_EQUAL((char*)digests[i], record.digest.data(), 16);
+        CHECK_EQUAL(opts.no_filename ? string() : string(DATA_DIR) + DATA[i], record.path);
+        if (opts.output_mode != PFO_OM_TEXT) CHECK_EQUAL(sizes[i], record.size);
+        CHECK_EQUAL(!opts.no_prefix || opts.output_mode == PFO_OM_BINARY, record.has_signature);
+        if (record.has_signature) {
+            PfffOptions decoded;
+            CHECK(PfffManifestReader::signature_to_options(record.signature, &decoded));
+            CHECK_EQUAL(opts.key, decoded.key);
+            CHECK_EQUAL(opts.output_format, decoded.output_format);
+            CHECK_EQUAL(opts.block_count, decoded.block_count);
+            CHECK_EQUAL(opts.block_size, decoded.block_size);
+            CHECK_EQUAL(opts.header_block_count, decoded.header_block_count);
+            CHECK_EQUAL(opts.with_size, decoded.with_size);
+            CHECK_EQUAL(opts.without_replacement, decoded.without_replacement);
+        }
+    }
+    CHECK(!reader.next(record));
+    CHECK_EQUAL("", reader.error_message);
+}
+
+TEST(TestPfffManifestRoundTrip) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 12345);
+    opts.block_count = 20;
+    opts.header_block_count = 3;
+    opts.with_size = true;
+    const int modes[] = { PFO_OM_TEXT, PFO_OM_BINARY, PFO_OM_NDJSON };
+    const int formats[] = { PFO_OF_POLY1305AES, PFO_OF_MD5 };
+    for (int m = 0; m < 3; m++) {
+        for (int f = 0; f < 2; f++) {
+            opts.output_mode = modes[m];
+            opts.output_format = formats[f];
+            opts.no_prefix = false; opts.no_filename = false;
+            check_round_trip(opts);
+            opts.no_prefix = true; opts.no_filename = true;
+            check_round_trip(opts);
+        }
+    }
+}
+
+TEST(TestPfffManifestParsing) {
+    // Escapes in NDJSON paths, unknown fields, blank lines
+    PfffManifestRecord record;
+    istringstream json("{\"digest\":\"00ff\",\"size\":7,\"extra\":true,\"path\":\"a\\\"b\\\\c\\u00e9\\ud83d\\ude00\"}\n\n"
+                       "{\"digest\":\"0g\"}\n");
+    PfffManifestReader json_reader(json);
+    CHECK(json_reader.next(record));
+    CHECK_EQUAL(string("\x00\xff", 2), record.digest);
+    CHECK_EQUAL(7, record.size);
+    CHECK_EQUAL("a\"b\\c\xc3\xa9\xf0\x9f\x98\x80", record.path);
+    CHECK(!json_reader.next(record));
+    CHECK(json_reader.error_message != "");
+
+    // CSV output is not a manifest
+    istringstream csv("0a,0b,0c\tfile\n");
+    PfffManifestReader csv_reader(csv);
+    CHECK(!csv_reader.next(record));
+    CHECK(csv_reader.error_message != "");
+
+    // Truncated binary
+    istringstream binary(string("PFFF\x01\x10", 6));
+    PfffManifestReader binary_reader(binary);
+    CHECK(!binary_reader.next(record));
+    CHECK(binary_reader.error_message != "");
+}
+
+};
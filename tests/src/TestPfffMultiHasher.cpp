@@ -0,0 +1,115 @@
+// Test of computing several fingerprints from a single read pass
+#include "config.h"
+#include "PfffMultiHasher.h"
+#include "PfffOptionManager.h"
+#include <sstream>
+
+using std::ostringstream;
+
+namespace TestPfffMultiHasher {
+
+/**
+ * Reads a file and counts the block sequences and the bytes requested.
+ */
+class CountingBlockReader: public LocalFileBlockReader {
+public:
+    long sequences;
+    unsigned long long bytes;
+
+    CountingBlockReader(const char* filename): LocalFileBlockReader(filename), sequences(0), bytes(0) {}
+
+    void begin_block_sequence(char* buffer) {
+        sequences++;
+        LocalFileBlockReader::begin_block_sequence(buffer);
+    }
+    bool next_block(unsigned long long block_start, unsigned long block_size) {
+        bytes += block_size;
+        return LocalFileBlockReader::next_block(block_start, block_size);
+    }
+};
+
+static string single(const PfffOptions& opts, const string& file, unsigned long long& bytes) {
+    PfffHasher hasher(&opts);
+    CountingBlockReader reader(file.c_str());
+    ostringstream out;
+    hasher.hash(out, &reader);
+    bytes += reader.bytes;
+    return out.str() + hasher.formatter->record_end();
+}
+
+TEST(TestMultiHasherSinglePass) {
+    const char* FILES[] = { "TestPfffOptions.in", "TestPfffHasherOnFiles1.in", "TestPfffHasherOnFiles2.in" };
+    PfffOptions opts[4];
+    pfff_options_init(&opts[0], 1);
+    opts[0].block_count = 20;
+    opts[0].block_size = 10;
+    opts[1] = opts[0];
+    opts[1].output_format = PFO_OF_MD5;
+    opts[2] = opts[0];
+    opts[2].key = 2;
+    opts[2].with_size = 1;
+    opts[3] = opts[0];
+    opts[3].output_format = PFO_OF_CSV;
+    opts[3].block_count = 40;
+    opts[3].header_block_count = 2;
+
+    PfffMultiHasher multi;
+    for (int i = 0; i < 4; i++) multi.hashers.push_back(new PfffHasher(&opts[i]));
+    for (int f = 0; f < 3; f++) {
+        string file = string(DATA_DIR) + FILES[f];
+        string expected;
+        unsigned long long separate_bytes = 0;
+        for (int i = 0; i < 4; i++) expected += single(opts[i], file, separate_bytes);
+
+        CountingBlockReader reader(file.c_str());
+        ostringstream out;
+        multi.hash(out, &reader);
+        out << multi.hashers.back()->formatter->record_end();
+        CHECK_EQUAL(expected, out.str());
+        if (separate_bytes == 0) continue;  // Empty file
+        CHECK_EQUAL(1, reader.sequences);
+        // The md5 sample is the poly1305aes one and the csv sample extends it (by 20 blocks and the header)
+        CHECK(reader.bytes < separate_bytes);
+        if (f == 0) CHECK(reader.bytes <= separate_bytes - 200 - 200);
+    }
+    
+    // Errors are reported as by a single hasher
+    LocalFileBlockReader missing((string(DATA_DIR) + "NonExistentFile").c_str());
+    ostringstream out;
+    CHECK_THROW(multi.hash(out, &missing), pfff_exception);
+    for (int i = 0; i < 4; i++) delete multi.hashers[i];
+}
+
+static bool parse(const char* a1, const char* a2, const char* a3, PfffOptionManager& optmgr) {
+    char* argv[] = { (char*)"pfff", (char*)a1, (char*)a2, (char*)a3, (char*)"x" };
+    ostringstream null;
+    optmgr.cerr = &null;
+    optmgr.TEST_MODE = true;
+    try {
+        optmgr.init_from_cmdline_or_die(5, argv);
+    }
+    catch (string&) {
+        return false;
+    }
+    return true;
+}
+
+TEST(TestMultiHasherOptions) {
+    PfffOptionManager a;
+    CHECK(parse("-n50", "-Akey=2,format=md5,with-size", "--also=block-count=10,adaptive=0", a));
+    CHECK_EQUAL(2, a.also_options.size());
+    CHECK_EQUAL(2, a.also_options[0].key);
+    CHECK_EQUAL(PFO_OF_MD5, a.also_options[0].output_format);
+    CHECK_EQUAL(1, a.also_options[0].with_size);
+    CHECK_EQUAL(50, a.also_options[0].block_count);
+    CHECK_EQUAL(1, a.also_options[1].key);
+    CHECK_EQUAL(10, a.also_options[1].block_count);
+    
+    PfffOptionManager b, c, d, e;
+    CHECK(!parse("-n50", "-Akey=2,format=sha1", "-k1", b));
+    CHECK(!parse("-n50", "-Ablock-count=0", "-k1", c));
+    CHECK(!parse("-mbinary", "-Akey=2", "-k1", d));
+    CHECK(!parse("-b", "-Aadaptive", "-k1", e));
+}
+
+}
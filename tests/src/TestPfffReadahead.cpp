@@ -0,0 +1,69 @@
+// Test of the cross-file readahead
+#include "config.h"
+#include "PfffReadahead.h"
+#include <sstream>
+
+using std::ostringstream;
+
+namespace TestPfffReadahead {
+
+static const char* FILES[] = { "TestPfffOptions.in", "NonExistentFile", "TestPfffHasherOnFiles1.in", "TestPfffBgzf.in",
+                               "TestPfffHasherOnFiles2.in" };
+static const int N_FILES = 5;
+
+static string direct(PfffHasher& hasher, const string& file) {
+    ostringstream out;
+    LocalFileBlockReader reader(file.c_str());
+    try {
+        hasher.hash(out, &reader);
+    }
+    catch (pfff_exception&) {
+        return "";
+    }
+    return out.str();
+}
+
+TEST(TestReadahead) {
+    PfffOptions opts, also;
+    pfff_options_init(&opts, 1);
+    opts.block_count = 20;
+    opts.block_size = 50;
+    pfff_options_init(&also, 2);
+    also.output_format = PFO_OF_MD5;
+    also.header_block_count = 2;
+    PfffHasher hasher(&opts), also_hasher(&also);
+    PfffMultiHasher hashers;
+    hashers.hashers.push_back(&hasher);
+    hashers.hashers.push_back(&also_hasher);
+
+    // Files are output in the order added, whenever that happens
+    PfffReadahead readahead(hashers);
+    int next = 0;
+    for (int i = 0; i < N_FILES; i++) {
+        readahead.add(new BufferingBlockReader(new LocalFileBlockReader((string(DATA_DIR) + FILES[i]).c_str()), 1024));
+        for (; readahead.size() > (i == N_FILES - 1 ? 0 : i % 3); next++) {
+            string file = string(DATA_DIR) + FILES[next];
+            string expected = direct(hasher, file);
+            ostringstream out;
+            if (expected == "") {
+                CHECK_THROW(readahead.output_next(out), pfff_exception);
+                continue;
+            }
+            readahead.output_next(out);
+            CHECK_EQUAL(expected + "\n" + direct(also_hasher, file), out.str());
+        }
+    }
+    CHECK_EQUAL(N_FILES, next);
+    CHECK_EQUAL(0, readahead.size());
+#ifdef POSIX_FADV_WILLNEED
+    CHECK(readahead.advised_ranges > 0);
+    CHECK(readahead.advised_bytes > 0);
+#endif
+
+    // Files left over are freed
+    PfffReadahead pending(hashers);
+    pending.add(new LocalFileBlockReader((string(DATA_DIR) + FILES[0]).c_str()));
+    CHECK_EQUAL(1, pending.size());
+}
+
+}
@@ -0,0 +1,154 @@
+// Test of the listing of directories on FTP and HTTP servers
+#include "config.h"
+#include "PfffRemoteListing.h"
+#include "PfffLoopbackServer.h"
+#include <sstream>
+
+using std::ostringstream;
+
+namespace TestPfffRemoteListing {
+
+/** The entries as "<type> <path> <size>" lines. */
+static string describe(const vector<PfffRemoteEntry>& entries) {
+    static const char* TYPES[] = { "file", "dir", "link", "failed" };
+    ostringstream out;
+    for (int i = 0; i < entries.size(); i++)
+        out << TYPES[entries[i].type] << " " << entries[i].path << " " << entries[i].size << "\n";
+    return out.str();
+}
+
+/** Everything the walker finds. */
+static string walk(PfffRemoteLister* lister, const char* root, long max_pending = PFFF_REMOTE_QUEUE_SIZE) {
+    vector<string> roots(1, root);
+    PfffRemoteWalker walker(lister, roots, max_pending);
+    vector<PfffRemoteEntry> entries;
+    PfffRemoteEntry entry;
+    while (walker.next(entry)) entries.push_back(entry);
+    return describe(entries);
+}
+
+// The files of tests/data/TestPfffTree, with their sizes
+static const char* FTP_TREE =
+    "file /TestPfffTree/a.txt 1619\n"
+    "file /TestPfffTree/b/c.txt 15\n"
+    "file /TestPfffTree/b/d/empty 0\n"
+    "file /TestPfffTree/z.bin 6016\n";
+
+TEST(TestParseMlsd) {
+    vector<PfffRemoteEntry> entries;
+    CHECK(FtpRemoteLister::parse_mlsd(
+        "type=cdir;modify=20100101000000; /pub\r\n"
+        "type=pdir;modify=20100101000000; /\r\n"
+        "Type=file;Size=1234;Modify=20100101000000; file name.txt\r\n"
+        "type=dir;modify=20100101000000; sub\r\n"
+        "type=OS.unix=slink:/etc;modify=20100101000000; link\r\n", entries));
+    CHECK_EQUAL("file file name.txt 1234\ndir sub -1\nlink link -1\n", describe(entries));
+    CHECK(!FtpRemoteLister::parse_mlsd("nonsense\r\n", entries));
+}
+
+TEST(TestParseList) {
+    vector<PfffRemoteEntry> entries;
+    CHECK(FtpRemoteLister::parse_list(
+        "total 12\r\n"
+        "drwxr-xr-x    2 ftp      ftp          4096 Jan 01  2010 sub dir\r\n"
+        "-rw-r--r--    1 ftp      ftp       1234567 Mar 15 12:30 file.txt\r\n"
+        "-rw-r--r--    1 owner         42 Mar 15 12:30 no group\r\n"
+        "lrwxrwxrwx    1 ftp      ftp             4 Jan 01  2010 link -> /etc\r\n"
+        "drwxr-xr-x    2 ftp      ftp          4096 Jan 01  2010 ..\r\n"
+        "01-01-10  12:00AM       <DIR>          dos dir\r\n"
+        "01-01-10  12:00AM                   17 dos.txt\r\n", entries));
+    CHECK_EQUAL("dir sub dir -1\nfile file.txt 1234567\nfile no group 42\nlink link -1\ndir dos dir -1\nfile dos.txt 17\n",
+                describe(entries));
+    CHECK(!FtpRemoteLister::parse_list("-rw-r--r-- garbage\r\n", entries));
+}
+
+TEST(TestParsePropfind) {
+    vector<PfffRemoteEntry> entries;
+    CHECK(HttpRemoteLister::parse_propfind(
+        "<?xml version=\"1.0\"?>\n"
+        "<multistatus xmlns=\"DAV:\">\n"
+        "<response><href>/dav/</href><propstat><prop><resourcetype><collection/></resourcetype></prop></propstat></response>\n"
+        "<response><href>http://host:8080/dav/a%20b.txt</href><propstat><prop><resourcetype/>"
+        "<getcontentlength>12</getcontentlength></prop></propstat></response>\n"
+        "<lp1:response xmlns:lp1=\"DAV:\"><lp1:href>/dav/sub</lp1:href><lp1:propstat><lp1:prop>"
+        "<lp1:resourcetype><lp1:collection/></lp1:resourcetype></lp1:prop></lp1:propstat></lp1:response>\n"
+        "<response><href>/dav/x&amp;y</href><propstat><prop><getcontentlength/></prop></propstat></response>\n"
+        "</multistatus>\n", entries));
+    CHECK_EQUAL("dir /dav/ -1\nfile /dav/a%20b.txt 12\ndir /dav/sub/ -1\nfile /dav/x&y -1\n", describe(entries));
+    CHECK(!HttpRemoteLister::parse_propfind("<html>Not WebDAV</html>", entries));
+}
+
+TEST(TestParseAutoindex) {
+    vector<PfffRemoteEntry> entries;
+    HttpRemoteLister::parse_autoindex(
+        "<html><body><table>\n"
+        "<tr><th><a href=\"?C=N;O=D\">Name</a></th></tr>\n"
+        "<tr><td><a href=\"/pub/\">Parent Directory</a></td></tr>\n"
+        "<a href=\"../\">../</a>\n"
+        "<tr><td><a href=\"a.txt\"><img src=\"text.gif\"></a></td><td><A HREF=\"a.txt\">a.txt</A></td></tr>\n"
+        "<a href='sub/'>sub/</a>\n"
+        "<a href=\"x&amp;y\">x&amp;y</a>\n"
+        "<a href=\"http://example.com/\">elsewhere</a> <a href=\"deeper/file\">deeper</a> <a name=\"anchor\">\n"
+        "</table></body></html>\n", entries);
+    CHECK_EQUAL("file a.txt -1\ndir sub/ -1\nfile x&y -1\n", describe(entries));
+}
+
+TEST(TestFtpWalk) {
+    for (int mlsd = 1; mlsd >= 0; mlsd--) {
+        PfffLoopbackFtpServer server(DATA_DIR, 0, mlsd);
+        server.start();
+        CHECK_EQUAL(FTP_TREE, walk(new FtpRemoteLister("127.0.0.1", server.port()), "/TestPfffTree"));
+        // A file is given on its own, a missing one too, so that reading it tells the error
+        CHECK_EQUAL("file /TestPfffTree/a.txt 1619\n", walk(new FtpRemoteLister("127.0.0.1", server.port()), "/TestPfffTree/a.txt"));
+        CHECK_EQUAL("file /NonExistentFile -1\n", walk(new FtpRemoteLister("127.0.0.1", server.port()), "/NonExistentFile"));
+        // Listing the whole tree before it is read
+        CHECK_EQUAL(FTP_TREE, walk(new FtpRemoteLister("127.0.0.1", server.port()), "/TestPfffTree", 0));
+        server.stop();
+    }
+}
+
+TEST(TestHttpWalk) {
+    // With WebDAV, the sizes are known
+    PfffLoopbackHttpServer webdav(DATA_DIR);
+    webdav.start();
+    CHECK_EQUAL(FTP_TREE, walk(new HttpRemoteLister("127.0.0.1", webdav.port()), "/TestPfffTree"));
+    CHECK_EQUAL("file /TestPfffTree/b/c.txt 15\n", walk(new HttpRemoteLister("127.0.0.1", webdav.port()), "/TestPfffTree/b/c.txt"));
+    webdav.stop();
+
+    // Without, directories are read from their index pages
+    PfffLoopbackHttpServer plain(DATA_DIR, 0, false, false);
+    plain.start();
+    CHECK_EQUAL("file /TestPfffTree/a.txt -1\nfile /TestPfffTree/b/c.txt -1\nfile /TestPfffTree/b/d/empty -1\nfile /TestPfffTree/z.bin -1\n",
+                walk(new HttpRemoteLister("127.0.0.1", plain.port()), "/TestPfffTree/"));
+    CHECK_EQUAL("file /TestPfffTree/a.txt -1\n", walk(new HttpRemoteLister("127.0.0.1", plain.port()), "/TestPfffTree/a.txt"));
+    plain.stop();
+}
+
+/** Lists /r as a directory with a subdirectory which can not be listed. */
+class BrokenLister: public PfffRemoteLister {
+public:
+    bool list(const string& dir, vector<PfffRemoteEntry>& entries) {
+        if (dir != "/r") {
+            error_message = "Permission denied";
+            return false;
+        }
+        entries.push_back(PfffRemoteEntry(PfffRemoteEntry::REGULAR, "/r/y", 5));
+        entries.push_back(PfffRemoteEntry(PfffRemoteEntry::DIRECTORY, "/r/x"));
+        return true;
+    }
+};
+
+TEST(TestWalkErrors) {
+    CHECK_EQUAL("failed /r/x -1\nfile /r/y 5\n", walk(new BrokenLister(), "/r"));
+    // A root which can not be listed is taken for a file
+    CHECK_EQUAL("file /s -1\n", walk(new BrokenLister(), "/s"));
+
+    // The walker can be left before the end
+    vector<string> roots(3, "/r");
+    PfffRemoteWalker* walker = new PfffRemoteWalker(new BrokenLister(), roots, 1);
+    PfffRemoteEntry entry;
+    CHECK(walker->next(entry));
+    delete walker;
+}
+
+}
@@ -0,0 +1,145 @@
+// Test of the cross-file read scheduler
+#include "config.h"
+#include "PfffScheduler.h"
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+
+using std::ostringstream;
+
+namespace TestPfffScheduler {
+
+static const char* FILES[] = { "TestPfffOptions.in", "TestPfffHasherOnFiles1.in", "TestPfffBgzf.in", "NonExistentFile",
+                               "TestPfffHasherOnFiles2.in", "TestPfffTree/a.txt", "TestPfffTree/z.bin" };
+static const int N_FILES = 7;
+
+/**
+ * Records the order of the reads made through all its instances.
+ */
+class RecordingBlockReader: public LocalFileBlockReader {
+public:
+    static vector<std::pair<string, unsigned long long> > reads;
+
+    RecordingBlockReader(const char* filename): LocalFileBlockReader(filename) {}
+
+    bool next_block(unsigned long long block_start, unsigned long block_size) {
+        reads.push_back(std::make_pair(filename, block_start));
+        return LocalFileBlockReader::next_block(block_start, block_size);
+    }
+};
+vector<std::pair<string, unsigned long long> > RecordingBlockReader::reads;
+
+static string direct(PfffHasher& hasher, const string& file) {
+    ostringstream out;
+    LocalFileBlockReader reader(file.c_str());
+    try {
+        hasher.hash(out, &reader);
+    }
+    catch (pfff_exception&) {
+        return "";
+    }
+    return out.str();
+}
+
+TEST(TestSchedulerFingerprints) {
+    PfffOptions opts, also;
+    pfff_options_init(&opts, 1);
+    opts.block_count = 20;
+    opts.block_size = 50;
+    pfff_options_init(&also, 2);
+    also.output_format = PFO_OF_MD5;
+    PfffHasher hasher(&opts), also_hasher(&also);
+
+    PfffMultiHasher hashers;
+    hashers.hashers.push_back(&hasher);
+    PfffMultiHasher both = hashers;
+    both.hashers.push_back(&also_hasher);
+    PfffScheduler scheduler(hashers), both_scheduler(both, 1000);
+    RecordingBlockReader::reads.clear();
+    for (int i = 0; i < N_FILES; i++) {
+        string file = string(DATA_DIR) + FILES[i];
+        scheduler.add(new RecordingBlockReader(file.c_str()));
+        both_scheduler.add(new LocalFileBlockReader(file.c_str()));
+    }
+    CHECK_EQUAL(N_FILES, scheduler.size());
+    scheduler.read();
+    both_scheduler.read();
+    CHECK(scheduler.reads <= RecordingBlockReader::reads.size());
+    for (int i = 0; i < N_FILES; i++) {
+        string file = string(DATA_DIR) + FILES[i];
+        string expected = direct(hasher, file);
+        ostringstream out, both_out;
+        if (expected == "") {
+            CHECK_THROW(scheduler.output(i, out), pfff_exception);
+            continue;
+        }
+        scheduler.output(i, out);
+        CHECK_EQUAL(expected, out.str());
+        both_scheduler.output(i, both_out);
+        CHECK_EQUAL(expected + "\n" + direct(also_hasher, file), both_out.str());
+    }
+
+    // With the physical locations known, the reads make a single sweep, possibly wrapped around
+    if (scheduler.physical_order) {
+        int descents = 0;
+        unsigned long long last = 0;
+        for (int i = 0; i < RecordingBlockReader::reads.size(); i++) {
+            int fd = open(RecordingBlockReader::reads[i].first.c_str(), O_RDONLY);
+            vector<PfffExtent> extents;
+            PfffScheduler::map_file(fd, lseek(fd, 0, SEEK_END), extents);
+            close(fd);
+            unsigned long long position = 0;
+            for (int e = 0; e < extents.size(); e++) {
+                if (extents[e].logical <= RecordingBlockReader::reads[i].second)
+                    position = extents[e].physical + (RecordingBlockReader::reads[i].second - extents[e].logical);
+            }
+            if (i > 0 && position < last) descents++;
+            last = position;
+        }
+        CHECK(descents <= 1);
+    }
+    scheduler.clear();
+    CHECK_EQUAL(0, scheduler.size());
+}
+
+TEST(TestSchedulerHoles) {
+    // A sparse file: 4KB of data in the middle of 8MB of holes
+    string file = string(DATA_DIR) + "TestPfffScheduler.tmp";
+    int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    CHECK(fd >= 0);
+    char data[4096];
+    for (int i = 0; i < sizeof(data); i++) data[i] = (char)(i * 7 + 1);
+    CHECK(ftruncate(fd, 8 << 20) == 0);
+    CHECK(pwrite(fd, data, sizeof(data), 4 << 20) == sizeof(data));
+    fsync(fd);
+    vector<PfffExtent> extents;
+    PfffScheduler::map_file(fd, 8 << 20, extents);
+    close(fd);
+    unsigned long long data_bytes = 0;
+    for (int i = 0; i < extents.size(); i++) data_bytes += extents[i].length;
+    CHECK(data_bytes >= sizeof(data));
+
+    PfffOptions opts;
+    pfff_options_init(&opts, 1);
+    opts.block_count = 200;
+    opts.block_size = 1000;
+    opts.header_block_count = 1;
+    PfffHasher hasher(&opts);
+    PfffMultiHasher hashers;
+    hashers.hashers.push_back(&hasher);
+    PfffScheduler scheduler(hashers);
+    scheduler.add(new LocalFileBlockReader(file.c_str()));
+    scheduler.read();
+    ostringstream out;
+    scheduler.output(0, out);
+    CHECK_EQUAL(direct(hasher, file), out.str());
+    // Where the file system tells the holes, they are not read
+    if (data_bytes < (8 << 20)) {
+        CHECK(scheduler.hole_bytes > 0);
+        CHECK(scheduler.bytes_read <= data_bytes);
+    }
+    CHECK(scheduler.bytes_read + scheduler.hole_bytes <= 200 * 1000 + 1000);
+    unlink(file.c_str());
+}
+
+}
@@ -0,0 +1,113 @@
+// Test of the simulated storage
+#include "config.h"
+#include "PfffSimulatedBlockReader.h"
+#include "PfffHasher.h"
+#include <cstring>
+#include <sstream>
+
+using std::ostringstream;
+
+namespace TestPfffSimulatedBlockReader {
+
+static const PfffStorageProfile TEST_PROFILE =
+    // name   open_ns  request_ns  seek_ns  seek_ns_per_gb  bytes_per_s  batched
+    { "test", 1000,    100,        10000,   0,              1000000000,  false };
+
+TEST(TestSimulatedContent) {
+    PfffStorageProfile profile;
+    CHECK(PfffSimulatedStorage::find_profile("hdd", profile));
+    CHECK(PfffSimulatedStorage::find_profile("http", profile));
+    CHECK(profile.batched);
+    CHECK(!PfffSimulatedStorage::find_profile("tape", profile));
+
+    // Content depends on the seed, the file name and the offset only
+    PfffSimulatedStorage a(TEST_PROFILE, 1), b(TEST_PROFILE, 1), c(TEST_PROFILE, 2);
+    char x[100], y[100], z[100];
+    a.fill("f", 0, x, 100);
+    b.fill("f", 0, y, 100);
+    CHECK(memcmp(x, y, 100) == 0);
+    c.fill("f", 0, z, 100);
+    CHECK(memcmp(x, z, 100) != 0);
+    b.fill("g", 0, z, 100);
+    CHECK(memcmp(x, z, 100) != 0);
+    b.fill("f", 13, y, 50);     // Unaligned reads see the same bytes
+    CHECK(memcmp(x + 13, y, 50) == 0);
+
+    // The reader zero-fills beyond the end of file
+    SimulatedBlockReader reader(&a, "f", 20);
+    CHECK_EQUAL(20, reader.size());
+    reader.begin_block_sequence(y);
+    CHECK(reader.next_block(10, 30));
+    CHECK(reader.end_block_sequence());
+    CHECK(memcmp(x + 10, y, 10) == 0);
+    for (int i = 10; i < 30; i++) CHECK_EQUAL(0, y[i]);
+
+    SimulatedBlockReader missing(&a, "m", -1);
+    CHECK(missing.size() < 0);
+    CHECK(missing.error_message != "");
+}
+
+TEST(TestSimulatedCosts) {
+    PfffSimulatedStorage storage(TEST_PROFILE);
+    char buffer[4000];
+    SimulatedBlockReader reader(&storage, "f", 100000);
+    reader.size();
+    CHECK_EQUAL(1000, storage.elapsed_ns);
+    reader.begin_block_sequence(buffer);
+    reader.next_block(0, 1000);     // Continues from the start of the device: no seek
+    reader.next_block(1000, 1000);  // Sequential: no seek
+    reader.next_block(5000, 1000);  // Seek
+    reader.end_block_sequence();
+    CHECK_EQUAL(3, storage.requests);
+    CHECK_EQUAL(1, storage.seeks);
+    CHECK_EQUAL(3000, storage.bytes);
+    CHECK_EQUAL(1000 + 3*100 + 3000 + 10000, storage.elapsed_ns);
+
+    // A second file is placed after the first one, 4K aligned
+    storage.reset();
+    SimulatedBlockReader second(&storage, "g", 10);
+    second.size();
+    second.begin_block_sequence(buffer);
+    second.next_block(0, 100);      // Only the 10 bytes within the file are transferred
+    CHECK_EQUAL(1, storage.seeks);
+    CHECK_EQUAL(10, storage.bytes);
+
+    // Batched profiles make one request per block sequence
+    PfffStorageProfile batched = TEST_PROFILE;
+    batched.batched = true;
+    PfffSimulatedStorage http(batched);
+    SimulatedBlockReader remote(&http, "f", 100000);
+    remote.begin_block_sequence(buffer);
+    remote.next_block(0, 1000);
+    remote.next_block(50000, 1000);
+    CHECK_EQUAL(0, http.requests);
+    remote.end_block_sequence();
+    CHECK_EQUAL(1, http.requests);
+    CHECK_EQUAL(2000, http.bytes);
+}
+
+TEST(TestSimulatedCoalescing) {
+    // Coalescing the reads of a fingerprint must pay off on a disk
+    PfffOptions opts;
+    pfff_options_init(&opts, 1);
+    PfffStorageProfile hdd;
+    PfffSimulatedStorage::find_profile("hdd", hdd);
+    long long size = 1 << 20;
+
+    PfffSimulatedStorage direct_storage(hdd), buffered_storage(hdd);
+    PfffHasher hasher(&opts);
+    ostringstream direct_out, buffered_out;
+    BlockReader* direct = new SimulatedBlockReader(&direct_storage, "f", size);
+    hasher.hash(direct_out, direct);
+    delete direct;
+    BlockReader* buffered = new BufferingBlockReader(new SimulatedBlockReader(&buffered_storage, "f", size), 65536);
+    hasher.hash(buffered_out, buffered);
+    delete buffered;
+
+    CHECK_EQUAL(direct_out.str(), buffered_out.str());
+    CHECK_EQUAL(opts.block_count, direct_storage.requests);
+    CHECK(buffered_storage.requests < direct_storage.requests);
+    CHECK(buffered_storage.elapsed_ns < direct_storage.elapsed_ns);
+}
+
+}
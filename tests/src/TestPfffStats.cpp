@@ -0,0 +1,92 @@
+// Test of the run statistics (pfff --stats)
+#include "config.h"
+#include "PfffStats.h"
+#include "PfffHasher.h"
+#include <sstream>
+
+using std::ostringstream;
+
+namespace TestPfffStats {
+
+TEST(TestPfffHistogram) {
+    PfffHistogram h;
+    CHECK_EQUAL(0, h.quantile(0.5));
+    h.add(0);
+    h.add(1);
+    h.add(3);
+    h.add(1000);
+    CHECK_EQUAL(4, h.count);
+    CHECK_EQUAL(1004, h.total_ns);
+    CHECK_EQUAL(1000, h.max_ns);
+    CHECK_EQUAL(1, h.buckets[0]);
+    CHECK_EQUAL(1, h.buckets[1]);
+    CHECK_EQUAL(1, h.buckets[2]);
+    CHECK_EQUAL(1, h.buckets[10]);
+    CHECK_EQUAL(4, h.quantile(0.5));     // Upper bound of the bucket [2, 4)
+    CHECK_EQUAL(1000, h.quantile(1.0));   // Clipped to the maximum
+
+    ostringstream out;
+    h.output(out);
+    CHECK(out.str().find("count=4\t") == 0);
+    CHECK(out.str().find("\thist=0:1,1:1,2:1,10:1") != string::npos);
+}
+
+TEST(TestMonitoringBlockReader) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 1);
+    opts.block_count = 40;
+    opts.block_size = 10;
+    string filename = string(DATA_DIR) + "TestPfffOptions.in";
+
+    // Plain fingerprint
+    PfffHasher plain_hasher(&opts);
+    LocalFileBlockReader plain_reader(filename.c_str());
+    ostringstream plain;
+    plain_hasher.hash(plain, &plain_reader);
+
+    // The same, with statistics through a buffering reader
+    PfffStats stats;
+    PfffHasher hasher(&opts);
+    hasher.stats = &stats;
+    BlockReader* reader = new LocalFileBlockReader(filename.c_str());
+    reader = new MonitoringBlockReader(reader, &stats, "physical");
+    reader = new BufferingBlockReader(reader, 100000);
+    reader = new MonitoringBlockReader(reader, &stats, "logical");
+    ostringstream monitored;
+    hasher.hash(monitored, reader);
+    long long size = reader->size();
+    delete reader;
+    CHECK_EQUAL(plain.str(), monitored.str());
+
+    PfffReaderStats& logical = stats.reader("logical");
+    PfffReaderStats& physical = stats.reader("physical");
+    CHECK_EQUAL(40, logical.requests);
+    CHECK_EQUAL(40, logical.next_block.count);
+    CHECK_EQUAL(1, logical.end_block_sequence.count);
+    CHECK_EQUAL(1, physical.requests);      // The whole file is within the request cost
+    CHECK(physical.bytes > 0 && physical.bytes <= size);
+    CHECK(logical.bytes <= 400);
+    CHECK_EQUAL(0, logical.errors + physical.errors);
+    CHECK_EQUAL(1, stats.phases[PFFF_PHASE_STAT].count);
+    CHECK_EQUAL(1, stats.phases[PFFF_PHASE_SAMPLE].count);
+    CHECK_EQUAL(1, stats.phases[PFFF_PHASE_POST_HASH].count);
+    CHECK_EQUAL(1, stats.phases[PFFF_PHASE_OUTPUT].count);
+
+    ostringstream out;
+    stats.output(out);
+    CHECK(out.str().find("# pfff stats\n") == 0);
+    CHECK(out.str().find("reader\tlogical\trequests=40\t") != string::npos);
+    CHECK(out.str().find("reader\tphysical\trequests=1\t") != string::npos);
+    CHECK(out.str().find("time\tpost_hash\tcount=1\t") != string::npos);
+    CHECK(out.str().find("time\tphysical.next_block\tcount=1\t") != string::npos);
+    CHECK(out.str().find("coalescing\tbuffering\tblocks=40\trequests=1\t") != string::npos);
+
+    // Errors are counted and the message is passed on
+    PfffStats error_stats;
+    MonitoringBlockReader missing(new LocalFileBlockReader((string(DATA_DIR) + "NonExistentFile").c_str()), &error_stats, "physical");
+    CHECK(missing.size() < 0);
+    CHECK(missing.error_message != "");
+    CHECK_EQUAL(1, error_stats.reader("physical").errors);
+}
+
+}
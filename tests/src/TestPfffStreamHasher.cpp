@@ -0,0 +1,144 @@
+// Test of fingerprinting streams
+#include "config.h"
+#include "PfffStreamHasher.h"
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <pthread.h>
+#include <sstream>
+#include <unistd.h>
+
+using std::ifstream;
+using std::istreambuf_iterator;
+using std::ostringstream;
+
+namespace TestPfffStreamHasher {
+
+static const char* FILES[] = { "TestPfffOptions.in", "TestPfffHasherOnFiles1.in", "TestPfffHasherOnFiles2.in", "TestPfffOptions.out" };
+static const int N_FILES = 4;
+
+static string read_file(const string& path) {
+    ifstream in(path.c_str(), std::ios::binary);
+    return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+}
+
+static string file_fingerprint(PfffMultiHasher& hashers, const string& path) {
+    LocalFileBlockReader reader(path.c_str());
+    ostringstream out;
+    hashers.hash(out, &reader);
+    return out.str();
+}
+
+TEST(TestStreamHasherUpdate) {
+    PfffOptions opts[3];
+    pfff_options_init(&opts[0], 5);
+    opts[0].block_count = 30;
+    opts[0].block_size = 7;
+    opts[0].header_block_count = 3;
+    opts[0].with_size = 1;
+    opts[1] = opts[0];
+    opts[1].output_format = PFO_OF_MD5;
+    opts[1].adaptive = 1;
+    opts[1].header_block_count = 0;
+    opts[2] = opts[0];
+    opts[2].output_format = PFO_OF_CSV;
+    opts[2].without_replacement = 1;
+    for (int i = 0; i < 3; i++) {
+        // Each hasher alone, then all together
+        PfffHasher hasher(&opts[i]), all1(&opts[0]), all2(&opts[1]), all3(&opts[2]);
+        PfffMultiHasher hashers;
+        if (i < 2) hashers.hashers.push_back(&hasher);
+        else {
+            hashers.hashers.push_back(&all1);
+            hashers.hashers.push_back(&all2);
+            hashers.hashers.push_back(&all3);
+        }
+        for (int f = 0; f < N_FILES; f++) {
+            string path = string(DATA_DIR) + FILES[f];
+            string contents = read_file(path);
+            PfffStreamHasher stream(&hashers, contents.size(), path);
+            // Chunks of varying sizes
+            unsigned long pos = 0;
+            for (unsigned long chunk = 1; pos < contents.size(); chunk = chunk * 3 % 101 + 1) {
+                unsigned long n = contents.size() - pos < chunk ? contents.size() - pos : chunk;
+                stream.update(contents.data() + pos, n);
+                pos += n;
+            }
+            ostringstream out;
+            stream.finish(out);
+            CHECK_EQUAL(file_fingerprint(hashers, path), out.str());
+        }
+    }
+
+    // The stream must be as long as announced
+    PfffHasher hasher(&opts[0]);
+    PfffMultiHasher hashers;
+    hashers.hashers.push_back(&hasher);
+    PfffStreamHasher stream(&hashers, 10, "x");
+    stream.update("123456789", 9);
+    ostringstream out;
+    CHECK_THROW(stream.finish(out), pfff_exception);
+    stream.update("01", 2);
+    CHECK_THROW(stream.finish(out), pfff_exception);
+    CHECK_THROW(PfffStreamHasher(&hashers, -1, "x"), pfff_exception);
+}
+
+struct Drain {
+    int fd;
+    string data;
+};
+
+static void* drain_main(void* arg) {
+    Drain* drain = (Drain*)arg;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(drain->fd, buffer, sizeof(buffer))) > 0) drain->data.append(buffer, n);
+    return NULL;
+}
+
+TEST(TestStreamHasherTee) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 1);
+    opts.block_size = 3;
+    PfffHasher hasher(&opts);
+    PfffMultiHasher hashers;
+    hashers.hashers.push_back(&hasher);
+    string path = string(DATA_DIR) + "TestPfffOptions.out";
+    string contents = read_file(path);
+    string expected = file_fingerprint(hashers, path);
+
+    // Between two files: read() and write()
+    string copy_path = string(DATA_DIR) + "TestPfffStreamHasher.tmp";
+    int in = open(path.c_str(), O_RDONLY);
+    int out = open(copy_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    PfffStreamHasher stream(&hashers, contents.size(), path);
+    CHECK(stream.tee(in, out));
+    close(in);
+    close(out);
+    ostringstream fingerprint;
+    stream.finish(fingerprint);
+    CHECK_EQUAL(expected, fingerprint.str());
+    CHECK(contents == read_file(copy_path));
+    unlink(copy_path.c_str());
+
+    // Into a pipe: splice() where possible
+    int pipe_fds[2];
+    CHECK_EQUAL(0, pipe(pipe_fds));
+    Drain drain;
+    drain.fd = pipe_fds[0];
+    pthread_t thread;
+    pthread_create(&thread, NULL, drain_main, &drain);
+    in = open(path.c_str(), O_RDONLY);
+    PfffStreamHasher piped(&hashers, contents.size(), path);
+    CHECK(piped.tee(in, pipe_fds[1]));
+    close(in);
+    close(pipe_fds[1]);
+    pthread_join(thread, NULL);
+    close(pipe_fds[0]);
+    ostringstream piped_fingerprint;
+    piped.finish(piped_fingerprint);
+    CHECK_EQUAL(expected, piped_fingerprint.str());
+    CHECK(contents == drain.data);
+}
+
+}
@@ -0,0 +1,144 @@
+// Test of fingerprinting tar members in place. TestPfffTar.tar (GNU format), TestPfffTarPax.tar (pax)
+// and TestPfffTarUstar.tar (ustar, the long name split into prefix and name) hold copies of test files.
+#include "config.h"
+#include "PfffTar.h"
+#include <cstring>
+#include <sstream>
+
+using std::ostringstream;
+
+namespace TestPfffTar {
+
+static const string LONG_DIR = "runs/a_rather_long_directory_name_for_the_run_of_2010_03_01/a_rather_long_directory_name_for_the_run_of_2010_03_01/";
+static const char* MEMBERS[] = { "runs/TestPfffOptions.in", "runs/empty", "runs/one_byte", "TestPfffBgzf.in" };
+static const char* FILES[] = { "TestPfffOptions.in", "TestPfffHasherOnFiles1.in", "TestPfffHasherOnFiles2.in", "TestPfffBgzf.in" };
+static const int N_MEMBERS = 4;
+
+static string member_name(int i) {
+    return i == 3 ? LONG_DIR + MEMBERS[i] : MEMBERS[i];
+}
+
+/**
+ * The fingerprint line of an extracted file, as it would be named in the archive.
+ */
+static string expected_line(PfffHasher& hasher, const string& archive, int i) {
+    ostringstream out;
+    LocalFileBlockReader file((string(DATA_DIR) + FILES[i]).c_str());
+    hasher.hash(out, &file);
+    string line = out.str();
+    return line.substr(0, line.find('\t') + 1) + archive + "!" + member_name(i) + "\n";
+}
+
+TEST(TestTarIndex) {
+    const char* archives[] = { "TestPfffTar.tar", "TestPfffTarPax.tar" };
+    for (int a = 0; a < 2; a++) {
+        LocalFileBlockReader archive((string(DATA_DIR) + archives[a]).c_str());
+        PfffTarIndex index;
+        CHECK(index.read(&archive));
+        // The directory and the symlink are skipped
+        CHECK_EQUAL(N_MEMBERS, index.members.size());
+        for (int i = 0; i < N_MEMBERS && i < index.members.size(); i++) {
+            CHECK_EQUAL(member_name(i), index.members[i].name);
+            CHECK_EQUAL(0, index.members[i].offset % TAR_BLOCK_SIZE);
+            LocalFileBlockReader file((string(DATA_DIR) + FILES[i]).c_str());
+            CHECK_EQUAL(file.size(), index.members[i].size);
+        }
+        CHECK_EQUAL(2, index.find("runs/one_byte"));
+        CHECK_EQUAL(-1, index.find("runs/link"));
+    }
+    LocalFileBlockReader ustar((string(DATA_DIR) + "TestPfffTarUstar.tar").c_str());
+    PfffTarIndex index;
+    CHECK(index.read(&ustar));
+    CHECK_EQUAL(1, index.members.size());
+    CHECK_EQUAL(member_name(3), index.members[0].name);
+
+    // Not a tar archive
+    LocalFileBlockReader other((string(DATA_DIR) + "TestPfffOptions.in").c_str());
+    CHECK(!index.read(&other));
+    CHECK(index.error_message.find("Not a tar archive") == 0);
+    LocalFileBlockReader missing((string(DATA_DIR) + "NonExistentFile.tar").c_str());
+    CHECK(!index.read(&missing));
+}
+
+TEST(TestTarMemberBlockReader) {
+    // Reads are confined to the member: beyond its end they see zeroes, not the next header
+    LocalFileBlockReader archive((string(DATA_DIR) + "TestPfffTar.tar").c_str());
+    PfffTarIndex index;
+    CHECK(index.read(&archive));
+    TarMemberBlockReader member(&archive, index.members[2], "a.tar");
+    CHECK_EQUAL("a.tar!runs/one_byte", member.get_filename());
+    CHECK_EQUAL(1, member.size());
+    char buffer[30];
+    memset(buffer, 'x', sizeof(buffer));
+    member.begin_block_sequence(buffer);
+    CHECK(member.next_block(0, 10));
+    CHECK(member.next_block(5, 20));
+    CHECK(member.end_block_sequence());
+    LocalFileBlockReader file((string(DATA_DIR) + FILES[2]).c_str());
+    char expected[30];
+    file.begin_block_sequence(expected);
+    file.next_block(0, 10);
+    file.next_block(5, 20);
+    file.end_block_sequence();
+    CHECK(memcmp(expected, buffer, 30) == 0);
+    CHECK(buffer[0] != 0);
+    for (int i = 1; i < 30; i++) CHECK_EQUAL(0, buffer[i]);
+}
+
+TEST(TestTarHasher) {
+    PfffOptions opts, also;
+    pfff_options_init(&opts, 1);
+    opts.block_count = 30;
+    opts.block_size = 20;
+    pfff_options_init(&also, 2);
+    also.output_format = PFO_OF_MD5;
+    PfffHasher hasher(&opts), also_hasher(&also);
+
+    const char* archives[] = { "TestPfffTar.tar", "TestPfffTarPax.tar" };
+    for (int a = 0; a < 2; a++) {
+        string archive = string(DATA_DIR) + archives[a];
+        string expected;
+        for (int i = 0; i < N_MEMBERS; i++) expected += expected_line(hasher, archive, i);
+
+        // The output is in archive order, whatever the number of threads
+        for (int threads = 0; threads <= 8; threads += 4) {
+            vector<const PfffOptions*> options(1, &opts);
+            PfffTarHasher tar_hasher(options, vector<unsigned long>(), threads, threads == 4 ? 1024 : 0);
+            ostringstream out, errors;
+            CHECK(tar_hasher.hash(out, errors, archive));
+            CHECK_EQUAL(expected, out.str());
+            CHECK_EQUAL("", errors.str());
+            CHECK_EQUAL(N_MEMBERS, tar_hasher.members_hashed);
+            CHECK_EQUAL(0, tar_hasher.members_failed);
+        }
+    }
+
+    // A single member, with a second fingerprint
+    string archive = string(DATA_DIR) + "TestPfffTar.tar";
+    vector<const PfffOptions*> options;
+    options.push_back(&opts);
+    options.push_back(&also);
+    PfffTarHasher tar_hasher(options, vector<unsigned long>(), 2, 0);
+    ostringstream out, errors;
+    CHECK(tar_hasher.hash(out, errors, archive, member_name(3)));
+    CHECK_EQUAL(expected_line(hasher, archive, 3) + expected_line(also_hasher, archive, 3), out.str());
+
+    CHECK(!tar_hasher.hash(out, errors, archive, "runs/link"));
+    CHECK(errors.str().find("Error: No member runs/link") == 0);
+}
+
+TEST(TestTarSplitName) {
+    string archive = string(DATA_DIR) + "TestPfffTar.tar";
+    string archive_name, member_name;
+    PfffTarHasher::split_name(archive, archive_name, member_name);
+    CHECK_EQUAL(archive, archive_name);
+    CHECK_EQUAL("", member_name);
+    PfffTarHasher::split_name(archive + "!runs/a!b", archive_name, member_name);
+    CHECK_EQUAL(archive, archive_name);
+    CHECK_EQUAL("runs/a!b", member_name);
+    PfffTarHasher::split_name("NonExistent!a", archive_name, member_name);
+    CHECK_EQUAL("NonExistent!a", archive_name);
+    CHECK_EQUAL("", member_name);
+}
+
+}
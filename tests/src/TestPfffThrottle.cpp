@@ -0,0 +1,129 @@
+// Test of the rate limiting of reads
+#include "config.h"
+#include "PfffThrottle.h"
+#include "PfffStats.h"
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+
+using std::ostringstream;
+
+namespace TestPfffThrottle {
+
+/** Serves zeros, taking the given time for each request. */
+class SlowBlockReader: public BlockReader {
+public:
+    SlowBlockReader(long delay_us): BlockReader("slow"), delay_us(delay_us) {}
+    long long _size() { return 1000000; }
+    void begin_block_sequence(char* buffer) { this->buffer = buffer; }
+    bool next_block(unsigned long long block_start, unsigned long block_size) {
+        if (delay_us > 0) usleep(delay_us);
+        memset(buffer, 0, block_size);
+        buffer += block_size;
+        return true;
+    }
+    bool end_block_sequence() { return true; }
+protected:
+    long delay_us;
+    char* buffer;
+};
+
+static PfffThrottleSettings settings(double iops, double bytes_per_s, long long latency_ns) {
+    PfffThrottleSettings result;
+    result.max_iops = iops;
+    result.max_bytes_per_s = bytes_per_s;
+    result.max_latency_ns = latency_ns;
+    return result;
+}
+
+static long long read_blocks(BlockReader* reader, int n_blocks, unsigned long block_size) {
+    char* buffer = new char[n_blocks * block_size];
+    long long start = pfff_now_ns();
+    reader->begin_block_sequence(buffer);
+    for (int i = 0; i < n_blocks; i++) reader->next_block(i * block_size * 2, block_size);
+    reader->end_block_sequence();
+    delete[] buffer;
+    return pfff_now_ns() - start;
+}
+
+TEST(TestRequestRate) {
+    // 200 requests/s with a burst of 20: the next 20 requests take 0.1s more
+    PfffThrottle throttle(settings(200, 0, 0));
+    BlockReader* reader = throttle.wrap(new SlowBlockReader(0), "disk");
+    long long elapsed = read_blocks(reader, 40, 100);
+    CHECK(elapsed >= 90000000LL);
+    CHECK(elapsed < 2000000000LL);
+    CHECK_EQUAL(40, throttle.limiter("disk")->requests);
+    CHECK(throttle.limiter("disk")->waited_ns > 0);
+
+    // Another device has its own limit
+    PfffRateLimiter* other = throttle.limiter("other");
+    CHECK(other != throttle.limiter("disk"));
+    CHECK_EQUAL(0, other->requests);
+    delete reader;
+}
+
+TEST(TestBandwidth) {
+    // 100000 bytes/s with a burst of 10000: 20000 bytes more take 0.2s
+    PfffThrottle throttle(settings(0, 100000, 0));
+    BlockReader* reader = throttle.wrap(new SlowBlockReader(0), "disk");
+    long long elapsed = read_blocks(reader, 30, 1000);
+    CHECK(elapsed >= 180000000LL);
+    CHECK(elapsed < 2000000000LL);
+    delete reader;
+}
+
+TEST(TestBackoff) {
+    // Requests slower than 1ms make the next ones pause, fast ones end the pause
+    PfffRateLimiter limiter(settings(0, 0, 1000000));
+    BlockReader* reader = new ThrottledBlockReader(new SlowBlockReader(3000), &limiter);
+    read_blocks(reader, 3, 10);
+    CHECK_EQUAL(3, limiter.backoffs);
+    CHECK(limiter.backoff_ns() >= 3000000LL);
+    CHECK(limiter.backoff_ns() <= PFFF_MAX_BACKOFF_NS);
+    CHECK(limiter.waited_ns >= 3000000LL);
+
+    delete reader;
+    reader = new ThrottledBlockReader(new SlowBlockReader(0), &limiter);
+    read_blocks(reader, 30, 10);
+    CHECK_EQUAL(3, limiter.backoffs);
+    CHECK_EQUAL(0, limiter.backoff_ns());
+    delete reader;
+}
+
+TEST(TestPassThrough) {
+    PfffThrottle throttle(settings(100000, 100000000, 1000000000LL));
+    BlockReader* reader = throttle.wrap(new LocalFileBlockReader(DATA_DIR "TestPfffOptions.in"), "disk");
+    LocalFileBlockReader direct(DATA_DIR "TestPfffOptions.in");
+    CHECK_EQUAL(direct.size(), reader->size());
+    CHECK_EQUAL(direct.get_filename(), reader->get_filename());
+    char expected[100], actual[100];
+    direct.begin_block_sequence(expected);
+    direct.next_block(10, 50);
+    direct.next_block(0, 50);
+    direct.end_block_sequence();
+    reader->begin_block_sequence(actual);
+    CHECK(reader->next_block(10, 50));
+    CHECK(reader->next_block(0, 50));
+    CHECK(reader->end_block_sequence());
+    CHECK(memcmp(expected, actual, 100) == 0);
+    delete reader;
+
+    // Errors are passed on
+    reader = throttle.wrap(new LocalFileBlockReader(DATA_DIR "NonExistentFile"), "disk");
+    CHECK(reader->size() < 0);
+    CHECK(reader->error_message != "");
+    delete reader;
+
+    ostringstream out;
+    throttle.output(out);
+    CHECK(out.str().find("throttle\tdisk\trequests=2\t") == 0);
+}
+
+TEST(TestDeviceKey) {
+    CHECK_EQUAL(PfffThrottle::device_key(DATA_DIR "TestPfffOptions.in"), PfffThrottle::device_key(DATA_DIR "TestPfffBgzf.in"));
+    CHECK(PfffThrottle::device_key(DATA_DIR "TestPfffOptions.in").find("device:") == 0);
+    CHECK_EQUAL(string(DATA_DIR "NonExistentFile"), PfffThrottle::device_key(DATA_DIR "NonExistentFile"));
+}
+
+}
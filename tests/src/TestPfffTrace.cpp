@@ -0,0 +1,83 @@
+// Test of I/O trace recording (pfff --trace)
+#include "config.h"
+#include "PfffTrace.h"
+#include "PfffHasher.h"
+#include "PfffStats.h"
+#include <sstream>
+
+using std::istringstream;
+using std::ostringstream;
+
+namespace TestPfffTrace {
+
+TEST(TestPfffTraceRoundTrip) {
+    ostringstream out;
+    PfffTraceWriter writer(out);
+    long long t = pfff_now_ns();
+    writer.record("a", 0, 10, t + 1000, 5, false);
+    writer.record("a", 1ULL << 40, 300, t + 1000, 7, false);  // Same start as the previous read
+    writer.record("b\tc", 20, 1, t + 5000, 0, true);
+    CHECK_EQUAL(3, writer.events);
+
+    istringstream in(out.str());
+    PfffTraceReader reader(in);
+    CHECK_EQUAL("", reader.error_message);
+    PfffTraceEvent e[3];
+    for (int i = 0; i < 3; i++) CHECK(reader.next(e[i]));
+    PfffTraceEvent last;
+    CHECK(!reader.next(last));
+    CHECK_EQUAL("", reader.error_message);
+
+    CHECK_EQUAL("a", e[0].filename);
+    CHECK_EQUAL(0, e[0].offset);
+    CHECK_EQUAL(10, e[0].length);
+    CHECK_EQUAL(5, e[0].duration_ns);
+    CHECK(!e[0].failed);
+    CHECK_EQUAL("a", e[1].filename);
+    CHECK(e[1].offset == (1ULL << 40));
+    CHECK_EQUAL(300, e[1].length);
+    CHECK_EQUAL(e[0].start_ns, e[1].start_ns);
+    CHECK_EQUAL("b\tc", e[2].filename);
+    CHECK_EQUAL(4000, e[2].start_ns - e[1].start_ns);
+    CHECK(e[2].failed);
+
+    // Truncated and foreign data
+    istringstream truncated(out.str().substr(0, out.str().size() - 2));
+    PfffTraceReader truncated_reader(truncated);
+    while (truncated_reader.next(last));
+    CHECK(truncated_reader.error_message != "");
+    istringstream foreign("PFFF\x01");
+    PfffTraceReader foreign_reader(foreign);
+    CHECK(!foreign_reader.next(last));
+    CHECK(foreign_reader.error_message != "");
+}
+
+TEST(TestTracingBlockReader) {
+    PfffOptions opts;
+    pfff_options_init(&opts, 1);
+    opts.block_count = 20;
+    opts.block_size = 10;
+    string filename = string(DATA_DIR) + "TestPfffOptions.in";
+
+    // The trace shows the coalesced reads made under the BufferingBlockReader
+    ostringstream out;
+    PfffTraceWriter writer(out);
+    PfffHasher hasher(&opts);
+    BlockReader* reader = new TracingBlockReader(new LocalFileBlockReader(filename.c_str()), &writer);
+    reader = new BufferingBlockReader(reader, 100000);
+    ostringstream fingerprint;
+    hasher.hash(fingerprint, reader);
+    delete reader;
+    CHECK_EQUAL(1, writer.events);
+
+    istringstream in(out.str());
+    PfffTraceReader trace(in);
+    PfffTraceEvent event;
+    CHECK(trace.next(event));
+    CHECK_EQUAL(filename, event.filename);
+    CHECK(!event.failed);
+    CHECK(event.length > 10);
+    CHECK(!trace.next(event));
+}
+
+}
@@ -0,0 +1,98 @@
+// Test of fingerprinting directory trees as a whole. TestPfffTree holds a.txt (a copy of TestPfffOptions.in),
+// b/c.txt, the empty b/d/empty and z.bin (a copy of TestPfffBgzf.in).
+#include "config.h"
+#include "PfffTreeBlockReader.h"
+#include "PfffHasher.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using std::ifstream;
+using std::ostringstream;
+
+namespace TestPfffTreeBlockReader {
+
+static const string ROOT = string(DATA_DIR) + "TestPfffTree";
+static const char* FILES[] = { "a.txt", "b/c.txt", "b/d/empty", "z.bin" };
+static const int N_FILES = 4;
+
+/**
+ * The virtual file, built the slow way.
+ */
+static string virtual_file() {
+    ostringstream listing, contents;
+    for (int i = 0; i < N_FILES; i++) {
+        ifstream in((ROOT + "/" + FILES[i]).c_str(), std::ios::binary);
+        ostringstream data;
+        data << in.rdbuf();
+        listing << FILES[i] << '\0' << data.str().size() << '\n';
+        contents << data.str();
+    }
+    return listing.str() + contents.str();
+}
+
+static long long read_string(void* user_data, char* buffer, unsigned long length, unsigned long long offset) {
+    const string* data = (const string*)user_data;
+    if (offset >= data->size()) return 0;
+    unsigned long n = data->size() - offset < length ? data->size() - offset : length;
+    memcpy(buffer, data->data() + offset, n);
+    return n;
+}
+
+/**
+ * Fingerprint without the filename.
+ */
+static string fingerprint(PfffHasher& hasher, BlockReader* reader) {
+    ostringstream out;
+    hasher.hash(out, reader);
+    return out.str().substr(0, out.str().find('\t'));
+}
+
+TEST(TestTreeContent) {
+    string expected = virtual_file();
+    VirtualTreeBlockReader tree(ROOT.c_str());
+    CHECK_EQUAL((long long)expected.size(), tree.size());
+    CHECK_EQUAL(N_FILES, tree.paths.size());
+    for (int i = 0; i < N_FILES && i < tree.paths.size(); i++) CHECK_EQUAL(FILES[i], tree.paths[i]);
+
+    // Blocks within the listing, across files (and the empty one), and beyond the end
+    vector<char> buffer(expected.size() + 100, 'x');
+    tree.begin_block_sequence(&buffer[0]);
+    CHECK(tree.next_block(0, 10));
+    CHECK(tree.next_block(tree.file_offsets[0] - 5, 1630));
+    CHECK(tree.next_block(tree.file_offsets[1] - 3, 30));
+    CHECK(tree.next_block(expected.size() - 10, 50));
+    CHECK(tree.end_block_sequence());
+    string padded = expected + string(100, '\0');
+    CHECK(memcmp(&buffer[0], padded.data(), 10) == 0);
+    CHECK(memcmp(&buffer[10], padded.data() + tree.file_offsets[0] - 5, 1630) == 0);
+    CHECK(memcmp(&buffer[1640], padded.data() + tree.file_offsets[1] - 3, 30) == 0);
+    CHECK(memcmp(&buffer[1670], padded.data() + expected.size() - 10, 50) == 0);
+    CHECK_EQUAL(3, tree.files_opened);
+
+    VirtualTreeBlockReader missing((string(DATA_DIR) + "NonExistentDirectory").c_str());
+    CHECK(missing.size() < 0);
+    CHECK(missing.error_message != "");
+    VirtualTreeBlockReader file((string(DATA_DIR) + "TestPfffOptions.in").c_str());
+    CHECK(file.size() < 0);
+}
+
+TEST(TestTreeFingerprint) {
+    string expected_data = virtual_file();
+    PfffOptions opts;
+    for (int variant = 0; variant < 3; variant++) {
+        pfff_options_init(&opts, variant + 1);
+        opts.block_count = 4;
+        opts.block_size = 100;
+        if (variant == 1) opts.header_block_count = 1;
+        if (variant == 2) opts.with_size = 1;
+        PfffHasher hasher(&opts);
+        CallbackBlockReader expected(read_string, &expected_data, expected_data.size());
+        VirtualTreeBlockReader tree(ROOT.c_str());
+        CHECK_EQUAL(fingerprint(hasher, &expected), fingerprint(hasher, &tree));
+        // Only the files holding sampled blocks are opened
+        CHECK(tree.files_opened <= 4);
+    }
+}
+
+}
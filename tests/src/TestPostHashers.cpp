@@ -3,6 +3,7 @@
 // CsvHasher and DebugHasher can live without a test, I think
 #include "config.h"
 #include "PfffPostHashing.h"
+#include <cstring>
 
 const int   NUM_TESTS = 8;
 const char* TEST_DATA[] = { 
@@ -39,3 +40,38 @@ TEST_FILEFIXTURE("TestPostHashers.out", TestPostHashers) {
     test_PostHasher(ph, this);
     delete ph;
 }
+
+/**
+ * Batched digests must equal the one-at-a-time ones, for any mix of lengths
+ * (groups of equal length, partial groups, lengths around the block boundaries).
+ */
+static void check_batch(const PostHasher& ph) {
+    const int N = 150;
+    char buffer[N][300];
+    const char* data[N];
+    long data_len[N];
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < 300; j++) buffer[i][j] = (char)(i*31 + j*7 + (i*j >> 3));
+        data[i] = buffer[i];
+        data_len[i] = i < 100 ? (i < 20 ? 40 : i * 3 % 260) : (i * 7919) % 300;
+    }
+    unsigned char batch[N*16], single[16];
+    ph.compute_digests(batch, data, data_len, N);
+    for (int i = 0; i < N; i++) {
+        ph.compute_digest(single, data[i], data_len[i]);
+        CHECK(memcmp(single, batch + 16*i, 16) == 0);
+    }
+    // All 0xff blocks exercise the final reduction of Poly1305
+    memset(buffer, 0xff, sizeof(buffer));
+    ph.compute_digests(batch, data, data_len, N);
+    for (int i = 0; i < N; i++) {
+        ph.compute_digest(single, data[i], data_len[i]);
+        CHECK(memcmp(single, batch + 16*i, 16) == 0);
+    }
+}
+
+TEST(TestPostHashersBatch) {
+    uint32_t keys[] = { 0, 1, 20, 500, 1000000, 2000000000 };
+    for (int i = 0; i < 6; i++) check_batch(Poly1305AesHasher(keys[i]));
+    check_batch(Md5Hasher());
+}